@@ -1,5 +1,4 @@
-#define _POSIX_C_SOURCE 200809
-#include <assert.h>
+#define _GNU_SOURCE
 #include <cairo/cairo.h>
 #include <fcntl.h>
 #include <pango/pangocairo.h>
@@ -10,6 +9,7 @@
 #include <unistd.h>
 #include <wayland-client.h>
 #include "config.h"
+#include "log.h"
 #include "pool-buffer.h"
 
 static bool set_cloexec(int fd) {
@@ -25,7 +25,21 @@ static bool set_cloexec(int fd) {
 	return true;
 }
 
-static int create_pool_file(size_t size, char **name) {
+static int create_pool_file(size_t size) {
+	int fd;
+#if HAVE_MEMFD_CREATE
+	fd = memfd_create("sway-client", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd >= 0) {
+		if (ftruncate(fd, size) < 0) {
+			close(fd);
+			return -1;
+		}
+		// The pool only ever grows, so the compositor can rely on that
+		fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK);
+		return fd;
+	}
+#endif
+
 	static const char template[] = "sway-client-XXXXXX";
 	const char *path = getenv("XDG_RUNTIME_DIR");
 	if (path == NULL) {
@@ -34,17 +48,20 @@ static int create_pool_file(size_t size, char **name) {
 	}
 
 	size_t name_size = strlen(template) + 1 + strlen(path) + 1;
-	*name = malloc(name_size);
-	if (*name == NULL) {
+	char *name = malloc(name_size);
+	if (name == NULL) {
 		fprintf(stderr, "allocation failed\n");
 		return -1;
 	}
-	snprintf(*name, name_size, "%s/%s", path, template);
+	snprintf(name, name_size, "%s/%s", path, template);
 
-	int fd = mkstemp(*name);
+	fd = mkstemp(name);
 	if (fd < 0) {
+		free(name);
 		return -1;
 	}
+	unlink(name);
+	free(name);
 
 	if (!set_cloexec(fd)) {
 		close(fd);
@@ -59,39 +76,144 @@ static int create_pool_file(size_t size, char **name) {
 	return fd;
 }
 
+static void buffer_finish(struct pool_buffer *buffer) {
+	if (buffer->buffer) {
+		wl_buffer_destroy(buffer->buffer);
+	}
+	if (buffer->cairo) {
+		cairo_destroy(buffer->cairo);
+	}
+	if (buffer->surface) {
+		cairo_surface_destroy(buffer->surface);
+	}
+	if (buffer->pango) {
+		g_object_unref(buffer->pango);
+	}
+	struct buffer_pool *pool = buffer->pool;
+	memset(buffer, 0, sizeof(struct pool_buffer));
+	buffer->pool = pool;
+}
+
 static void buffer_release(void *data, struct wl_buffer *wl_buffer) {
 	struct pool_buffer *buffer = data;
 	buffer->busy = false;
+	if (buffer->orphaned) {
+		buffer_finish(buffer);
+	}
 }
 
 static const struct wl_buffer_listener buffer_listener = {
 	.release = buffer_release
 };
 
-static struct pool_buffer *create_buffer(struct wl_shm *shm,
+static bool pool_is_busy(struct buffer_pool *pool) {
+	for (int i = 0; i < pool->buffer_count; ++i) {
+		if (pool->buffers[i].busy) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void pool_unmap(struct buffer_pool *pool) {
+	for (int i = 0; i < pool->buffer_count; ++i) {
+		struct pool_buffer *buffer = &pool->buffers[i];
+		if (!buffer->busy) {
+			buffer_finish(buffer);
+			continue;
+		}
+		// The compositor reads the buffer from its own mapping, so ours can go
+		if (buffer->cairo) {
+			cairo_destroy(buffer->cairo);
+			cairo_surface_destroy(buffer->surface);
+			g_object_unref(buffer->pango);
+			buffer->cairo = NULL;
+			buffer->surface = NULL;
+			buffer->pango = NULL;
+		}
+		buffer->data = NULL;
+		buffer->orphaned = true;
+	}
+	if (pool->data) {
+		munmap(pool->data, pool->size);
+		pool->data = NULL;
+	}
+}
+
+static void pool_close(struct buffer_pool *pool) {
+	if (pool->shm_pool) {
+		wl_shm_pool_destroy(pool->shm_pool);
+		close(pool->fd);
+		pool->shm_pool = NULL;
+		pool->fd = -1;
+	}
+	pool->size = pool->base = pool->slot_size = 0;
+}
+
+/**
+ * Lay out slots of at least the given size. Idle buffers are destroyed and
+ * busy ones are orphaned. While the compositor holds buffers, the new slots go
+ * after the old ones and the pool grows; otherwise the pool starts afresh,
+ * which also gives back the memory of a pool that is much larger than needed.
+ */
+static bool pool_layout(struct wl_shm *shm, struct buffer_pool *pool,
+		size_t needed) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	// Leave some room so that growing a little doesn't need a new layout
+	size_t slot_size = needed + needed / 8;
+	slot_size = (slot_size + page - 1) / page * page;
+
+	bool busy = pool_is_busy(pool);
+	pool_unmap(pool);
+	if (!busy) {
+		pool_close(pool);
+	}
+
+	size_t base = pool->size;
+	size_t size = base + slot_size * BUFFER_POOL_MAX;
+	if (!pool->shm_pool) {
+		pool->fd = create_pool_file(size);
+		if (pool->fd < 0) {
+			wlr_log(WLR_ERROR, "Unable to create a shared memory file");
+			return false;
+		}
+		pool->shm_pool = wl_shm_create_pool(shm, pool->fd, size);
+	} else {
+		if (ftruncate(pool->fd, size) < 0) {
+			wlr_log_errno(WLR_ERROR, "Unable to grow the buffer pool");
+			pool->slot_size = 0;
+			return false;
+		}
+		wl_shm_pool_resize(pool->shm_pool, size);
+	}
+
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			pool->fd, 0);
+	if (data == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "Unable to map the buffer pool");
+		pool_close(pool);
+		return false;
+	}
+	pool->data = data;
+	pool->size = size;
+	pool->base = base;
+	pool->slot_size = slot_size;
+	return true;
+}
+
+static struct pool_buffer *create_buffer(struct buffer_pool *pool,
 		struct pool_buffer *buf, int32_t width, int32_t height,
 		uint32_t format) {
 	uint32_t stride = width * 4;
-	size_t size = stride * height;
-
-	char *name;
-	int fd = create_pool_file(size, &name);
-	assert(fd != -1);
-	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-	struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
-	buf->buffer = wl_shm_pool_create_buffer(pool, 0,
-			width, height, stride, format);
-	wl_shm_pool_destroy(pool);
-	close(fd);
-	unlink(name);
-	free(name);
-	fd = -1;
+	size_t slot = buf - pool->buffers;
 
-	buf->size = size;
+	buf->offset = pool->base + slot * pool->slot_size;
+	buf->buffer = wl_shm_pool_create_buffer(pool->shm_pool, buf->offset,
+			width, height, stride, format);
 	buf->width = width;
 	buf->height = height;
-	buf->data = data;
-	buf->surface = cairo_image_surface_create_for_data(data,
+	buf->data = (char *)pool->data + buf->offset;
+	buf->surface = cairo_image_surface_create_for_data(buf->data,
 			CAIRO_FORMAT_ARGB32, width, height, stride);
 	buf->cairo = cairo_create(buf->surface);
 	buf->pango = pango_cairo_create_context(buf->cairo);
@@ -100,46 +222,69 @@ static struct pool_buffer *create_buffer(struct wl_shm *shm,
 	return buf;
 }
 
-void destroy_buffer(struct pool_buffer *buffer) {
-	if (buffer->buffer) {
-		wl_buffer_destroy(buffer->buffer);
-	}
-	if (buffer->cairo) {
-		cairo_destroy(buffer->cairo);
+void destroy_buffer_pool(struct buffer_pool *pool) {
+	if (pool->dropped_frames) {
+		wlr_log(WLR_DEBUG, "Buffer pool %p dropped %llu frames", pool,
+				(unsigned long long)pool->dropped_frames);
 	}
-	if (buffer->surface) {
-		cairo_surface_destroy(buffer->surface);
+	for (int i = 0; i < pool->buffer_count; ++i) {
+		buffer_finish(&pool->buffers[i]);
 	}
-	if (buffer->pango) {
-		g_object_unref(buffer->pango);
-	}
-	if (buffer->data) {
-		munmap(buffer->data, buffer->size);
+	if (pool->data) {
+		munmap(pool->data, pool->size);
 	}
-	memset(buffer, 0, sizeof(struct pool_buffer));
+	pool_close(pool);
+	memset(pool, 0, sizeof(struct buffer_pool));
 }
 
 struct pool_buffer *get_next_buffer(struct wl_shm *shm,
-		struct pool_buffer pool[static 2], uint32_t width, uint32_t height) {
+		struct buffer_pool *pool, uint32_t width, uint32_t height) {
+	if (width == 0 || height == 0) {
+		return NULL;
+	}
+
 	struct pool_buffer *buffer = NULL;
 
-	for (size_t i = 0; i < 2; ++i) {
-		if (pool[i].busy) {
+	// Prefer an idle buffer which already has the right size
+	for (int i = 0; i < pool->buffer_count; ++i) {
+		struct pool_buffer *candidate = &pool->buffers[i];
+		if (candidate->busy) {
 			continue;
 		}
-		buffer = &pool[i];
+		if (!buffer || (candidate->width == width &&
+					candidate->height == height)) {
+			buffer = candidate;
+		}
+	}
+
+	// The compositor holds all of them, so add another one
+	if (!buffer && pool->buffer_count < BUFFER_POOL_MAX) {
+		buffer = &pool->buffers[pool->buffer_count++];
+		buffer->pool = pool;
 	}
 
 	if (!buffer) {
+		++pool->dropped_frames;
+		wlr_log(WLR_DEBUG, "All buffers are busy, dropping a frame "
+				"(%llu so far)", (unsigned long long)pool->dropped_frames);
 		return NULL;
 	}
 
+	size_t needed = (size_t)width * 4 * height;
+	bool busy = pool_is_busy(pool);
+	if (!pool->shm_pool || needed > pool->slot_size ||
+			(!busy && (needed < pool->slot_size / 4 || pool->base > 0))) {
+		if (!pool_layout(shm, pool, needed)) {
+			return NULL;
+		}
+	}
+
 	if (buffer->width != width || buffer->height != height) {
-		destroy_buffer(buffer);
+		buffer_finish(buffer);
 	}
 
 	if (!buffer->buffer) {
-		if (!create_buffer(shm, buffer, width, height,
+		if (!create_buffer(pool, buffer, width, height,
 					WL_SHM_FORMAT_ARGB8888)) {
 			return NULL;
 		}
@@ -1,8 +1,21 @@
 #include <assert.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <wlr/util/log.h>
 #include "background-image.h"
 #include "cairo.h"
+#include "list.h"
+
+// How many sizes of each image are kept
+#define SCALED_CACHE_MAX 4
+
+struct scaled_background {
+	enum background_mode mode;
+	int width, height;
+	cairo_surface_t *surface;
+};
+
+static const cairo_user_data_key_t scaled_cache_key;
 
 enum background_mode parse_background_mode(const char *mode) {
 	if (strcmp(mode, "stretch") == 0) {
@@ -53,7 +66,7 @@ cairo_surface_t *load_background_image(const char *path) {
 	return image;
 }
 
-void render_background_image(cairo_t *cairo, cairo_surface_t *image,
+static void paint_background_image(cairo_t *cairo, cairo_surface_t *image,
 		enum background_mode mode, int buffer_width, int buffer_height) {
 	double width = cairo_image_surface_get_width(image);
 	double height = cairo_image_surface_get_height(image);
@@ -109,6 +122,7 @@ void render_background_image(cairo_t *cairo, cairo_surface_t *image,
 		cairo_pattern_t *pattern = cairo_pattern_create_for_surface(image);
 		cairo_pattern_set_extend(pattern, CAIRO_EXTEND_REPEAT);
 		cairo_set_source(cairo, pattern);
+		cairo_pattern_destroy(pattern);
 		break;
 	}
 	case BACKGROUND_MODE_SOLID_COLOR:
@@ -119,3 +133,86 @@ void render_background_image(cairo_t *cairo, cairo_surface_t *image,
 	cairo_paint(cairo);
 	cairo_restore(cairo);
 }
+
+static void scaled_cache_destroy(void *data) {
+	list_t *cache = data;
+	for (int i = 0; i < cache->length; ++i) {
+		struct scaled_background *scaled = cache->items[i];
+		cairo_surface_destroy(scaled->surface);
+		free(scaled);
+	}
+	list_free(cache);
+}
+
+/**
+ * Return the image as it looks in a buffer of the given size, rendering it
+ * unless it's cached. The cache lives as long as the image, and keeps the
+ * most recently used sizes.
+ */
+static cairo_surface_t *get_scaled_image(cairo_surface_t *image,
+		enum background_mode mode, int buffer_width, int buffer_height) {
+	list_t *cache = cairo_surface_get_user_data(image, &scaled_cache_key);
+	if (!cache) {
+		cache = create_list();
+		if (cairo_surface_set_user_data(image, &scaled_cache_key, cache,
+					scaled_cache_destroy) != CAIRO_STATUS_SUCCESS) {
+			list_free(cache);
+			return NULL;
+		}
+	}
+
+	for (int i = 0; i < cache->length; ++i) {
+		struct scaled_background *scaled = cache->items[i];
+		if (scaled->mode == mode && scaled->width == buffer_width &&
+				scaled->height == buffer_height) {
+			list_move_to_end(cache, scaled);
+			return scaled->surface;
+		}
+	}
+
+	struct scaled_background *scaled =
+		calloc(1, sizeof(struct scaled_background));
+	if (!scaled) {
+		return NULL;
+	}
+	scaled->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+			buffer_width, buffer_height);
+	if (cairo_surface_status(scaled->surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(scaled->surface);
+		free(scaled);
+		return NULL;
+	}
+	scaled->mode = mode;
+	scaled->width = buffer_width;
+	scaled->height = buffer_height;
+	cairo_t *cairo = cairo_create(scaled->surface);
+	paint_background_image(cairo, image, mode, buffer_width, buffer_height);
+	cairo_destroy(cairo);
+	wlr_log(WLR_DEBUG, "Scaled background image to %dx%d",
+			buffer_width, buffer_height);
+
+	if (cache->length == SCALED_CACHE_MAX) {
+		struct scaled_background *oldest = cache->items[0];
+		list_del(cache, 0);
+		cairo_surface_destroy(oldest->surface);
+		free(oldest);
+	}
+	list_add(cache, scaled);
+	return scaled->surface;
+}
+
+void render_background_image(cairo_t *cairo, cairo_surface_t *image,
+		enum background_mode mode, int buffer_width, int buffer_height) {
+	cairo_surface_t *scaled =
+		get_scaled_image(image, mode, buffer_width, buffer_height);
+	if (!scaled) {
+		paint_background_image(cairo, image, mode,
+				buffer_width, buffer_height);
+		return;
+	}
+	// Already at the size of the buffer, so this is a plain copy
+	cairo_save(cairo);
+	cairo_set_source_surface(cairo, scaled, 0, 0);
+	cairo_paint(cairo);
+	cairo_restore(cairo);
+}
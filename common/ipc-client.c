@@ -1,13 +1,20 @@
 #define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <json-c/json.h>
 #include "ipc-client.h"
+#include "ipc-encoding.h"
 #include "log.h"
+#include "loop.h"
 
 static const char ipc_magic[] = {'i', '3', '-', 'i', 'p', 'c'};
 static const size_t ipc_header_size = sizeof(ipc_magic)+8;
@@ -109,19 +116,35 @@ void free_ipc_response(struct ipc_response *response) {
 	free(response);
 }
 
-char *ipc_single_command(int socketfd, uint32_t type, const char *payload, uint32_t *len) {
-	char data[ipc_header_size];
+static void ipc_fill_header(char *data, uint32_t type, uint32_t length) {
 	uint32_t *data32 = (uint32_t *)(data + sizeof(ipc_magic));
 	memcpy(data, ipc_magic, sizeof(ipc_magic));
-	memcpy(&data32[0], len, sizeof(*len));
+	memcpy(&data32[0], &length, sizeof(length));
 	memcpy(&data32[1], &type, sizeof(type));
+}
 
-	if (write(socketfd, data, ipc_header_size) == -1) {
-		sway_abort("Unable to send IPC header");
-	}
+char *ipc_single_command(int socketfd, uint32_t type, const char *payload, uint32_t *len) {
+	char data[ipc_header_size];
+	ipc_fill_header(data, type, *len);
 
-	if (write(socketfd, payload, *len) == -1) {
-		sway_abort("Unable to send IPC payload");
+	struct iovec iov[2] = {
+		{ .iov_base = data, .iov_len = ipc_header_size },
+		{ .iov_base = (void *)payload, .iov_len = *len },
+	};
+	size_t total = ipc_header_size + *len;
+	while (total > 0) {
+		ssize_t written = writev(socketfd, iov, 2);
+		if (written == -1) {
+			sway_abort("Unable to send IPC request");
+		}
+		total -= written;
+		for (int i = 0; i < 2; ++i) {
+			size_t n = (size_t)written < iov[i].iov_len ?
+				(size_t)written : iov[i].iov_len;
+			iov[i].iov_base = (char *)iov[i].iov_base + n;
+			iov[i].iov_len -= n;
+			written -= n;
+		}
 	}
 
 	struct ipc_response *resp = ipc_recv_response(socketfd);
@@ -131,3 +154,387 @@ char *ipc_single_command(int socketfd, uint32_t type, const char *payload, uint3
 
 	return response;
 }
+
+struct ipc_buffer {
+	char *data;
+	size_t length;
+	size_t capacity;
+};
+
+// A request which has been sent and is waiting for its reply
+struct ipc_request {
+	uint32_t type;
+	void (*callback)(struct ipc_response *response, void *data);
+	void *data;
+};
+
+struct ipc_connection {
+	int fd;
+	struct loop *loop;
+	bool failed;
+	bool dispatching;
+
+	// Replies arrive in the order the requests were sent
+	struct ipc_request *requests;
+	size_t requests_head;
+	size_t requests_length;
+	size_t requests_capacity;
+
+	// Both buffers are kept for the lifetime of the connection
+	struct ipc_buffer out;
+	struct ipc_buffer in;
+
+	void (*event_callback)(struct ipc_response *response, void *data);
+	void *event_data;
+};
+
+static bool ipc_buffer_reserve(struct ipc_buffer *buffer, size_t size) {
+	if (buffer->length + size <= buffer->capacity) {
+		return true;
+	}
+	size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+	while (buffer->length + size > capacity) {
+		capacity *= 2;
+	}
+	char *data = realloc(buffer->data, capacity);
+	if (!data) {
+		wlr_log(WLR_ERROR, "Unable to allocate IPC buffer");
+		return false;
+	}
+	buffer->data = data;
+	buffer->capacity = capacity;
+	return true;
+}
+
+static bool ipc_buffer_append(struct ipc_buffer *buffer,
+		const void *data, size_t length) {
+	if (!ipc_buffer_reserve(buffer, length)) {
+		return false;
+	}
+	memcpy(buffer->data + buffer->length, data, length);
+	buffer->length += length;
+	return true;
+}
+
+static void ipc_buffer_consume(struct ipc_buffer *buffer, size_t length) {
+	memmove(buffer->data, buffer->data + length, buffer->length - length);
+	buffer->length -= length;
+}
+
+static void ipc_connection_update_mask(struct ipc_connection *conn) {
+	if (conn->loop && !conn->failed) {
+		loop_update_fd(conn->loop, conn->fd,
+				POLLIN | (conn->out.length ? POLLOUT : 0));
+	}
+}
+
+static void ipc_connection_fail(struct ipc_connection *conn) {
+	if (conn->failed) {
+		return;
+	}
+	conn->failed = true;
+	if (conn->loop) {
+		loop_remove_fd(conn->loop, conn->fd);
+	}
+	while (conn->requests_head < conn->requests_length) {
+		struct ipc_request *request = &conn->requests[conn->requests_head++];
+		if (request->callback) {
+			request->callback(NULL, request->data);
+		}
+	}
+	if (conn->event_callback) {
+		conn->event_callback(NULL, conn->event_data);
+	}
+}
+
+static bool ipc_connection_flush(struct ipc_connection *conn) {
+	while (conn->out.length > 0) {
+		ssize_t written = write(conn->fd, conn->out.data, conn->out.length);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN) {
+				break;
+			}
+			wlr_log_errno(WLR_ERROR, "Unable to send IPC request");
+			ipc_connection_fail(conn);
+			return false;
+		}
+		ipc_buffer_consume(&conn->out, written);
+	}
+	ipc_connection_update_mask(conn);
+	return true;
+}
+
+static void ipc_connection_deliver(struct ipc_connection *conn,
+		struct ipc_response *response) {
+	if (response->type & (1u << 31)) {
+		if (conn->event_callback) {
+			conn->event_callback(response, conn->event_data);
+		}
+		return;
+	}
+	if (conn->requests_head == conn->requests_length) {
+		wlr_log(WLR_ERROR, "Received unexpected IPC reply of type %u",
+				response->type);
+		return;
+	}
+	struct ipc_request request = conn->requests[conn->requests_head++];
+	if (conn->requests_head == conn->requests_length) {
+		conn->requests_head = conn->requests_length = 0;
+	}
+	if (request.type != response->type) {
+		wlr_log(WLR_ERROR, "Expected IPC reply of type %u, got %u",
+				request.type, response->type);
+	}
+	if (request.callback) {
+		request.callback(response, request.data);
+	}
+}
+
+/**
+ * Read everything available without blocking and deliver complete messages.
+ */
+static bool ipc_connection_dispatch(struct ipc_connection *conn) {
+	while (true) {
+		// Keep a spare byte so the payload can be NUL terminated in place
+		if (!ipc_buffer_reserve(&conn->in, 4096 + 1)) {
+			ipc_connection_fail(conn);
+			return false;
+		}
+		size_t space = conn->in.capacity - conn->in.length - 1;
+		ssize_t received = read(conn->fd, conn->in.data + conn->in.length,
+				space);
+		if (received == 0) {
+			wlr_log(WLR_DEBUG, "IPC connection closed");
+			ipc_connection_fail(conn);
+			return false;
+		} else if (received == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN) {
+				break;
+			}
+			wlr_log_errno(WLR_ERROR, "Unable to receive IPC response");
+			ipc_connection_fail(conn);
+			return false;
+		}
+		conn->in.length += received;
+		if ((size_t)received < space) {
+			break;
+		}
+	}
+
+	conn->dispatching = true;
+	size_t offset = 0;
+	while (!conn->failed && conn->in.length - offset >= ipc_header_size) {
+		char *data = conn->in.data + offset;
+		if (memcmp(data, ipc_magic, sizeof(ipc_magic)) != 0) {
+			wlr_log(WLR_ERROR, "Invalid IPC response header");
+			ipc_connection_fail(conn);
+			break;
+		}
+		struct ipc_response response;
+		uint32_t *data32 = (uint32_t *)(data + sizeof(ipc_magic));
+		memcpy(&response.size, &data32[0], sizeof(data32[0]));
+		memcpy(&response.type, &data32[1], sizeof(data32[1]));
+		size_t length = ipc_header_size + response.size;
+		if (conn->in.length - offset < length) {
+			break;
+		}
+		response.payload = data + ipc_header_size;
+		// The following byte belongs to the next message, if any
+		char next = response.payload[response.size];
+		response.payload[response.size] = '\0';
+		ipc_connection_deliver(conn, &response);
+		response.payload[response.size] = next;
+		offset += length;
+	}
+	conn->dispatching = false;
+	ipc_buffer_consume(&conn->in, offset);
+	return !conn->failed;
+}
+
+static void ipc_connection_handle_fd(int fd, short mask, void *data) {
+	struct ipc_connection *conn = data;
+	if (mask & POLLOUT) {
+		ipc_connection_flush(conn);
+	}
+	if (!conn->failed && (mask & (POLLIN | POLLHUP | POLLERR))) {
+		ipc_connection_dispatch(conn);
+	}
+}
+
+struct ipc_connection *ipc_connection_create(int socketfd, struct loop *loop) {
+	int flags = fcntl(socketfd, F_GETFL);
+	if (flags == -1 || fcntl(socketfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		wlr_log_errno(WLR_ERROR, "Unable to set NONBLOCK on IPC socket");
+		return NULL;
+	}
+	struct ipc_connection *conn = calloc(1, sizeof(struct ipc_connection));
+	if (!conn) {
+		wlr_log(WLR_ERROR, "Unable to allocate IPC connection");
+		return NULL;
+	}
+	conn->fd = socketfd;
+	conn->loop = loop;
+	if (loop) {
+		loop_add_fd(loop, socketfd, POLLIN, ipc_connection_handle_fd, conn);
+	}
+	return conn;
+}
+
+void ipc_connection_destroy(struct ipc_connection *conn) {
+	if (!conn) {
+		return;
+	}
+	if (conn->loop && !conn->failed) {
+		loop_remove_fd(conn->loop, conn->fd);
+	}
+	close(conn->fd);
+	free(conn->requests);
+	free(conn->out.data);
+	free(conn->in.data);
+	free(conn);
+}
+
+void ipc_connection_set_event_handler(struct ipc_connection *conn,
+		void (*callback)(struct ipc_response *response, void *data),
+		void *data) {
+	conn->event_callback = callback;
+	conn->event_data = data;
+}
+
+bool ipc_connection_send(struct ipc_connection *conn, uint32_t type,
+		const char *payload, uint32_t payload_length,
+		void (*callback)(struct ipc_response *response, void *data),
+		void *data) {
+	if (conn->failed) {
+		return false;
+	}
+
+	if (conn->requests_length == conn->requests_capacity) {
+		size_t capacity = conn->requests_capacity ?
+			conn->requests_capacity * 2 : 16;
+		struct ipc_request *requests = realloc(conn->requests,
+				capacity * sizeof(struct ipc_request));
+		if (!requests) {
+			wlr_log(WLR_ERROR, "Unable to allocate IPC request");
+			return false;
+		}
+		conn->requests = requests;
+		conn->requests_capacity = capacity;
+	}
+
+	char header[ipc_header_size];
+	ipc_fill_header(header, type, payload_length);
+	size_t total = ipc_header_size + payload_length;
+	size_t written = 0;
+	if (conn->out.length == 0) {
+		// Nothing is queued, so try sending the whole message right away
+		struct iovec iov[2] = {
+			{ .iov_base = header, .iov_len = ipc_header_size },
+			{ .iov_base = (void *)payload, .iov_len = payload_length },
+		};
+		ssize_t ret;
+		do {
+			ret = writev(conn->fd, iov, 2);
+		} while (ret == -1 && errno == EINTR);
+		if (ret == -1 && errno != EAGAIN) {
+			wlr_log_errno(WLR_ERROR, "Unable to send IPC request");
+			ipc_connection_fail(conn);
+			return false;
+		}
+		written = ret == -1 ? 0 : (size_t)ret;
+	}
+	if (written < total) {
+		if (written < ipc_header_size) {
+			if (!ipc_buffer_append(&conn->out, header + written,
+						ipc_header_size - written)) {
+				ipc_connection_fail(conn);
+				return false;
+			}
+			written = ipc_header_size;
+		}
+		if (!ipc_buffer_append(&conn->out,
+					payload + (written - ipc_header_size),
+					total - written)) {
+			ipc_connection_fail(conn);
+			return false;
+		}
+		ipc_connection_update_mask(conn);
+	}
+
+	conn->requests[conn->requests_length++] = (struct ipc_request){
+		.type = type,
+		.callback = callback,
+		.data = data,
+	};
+	return true;
+}
+
+bool ipc_connection_roundtrip(struct ipc_connection *conn) {
+	if (!sway_assert(!conn->dispatching,
+				"Cannot roundtrip from an IPC callback")) {
+		return false;
+	}
+	while (!conn->failed && conn->requests_head < conn->requests_length) {
+		struct pollfd pfd = {
+			.fd = conn->fd,
+			.events = POLLIN | (conn->out.length ? POLLOUT : 0),
+		};
+		if (poll(&pfd, 1, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			wlr_log_errno(WLR_ERROR, "Unable to poll IPC socket");
+			ipc_connection_fail(conn);
+			break;
+		}
+		ipc_connection_handle_fd(conn->fd, pfd.revents, conn);
+	}
+	return !conn->failed;
+}
+
+bool ipc_connection_poll(struct ipc_connection *conn) {
+	if (!sway_assert(!conn->dispatching,
+				"Cannot poll from an IPC callback")) {
+		return false;
+	}
+	if (!conn->failed && conn->out.length) {
+		ipc_connection_flush(conn);
+	}
+	if (!conn->failed) {
+		ipc_connection_dispatch(conn);
+	}
+	return !conn->failed;
+}
+
+size_t ipc_connection_get_pending(struct ipc_connection *conn) {
+	return conn->requests_length - conn->requests_head;
+}
+
+static void handle_set_encoding(struct ipc_response *response, void *data) {
+	bool *ok = data;
+	// The reply is sent in the old encoding, which is always JSON here
+	json_object *result = response ? json_tokener_parse(response->payload) : NULL;
+	json_object *success = NULL;
+	*ok = result && json_object_object_get_ex(result, "success", &success)
+		&& json_object_get_boolean(success);
+	json_object_put(result);
+}
+
+bool ipc_set_encoding(struct ipc_connection *conn,
+		enum ipc_encoding encoding) {
+	const char *name = ipc_encoding_name(encoding);
+	bool ok = false;
+	if (!ipc_connection_send(conn, IPC_SET_ENCODING, name, strlen(name),
+				handle_set_encoding, &ok)
+			|| !ipc_connection_roundtrip(conn) || !ok) {
+		wlr_log(WLR_DEBUG, "IPC encoding %s is not supported", name);
+		return false;
+	}
+	return true;
+}
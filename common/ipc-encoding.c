@@ -0,0 +1,520 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <json-c/json.h>
+#include "ipc-encoding.h"
+#include "log.h"
+
+// See RFC 7049 for the CBOR format
+enum cbor_major_type {
+	CBOR_UINT = 0,
+	CBOR_NEGINT = 1,
+	CBOR_BYTES = 2,
+	CBOR_TEXT = 3,
+	CBOR_ARRAY = 4,
+	CBOR_MAP = 5,
+	CBOR_SIMPLE = 7,
+};
+
+enum cbor_initial_byte {
+	CBOR_FALSE = 0xF4,
+	CBOR_TRUE = 0xF5,
+	CBOR_NULL = 0xF6,
+	CBOR_FLOAT32 = 0xFA,
+	CBOR_FLOAT64 = 0xFB,
+	CBOR_BREAK = 0xFF,
+};
+
+// Additional information for arrays and maps terminated by CBOR_BREAK
+static const uint8_t cbor_indefinite = 31;
+
+// Limits the recursion when decoding untrusted payloads
+static const int cbor_max_depth = 512;
+
+const char *ipc_encoding_name(enum ipc_encoding encoding) {
+	switch (encoding) {
+	case IPC_ENCODING_JSON:
+		return "json";
+	case IPC_ENCODING_CBOR:
+		return "cbor";
+	case IPC_ENCODING_COUNT:
+		break;
+	}
+	return NULL;
+}
+
+void ipc_serializer_init(struct ipc_serializer *serializer,
+		enum ipc_encoding encoding) {
+	memset(serializer, 0, sizeof(struct ipc_serializer));
+	serializer->encoding = encoding;
+}
+
+char *ipc_serializer_finish(struct ipc_serializer *serializer, size_t *length) {
+	if (serializer->failed) {
+		free(serializer->data);
+		return NULL;
+	}
+	if (length) {
+		*length = serializer->length;
+	}
+	return serializer->data;
+}
+
+static void append(struct ipc_serializer *serializer,
+		const void *data, size_t length) {
+	if (serializer->failed) {
+		return;
+	}
+	// Always leave room for a terminating NUL so JSON can be used as a string
+	if (serializer->length + length + 1 > serializer->capacity) {
+		size_t capacity = serializer->capacity ? serializer->capacity : 4096;
+		while (serializer->length + length + 1 > capacity) {
+			capacity *= 2;
+		}
+		char *data = realloc(serializer->data, capacity);
+		if (!data) {
+			wlr_log(WLR_ERROR, "Unable to allocate IPC payload");
+			serializer->failed = true;
+			return;
+		}
+		serializer->data = data;
+		serializer->capacity = capacity;
+	}
+	memcpy(serializer->data + serializer->length, data, length);
+	serializer->length += length;
+	serializer->data[serializer->length] = '\0';
+}
+
+static void append_str(struct ipc_serializer *serializer, const char *str) {
+	append(serializer, str, strlen(str));
+}
+
+static void append_byte(struct ipc_serializer *serializer, uint8_t byte) {
+	append(serializer, &byte, 1);
+}
+
+static char last_char(struct ipc_serializer *serializer) {
+	return serializer->length ? serializer->data[serializer->length - 1] : 0;
+}
+
+/**
+ * JSON values need to be separated from the previous array element.
+ */
+static void json_begin_value(struct ipc_serializer *serializer) {
+	char last = last_char(serializer);
+	if (last != 0 && last != '[' && last != ':') {
+		append_str(serializer, ",");
+	}
+}
+
+static void cbor_append_head(struct ipc_serializer *serializer,
+		enum cbor_major_type type, uint64_t value) {
+	uint8_t head[9];
+	size_t length;
+	if (value < 24) {
+		head[0] = type << 5 | value;
+		length = 1;
+	} else if (value <= UINT8_MAX) {
+		head[0] = type << 5 | 24;
+		length = 2;
+	} else if (value <= UINT16_MAX) {
+		head[0] = type << 5 | 25;
+		length = 3;
+	} else if (value <= UINT32_MAX) {
+		head[0] = type << 5 | 26;
+		length = 5;
+	} else {
+		head[0] = type << 5 | 27;
+		length = 9;
+	}
+	// Big endian argument
+	for (size_t i = 1; i < length; ++i) {
+		head[i] = value >> (8 * (length - 1 - i));
+	}
+	append(serializer, head, length);
+}
+
+static void cbor_append_text(struct ipc_serializer *serializer,
+		const char *str, size_t length) {
+	cbor_append_head(serializer, CBOR_TEXT, length);
+	append(serializer, str, length);
+}
+
+void ipc_serializer_add_key(struct ipc_serializer *serializer,
+		const char *key) {
+	switch (serializer->encoding) {
+	case IPC_ENCODING_JSON:
+		if (last_char(serializer) != '{') {
+			append_str(serializer, ",");
+		}
+		append_str(serializer, "\"");
+		append_str(serializer, key);
+		append_str(serializer, "\":");
+		break;
+	case IPC_ENCODING_CBOR:
+		cbor_append_text(serializer, key, strlen(key));
+		break;
+	case IPC_ENCODING_COUNT:
+		break;
+	}
+}
+
+void ipc_serializer_begin_object(struct ipc_serializer *serializer) {
+	switch (serializer->encoding) {
+	case IPC_ENCODING_JSON:
+		json_begin_value(serializer);
+		append_str(serializer, "{");
+		break;
+	case IPC_ENCODING_CBOR:
+		append_byte(serializer, CBOR_MAP << 5 | cbor_indefinite);
+		break;
+	case IPC_ENCODING_COUNT:
+		break;
+	}
+}
+
+void ipc_serializer_end_object(struct ipc_serializer *serializer) {
+	switch (serializer->encoding) {
+	case IPC_ENCODING_JSON:
+		append_str(serializer, "}");
+		break;
+	case IPC_ENCODING_CBOR:
+		append_byte(serializer, CBOR_BREAK);
+		break;
+	case IPC_ENCODING_COUNT:
+		break;
+	}
+}
+
+void ipc_serializer_begin_array(struct ipc_serializer *serializer) {
+	switch (serializer->encoding) {
+	case IPC_ENCODING_JSON:
+		json_begin_value(serializer);
+		append_str(serializer, "[");
+		break;
+	case IPC_ENCODING_CBOR:
+		append_byte(serializer, CBOR_ARRAY << 5 | cbor_indefinite);
+		break;
+	case IPC_ENCODING_COUNT:
+		break;
+	}
+}
+
+void ipc_serializer_end_array(struct ipc_serializer *serializer) {
+	switch (serializer->encoding) {
+	case IPC_ENCODING_JSON:
+		append_str(serializer, "]");
+		break;
+	case IPC_ENCODING_CBOR:
+		append_byte(serializer, CBOR_BREAK);
+		break;
+	case IPC_ENCODING_COUNT:
+		break;
+	}
+}
+
+void ipc_serializer_add_bool(struct ipc_serializer *serializer, bool value) {
+	switch (serializer->encoding) {
+	case IPC_ENCODING_JSON:
+		json_begin_value(serializer);
+		append_str(serializer, value ? "true" : "false");
+		break;
+	case IPC_ENCODING_CBOR:
+		append_byte(serializer, value ? CBOR_TRUE : CBOR_FALSE);
+		break;
+	case IPC_ENCODING_COUNT:
+		break;
+	}
+}
+
+static void cbor_append_object(struct ipc_serializer *serializer,
+		json_object *value, bool open) {
+	switch (json_object_get_type(value)) {
+	case json_type_null:
+		append_byte(serializer, CBOR_NULL);
+		break;
+	case json_type_boolean:
+		append_byte(serializer,
+				json_object_get_boolean(value) ? CBOR_TRUE : CBOR_FALSE);
+		break;
+	case json_type_int:;
+		int64_t i = json_object_get_int64(value);
+		if (i >= 0) {
+			cbor_append_head(serializer, CBOR_UINT, (uint64_t)i);
+		} else {
+			cbor_append_head(serializer, CBOR_NEGINT, (uint64_t)(-1 - i));
+		}
+		break;
+	case json_type_double:;
+		double d = json_object_get_double(value);
+		uint64_t bits;
+		memcpy(&bits, &d, sizeof(bits));
+		uint8_t data[9] = { CBOR_FLOAT64 };
+		for (int j = 0; j < 8; ++j) {
+			data[1 + j] = bits >> (8 * (7 - j));
+		}
+		append(serializer, data, sizeof(data));
+		break;
+	case json_type_string:
+		cbor_append_text(serializer, json_object_get_string(value),
+				json_object_get_string_len(value));
+		break;
+	case json_type_array:;
+		size_t length = json_object_array_length(value);
+		cbor_append_head(serializer, CBOR_ARRAY, length);
+		for (size_t j = 0; j < length; ++j) {
+			cbor_append_object(serializer,
+					json_object_array_get_idx(value, j), false);
+		}
+		break;
+	case json_type_object:
+		if (open) {
+			append_byte(serializer, CBOR_MAP << 5 | cbor_indefinite);
+		} else {
+			cbor_append_head(serializer, CBOR_MAP,
+					json_object_object_length(value));
+		}
+		json_object_object_foreach(value, key, member) {
+			cbor_append_text(serializer, key, strlen(key));
+			cbor_append_object(serializer, member, false);
+		}
+		break;
+	}
+}
+
+void ipc_serializer_add_object(struct ipc_serializer *serializer,
+		json_object *value) {
+	switch (serializer->encoding) {
+	case IPC_ENCODING_JSON:
+		json_begin_value(serializer);
+		append_str(serializer,
+			json_object_to_json_string_ext(value, JSON_C_TO_STRING_PLAIN));
+		break;
+	case IPC_ENCODING_CBOR:
+		cbor_append_object(serializer, value, false);
+		break;
+	case IPC_ENCODING_COUNT:
+		break;
+	}
+}
+
+void ipc_serializer_add_open_object(struct ipc_serializer *serializer,
+		json_object *object) {
+	if (!sway_assert(json_object_is_type(object, json_type_object),
+				"Expected a JSON object")) {
+		return;
+	}
+	switch (serializer->encoding) {
+	case IPC_ENCODING_JSON:;
+		const char *json_string =
+			json_object_to_json_string_ext(object, JSON_C_TO_STRING_PLAIN);
+		json_begin_value(serializer);
+		// Leave out the closing brace
+		append(serializer, json_string, strlen(json_string) - 1);
+		break;
+	case IPC_ENCODING_CBOR:
+		cbor_append_object(serializer, object, true);
+		break;
+	case IPC_ENCODING_COUNT:
+		break;
+	}
+}
+
+void ipc_serializer_add_encoded(struct ipc_serializer *serializer,
+		const char *data, size_t length) {
+	if (serializer->encoding == IPC_ENCODING_JSON) {
+		json_begin_value(serializer);
+	}
+	append(serializer, data, length);
+}
+
+char *ipc_encode_object(enum ipc_encoding encoding, json_object *object,
+		size_t *length) {
+	if (encoding == IPC_ENCODING_JSON) {
+		const char *json_string = json_object_to_json_string(object);
+		if (length) {
+			*length = strlen(json_string);
+		}
+		return strdup(json_string);
+	}
+	struct ipc_serializer serializer;
+	ipc_serializer_init(&serializer, encoding);
+	ipc_serializer_add_object(&serializer, object);
+	return ipc_serializer_finish(&serializer, length);
+}
+
+struct cbor_decoder {
+	const uint8_t *pos;
+	const uint8_t *end;
+};
+
+static bool cbor_read_head(struct cbor_decoder *decoder, uint8_t *type,
+		uint8_t *info, uint64_t *value) {
+	if (decoder->pos >= decoder->end) {
+		return false;
+	}
+	*type = *decoder->pos >> 5;
+	*info = *decoder->pos & 0x1F;
+	decoder->pos++;
+
+	size_t length;
+	if (*info < 24 || *info == cbor_indefinite) {
+		*value = *info;
+		return true;
+	} else if (*info <= 27) {
+		length = 1 << (*info - 24);
+	} else {
+		return false;
+	}
+	if ((size_t)(decoder->end - decoder->pos) < length) {
+		return false;
+	}
+	*value = 0;
+	for (size_t i = 0; i < length; ++i) {
+		*value = *value << 8 | decoder->pos[i];
+	}
+	decoder->pos += length;
+	return true;
+}
+
+static bool cbor_at_break(struct cbor_decoder *decoder) {
+	return decoder->pos < decoder->end && *decoder->pos == CBOR_BREAK;
+}
+
+static bool cbor_decode_item(struct cbor_decoder *decoder, int depth,
+		json_object **out);
+
+static bool cbor_decode_float(uint8_t info, uint64_t value,
+		json_object **out) {
+	if (info == (CBOR_FLOAT64 & 0x1F)) {
+		double d;
+		memcpy(&d, &value, sizeof(d));
+		*out = json_object_new_double(d);
+	} else if (info == (CBOR_FLOAT32 & 0x1F)) {
+		uint32_t bits = value;
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		*out = json_object_new_double(f);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static bool cbor_decode_simple(uint8_t info, uint64_t value,
+		json_object **out) {
+	switch (CBOR_SIMPLE << 5 | info) {
+	case CBOR_FALSE:
+		*out = json_object_new_boolean(false);
+		return true;
+	case CBOR_TRUE:
+		*out = json_object_new_boolean(true);
+		return true;
+	case CBOR_NULL:
+		*out = NULL;
+		return true;
+	}
+	return cbor_decode_float(info, value, out);
+}
+
+static bool cbor_decode_array(struct cbor_decoder *decoder, int depth,
+		uint8_t info, uint64_t length, json_object **out) {
+	json_object *array = json_object_new_array();
+	for (uint64_t i = 0; info == cbor_indefinite || i < length; ++i) {
+		if (info == cbor_indefinite && cbor_at_break(decoder)) {
+			decoder->pos++;
+			break;
+		}
+		json_object *item;
+		if (!cbor_decode_item(decoder, depth + 1, &item)) {
+			json_object_put(array);
+			return false;
+		}
+		json_object_array_add(array, item);
+	}
+	*out = array;
+	return true;
+}
+
+static bool cbor_decode_map(struct cbor_decoder *decoder, int depth,
+		uint8_t info, uint64_t length, json_object **out) {
+	json_object *map = json_object_new_object();
+	for (uint64_t i = 0; info == cbor_indefinite || i < length; ++i) {
+		if (info == cbor_indefinite && cbor_at_break(decoder)) {
+			decoder->pos++;
+			break;
+		}
+		json_object *key, *value;
+		if (!cbor_decode_item(decoder, depth + 1, &key)) {
+			goto error;
+		}
+		if (!json_object_is_type(key, json_type_string)) {
+			json_object_put(key);
+			goto error;
+		}
+		if (!cbor_decode_item(decoder, depth + 1, &value)) {
+			json_object_put(key);
+			goto error;
+		}
+		json_object_object_add(map, json_object_get_string(key), value);
+		json_object_put(key);
+	}
+	*out = map;
+	return true;
+error:
+	json_object_put(map);
+	return false;
+}
+
+static bool cbor_decode_item(struct cbor_decoder *decoder, int depth,
+		json_object **out) {
+	uint8_t type, info;
+	uint64_t value;
+	if (depth > cbor_max_depth ||
+			!cbor_read_head(decoder, &type, &info, &value)) {
+		return false;
+	}
+	switch (type) {
+	case CBOR_UINT:
+		*out = json_object_new_int64(value);
+		return true;
+	case CBOR_NEGINT:
+		*out = json_object_new_int64(-1 - (int64_t)value);
+		return true;
+	case CBOR_BYTES:
+	case CBOR_TEXT:
+		if (info == cbor_indefinite ||
+				(uint64_t)(decoder->end - decoder->pos) < value) {
+			return false;
+		}
+		*out = json_object_new_string_len((const char *)decoder->pos, value);
+		decoder->pos += value;
+		return true;
+	case CBOR_ARRAY:
+		return cbor_decode_array(decoder, depth, info, value, out);
+	case CBOR_MAP:
+		return cbor_decode_map(decoder, depth, info, value, out);
+	case CBOR_SIMPLE:
+		return cbor_decode_simple(info, value, out);
+	}
+	// Tags are never sent by sway
+	return false;
+}
+
+json_object *ipc_decode_payload(enum ipc_encoding encoding,
+		const char *payload, size_t length) {
+	if (encoding == IPC_ENCODING_JSON) {
+		return json_tokener_parse(payload);
+	}
+	struct cbor_decoder decoder = {
+		.pos = (const uint8_t *)payload,
+		.end = (const uint8_t *)payload + length,
+	};
+	json_object *object = NULL;
+	if (!cbor_decode_item(&decoder, 0, &object)) {
+		wlr_log(WLR_ERROR, "Unable to decode CBOR IPC payload");
+		return NULL;
+	}
+	return object;
+}
@@ -1,110 +1,273 @@
 #define _POSIX_C_SOURCE 200112L
+#include <errno.h>
 #include <limits.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <time.h>
 #include <unistd.h>
 #include "list.h"
 #include "log.h"
 #include "loop.h"
 
+// How many ready fds are fetched from epoll at once
+#define LOOP_MAX_EVENTS 32
+
 struct loop_fd_event {
 	void (*callback)(int fd, short mask, void *data);
 	void *data;
+	int fd;
+	short mask;
+	// epoll refuses regular files, which poll considers to always be ready
+	bool always_ready;
 };
 
 struct loop_timer {
 	void (*callback)(void *data);
 	void *data;
 	struct timespec expiry;
+	int heap_index; // -1 once the timer has been taken out of the heap
 };
 
 struct loop {
-	struct pollfd *fds;
-	int fd_length;
-	int fd_capacity;
+	int epoll_fd;
+
+	// Indexed by fd, so that fds can be looked up and removed in O(1)
+	struct loop_fd_event **fd_events;
+	int fd_events_size;
+	list_t *always_ready; // struct loop_fd_event
 
-	list_t *fd_events; // struct loop_fd_event
-	list_t *timers; // struct loop_timer
+	// Binary min-heap ordered by expiry
+	struct loop_timer **timers;
+	int timer_length;
+	int timer_capacity;
 };
 
+static bool timer_before(const struct loop_timer *a,
+		const struct loop_timer *b) {
+	return a->expiry.tv_sec < b->expiry.tv_sec ||
+		(a->expiry.tv_sec == b->expiry.tv_sec &&
+		 a->expiry.tv_nsec < b->expiry.tv_nsec);
+}
+
+static void heap_set(struct loop *loop, int index, struct loop_timer *timer) {
+	loop->timers[index] = timer;
+	timer->heap_index = index;
+}
+
+static void heap_sift_up(struct loop *loop, int index) {
+	struct loop_timer *timer = loop->timers[index];
+	while (index > 0) {
+		int parent = (index - 1) / 2;
+		if (!timer_before(timer, loop->timers[parent])) {
+			break;
+		}
+		heap_set(loop, index, loop->timers[parent]);
+		index = parent;
+	}
+	heap_set(loop, index, timer);
+}
+
+static void heap_sift_down(struct loop *loop, int index) {
+	struct loop_timer *timer = loop->timers[index];
+	while (true) {
+		int child = index * 2 + 1;
+		if (child >= loop->timer_length) {
+			break;
+		}
+		if (child + 1 < loop->timer_length &&
+				timer_before(loop->timers[child + 1], loop->timers[child])) {
+			++child;
+		}
+		if (!timer_before(loop->timers[child], timer)) {
+			break;
+		}
+		heap_set(loop, index, loop->timers[child]);
+		index = child;
+	}
+	heap_set(loop, index, timer);
+}
+
+static void heap_remove(struct loop *loop, struct loop_timer *timer) {
+	int index = timer->heap_index;
+	timer->heap_index = -1;
+	struct loop_timer *last = loop->timers[--loop->timer_length];
+	if (last == timer) {
+		return;
+	}
+	heap_set(loop, index, last);
+	if (index > 0 && timer_before(last, loop->timers[(index - 1) / 2])) {
+		heap_sift_up(loop, index);
+	} else {
+		heap_sift_down(loop, index);
+	}
+}
+
+static uint32_t poll_to_epoll(short mask) {
+	uint32_t events = 0;
+	if (mask & POLLIN) {
+		events |= EPOLLIN;
+	}
+	if (mask & POLLOUT) {
+		events |= EPOLLOUT;
+	}
+	if (mask & POLLPRI) {
+		events |= EPOLLPRI;
+	}
+	return events;
+}
+
+static short epoll_to_poll(uint32_t events) {
+	short mask = 0;
+	if (events & EPOLLIN) {
+		mask |= POLLIN;
+	}
+	if (events & EPOLLOUT) {
+		mask |= POLLOUT;
+	}
+	if (events & EPOLLPRI) {
+		mask |= POLLPRI;
+	}
+	if (events & EPOLLERR) {
+		mask |= POLLERR;
+	}
+	if (events & EPOLLHUP) {
+		mask |= POLLHUP;
+	}
+	return mask;
+}
+
 struct loop *loop_create(void) {
 	struct loop *loop = calloc(1, sizeof(struct loop));
 	if (!loop) {
 		wlr_log(WLR_ERROR, "Unable to allocate memory for loop");
 		return NULL;
 	}
-	loop->fd_capacity = 10;
-	loop->fds = malloc(sizeof(struct pollfd) * loop->fd_capacity);
-	loop->fd_events = create_list();
-	loop->timers = create_list();
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epoll_fd == -1) {
+		wlr_log_errno(WLR_ERROR, "Unable to create epoll instance");
+		free(loop);
+		return NULL;
+	}
+	loop->always_ready = create_list();
 	return loop;
 }
 
 void loop_destroy(struct loop *loop) {
-	list_free_items_and_destroy(loop->fd_events);
-	list_free_items_and_destroy(loop->timers);
-	free(loop->fds);
+	for (int i = 0; i < loop->fd_events_size; ++i) {
+		free(loop->fd_events[i]);
+	}
+	for (int i = 0; i < loop->timer_length; ++i) {
+		free(loop->timers[i]);
+	}
+	list_free(loop->always_ready);
+	free(loop->fd_events);
+	free(loop->timers);
+	close(loop->epoll_fd);
 	free(loop);
 }
 
-void loop_poll(struct loop *loop) {
-	// Calculate next timer in ms
-	int ms = INT_MAX;
-	if (loop->timers->length) {
-		struct timespec now;
-		clock_gettime(CLOCK_MONOTONIC, &now);
-		for (int i = 0; i < loop->timers->length; ++i) {
-			struct loop_timer *timer = loop->timers->items[i];
-			int timer_ms = (timer->expiry.tv_sec - now.tv_sec) * 1000;
-			timer_ms += (timer->expiry.tv_nsec - now.tv_nsec) / 1000000;
-			if (timer_ms < ms) {
-				ms = timer_ms;
-			}
-		}
+static int next_timeout_ms(struct loop *loop) {
+	if (loop->always_ready->length) {
+		return 0;
 	}
-	if (ms < 0) {
-		ms = 0;
+	if (!loop->timer_length) {
+		return -1;
 	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	struct loop_timer *timer = loop->timers[0];
+	long long ns = (timer->expiry.tv_sec - now.tv_sec) * 1000000000LL +
+		(timer->expiry.tv_nsec - now.tv_nsec);
+	if (ns <= 0) {
+		return 0;
+	}
+	// Round up, so that we don't wake up just before the timer expires
+	long long ms = (ns + 999999) / 1000000;
+	return ms > INT_MAX ? INT_MAX : (int)ms;
+}
 
-	poll(loop->fds, loop->fd_length, ms);
+static void dispatch_fd(struct loop *loop, int fd, short revents) {
+	if (fd < 0 || fd >= loop->fd_events_size || !loop->fd_events[fd]) {
+		// Removed by an earlier callback
+		return;
+	}
+	struct loop_fd_event *event = loop->fd_events[fd];
 
-	// Dispatch fds
-	for (int i = 0; i < loop->fd_length; ++i) {
-		struct pollfd pfd = loop->fds[i];
-		struct loop_fd_event *event = loop->fd_events->items[i];
+	// Always send these events
+	short events = event->mask | POLLHUP | POLLERR;
 
-		// Always send these events
-		unsigned events = pfd.events | POLLHUP | POLLERR;
+	if (revents & events) {
+		event->callback(fd, revents & events, event->data);
+	}
+}
 
-		if (pfd.revents & events) {
-			event->callback(pfd.fd, pfd.revents, event->data);
+void loop_poll(struct loop *loop) {
+	struct epoll_event events[LOOP_MAX_EVENTS];
+	int n = epoll_wait(loop->epoll_fd, events, LOOP_MAX_EVENTS,
+			next_timeout_ms(loop));
+	if (n == -1 && errno != EINTR) {
+		wlr_log_errno(WLR_ERROR, "epoll_wait failed");
+	}
+
+	// Dispatch fds
+	for (int i = 0; i < n; ++i) {
+		dispatch_fd(loop, events[i].data.fd, epoll_to_poll(events[i].events));
+	}
+	for (int i = 0; i < loop->always_ready->length; ++i) {
+		struct loop_fd_event *event = loop->always_ready->items[i];
+		dispatch_fd(loop, event->fd, event->mask & (POLLIN | POLLOUT));
+		if (i < loop->always_ready->length &&
+				loop->always_ready->items[i] != event) {
+			// The callback removed its fd
+			--i;
 		}
 	}
 
 	// Dispatch timers
-	if (loop->timers->length) {
+	if (loop->timer_length) {
 		struct timespec now;
 		clock_gettime(CLOCK_MONOTONIC, &now);
-		for (int i = 0; i < loop->timers->length; ++i) {
-			struct loop_timer *timer = loop->timers->items[i];
-			bool expired = timer->expiry.tv_sec < now.tv_sec ||
-				(timer->expiry.tv_sec == now.tv_sec &&
-				 timer->expiry.tv_nsec < now.tv_nsec);
-			if (expired) {
-				timer->callback(timer->data);
-				loop_remove_timer(loop, timer);
-				--i;
-			}
+		struct loop_timer expired_at = { .expiry = now };
+		while (loop->timer_length &&
+				timer_before(loop->timers[0], &expired_at)) {
+			struct loop_timer *timer = loop->timers[0];
+			heap_remove(loop, timer);
+			timer->callback(timer->data);
+			free(timer);
 		}
 	}
 }
 
 void loop_add_fd(struct loop *loop, int fd, short mask,
 		void (*callback)(int fd, short mask, void *data), void *data) {
+	if (fd < 0) {
+		return;
+	}
+	if (fd >= loop->fd_events_size) {
+		int size = loop->fd_events_size ? loop->fd_events_size : 16;
+		while (size <= fd) {
+			size *= 2;
+		}
+		struct loop_fd_event **fd_events = realloc(loop->fd_events,
+				sizeof(struct loop_fd_event *) * size);
+		if (!fd_events) {
+			wlr_log(WLR_ERROR, "Unable to allocate memory for event");
+			return;
+		}
+		memset(&fd_events[loop->fd_events_size], 0,
+				sizeof(struct loop_fd_event *) * (size - loop->fd_events_size));
+		loop->fd_events = fd_events;
+		loop->fd_events_size = size;
+	}
+	if (loop->fd_events[fd]) {
+		wlr_log(WLR_ERROR, "fd %d is already in the loop", fd);
+		return;
+	}
+
 	struct loop_fd_event *event = calloc(1, sizeof(struct loop_fd_event));
 	if (!event) {
 		wlr_log(WLR_ERROR, "Unable to allocate memory for event");
@@ -112,21 +275,68 @@ void loop_add_fd(struct loop *loop, int fd, short mask,
 	}
 	event->callback = callback;
 	event->data = data;
-	list_add(loop->fd_events, event);
+	event->fd = fd;
+	event->mask = mask;
 
-	struct pollfd pfd = {fd, mask, 0};
+	struct epoll_event ev = {
+		.events = poll_to_epoll(mask),
+		.data.fd = fd,
+	};
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		if (errno != EPERM) {
+			wlr_log_errno(WLR_ERROR, "Unable to add fd %d to the loop", fd);
+			free(event);
+			return;
+		}
+		event->always_ready = true;
+		list_add(loop->always_ready, event);
+	}
+	loop->fd_events[fd] = event;
+}
 
-	if (loop->fd_length == loop->fd_capacity) {
-		loop->fd_capacity += 10;
-		loop->fds = realloc(loop->fds,
-				sizeof(struct pollfd) * loop->fd_capacity);
+static struct loop_fd_event *get_fd_event(struct loop *loop, int fd) {
+	if (fd < 0 || fd >= loop->fd_events_size) {
+		return NULL;
 	}
+	return loop->fd_events[fd];
+}
 
-	loop->fds[loop->fd_length++] = pfd;
+bool loop_update_fd(struct loop *loop, int fd, short mask) {
+	struct loop_fd_event *event = get_fd_event(loop, fd);
+	if (!event) {
+		return false;
+	}
+	if (event->mask == mask) {
+		return true;
+	}
+	event->mask = mask;
+	if (!event->always_ready) {
+		struct epoll_event ev = {
+			.events = poll_to_epoll(mask),
+			.data.fd = fd,
+		};
+		if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+			wlr_log_errno(WLR_ERROR, "Unable to update fd %d in the loop", fd);
+			return false;
+		}
+	}
+	return true;
 }
 
 struct loop_timer *loop_add_timer(struct loop *loop, int ms,
 		void (*callback)(void *data), void *data) {
+	if (loop->timer_length == loop->timer_capacity) {
+		int capacity = loop->timer_capacity ? loop->timer_capacity * 2 : 8;
+		struct loop_timer **timers = realloc(loop->timers,
+				sizeof(struct loop_timer *) * capacity);
+		if (!timers) {
+			wlr_log(WLR_ERROR, "Unable to allocate memory for timer");
+			return NULL;
+		}
+		loop->timers = timers;
+		loop->timer_capacity = capacity;
+	}
+
 	struct loop_timer *timer = calloc(1, sizeof(struct loop_timer));
 	if (!timer) {
 		wlr_log(WLR_ERROR, "Unable to allocate memory for timer");
@@ -145,34 +355,37 @@ struct loop_timer *loop_add_timer(struct loop *loop, int ms,
 	}
 	timer->expiry.tv_nsec += nsec;
 
-	list_add(loop->timers, timer);
+	heap_set(loop, loop->timer_length++, timer);
+	heap_sift_up(loop, timer->heap_index);
 
 	return timer;
 }
 
 bool loop_remove_fd(struct loop *loop, int fd) {
-	for (int i = 0; i < loop->fd_length; ++i) {
-		if (loop->fds[i].fd == fd) {
-			free(loop->fd_events->items[i]);
-			list_del(loop->fd_events, i);
-
-			loop->fd_length--;
-			memmove(&loop->fds[i], &loop->fds[i + 1],
-					sizeof(struct pollfd) * (loop->fd_length - i));
-
-			return true;
-		}
+	struct loop_fd_event *event = get_fd_event(loop, fd);
+	if (!event) {
+		return false;
+	}
+	if (event->always_ready) {
+		list_del(loop->always_ready,
+				list_find(loop->always_ready, event));
+	} else if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL) == -1) {
+		// Happens if the fd has been closed already, which also removes it
+		// from the epoll instance
+		wlr_log_errno(WLR_DEBUG, "Unable to remove fd %d from the loop", fd);
 	}
-	return false;
+	loop->fd_events[fd] = NULL;
+	free(event);
+	return true;
 }
 
 bool loop_remove_timer(struct loop *loop, struct loop_timer *timer) {
-	for (int i = 0; i < loop->timers->length; ++i) {
-		if (loop->timers->items[i] == timer) {
-			list_del(loop->timers, i);
-			free(timer);
-			return true;
-		}
+	if (timer->heap_index < 0 || timer->heap_index >= loop->timer_length ||
+			loop->timers[timer->heap_index] != timer) {
+		// Expired, and its callback is running
+		return false;
 	}
-	return false;
+	heap_remove(loop, timer);
+	free(timer);
+	return true;
 }
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <cairo/cairo.h>
 #include <pango/pangocairo.h>
 #include <stdarg.h>
@@ -7,12 +8,41 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cairo.h"
+#include "list.h"
 #include "log.h"
 #include "stringop.h"
 
 static const char overflow[] = "[buffer overflow]";
 static const int max_chars = 16384;
 
+// Fonts are few, but text changes, so most entries are layouts
+#define FONT_CACHE_MAX 16
+#define LAYOUT_CACHE_MAX 256
+
+struct cached_font {
+	char *font;
+	PangoFontDescription *desc;
+};
+
+/**
+ * A layout which has been shaped already. Pango keeps the lines and extents
+ * of a layout until its text, attributes or context change, so using it again
+ * for the same text costs almost nothing.
+ */
+struct cached_layout {
+	uint32_t hash; // Of the font and the text
+	char *font;
+	char *text;
+	double scale;
+	bool markup;
+	unsigned long font_options;
+	PangoLayout *layout;
+};
+
+// Both are least recently used first
+static list_t *font_cache = NULL; // struct cached_font
+static list_t *layout_cache = NULL; // struct cached_layout
+
 size_t escape_markup_text(const char *src, char *dest) {
 	size_t length = 0;
 	if (dest) {
@@ -53,6 +83,35 @@ size_t escape_markup_text(const char *src, char *dest) {
 	return length;
 }
 
+static const PangoFontDescription *get_font_description(const char *font) {
+	if (!font_cache) {
+		font_cache = create_list();
+	}
+	for (int i = 0; i < font_cache->length; ++i) {
+		struct cached_font *cached = font_cache->items[i];
+		if (strcmp(cached->font, font) == 0) {
+			list_move_to_end(font_cache, cached);
+			return cached->desc;
+		}
+	}
+
+	struct cached_font *cached = calloc(1, sizeof(struct cached_font));
+	if (!cached) {
+		return NULL;
+	}
+	cached->font = strdup(font);
+	cached->desc = pango_font_description_from_string(font);
+	list_add(font_cache, cached);
+	if (font_cache->length > FONT_CACHE_MAX) {
+		struct cached_font *oldest = font_cache->items[0];
+		list_del(font_cache, 0);
+		pango_font_description_free(oldest->desc);
+		free(oldest->font);
+		free(oldest);
+	}
+	return cached->desc;
+}
+
 PangoLayout *get_pango_layout(cairo_t *cairo, const char *font,
 		const char *text, double scale, bool markup) {
 	PangoLayout *layout = pango_cairo_create_layout(cairo);
@@ -76,12 +135,84 @@ PangoLayout *get_pango_layout(cairo_t *cairo, const char *font,
 	}
 
 	pango_attr_list_insert(attrs, pango_attr_scale_new(scale));
-	PangoFontDescription *desc = pango_font_description_from_string(font);
-	pango_layout_set_font_description(layout, desc);
+	const PangoFontDescription *desc = get_font_description(font);
+	if (desc) {
+		pango_layout_set_font_description(layout, desc);
+	}
 	pango_layout_set_single_paragraph_mode(layout, 1);
 	pango_layout_set_attributes(layout, attrs);
 	pango_attr_list_unref(attrs);
-	pango_font_description_free(desc);
+	return layout;
+}
+
+static uint32_t hash_string(uint32_t hash, const char *str) {
+	// FNV-1a
+	for (; *str; ++str) {
+		hash ^= (uint8_t)*str;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void cached_layout_destroy(struct cached_layout *cached) {
+	g_object_unref(cached->layout);
+	free(cached->font);
+	free(cached->text);
+	free(cached);
+}
+
+/**
+ * Returns a layout for the text, which has the font options of the cairo
+ * context and has been updated for its transformation. Layouts are shared, so
+ * the caller must g_object_unref the result and must not change it.
+ */
+static PangoLayout *get_cached_layout(cairo_t *cairo, const char *font,
+		const char *text, double scale, bool markup) {
+	cairo_font_options_t *fo = cairo_font_options_create();
+	cairo_get_font_options(cairo, fo);
+	unsigned long font_options = cairo_font_options_hash(fo);
+	uint32_t hash = hash_string(hash_string(2166136261u, font), text);
+
+	if (!layout_cache) {
+		layout_cache = create_list();
+	}
+	// Search from the end, where the most recently used ones are
+	for (int i = layout_cache->length - 1; i >= 0; --i) {
+		struct cached_layout *cached = layout_cache->items[i];
+		if (cached->hash == hash && cached->scale == scale &&
+				cached->markup == markup &&
+				cached->font_options == font_options &&
+				strcmp(cached->text, text) == 0 &&
+				strcmp(cached->font, font) == 0) {
+			cairo_font_options_destroy(fo);
+			list_move_to_end(layout_cache, cached);
+			// Only lays the text out again if the transformation changed
+			pango_cairo_update_layout(cairo, cached->layout);
+			return g_object_ref(cached->layout);
+		}
+	}
+
+	PangoLayout *layout = get_pango_layout(cairo, font, text, scale, markup);
+	pango_cairo_context_set_font_options(pango_layout_get_context(layout), fo);
+	cairo_font_options_destroy(fo);
+	pango_cairo_update_layout(cairo, layout);
+
+	struct cached_layout *cached = calloc(1, sizeof(struct cached_layout));
+	if (!cached) {
+		return layout;
+	}
+	cached->hash = hash;
+	cached->font = strdup(font);
+	cached->text = strdup(text);
+	cached->scale = scale;
+	cached->markup = markup;
+	cached->font_options = font_options;
+	cached->layout = g_object_ref(layout);
+	list_add(layout_cache, cached);
+	if (layout_cache->length > LAYOUT_CACHE_MAX) {
+		cached_layout_destroy(layout_cache->items[0]);
+		list_del(layout_cache, 0);
+	}
 	return layout;
 }
 
@@ -96,8 +227,7 @@ void get_text_size(cairo_t *cairo, const char *font, int *width, int *height,
 	}
 	va_end(args);
 
-	PangoLayout *layout = get_pango_layout(cairo, font, buf, scale, markup);
-	pango_cairo_update_layout(cairo, layout);
+	PangoLayout *layout = get_cached_layout(cairo, font, buf, scale, markup);
 	pango_layout_get_pixel_size(layout, width, height);
 	if (baseline) {
 		*baseline = pango_layout_get_baseline(layout) / PANGO_SCALE;
@@ -116,12 +246,7 @@ void pango_printf(cairo_t *cairo, const char *font,
 	}
 	va_end(args);
 
-	PangoLayout *layout = get_pango_layout(cairo, font, buf, scale, markup);
-	cairo_font_options_t *fo = cairo_font_options_create();
-	cairo_get_font_options(cairo, fo);
-	pango_cairo_context_set_font_options(pango_layout_get_context(layout), fo);
-	cairo_font_options_destroy(fo);
-	pango_cairo_update_layout(cairo, layout);
+	PangoLayout *layout = get_cached_layout(cairo, font, buf, scale, markup);
 	pango_cairo_show_layout(cairo, layout);
 	g_object_unref(layout);
 }
@@ -14,6 +14,11 @@ enum background_mode {
 
 enum background_mode parse_background_mode(const char *mode);
 cairo_surface_t *load_background_image(const char *path);
+
+/**
+ * Paint the image as it looks in a buffer of the given size. The image is
+ * scaled once per size and mode, and later calls copy the cached result.
+ */
 void render_background_image(cairo_t *cairo, cairo_surface_t *image,
 		enum background_mode mode, int buffer_width, int buffer_height);
 
@@ -1,10 +1,15 @@
 #ifndef _SWAY_IPC_CLIENT_H
 #define _SWAY_IPC_CLIENT_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "ipc.h"
 
+struct loop;
+struct ipc_connection;
+
 /**
  * IPC response including type of IPC response, size of payload and the json
  * encoded payload string.
@@ -37,4 +42,56 @@ struct ipc_response *ipc_recv_response(int socketfd);
  */
 void free_ipc_response(struct ipc_response *response);
 
+/**
+ * Wraps a connected socket for asynchronous use, taking ownership of it.
+ * Requests are written without blocking and their replies are delivered to
+ * callbacks in the order the requests were sent. If loop is not NULL, the
+ * socket is added to it and serviced from loop_poll.
+ */
+struct ipc_connection *ipc_connection_create(int socketfd, struct loop *loop);
+/**
+ * Closes the socket. Callbacks of requests which are still pending are not
+ * called.
+ */
+void ipc_connection_destroy(struct ipc_connection *conn);
+/**
+ * Sets the function which receives events. It is called with a NULL response
+ * if the connection fails.
+ */
+void ipc_connection_set_event_handler(struct ipc_connection *conn,
+		void (*callback)(struct ipc_response *response, void *data),
+		void *data);
+/**
+ * Queues a request. The callback may be NULL if the reply is not needed.
+ * Otherwise, it is called once with the reply, or with NULL if the connection
+ * fails first. The response and its payload are only valid during the call.
+ * Callbacks may send further requests but must not destroy the connection.
+ * Returns false if the connection has failed.
+ */
+bool ipc_connection_send(struct ipc_connection *conn, uint32_t type,
+		const char *payload, uint32_t payload_length,
+		void (*callback)(struct ipc_response *response, void *data),
+		void *data);
+/**
+ * Blocks until every request sent so far has been answered. Events received
+ * meanwhile are dispatched as usual. Returns false if the connection failed.
+ */
+bool ipc_connection_roundtrip(struct ipc_connection *conn);
+/**
+ * Sends what is queued and delivers the replies and events which have
+ * arrived, without blocking. Returns false if the connection failed.
+ */
+bool ipc_connection_poll(struct ipc_connection *conn);
+/**
+ * Returns the number of requests which are waiting for a reply.
+ */
+size_t ipc_connection_get_pending(struct ipc_connection *conn);
+/**
+ * Asks sway to send all further replies and events in the given encoding.
+ * This blocks until sway has answered. Returns false if sway does not support
+ * the encoding, in which case JSON continues to be used.
+ */
+bool ipc_set_encoding(struct ipc_connection *conn,
+		enum ipc_encoding encoding);
+
 #endif
@@ -0,0 +1,77 @@
+#ifndef _SWAY_IPC_ENCODING_H
+#define _SWAY_IPC_ENCODING_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <json-c/json.h>
+#include "ipc.h"
+
+/**
+ * Incrementally serialises an IPC payload in either JSON or CBOR. Values are
+ * separated automatically, so callers only need to add keys and values in
+ * order. Keys are written verbatim and must not need escaping.
+ */
+struct ipc_serializer {
+	enum ipc_encoding encoding;
+	char *data;
+	size_t length;
+	size_t capacity;
+	bool failed;
+};
+
+void ipc_serializer_init(struct ipc_serializer *serializer,
+		enum ipc_encoding encoding);
+
+/**
+ * Return the serialised payload, which the caller must free, or NULL if memory
+ * could not be allocated. The length of the payload is stored in length, if it
+ * is not NULL.
+ */
+char *ipc_serializer_finish(struct ipc_serializer *serializer, size_t *length);
+
+void ipc_serializer_add_key(struct ipc_serializer *serializer, const char *key);
+
+void ipc_serializer_begin_object(struct ipc_serializer *serializer);
+
+void ipc_serializer_end_object(struct ipc_serializer *serializer);
+
+void ipc_serializer_begin_array(struct ipc_serializer *serializer);
+
+void ipc_serializer_end_array(struct ipc_serializer *serializer);
+
+void ipc_serializer_add_bool(struct ipc_serializer *serializer, bool value);
+
+void ipc_serializer_add_object(struct ipc_serializer *serializer,
+		json_object *value);
+
+/**
+ * Add the members of a JSON object without ending it, so that more keys can
+ * be added before ipc_serializer_end_object is called.
+ */
+void ipc_serializer_add_open_object(struct ipc_serializer *serializer,
+		json_object *object);
+
+/**
+ * Add a value which has already been serialised in the same encoding.
+ */
+void ipc_serializer_add_encoded(struct ipc_serializer *serializer,
+		const char *data, size_t length);
+
+/**
+ * Serialise a complete JSON object in the given encoding.
+ */
+char *ipc_encode_object(enum ipc_encoding encoding, json_object *object,
+		size_t *length);
+
+/**
+ * Parse an IPC payload which was sent in the given encoding.
+ * Returns NULL if the payload is malformed.
+ */
+json_object *ipc_decode_payload(enum ipc_encoding encoding,
+		const char *payload, size_t length);
+
+/**
+ * Return the name used to request the encoding in IPC_SET_ENCODING.
+ */
+const char *ipc_encoding_name(enum ipc_encoding encoding);
+
+#endif
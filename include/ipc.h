@@ -3,6 +3,14 @@
 
 #define event_mask(ev) (1 << (ev & 0x7F))
 
+// Payload encodings of replies and events, selected with IPC_SET_ENCODING
+enum ipc_encoding {
+	IPC_ENCODING_JSON,
+	IPC_ENCODING_CBOR,
+
+	IPC_ENCODING_COUNT,
+};
+
 enum ipc_command_type {
 	// i3 command types - see i3's I3_REPLY_TYPE constants
 	IPC_COMMAND = 0,
@@ -21,6 +29,11 @@ enum ipc_command_type {
 	// sway-specific command types
 	IPC_GET_INPUTS = 100,
 	IPC_GET_SEATS = 101,
+	IPC_GET_CLIENTS = 102,
+	IPC_SET_ENCODING = 103,
+	IPC_GET_RENDER_STATS = 104,
+	IPC_GET_TEXTURE_USAGE = 105,
+	IPC_GET_TIMINGS = 106,
 
 	// Events sent from sway to clients. Events have the highest bits set.
 	IPC_EVENT_WORKSPACE = ((1<<31) | 0),
@@ -34,6 +47,7 @@ enum ipc_command_type {
 
 	// sway-specific event types
 	IPC_EVENT_BAR_STATE_UPDATE = ((1<<31) | 20),
+	IPC_EVENT_RENDER_STATS = ((1<<31) | 21),
 };
 
 #endif
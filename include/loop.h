@@ -7,6 +7,10 @@
  *
  * The loop consists of file descriptors and timers. Typically the Wayland
  * display's file descriptor will be one of the fds in the loop.
+ *
+ * The fds are watched with epoll and the timers are kept in a heap, so a
+ * wakeup only costs as much as the fds which are ready and the timers which
+ * have expired.
  */
 
 struct loop;
@@ -33,6 +37,11 @@ void loop_poll(struct loop *loop);
 void loop_add_fd(struct loop *loop, int fd, short mask,
 		void (*func)(int fd, short mask, void *data), void *data);
 
+/**
+ * Change the events which are polled for on a file descriptor in the loop.
+ */
+bool loop_update_fd(struct loop *loop, int fd, short mask);
+
 /**
  * Add a timer to the loop.
  *
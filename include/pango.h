@@ -15,6 +15,11 @@
 size_t escape_markup_text(const char *src, char *dest);
 PangoLayout *get_pango_layout(cairo_t *cairo, const char *font,
 		const char *text, double scale, bool markup);
+/**
+ * Text is shaped once for each font, scale, markup flag and set of font
+ * options, and the layouts of recently used strings are kept, so measuring and
+ * then drawing the same text doesn't shape it twice.
+ */
 void get_text_size(cairo_t *cairo, const char *font, int *width, int *height,
 		int *baseline, double scale, bool markup, const char *fmt, ...);
 void pango_printf(cairo_t *cairo, const char *font,
@@ -6,19 +6,53 @@
 #include <stdint.h>
 #include <wayland-client.h>
 
+// How many buffers a surface may have while the compositor holds some
+#define BUFFER_POOL_MAX 4
+
+struct buffer_pool;
+
 struct pool_buffer {
+	struct buffer_pool *pool;
 	struct wl_buffer *buffer;
 	cairo_surface_t *surface;
 	cairo_t *cairo;
 	PangoContext *pango;
 	uint32_t width, height;
 	void *data;
-	size_t size;
+	size_t offset; // Into the pool
 	bool busy;
+	// The pool has been remapped while the compositor held this buffer, so
+	// it is destroyed as soon as it's released
+	bool orphaned;
+};
+
+/**
+ * The buffers of one surface, sub-allocated from a single shared memory
+ * file. Each buffer gets a slot of the same size, which is rounded up so that
+ * small size changes don't need a new mapping.
+ */
+struct buffer_pool {
+	int fd;
+	struct wl_shm_pool *shm_pool;
+	void *data;
+	size_t size; // Of the file and the mapping
+	size_t base; // Where the slots start
+	size_t slot_size;
+
+	struct pool_buffer buffers[BUFFER_POOL_MAX];
+	int buffer_count; // Slots which have been used
+
+	// Frames which couldn't be drawn because every buffer was busy
+	uint64_t dropped_frames;
 };
 
+/**
+ * Return a buffer which the compositor doesn't hold, or NULL if all of them
+ * are busy, in which case the frame should be skipped. The pool must be zeroed
+ * before it's first used.
+ */
 struct pool_buffer *get_next_buffer(struct wl_shm *shm,
-		struct pool_buffer pool[static 2], uint32_t width, uint32_t height);
-void destroy_buffer(struct pool_buffer *buffer);
+		struct buffer_pool *pool, uint32_t width, uint32_t height);
+void destroy_buffer_pool(struct buffer_pool *pool);
 
 #endif
@@ -169,8 +169,12 @@ struct output_config {
 	char *background_option;
 	char *background_fallback;
 	enum config_dpms dpms_state;
+	int max_render_time; // In milliseconds, or one of the values below
 };
 
+#define MAX_RENDER_TIME_OFF 0
+#define MAX_RENDER_TIME_AUTO -2
+
 /**
  * Stores size of gaps for each side
  */
@@ -431,6 +435,8 @@ struct sway_config {
 	bool tiling_drag;
 	int tiling_drag_threshold;
 
+	size_t texture_budget; // bytes, 0 if there is none
+
 	bool smart_gaps;
 	int gaps_inner;
 	struct side_gaps gaps_outer;
@@ -581,7 +587,12 @@ void load_swaybar(struct bar_config *bar);
 
 void load_swaybars(void);
 
-void terminate_swaybg(pid_t pid);
+void terminate_swaybg(void);
+
+/**
+ * Send the output's background configuration to swaybg, starting it if needed.
+ */
+void update_swaybg(struct sway_output *output, struct output_config *oc);
 
 struct bar_config *default_bar_config(void);
 
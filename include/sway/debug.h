@@ -4,6 +4,8 @@
 
 struct sway_debug {
 	bool noatomic;         // Ignore atomic layout updates
+	bool noocclusion;      // Draw everything, even if covered by opaque surfaces
+	bool render_stats;     // Log statistics about each rendered frame
 	bool render_tree;      // Render the tree overlay
 	bool txn_timings;      // Log verbose messages about transactions
 	bool txn_wait;         // Always wait for the timeout before applying
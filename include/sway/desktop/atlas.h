@@ -0,0 +1,55 @@
+#ifndef _SWAY_ATLAS_H
+#define _SWAY_ATLAS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_box.h>
+
+/**
+ * Titlebar and mark images are packed into shared atlas textures, one set of
+ * pages per output scale, so that they don't each need a texture of their own.
+ * Pages are divided into shelves of similar height, which are filled left to
+ * right.
+ */
+
+struct sway_atlas_shelf;
+
+struct sway_atlas_image {
+	// The atlas page, or the image's own texture if it is too large for one
+	struct wlr_texture *texture;
+	struct wlr_box box; // Position of the image within the texture
+
+	struct sway_atlas_shelf *shelf; // NULL if the texture is the image's own
+	int reserved_width; // Space reserved for the image in the shelf
+};
+
+/**
+ * Replace the contents of an image with ARGB8888 pixels rendered for the given
+ * scale, creating it if *image is NULL. The image keeps its place in the atlas
+ * if the new pixels fit into it, in which case only that part of the page is
+ * uploaded. On failure, or if the new image is empty, *image is destroyed and
+ * set to NULL.
+ */
+void atlas_image_update(struct sway_atlas_image **image,
+		struct wlr_renderer *renderer, float scale,
+		int stride, int width, int height, const void *data);
+
+void atlas_image_destroy(struct sway_atlas_image *image);
+
+/**
+ * Free the empty page which is kept around for reuse, if any.
+ */
+void atlas_trim(void);
+
+struct sway_atlas_usage {
+	int pages;
+	int images;
+	int own_textures; // Images which were too large for a page
+	size_t bytes; // Texture memory allocated for pages and own textures
+	size_t image_bytes; // Texture memory taken up by the images themselves
+};
+
+void atlas_get_usage(struct sway_atlas_usage *usage);
+
+#endif
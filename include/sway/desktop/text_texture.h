@@ -0,0 +1,80 @@
+#ifndef _SWAY_TEXT_TEXTURE_H
+#define _SWAY_TEXT_TEXTURE_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <wayland-server-protocol.h>
+#include <wlr/render/wlr_renderer.h>
+
+/**
+ * Rendered title and mark text is shared between containers and kept around
+ * for a while after its last user goes away, so that a container which moves
+ * back and forth between outputs of different scales, or several containers
+ * with the same title, don't each have to rasterise the text again.
+ *
+ * While the images take up more memory than the configured budget allows, the
+ * images of text which isn't on screen and hasn't been drawn for a while are
+ * freed. They are rasterised again when they are next drawn.
+ */
+
+struct sway_atlas_image;
+
+/**
+ * Everything which affects how a piece of text is rasterised.
+ */
+struct sway_text_texture_key {
+	const char *text;
+	const char *font;
+	bool markup;
+	bool subpixel_antialias; // Also enables full hinting
+	float scale;
+	enum wl_output_subpixel subpixel;
+	int height;
+	float foreground[4];
+	float background[4];
+	struct wlr_renderer *renderer;
+};
+
+struct sway_text_texture {
+	struct sway_text_texture_key key; // Owns the text and font strings
+	uint32_t hash; // Of the key's font and text
+	struct sway_atlas_image *image; // NULL if evicted
+	uint32_t last_rendered; // msec
+	int refs;
+	bool visible; // A container showing it is on screen, set by the budget
+	struct wl_list link; // text_textures.unused, when refs is 0
+};
+
+/**
+ * Point *texture at a texture for the key, rasterising the text unless it is
+ * cached already. On failure, or if the text is empty, *texture is released
+ * and set to NULL.
+ */
+void text_texture_update(struct sway_text_texture **texture,
+		const struct sway_text_texture_key *key);
+
+void text_texture_release(struct sway_text_texture *texture);
+
+/**
+ * Return the image to draw for the texture, rasterising it again if it has
+ * been evicted. Returns NULL if texture is NULL or rasterising fails.
+ */
+struct sway_atlas_image *text_texture_get_image(
+		struct sway_text_texture *texture);
+
+/**
+ * Evict images which aren't on screen and haven't been drawn recently, least
+ * recently drawn first, until the images fit into the configured budget.
+ */
+void text_texture_enforce_budget(const struct timespec *now);
+
+struct sway_text_texture_stats {
+	int textures;
+	int unused; // Kept for reuse, but not used by any container
+	int evicted;
+	uint64_t evictions;
+};
+
+void text_texture_get_stats(struct sway_text_texture_stats *stats);
+
+#endif
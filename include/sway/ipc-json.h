@@ -1,16 +1,35 @@
 #ifndef _SWAY_IPC_JSON_H
 #define _SWAY_IPC_JSON_H
 #include <json-c/json.h>
+#include "ipc.h"
 #include "sway/tree/container.h"
 #include "sway/input/input-manager.h"
+#include "sway/timing.h"
 
 json_object *ipc_json_get_version(void);
 
 json_object *ipc_json_describe_disabled_output(struct sway_output *o);
-json_object *ipc_json_describe_node(struct sway_node *node);
-json_object *ipc_json_describe_node_recursive(struct sway_node *node);
+json_object *ipc_json_describe_render_stats(struct sway_output *output);
+json_object *ipc_json_describe_texture_usage(void);
+json_object *ipc_json_describe_timings(struct sway_timings *timings);
 json_object *ipc_json_describe_input(struct sway_input_device *device);
 json_object *ipc_json_describe_seat(struct sway_seat *seat);
 json_object *ipc_json_describe_bar_config(struct bar_config *bar);
 
+/**
+ * The node describers return a newly allocated payload in the given encoding
+ * and store its length in length. It is assembled from per-node fragments
+ * which are cached until the node is invalidated.
+ */
+char *ipc_json_describe_node_recursive(struct sway_node *node,
+		enum ipc_encoding encoding, size_t *length);
+char *ipc_json_describe_workspaces(enum ipc_encoding encoding, size_t *length);
+char *ipc_json_describe_outputs(enum ipc_encoding encoding, size_t *length);
+
+/**
+ * Drop the node's cached fragments. This must be called whenever anything
+ * in the node's description changes, other than its children.
+ */
+void ipc_json_invalidate_node(struct sway_node *node);
+
 #endif
@@ -19,5 +19,6 @@ void ipc_event_bar_state_update(struct bar_config *bar);
 void ipc_event_mode(const char *mode, bool pango);
 void ipc_event_shutdown(const char *reason);
 void ipc_event_binding(struct sway_binding *binding);
+void ipc_event_render_stats(struct sway_output *output);
 
 #endif
@@ -14,11 +14,23 @@ struct sway_layer_surface {
 	struct wl_listener unmap;
 	struct wl_listener surface_commit;
 	struct wl_listener output_destroy;
+	struct wl_listener new_subsurface;
+
+	struct wl_list subsurfaces; // sway_layer_subsurface::link
 
 	bool configured;
 	struct wlr_box geo;
 };
 
+struct sway_layer_subsurface {
+	struct wlr_subsurface *wlr_subsurface;
+	struct sway_layer_surface *layer;
+	struct wl_list link; // sway_layer_surface::subsurfaces
+
+	struct wl_listener commit;
+	struct wl_listener destroy;
+};
+
 struct sway_output;
 void arrange_layers(struct sway_output *output);
 
@@ -17,6 +17,30 @@ struct sway_output_state {
 	struct sway_workspace *active_workspace;
 };
 
+/**
+ * Measurements of a rendered frame, reported by get_render_stats.
+ */
+struct sway_frame_stats {
+	int64_t cpu_nsec; // Time spent building the frame
+	int texture_draws;
+	int rect_draws;
+	float damaged; // Fraction of the output which was redrawn
+	int frame_done; // Number of surfaces sent a frame done event
+};
+
+#define RENDER_STATS_FRAMES 256
+
+struct sway_render_stats {
+	// The most recent frames, oldest first starting at frames_next
+	struct sway_frame_stats frames[RENDER_STATS_FRAMES];
+	int frames_length;
+	int frames_next;
+
+	uint64_t rendered; // Since the output was created
+	uint64_t skipped; // Frame events where nothing was damaged
+	struct timespec last_event;
+};
+
 struct sway_output {
 	struct sway_node node;
 	struct wlr_output *wlr_output;
@@ -28,6 +52,16 @@ struct sway_output {
 	struct timespec last_frame;
 	struct wlr_output_damage *damage;
 
+	// Rendering is delayed until shortly before the next expected vblank,
+	// see max_render_time in sway-output(5)
+	int max_render_time; // In milliseconds, or MAX_RENDER_TIME_*
+	struct wl_event_source *repaint_timer;
+	struct timespec last_presentation;
+	int refresh_nsec; // Zero if unknown
+	int64_t render_time_avg_nsec, render_time_dev_nsec; // Zero if no samples
+
+	struct sway_render_stats render_stats;
+
 	int lx, ly;
 	int width, height;
 
@@ -46,7 +80,7 @@ struct sway_output {
 
 	struct wl_list link;
 
-	pid_t bg_pid;
+	char *swaybg_config; // The line last sent to swaybg, NULL if none
 
 	struct {
 		struct wl_signal destroy;
@@ -98,8 +132,11 @@ bool output_has_opaque_overlay_layer_surface(struct sway_output *output);
 
 struct sway_workspace *output_get_active_workspace(struct sway_output *output);
 
+/**
+ * Render a frame, filling in the draw counts and damaged area of the stats.
+ */
 void output_render(struct sway_output *output, struct timespec *when,
-	pixman_region32_t *damage);
+	pixman_region32_t *damage, struct sway_frame_stats *stats);
 
 void output_surface_for_each_surface(struct sway_output *output,
 		struct wlr_surface *surface, double ox, double oy,
@@ -14,6 +14,7 @@
 #include <wlr/types/wlr_xdg_shell.h>
 #include "config.h"
 #include "list.h"
+#include "sway/timing.h"
 #if HAVE_XWAYLAND
 #include "sway/xwayland.h"
 #endif
@@ -63,6 +64,8 @@ struct sway_server {
 	size_t txn_timeout_ms;
 	list_t *transactions;
 	list_t *dirty_nodes;
+
+	struct sway_timings timings;
 };
 
 struct sway_server server;
@@ -0,0 +1,33 @@
+#ifndef _SWAY_TIMING_H
+#define _SWAY_TIMING_H
+#include <stdint.h>
+#include <time.h>
+
+#define TIMING_SAMPLES 1024
+
+/**
+ * The durations of the most recent occurrences of something, along with how
+ * often it has happened since the timings were last reset.
+ */
+struct sway_timing {
+	int64_t samples[TIMING_SAMPLES]; // nsec
+	int length, next;
+	uint64_t count;
+};
+
+struct sway_timings {
+	struct sway_timing transaction_latency; // From commit until applied
+	struct sway_timing arrange;
+	struct sway_timing render; // CPU time of output frames
+};
+
+void timing_add(struct sway_timing *timing, int64_t nsec);
+
+/**
+ * Return the time since start, in nanoseconds.
+ */
+int64_t timing_since(const struct timespec *start);
+
+void timings_reset(struct sway_timings *timings);
+
+#endif
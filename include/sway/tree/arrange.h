@@ -1,5 +1,6 @@
 #ifndef _SWAY_ARRANGE_H
 #define _SWAY_ARRANGE_H
+#include <stdbool.h>
 
 struct sway_output;
 struct sway_workspace;
@@ -8,8 +9,23 @@ struct sway_node;
 
 void arrange_container(struct sway_container *container);
 
+/**
+ * Arrange the workspace. A hidden workspace is only marked stale, and
+ * arranged once it's shown or something needs its geometry.
+ */
 void arrange_workspace(struct sway_workspace *workspace);
 
+/**
+ * Arrange the workspace now if arranging it has been deferred, whether it's
+ * visible or not.
+ */
+void arrange_workspace_if_stale(struct sway_workspace *workspace);
+
+/**
+ * Arrange the visible workspaces whose arrangement has been deferred.
+ */
+void arrange_stale_workspaces(void);
+
 void arrange_output(struct sway_output *output);
 
 void arrange_root(void);
@@ -25,6 +25,7 @@ enum sway_container_border {
 	B_CSD,
 };
 
+struct sway_text_texture;
 struct sway_root;
 struct sway_output;
 struct sway_workspace;
@@ -121,18 +122,18 @@ struct sway_container {
 
 	float alpha;
 
-	struct wlr_texture *title_focused;
-	struct wlr_texture *title_focused_inactive;
-	struct wlr_texture *title_unfocused;
-	struct wlr_texture *title_urgent;
+	struct sway_text_texture *title_focused;
+	struct sway_text_texture *title_focused_inactive;
+	struct sway_text_texture *title_unfocused;
+	struct sway_text_texture *title_urgent;
 	size_t title_height;
 	size_t title_baseline;
 
 	list_t *marks; // char *
-	struct wlr_texture *marks_focused;
-	struct wlr_texture *marks_focused_inactive;
-	struct wlr_texture *marks_unfocused;
-	struct wlr_texture *marks_urgent;
+	struct sway_text_texture *marks_focused;
+	struct sway_text_texture *marks_focused_inactive;
+	struct sway_text_texture *marks_unfocused;
+	struct sway_text_texture *marks_urgent;
 
 	struct {
 		struct wl_signal destroy;
@@ -1,6 +1,7 @@
 #ifndef _SWAY_NODE_H
 #define _SWAY_NODE_H
 #include <stdbool.h>
+#include "ipc.h"
 #include "list.h"
 
 struct sway_root;
@@ -40,6 +41,14 @@ struct sway_node {
 	// the current.
 	bool dirty;
 
+	// Cached IPC description of this node without its children in each
+	// encoding, or NULL if it needs to be regenerated.
+	// See ipc_json_invalidate_node.
+	struct {
+		char *data;
+		size_t length;
+	} ipc_cache[IPC_ENCODING_COUNT];
+
 	struct {
 		struct wl_signal destroy;
 	} events;
@@ -317,6 +317,10 @@ void view_map(struct sway_view *view, struct wlr_surface *wlr_surface,
 
 void view_unmap(struct sway_view *view);
 
+/**
+ * Resize a floating view to the size it committed on its own, which also
+ * becomes its natural size.
+ */
 void view_update_size(struct sway_view *view, int width, int height);
 
 void view_child_init(struct sway_view_child *child,
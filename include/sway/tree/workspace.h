@@ -41,6 +41,7 @@ struct sway_workspace {
 	list_t *tiling;             // struct sway_container
 	list_t *output_priority;
 	bool urgent;
+	bool arrange_stale; // Hidden, and arranging it has been deferred
 
 	struct sway_workspace_state current;
 };
@@ -125,6 +126,13 @@ void workspace_update_representation(struct sway_workspace *ws);
 
 void workspace_get_box(struct sway_workspace *workspace, struct wlr_box *box);
 
+/**
+ * Get the box the workspace will have once it's arranged. This differs from
+ * workspace_get_box for hidden workspaces whose arrangement has been deferred.
+ */
+void workspace_get_arranged_box(struct sway_workspace *workspace,
+		struct wlr_box *box);
+
 size_t workspace_num_tiling_views(struct sway_workspace *ws);
 
 #endif
@@ -3,6 +3,7 @@
 #include <wayland-client.h>
 #include "config.h"
 #include "input.h"
+#include "ipc-client.h"
 #include "pool-buffer.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "xdg-output-unstable-v1-client-protocol.h"
@@ -37,9 +38,17 @@ struct swaybar {
 	struct status_line *status;
 
 	struct loop *eventloop;
-
-	int ipc_event_socketfd;
-	int ipc_socketfd;
+	// Cleared to leave bar_run, for callbacks which must not tear down the bar
+	bool running;
+	int exit_code; // Returned by swaybar once bar_run has been left
+
+	struct ipc_connection *ipc_event_connection;
+	struct ipc_connection *ipc_connection;
+	enum ipc_encoding ipc_event_encoding;
+	enum ipc_encoding ipc_encoding;
+	// Whether a get_workspaces request is in flight, and whether another
+	// workspace event arrived after it was sent
+	bool workspaces_pending, workspaces_outdated;
 
 	struct wl_list outputs; // swaybar_output::link
 
@@ -66,7 +75,7 @@ struct swaybar_output {
 	uint32_t width, height;
 	int32_t scale;
 	enum wl_output_subpixel subpixel;
-	struct pool_buffer buffers[2];
+	struct buffer_pool buffers;
 	struct pool_buffer *current_buffer;
 	bool dirty;
 	bool frame_scheduled;
@@ -9,15 +9,22 @@
 
 struct swaybar_output;
 
+// Premultiplied ARGB in native byte order, as cairo uses it
 struct swaybar_pixmap {
 	int size;
 	unsigned char pixels[];
 };
 
+struct swaybar_scaled_icon {
+	int size;
+	cairo_surface_t *surface;
+};
+
 struct swaybar_sni {
 	// icon properties
 	struct swaybar_tray *tray;
 	cairo_surface_t *icon;
+	list_t *scaled_icons; // struct swaybar_scaled_icon *
 	int min_size;
 	int max_size;
 
@@ -39,6 +46,10 @@ struct swaybar_sni {
 	sd_bus_slot *new_icon_slot;
 	sd_bus_slot *new_attention_icon_slot;
 	sd_bus_slot *new_status_slot;
+
+	// The GetAll call in flight, and whether another one is needed after it
+	sd_bus_slot *get_all_slot;
+	bool get_all_pending;
 };
 
 struct swaybar_sni *create_sni(char *id, struct swaybar_tray *tray);
@@ -12,6 +12,7 @@
 #include "swaybar/tray/host.h"
 #include "list.h"
 
+struct loop_timer;
 struct swaybar;
 struct swaybar_output;
 struct swaybar_watcher;
@@ -30,11 +31,15 @@ struct swaybar_tray {
 
 	list_t *basedirs; // char *
 	list_t *themes; // struct swaybar_theme *
+
+	// Changes to items are drawn together, once the bus has been processed
+	struct loop_timer *redraw_timer;
 };
 
 struct swaybar_tray *create_tray(struct swaybar *bar);
 void destroy_tray(struct swaybar_tray *tray);
 void tray_in(int fd, short mask, void *data);
+void set_tray_dirty(struct swaybar_tray *tray);
 uint32_t render_tray(cairo_t *cairo, struct swaybar_output *output, double *x);
 
 #endif
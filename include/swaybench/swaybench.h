@@ -0,0 +1,46 @@
+#ifndef _SWAYBENCH_H
+#define _SWAYBENCH_H
+#include <stdbool.h>
+
+/**
+ * How a synthetic client behaves. Clients keep running until sway closes
+ * their window or the connection.
+ */
+struct swaybench_client_args {
+	int index;
+	int configure_delay_ms; // How long to wait before acking a configure
+	int churn_interval_ms; // How often titles or content change when enabled
+};
+
+/**
+ * Run a synthetic xdg-shell client. SIGUSR1 toggles changing its title and
+ * SIGUSR2 toggles committing damage, every churn_interval_ms.
+ */
+int swaybench_run_client(const struct swaybench_client_args *args);
+
+struct swaybench_phase {
+	const char *name;
+	// Commands are sent one by one, each once the previous one has settled,
+	// and the whole list is repeated this many times
+	const char *const *commands;
+	int repeat;
+	// If non-zero, clients change their titles and/or commit damage for this
+	// long
+	int churn_ms;
+	bool churn_titles;
+	bool churn_damage;
+	// If non-zero, this many requests are sent one at a time, and then again
+	// without waiting for replies
+	int ipc_requests;
+};
+
+struct swaybench_scenario {
+	const char *name;
+	const char *description;
+	int clients;
+	int configure_delay_ms;
+	int churn_interval_ms;
+	const struct swaybench_phase *phases; // Terminated by a NULL name
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _SWAYLOCK_COMM_H
+#define _SWAYLOCK_COMM_H
+#include <stdbool.h>
+#include <sys/types.h>
+
+struct swaylock_password;
+
+/**
+ * Fork the process which checks passwords. It runs run_pw_backend_child,
+ * which is implemented by the backend, for as long as swaylock runs.
+ */
+bool spawn_comm_child(void);
+
+/**
+ * Used by the parent once the child has gone away. Closes the pipes and reaps
+ * the child, after which get_comm_reply_fd returns -1 until it is spawned
+ * again.
+ */
+void close_comm_child(void);
+
+/**
+ * Used by the child. Reads the next password into a newly allocated buffer,
+ * which the caller must clear and free. Returns the size of the buffer, 0 once
+ * the parent has gone away, or -1 on error.
+ */
+ssize_t read_comm_request(char **buf_ptr);
+bool write_comm_reply(bool success);
+
+/**
+ * Used by the child when the backend could not be set up. Fails every attempt
+ * until the parent goes away, since exiting would only get the child spawned
+ * again. Never returns.
+ */
+void reject_comm_requests(void);
+
+/**
+ * Used by the parent. Sends the password to the child and clears it. The
+ * reply arrives on the fd returned by get_comm_reply_fd.
+ */
+bool write_comm_request(struct swaylock_password *pw);
+bool read_comm_reply(bool *success);
+int get_comm_reply_fd(void);
+
+/**
+ * Runs in the child. Never returns.
+ */
+void run_pw_backend_child(void);
+
+#endif
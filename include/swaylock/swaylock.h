@@ -57,9 +57,11 @@ struct swaylock_state {
 	struct loop *eventloop;
 	struct loop_timer *clear_indicator_timer; // clears the indicator
 	struct loop_timer *clear_password_timer;  // clears the password buffer
-	struct loop_timer *verify_password_timer;
+	struct loop_timer *verify_animation_timer; // moves the indicator on
+	int verify_animation_step;
 	struct wl_display *display;
 	struct wl_compositor *compositor;
+	struct wl_subcompositor *subcompositor;
 	struct zwlr_layer_shell_v1 *layer_shell;
 	struct zwlr_input_inhibit_manager_v1 *input_inhibit_manager;
 	struct wl_shm *shm;
@@ -69,6 +71,8 @@ struct swaylock_state {
 	struct swaylock_password password;
 	struct swaylock_xkb xkb;
 	enum auth_state auth_state;
+	// Enter was pressed while the last password was still being checked
+	bool submit_queued;
 	bool run_display;
 	struct zxdg_output_manager_v1 *zxdg_output_manager;
 };
@@ -81,10 +85,19 @@ struct swaylock_surface {
 	struct zxdg_output_v1 *xdg_output;
 	struct wl_surface *surface;
 	struct zwlr_layer_surface_v1 *layer_surface;
-	struct pool_buffer buffers[2];
+	struct buffer_pool buffers;
 	struct pool_buffer *current_buffer;
 	bool frame_pending, dirty;
 	uint32_t width, height;
+	// The background is only drawn again when the buffer size changes
+	uint32_t background_width, background_height;
+	// The indicator is drawn on a small subsurface of its own, so that typing
+	// doesn't redraw the whole output
+	struct wl_surface *child;
+	struct wl_subsurface *subsurface;
+	struct buffer_pool indicator_buffers;
+	int indicator_size; // Surface-local, 0 if hidden
+	bool position_pending; // Waits for a commit of the background surface
 	int32_t scale;
 	enum wl_output_subpixel subpixel;
 	char *output_name;
@@ -106,7 +119,9 @@ void render_frames(struct swaylock_state *state);
 void damage_surface(struct swaylock_surface *surface);
 void damage_state(struct swaylock_state *state);
 void initialize_pw_backend(void);
-bool attempt_password(struct swaylock_password *pw);
+bool restart_pw_backend(void);
+void swaylock_watch_comm_reply(struct swaylock_state *state);
+void swaylock_handle_auth_result(struct swaylock_state *state, bool success);
 void clear_password_buffer(struct swaylock_password *pw);
 
 #endif
@@ -12,6 +12,7 @@
 #include "sway/security.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
+#include "sway/tree/arrange.h"
 #include "sway/tree/view.h"
 #include "stringop.h"
 #include "log.h"
@@ -86,6 +87,7 @@ static struct cmd_handler handlers[] = {
 	{ "show_marks", cmd_show_marks },
 	{ "smart_borders", cmd_smart_borders },
 	{ "smart_gaps", cmd_smart_gaps },
+	{ "texture_budget", cmd_texture_budget },
 	{ "tiling_drag", cmd_tiling_drag },
 	{ "tiling_drag_threshold", cmd_tiling_drag_threshold },
 	{ "title_align", cmd_title_align },
@@ -198,6 +200,11 @@ static void set_config_node(struct sway_node *node) {
 	case N_OUTPUT:
 		break;
 	}
+
+	// Commands work with the geometry of the workspace they run on
+	if (config->handler_context.workspace) {
+		arrange_workspace_if_stale(config->handler_context.workspace);
+	}
 }
 
 list_t *execute_command(char *_exec, struct sway_seat *seat,
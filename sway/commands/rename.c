@@ -5,6 +5,7 @@
 #include "stringop.h"
 #include "sway/commands.h"
 #include "sway/config.h"
+#include "sway/ipc-json.h"
 #include "sway/ipc-server.h"
 #include "sway/output.h"
 #include "sway/tree/container.h"
@@ -92,6 +93,11 @@ struct cmd_results *cmd_rename(int argc, char **argv) {
 	wlr_log(WLR_DEBUG, "renaming workspace '%s' to '%s'", workspace->name, new_name);
 	free(workspace->name);
 	workspace->name = new_name;
+	// The output describes its current workspace by name
+	ipc_json_invalidate_node(&workspace->node);
+	if (workspace->output) {
+		ipc_json_invalidate_node(&workspace->output->node);
+	}
 
 	output_sort_workspaces(workspace->output);
 	ipc_event_workspace(NULL, workspace, "rename");
@@ -2,6 +2,7 @@
 #include <strings.h>
 #include "sway/commands.h"
 #include "sway/input/seat.h"
+#include "sway/ipc-json.h"
 #include "sway/ipc-server.h"
 #include "sway/output.h"
 #include "sway/tree/arrange.h"
@@ -28,6 +29,7 @@ struct cmd_results *cmd_sticky(int argc, char **argv) {
 	}
 
 	container->is_sticky = parse_boolean(argv[0], container->is_sticky);
+	ipc_json_invalidate_node(&container->node);
 
 	if (container->is_sticky) {
 		// move container to active workspace
@@ -0,0 +1,29 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "sway/commands.h"
+#include "sway/config.h"
+#include "log.h"
+
+struct cmd_results *cmd_texture_budget(int argc, char **argv) {
+	struct cmd_results *error = NULL;
+	if ((error = checkarg(argc, "texture_budget", EXPECTED_EQUAL_TO, 1))) {
+		return error;
+	}
+
+	if (strcasecmp(argv[0], "none") == 0) {
+		config->texture_budget = 0;
+		return cmd_results_new(CMD_SUCCESS, NULL, NULL);
+	}
+
+	char *inv;
+	long value = strtol(argv[0], &inv, 10);
+	if (*inv != '\0' || value <= 0) {
+		return cmd_results_new(CMD_INVALID, "texture_budget",
+			"Invalid budget specified");
+	}
+
+	config->texture_budget = (size_t)value * 1024 * 1024;
+
+	return cmd_results_new(CMD_SUCCESS, NULL, NULL);
+}
@@ -229,6 +229,7 @@ static void config_defaults(struct sway_config *config) {
 	config->title_align = ALIGN_LEFT;
 	config->tiling_drag = true;
 	config->tiling_drag_threshold = 9;
+	config->texture_budget = 0;
 
 	config->smart_gaps = false;
 	config->gaps_inner = 0;
@@ -1,5 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <string.h>
 #include <signal.h>
@@ -42,6 +44,7 @@ struct output_config *new_output_config(const char *name) {
 	oc->x = oc->y = -1;
 	oc->scale = -1;
 	oc->transform = -1;
+	oc->max_render_time = -1;
 	return oc;
 }
 
@@ -85,6 +88,9 @@ void merge_output_config(struct output_config *dst, struct output_config *src) {
 	if (src->dpms_state != 0) {
 		dst->dpms_state = src->dpms_state;
 	}
+	if (src->max_render_time != -1) {
+		dst->max_render_time = src->max_render_time;
+	}
 }
 
 static void merge_wildcard_on_all(struct output_config *wildcard) {
@@ -164,13 +170,151 @@ static void set_mode(struct wlr_output *output, int width, int height,
 	}
 }
 
-void terminate_swaybg(pid_t pid) {
-	int ret = kill(pid, SIGTERM);
-	if (ret != 0) {
-		wlr_log(WLR_ERROR, "Unable to terminate swaybg [pid: %d]", pid);
+// A single swaybg draws the backgrounds of all outputs. It reads one line of
+// configuration per output from a pipe.
+static struct {
+	pid_t pid;
+	int fd;
+	char *command; // The swaybg_command it was started with
+} swaybg = { .fd = -1 };
+
+void terminate_swaybg(void) {
+	if (swaybg.fd != -1) {
+		close(swaybg.fd);
+		swaybg.fd = -1;
+	}
+	if (swaybg.pid > 0) {
+		if (kill(swaybg.pid, SIGTERM) != 0) {
+			wlr_log(WLR_ERROR, "Unable to terminate swaybg [pid: %d]",
+					swaybg.pid);
+		} else {
+			int status;
+			waitpid(swaybg.pid, &status, 0);
+		}
+	}
+	swaybg.pid = 0;
+	free(swaybg.command);
+	swaybg.command = NULL;
+}
+
+static bool swaybg_write(const char *line) {
+	// Lines are much shorter than PIPE_BUF, so they are written atomically
+	size_t len = strlen(line);
+	if (write(swaybg.fd, line, len) != (ssize_t)len) {
+		wlr_log_errno(WLR_ERROR, "Unable to send configuration to swaybg");
+		return false;
+	}
+	return true;
+}
+
+static bool spawn_swaybg(void) {
+	int fd[2];
+	if (pipe(fd) != 0) {
+		wlr_log_errno(WLR_ERROR, "Unable to create pipe for swaybg");
+		return false;
+	}
+	fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+	// Never let a stuck swaybg block sway
+	fcntl(fd[1], F_SETFL, O_NONBLOCK);
+
+	wlr_log(WLR_DEBUG, "Spawning swaybg: %s", config->swaybg_command);
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fd[1]);
+		dup2(fd[0], STDIN_FILENO);
+		close(fd[0]);
+		execl("/bin/sh", "/bin/sh", "-c", config->swaybg_command, NULL);
+		_exit(1);
+	}
+	close(fd[0]);
+	if (pid < 0) {
+		wlr_log_errno(WLR_ERROR, "Unable to fork swaybg");
+		close(fd[1]);
+		return false;
+	}
+	swaybg.pid = pid;
+	swaybg.fd = fd[1];
+	swaybg.command = strdup(config->swaybg_command);
+
+	// Catch the new instance up on every output
+	for (int i = 0; i < root->outputs->length; ++i) {
+		struct sway_output *output = root->outputs->items[i];
+		if (output->swaybg_config && !swaybg_write(output->swaybg_config)) {
+			terminate_swaybg();
+			return false;
+		}
+	}
+	return true;
+}
+
+void update_swaybg(struct sway_output *output, struct output_config *oc) {
+	const char *name = output->wlr_output->name;
+	char *line = NULL;
+	if (oc && oc->background && config->swaybg_command) {
+		if (strpbrk(oc->background, "\t\n")) {
+			wlr_log(WLR_ERROR, "Background path for %s must not contain "
+					"tabs or newlines", name);
+		} else {
+			size_t len = snprintf(NULL, 0, "%s\t%s\t%s\t%s\n", name,
+					oc->background, oc->background_option,
+					oc->background_fallback ? oc->background_fallback : "");
+			line = malloc(len + 1);
+			if (!line) {
+				wlr_log(WLR_ERROR, "Unable to allocate swaybg configuration");
+				return;
+			}
+			snprintf(line, len + 1, "%s\t%s\t%s\t%s\n", name,
+					oc->background, oc->background_option,
+					oc->background_fallback ? oc->background_fallback : "");
+		}
+	}
+
+	if (line && output->swaybg_config && swaybg.pid &&
+			strcmp(line, output->swaybg_config) == 0 &&
+			strcmp(swaybg.command, config->swaybg_command) == 0) {
+		// Nothing changed, which is the case for most outputs on reload
+		free(line);
+		return;
+	}
+
+	bool had_background = output->swaybg_config != NULL;
+	free(output->swaybg_config);
+	output->swaybg_config = line;
+	if (line) {
+		wlr_log(WLR_DEBUG, "Setting background for output %s to %s",
+				name, oc->background);
+	}
+
+	if (!config->swaybg_command) {
+		terminate_swaybg();
+		return;
+	}
+	if (swaybg.pid && strcmp(swaybg.command, config->swaybg_command) != 0) {
+		terminate_swaybg();
+	}
+	if (!swaybg.pid) {
+		if (line) {
+			// Sends this output's configuration as well
+			spawn_swaybg();
+		}
+		return;
+	}
+
+	bool sent;
+	if (line) {
+		sent = swaybg_write(line);
+	} else if (had_background) {
+		size_t len = strlen(name) + 2;
+		char removal[len];
+		snprintf(removal, len, "%s\n", name);
+		sent = swaybg_write(removal);
 	} else {
-		int status;
-		waitpid(pid, &status, 0);
+		return;
+	}
+	if (!sent) {
+		// swaybg has probably exited, so start another one
+		terminate_swaybg();
+		spawn_swaybg();
 	}
 }
 
@@ -209,6 +353,11 @@ void apply_output_config(struct output_config *oc, struct sway_output *output) {
 		wlr_log(WLR_DEBUG, "Set %s transform to %d", oc->name, oc->transform);
 		wlr_output_set_transform(wlr_output, oc->transform);
 	}
+	if (oc && oc->max_render_time != -1) {
+		wlr_log(WLR_DEBUG, "Set %s max render time to %d",
+			oc->name, oc->max_render_time);
+		output->max_render_time = oc->max_render_time;
+	}
 
 	// Find position for it
 	if (oc && (oc->x != -1 || oc->y != -1)) {
@@ -218,43 +367,7 @@ void apply_output_config(struct output_config *oc, struct sway_output *output) {
 		wlr_output_layout_add_auto(root->output_layout, wlr_output);
 	}
 
-	int output_i;
-	for (output_i = 0; output_i < root->outputs->length; ++output_i) {
-		if (root->outputs->items[output_i] == output) {
-			break;
-		}
-	}
-
-	if (output->bg_pid != 0) {
-		terminate_swaybg(output->bg_pid);
-	}
-	if (oc && oc->background && config->swaybg_command) {
-		wlr_log(WLR_DEBUG, "Setting background for output %d to %s",
-				output_i, oc->background);
-
-		size_t len = snprintf(NULL, 0, "%s %d \"%s\" %s %s",
-				config->swaybg_command, output_i, oc->background,
-				oc->background_option,
-				oc->background_fallback ? oc->background_fallback : "");
-		char *command = malloc(len + 1);
-		if (!command) {
-			wlr_log(WLR_DEBUG, "Unable to allocate swaybg command");
-			return;
-		}
-		snprintf(command, len + 1, "%s %d \"%s\" %s %s",
-				config->swaybg_command, output_i, oc->background,
-				oc->background_option,
-				oc->background_fallback ? oc->background_fallback : "");
-		wlr_log(WLR_DEBUG, "-> %s", command);
-
-		char *const cmd[] = { "sh", "-c", command, NULL };
-		output->bg_pid = fork();
-		if (output->bg_pid == 0) {
-			execvp(cmd[0], cmd);
-		} else {
-			free(command);
-		}
-	}
+	update_swaybg(output, oc);
 
 	if (oc) {
 		switch (oc->dpms_state) {
@@ -285,6 +398,7 @@ static void default_output_config(struct output_config *oc,
 	oc->x = oc->y = -1;
 	oc->scale = 1;
 	oc->transform = WL_OUTPUT_TRANSFORM_NORMAL;
+	oc->max_render_time = MAX_RENDER_TIME_OFF;
 }
 
 static struct output_config *get_output_config(char *identifier,
@@ -0,0 +1,399 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-server.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include "sway/desktop/atlas.h"
+#include "list.h"
+#include "log.h"
+
+#define ATLAS_PAGE_WIDTH 2048
+#define ATLAS_PAGE_HEIGHT 1024
+// Reserved widths are rounded up, so that a title which grows a little can
+// stay where it is
+#define ATLAS_WIDTH_STEP 32
+// Images are separated by a transparent gap, so that nothing bleeds into them
+// when they are sampled
+#define ATLAS_GAP 1
+
+struct sway_atlas_page {
+	float scale;
+	struct wlr_renderer *renderer;
+	struct wlr_texture *texture;
+	list_t *shelves; // struct sway_atlas_shelf *
+	int used_height;
+	int images;
+};
+
+struct sway_atlas_shelf {
+	struct sway_atlas_page *page;
+	int y, height;
+	int used_width;
+	int images;
+	// Space freed before used_width, sorted by x
+	list_t *holes; // struct sway_atlas_span *
+};
+
+struct sway_atlas_span {
+	int x, width;
+};
+
+static list_t *pages = NULL; // struct sway_atlas_page *
+// The last page which became empty is kept, so that an image which moves
+// doesn't free a page only to allocate and upload a new one
+static struct sway_atlas_page *empty_page = NULL;
+static struct sway_atlas_usage usage = {0};
+
+static struct sway_atlas_page *page_create(struct wlr_renderer *renderer,
+		float scale) {
+	struct sway_atlas_page *page = calloc(1, sizeof(struct sway_atlas_page));
+	if (!page) {
+		return NULL;
+	}
+	// The page starts out transparent
+	void *data = calloc(ATLAS_PAGE_WIDTH * ATLAS_PAGE_HEIGHT, 4);
+	if (!data) {
+		free(page);
+		return NULL;
+	}
+	page->texture = wlr_texture_from_pixels(renderer, WL_SHM_FORMAT_ARGB8888,
+			ATLAS_PAGE_WIDTH * 4, ATLAS_PAGE_WIDTH, ATLAS_PAGE_HEIGHT, data);
+	free(data);
+	if (!page->texture) {
+		free(page);
+		return NULL;
+	}
+	page->scale = scale;
+	page->renderer = renderer;
+	page->shelves = create_list();
+
+	if (!pages) {
+		pages = create_list();
+	}
+	list_add(pages, page);
+	++usage.pages;
+	usage.bytes += ATLAS_PAGE_WIDTH * ATLAS_PAGE_HEIGHT * 4;
+	wlr_log(WLR_DEBUG, "Created atlas page %p for scale %f", page, scale);
+	return page;
+}
+
+static void shelf_destroy(struct sway_atlas_shelf *shelf) {
+	list_free_items_and_destroy(shelf->holes);
+	free(shelf);
+}
+
+static void page_clear_shelves(struct sway_atlas_page *page) {
+	for (int i = 0; i < page->shelves->length; ++i) {
+		shelf_destroy(page->shelves->items[i]);
+	}
+	page->shelves->length = 0;
+	page->used_height = 0;
+}
+
+static void page_destroy(struct sway_atlas_page *page) {
+	wlr_log(WLR_DEBUG, "Destroying atlas page %p", page);
+	int index = list_find(pages, page);
+	if (index != -1) {
+		list_del(pages, index);
+	}
+	if (page == empty_page) {
+		empty_page = NULL;
+	}
+	page_clear_shelves(page);
+	list_free(page->shelves);
+	wlr_texture_destroy(page->texture);
+	free(page);
+	--usage.pages;
+	usage.bytes -= ATLAS_PAGE_WIDTH * ATLAS_PAGE_HEIGHT * 4;
+}
+
+static void page_release(struct sway_atlas_page *page) {
+	page_clear_shelves(page);
+	if (empty_page) {
+		page_destroy(empty_page);
+	}
+	empty_page = page;
+}
+
+void atlas_trim(void) {
+	if (empty_page) {
+		page_destroy(empty_page);
+	}
+}
+
+/**
+ * Take width from the first hole it fits into, or from the end of the shelf.
+ */
+static bool shelf_reserve(struct sway_atlas_shelf *shelf, int width, int *x) {
+	for (int i = 0; i < shelf->holes->length; ++i) {
+		struct sway_atlas_span *hole = shelf->holes->items[i];
+		if (hole->width < width) {
+			continue;
+		}
+		*x = hole->x;
+		hole->x += width;
+		hole->width -= width;
+		if (hole->width == 0) {
+			list_del(shelf->holes, i);
+			free(hole);
+		}
+		return true;
+	}
+	if (shelf->used_width + width > ATLAS_PAGE_WIDTH) {
+		return false;
+	}
+	*x = shelf->used_width;
+	shelf->used_width += width;
+	return true;
+}
+
+static void shelf_free(struct sway_atlas_shelf *shelf, int x, int width) {
+	int index = 0;
+	while (index < shelf->holes->length) {
+		struct sway_atlas_span *hole = shelf->holes->items[index];
+		if (hole->x > x) {
+			break;
+		}
+		++index;
+	}
+	struct sway_atlas_span *prev = index > 0 ?
+		shelf->holes->items[index - 1] : NULL;
+	struct sway_atlas_span *next = index < shelf->holes->length ?
+		shelf->holes->items[index] : NULL;
+
+	if (prev && prev->x + prev->width == x) {
+		prev->width += width;
+	} else {
+		prev = calloc(1, sizeof(struct sway_atlas_span));
+		if (!prev) {
+			// The space is lost until the shelf is empty
+			return;
+		}
+		prev->x = x;
+		prev->width = width;
+		list_insert(shelf->holes, index++, prev);
+	}
+	if (next && prev->x + prev->width == next->x) {
+		prev->width += next->width;
+		list_del(shelf->holes, index);
+		free(next);
+	}
+	// A hole at the end gives its space back to the shelf
+	if (prev->x + prev->width == shelf->used_width) {
+		shelf->used_width = prev->x;
+		list_del(shelf->holes, shelf->holes->length - 1);
+		free(prev);
+	}
+}
+
+static struct sway_atlas_shelf *page_find_shelf(struct sway_atlas_page *page,
+		int width, int height, int *x) {
+	// Shelves which are much taller than the image would waste space
+	for (int i = 0; i < page->shelves->length; ++i) {
+		struct sway_atlas_shelf *shelf = page->shelves->items[i];
+		if (shelf->height >= height && shelf->height <= height + height / 4
+				&& shelf_reserve(shelf, width, x)) {
+			return shelf;
+		}
+	}
+	if (page->used_height + height > ATLAS_PAGE_HEIGHT) {
+		return NULL;
+	}
+	struct sway_atlas_shelf *shelf = calloc(1, sizeof(struct sway_atlas_shelf));
+	if (!shelf) {
+		return NULL;
+	}
+	shelf->holes = create_list();
+	shelf->page = page;
+	shelf->y = page->used_height;
+	shelf->height = height;
+	page->used_height += height;
+	list_add(page->shelves, shelf);
+	shelf_reserve(shelf, width, x);
+	return shelf;
+}
+
+/**
+ * Reserve space for an image, including the gap around it.
+ */
+static struct sway_atlas_shelf *atlas_reserve(struct wlr_renderer *renderer,
+		float scale, int width, int height, int *x) {
+	for (int i = 0; pages && i < pages->length; ++i) {
+		struct sway_atlas_page *page = pages->items[i];
+		if (page->scale != scale || page->renderer != renderer) {
+			continue;
+		}
+		struct sway_atlas_shelf *shelf =
+			page_find_shelf(page, width, height, x);
+		if (shelf) {
+			return shelf;
+		}
+	}
+	struct sway_atlas_page *page = page_create(renderer, scale);
+	if (!page) {
+		return NULL;
+	}
+	struct sway_atlas_shelf *shelf = page_find_shelf(page, width, height, x);
+	if (!shelf) {
+		page_destroy(page);
+		return NULL;
+	}
+	return shelf;
+}
+
+static void atlas_release(struct sway_atlas_image *image) {
+	struct sway_atlas_shelf *shelf = image->shelf;
+	struct sway_atlas_page *page = shelf->page;
+	image->shelf = NULL;
+	if (--page->images == 0) {
+		page_release(page);
+		return;
+	}
+	if (--shelf->images == 0) {
+		for (int i = 0; i < shelf->holes->length; ++i) {
+			free(shelf->holes->items[i]);
+		}
+		shelf->holes->length = 0;
+		shelf->used_width = 0;
+		return;
+	}
+	shelf_free(shelf, image->box.x - ATLAS_GAP, image->reserved_width);
+}
+
+void atlas_image_destroy(struct sway_atlas_image *image) {
+	if (!image) {
+		return;
+	}
+	--usage.images;
+	usage.image_bytes -= (size_t)image->box.width * image->box.height * 4;
+	if (image->shelf) {
+		atlas_release(image);
+	} else {
+		--usage.own_textures;
+		usage.bytes -= (size_t)image->box.width * image->box.height * 4;
+		wlr_texture_destroy(image->texture);
+	}
+	free(image);
+}
+
+void atlas_get_usage(struct sway_atlas_usage *_usage) {
+	*_usage = usage;
+}
+
+static bool image_fits(struct sway_atlas_image *image, float scale,
+		int width, int height) {
+	struct sway_atlas_shelf *shelf = image->shelf;
+	return shelf && shelf->page->scale == scale &&
+		width + ATLAS_GAP * 2 <= image->reserved_width &&
+		height == image->box.height;
+}
+
+/**
+ * Upload the pixels of an image in the atlas together with the gap around it,
+ * since its place may still hold whatever was there before.
+ */
+static bool image_write_pixels(struct sway_atlas_image *image,
+		int stride, const void *data) {
+	int width = image->box.width + ATLAS_GAP * 2;
+	int height = image->box.height + ATLAS_GAP * 2;
+	uint32_t *padded = calloc((size_t)width * height, 4);
+	if (!padded) {
+		return false;
+	}
+	for (int y = 0; y < image->box.height; ++y) {
+		memcpy(padded + (y + ATLAS_GAP) * width + ATLAS_GAP,
+				(const char *)data + (size_t)y * stride,
+				(size_t)image->box.width * 4);
+	}
+	bool ok = wlr_texture_write_pixels(image->texture, width * 4,
+			width, height, 0, 0, image->box.x - ATLAS_GAP,
+			image->box.y - ATLAS_GAP, padded);
+	free(padded);
+	return ok;
+}
+
+void atlas_image_update(struct sway_atlas_image **_image,
+		struct wlr_renderer *renderer, float scale,
+		int stride, int width, int height, const void *data) {
+	struct sway_atlas_image *old = *_image;
+	if (width <= 0 || height <= 0) {
+		atlas_image_destroy(old);
+		*_image = NULL;
+		return;
+	}
+
+	if (old && image_fits(old, scale, width, height)) {
+		usage.image_bytes += (size_t)(width - old->box.width) * height * 4;
+		old->box.width = width;
+		if (!image_write_pixels(old, stride, data)) {
+			atlas_image_destroy(old);
+			*_image = NULL;
+		}
+		return;
+	}
+
+	// The old image keeps its place until the new one has one, so that a
+	// page holding only the old image isn't freed and allocated again
+	struct sway_atlas_image *image = calloc(1, sizeof(struct sway_atlas_image));
+	*_image = image;
+	if (!image) {
+		wlr_log(WLR_ERROR, "Unable to allocate atlas image");
+		atlas_image_destroy(old);
+		return;
+	}
+
+	int reserved_width = width + ATLAS_GAP * 2;
+	reserved_width += ATLAS_WIDTH_STEP - 1;
+	reserved_width -= reserved_width % ATLAS_WIDTH_STEP;
+	int reserved_height = height + ATLAS_GAP * 2;
+
+	int x = 0;
+	struct sway_atlas_shelf *shelf = NULL;
+	if (reserved_width <= ATLAS_PAGE_WIDTH &&
+			reserved_height <= ATLAS_PAGE_HEIGHT) {
+		shelf = atlas_reserve(renderer, scale, reserved_width,
+				reserved_height, &x);
+	}
+	if (shelf) {
+		// Counted before the old image is released, which may share the page
+		++shelf->images;
+		if (shelf->page->images++ == 0 && shelf->page == empty_page) {
+			empty_page = NULL;
+		}
+	}
+	atlas_image_destroy(old);
+	if (!shelf) {
+		// Too large for a page, or no page could be created
+		image->texture = wlr_texture_from_pixels(renderer,
+				WL_SHM_FORMAT_ARGB8888, stride, width, height, data);
+		image->box.width = width;
+		image->box.height = height;
+		if (!image->texture) {
+			free(image);
+			*_image = NULL;
+			return;
+		}
+		++usage.images;
+		++usage.own_textures;
+		usage.image_bytes += (size_t)width * height * 4;
+		usage.bytes += (size_t)width * height * 4;
+		return;
+	}
+
+	image->shelf = shelf;
+	image->texture = shelf->page->texture;
+	image->reserved_width = reserved_width;
+	image->box.x = x + ATLAS_GAP;
+	image->box.y = shelf->y + ATLAS_GAP;
+	image->box.width = width;
+	image->box.height = height;
+	++usage.images;
+	usage.image_bytes += (size_t)width * height * 4;
+
+	if (!image_write_pixels(image, stride, data)) {
+		atlas_image_destroy(image);
+		*_image = NULL;
+	}
+}
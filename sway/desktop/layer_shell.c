@@ -287,6 +287,62 @@ static void handle_surface_commit(struct wl_listener *listener, void *data) {
 	transaction_commit_dirty();
 }
 
+static void subsurface_destroy(struct sway_layer_subsurface *subsurface) {
+	wl_list_remove(&subsurface->link);
+	wl_list_remove(&subsurface->commit.link);
+	wl_list_remove(&subsurface->destroy.link);
+	free(subsurface);
+}
+
+static void subsurface_handle_commit(struct wl_listener *listener,
+		void *data) {
+	struct sway_layer_subsurface *subsurface =
+		wl_container_of(listener, subsurface, commit);
+	struct sway_layer_surface *layer = subsurface->layer;
+	struct wlr_output *wlr_output = layer->layer_surface->output;
+	if (wlr_output == NULL || wlr_output->data == NULL) {
+		return;
+	}
+	// Desynchronized subsurfaces are committed without their parent
+	output_damage_surface(wlr_output->data,
+		layer->geo.x + subsurface->wlr_subsurface->current.x,
+		layer->geo.y + subsurface->wlr_subsurface->current.y,
+		subsurface->wlr_subsurface->surface, false);
+}
+
+static void subsurface_handle_destroy(struct wl_listener *listener,
+		void *data) {
+	struct sway_layer_subsurface *subsurface =
+		wl_container_of(listener, subsurface, destroy);
+	subsurface_destroy(subsurface);
+}
+
+static void layer_subsurface_create(struct sway_layer_surface *layer,
+		struct wlr_subsurface *wlr_subsurface) {
+	struct sway_layer_subsurface *subsurface =
+		calloc(1, sizeof(struct sway_layer_subsurface));
+	if (subsurface == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	subsurface->wlr_subsurface = wlr_subsurface;
+	subsurface->layer = layer;
+	wl_list_insert(&layer->subsurfaces, &subsurface->link);
+
+	subsurface->commit.notify = subsurface_handle_commit;
+	wl_signal_add(&wlr_subsurface->surface->events.commit,
+		&subsurface->commit);
+	subsurface->destroy.notify = subsurface_handle_destroy;
+	wl_signal_add(&wlr_subsurface->events.destroy, &subsurface->destroy);
+}
+
+static void handle_new_subsurface(struct wl_listener *listener, void *data) {
+	struct sway_layer_surface *layer =
+		wl_container_of(listener, layer, new_subsurface);
+	struct wlr_subsurface *wlr_subsurface = data;
+	layer_subsurface_create(layer, wlr_subsurface);
+}
+
 static void unmap(struct sway_layer_surface *sway_layer) {
 	struct wlr_output *wlr_output = sway_layer->layer_surface->output;
 	if (wlr_output == NULL) {
@@ -318,6 +374,11 @@ static void handle_destroy(struct wl_listener *listener, void *data) {
 	wl_list_remove(&sway_layer->map.link);
 	wl_list_remove(&sway_layer->unmap.link);
 	wl_list_remove(&sway_layer->surface_commit.link);
+	wl_list_remove(&sway_layer->new_subsurface.link);
+	struct sway_layer_subsurface *subsurface, *tmp;
+	wl_list_for_each_safe(subsurface, tmp, &sway_layer->subsurfaces, link) {
+		subsurface_destroy(subsurface);
+	}
 	if (sway_layer->layer_surface->output != NULL) {
 		struct sway_output *output = sway_layer->layer_surface->output->data;
 		if (output != NULL) {
@@ -405,7 +466,18 @@ void handle_layer_shell_surface(struct wl_listener *listener, void *data) {
 	wl_signal_add(&layer_surface->events.map, &sway_layer->map);
 	sway_layer->unmap.notify = handle_unmap;
 	wl_signal_add(&layer_surface->events.unmap, &sway_layer->unmap);
-	// TODO: Listen for subsurfaces
+
+	// Only direct subsurfaces are tracked, which is what clients such as
+	// swaylock use
+	wl_list_init(&sway_layer->subsurfaces);
+	sway_layer->new_subsurface.notify = handle_new_subsurface;
+	wl_signal_add(&layer_surface->surface->events.new_subsurface,
+		&sway_layer->new_subsurface);
+	struct wlr_subsurface *wlr_subsurface;
+	wl_list_for_each(wlr_subsurface, &layer_surface->surface->subsurfaces,
+			parent_link) {
+		layer_subsurface_create(sway_layer, wlr_subsurface);
+	}
 
 	sway_layer->layer_surface = layer_surface;
 	layer_surface->data = sway_layer;
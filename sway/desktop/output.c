@@ -17,9 +17,11 @@
 #include "config.h"
 #include "log.h"
 #include "sway/config.h"
+#include "sway/desktop/text_texture.h"
 #include "sway/desktop/transaction.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
+#include "sway/ipc-server.h"
 #include "sway/layers.h"
 #include "sway/output.h"
 #include "sway/server.h"
@@ -345,25 +347,72 @@ bool output_has_opaque_overlay_layer_surface(struct sway_output *output) {
 	return false;
 }
 
+struct send_frame_done_data {
+	struct timespec *when;
+	int count;
+};
+
 static void send_frame_done_iterator(struct sway_output *output,
 		struct wlr_surface *surface, struct wlr_box *box, float rotation,
-		void *data) {
-	struct timespec *when = data;
-	wlr_surface_send_frame_done(surface, when);
+		void *_data) {
+	struct send_frame_done_data *data = _data;
+	wlr_surface_send_frame_done(surface, data->when);
+	++data->count;
 }
 
-static void send_frame_done(struct sway_output *output, struct timespec *when) {
-	output_for_each_surface(output, send_frame_done_iterator, when);
+/**
+ * Returns the number of surfaces which were sent the event.
+ */
+static int send_frame_done(struct sway_output *output, struct timespec *when) {
+	struct send_frame_done_data data = {
+		.when = when,
+		.count = 0,
+	};
+	output_for_each_surface(output, send_frame_done_iterator, &data);
+	return data.count;
 }
 
-static void damage_handle_frame(struct wl_listener *listener, void *data) {
-	struct sway_output *output =
-		wl_container_of(listener, output, damage_frame);
+static int64_t timespec_to_nsec(const struct timespec *t) {
+	return (int64_t)t->tv_sec * 1000000000 + t->tv_nsec;
+}
 
-	if (!output->wlr_output->enabled) {
+/**
+ * Feed the duration of a frame into the moving estimate used by
+ * "max_render_time auto". The mean deviation is tracked as well, so that the
+ * estimate has room for outliers.
+ */
+static void output_update_render_time(struct sway_output *output,
+		int64_t nsec) {
+	if (output->render_time_avg_nsec == 0) {
+		output->render_time_avg_nsec = nsec;
+		output->render_time_dev_nsec = nsec / 2;
 		return;
 	}
+	int64_t error = nsec - output->render_time_avg_nsec;
+	output->render_time_avg_nsec += error / 8;
+	output->render_time_dev_nsec +=
+		(llabs(error) - output->render_time_dev_nsec) / 4;
+}
+
+static void output_record_frame(struct sway_output *output,
+		struct sway_frame_stats *frame, struct timespec *now) {
+	struct sway_render_stats *stats = &output->render_stats;
+	stats->frames[stats->frames_next] = *frame;
+	stats->frames_next = (stats->frames_next + 1) % RENDER_STATS_FRAMES;
+	if (stats->frames_length < RENDER_STATS_FRAMES) {
+		++stats->frames_length;
+	}
+	++stats->rendered;
+
+	// Subscribers get the statistics at most once a second per output
+	if (timespec_to_nsec(now) - timespec_to_nsec(&stats->last_event)
+			>= 1000000000) {
+		stats->last_event = *now;
+		ipc_event_render_stats(output);
+	}
+}
 
+static void output_repaint(struct sway_output *output) {
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
@@ -374,14 +423,88 @@ static void damage_handle_frame(struct wl_listener *listener, void *data) {
 		return;
 	}
 
+	struct sway_frame_stats frame = {0};
+	bool rendered = needs_swap && pixman_region32_not_empty(&damage);
 	if (needs_swap) {
-		output_render(output, &now, &damage);
+		output_render(output, &now, &damage, &frame);
+
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		frame.cpu_nsec = timespec_to_nsec(&end) - timespec_to_nsec(&now);
+		output_update_render_time(output, frame.cpu_nsec);
+		timing_add(&server.timings.render, frame.cpu_nsec);
+	}
+	if (!rendered) {
+		++output->render_stats.skipped;
 	}
 
 	pixman_region32_fini(&damage);
 
 	// Send frame done to all visible surfaces
-	send_frame_done(output, &now);
+	frame.frame_done = send_frame_done(output, &now);
+
+	if (rendered) {
+		output_record_frame(output, &frame, &now);
+		text_texture_enforce_budget(&now);
+	}
+}
+
+static int output_repaint_timer_handler(void *data) {
+	struct sway_output *output = data;
+	if (output->wlr_output && output->wlr_output->enabled) {
+		output_repaint(output);
+	}
+	return 0;
+}
+
+/**
+ * Return how many milliseconds to wait before rendering, so that the frame
+ * is finished just in time for the next vblank.
+ */
+static int output_repaint_delay(struct sway_output *output) {
+	if (output->max_render_time == MAX_RENDER_TIME_OFF ||
+			output->refresh_nsec <= 0) {
+		return 0;
+	}
+
+	int64_t render_nsec;
+	if (output->max_render_time == MAX_RENDER_TIME_AUTO) {
+		if (output->render_time_avg_nsec == 0) {
+			return 0;
+		}
+		// One millisecond of safety margin covers the timer's resolution
+		render_nsec = output->render_time_avg_nsec +
+			4 * output->render_time_dev_nsec + 1000000;
+	} else {
+		render_nsec = (int64_t)output->max_render_time * 1000000;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t since_presentation = timespec_to_nsec(&now) -
+		timespec_to_nsec(&output->last_presentation);
+	if (since_presentation < 0) {
+		return 0;
+	}
+	int64_t until_vblank = output->refresh_nsec -
+		since_presentation % output->refresh_nsec;
+	return (until_vblank - render_nsec) / 1000000;
+}
+
+static void damage_handle_frame(struct wl_listener *listener, void *data) {
+	struct sway_output *output =
+		wl_container_of(listener, output, damage_frame);
+
+	if (!output->wlr_output->enabled) {
+		return;
+	}
+
+	int delay = output_repaint_delay(output);
+	if (delay < 1) {
+		output_repaint(output);
+	} else {
+		wl_event_source_timer_update(output->repaint_timer, delay);
+	}
 }
 
 void output_damage_whole(struct sway_output *output) {
@@ -506,6 +629,11 @@ static void handle_transform(struct wl_listener *listener, void *data) {
 }
 
 static void update_textures(struct sway_container *con, void *data) {
+	// Only containers which take their scale from this output are affected
+	struct sway_output *output = data;
+	if (container_get_effective_output(con) != output) {
+		return;
+	}
 	container_update_title_textures(con);
 	container_update_marks_textures(con);
 }
@@ -513,7 +641,7 @@ static void update_textures(struct sway_container *con, void *data) {
 static void handle_scale(struct wl_listener *listener, void *data) {
 	struct sway_output *output = wl_container_of(listener, output, scale);
 	arrange_layers(output);
-	output_for_each_container(output, update_textures, NULL);
+	root_for_each_container(update_textures, output);
 	arrange_output(output);
 	transaction_commit_dirty();
 }
@@ -530,6 +658,9 @@ static void handle_present(struct wl_listener *listener, void *data) {
 	struct sway_output *output = wl_container_of(listener, output, present);
 	struct wlr_output_event_present *output_event = data;
 
+	output->last_presentation = *output_event->when;
+	output->refresh_nsec = output_event->refresh;
+
 	struct wlr_presentation_event event = {
 		.output = output->wlr_output,
 		.tv_sec = (uint64_t)output_event->when->tv_sec,
@@ -553,6 +684,8 @@ void handle_new_output(struct wl_listener *listener, void *data) {
 	output->server = server;
 	output->damage = wlr_output_damage_create(wlr_output);
 	output->destroy.notify = handle_destroy;
+	output->repaint_timer = wl_event_loop_add_timer(server->wl_event_loop,
+		output_repaint_timer_handler, output);
 
 	struct output_config *oc = output_find_config(output);
 
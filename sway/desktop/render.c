@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <strings.h>
 #include <time.h>
@@ -17,6 +18,8 @@
 #include "config.h"
 #include "sway/config.h"
 #include "sway/debug.h"
+#include "sway/desktop/atlas.h"
+#include "sway/desktop/text_texture.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
 #include "sway/layers.h"
@@ -33,6 +36,57 @@ struct render_data {
 	float alpha;
 };
 
+/**
+ * The damage of the frame being rendered before occluded regions were
+ * subtracted from it, and the number of draws which were skipped because
+ * everything they would have touched is covered. Only tracked when the
+ * render-stats debug flag is set.
+ */
+static pixman_region32_t *frame_damage = NULL;
+static size_t frame_occluded_draws = 0;
+
+// Draw calls issued for the frame being rendered
+static int frame_texture_draws = 0;
+static int frame_rect_draws = 0;
+static int frame_clears = 0;
+
+#define RECT_BATCH_COLORS 8
+
+/**
+ * Solid rectangles are not drawn straight away, but collected into one region
+ * per colour. Neighbouring borders, padding and separators merge into a few
+ * large rectangles, which are drawn once per damage rectangle when the batch
+ * is flushed.
+ *
+ * The batch must be flushed before drawing anything which overlaps it, to
+ * keep the stacking order intact.
+ */
+static struct {
+	struct wlr_output *output;
+	int length;
+	struct {
+		float color[4];
+		pixman_region32_t region;
+	} colors[RECT_BATCH_COLORS];
+	pixman_region32_t pending; // Union of all the regions
+} rect_batch;
+
+static void count_occluded_draw(const struct wlr_box *box) {
+	if (!frame_damage) {
+		return;
+	}
+	pixman_box32_t rect = {
+		.x1 = box->x,
+		.y1 = box->y,
+		.x2 = box->x + box->width,
+		.y2 = box->y + box->height,
+	};
+	if (pixman_region32_contains_rectangle(frame_damage, &rect)
+			!= PIXMAN_REGION_OUT) {
+		++frame_occluded_draws;
+	}
+}
+
 /**
  * Apply scale to a width or height.
  *
@@ -78,6 +132,104 @@ static void scissor_output(struct wlr_output *wlr_output,
 	wlr_renderer_scissor(renderer, &box);
 }
 
+static void rect_batch_begin(struct wlr_output *wlr_output) {
+	rect_batch.output = wlr_output;
+	rect_batch.length = 0;
+	pixman_region32_init(&rect_batch.pending);
+}
+
+static void rect_batch_flush(void) {
+	if (rect_batch.length == 0) {
+		return;
+	}
+	struct wlr_output *wlr_output = rect_batch.output;
+	struct wlr_renderer *renderer =
+		wlr_backend_get_renderer(wlr_output->backend);
+
+	for (int i = 0; i < rect_batch.length; ++i) {
+		pixman_region32_t *region = &rect_batch.colors[i].region;
+		int nrects;
+		pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+		for (int j = 0; j < nrects; ++j) {
+			struct wlr_box box = {
+				.x = rects[j].x1,
+				.y = rects[j].y1,
+				.width = rects[j].x2 - rects[j].x1,
+				.height = rects[j].y2 - rects[j].y1,
+			};
+			scissor_output(wlr_output, &rects[j]);
+			wlr_render_rect(renderer, &box, rect_batch.colors[i].color,
+				wlr_output->transform_matrix);
+			++frame_rect_draws;
+		}
+		pixman_region32_fini(region);
+	}
+	rect_batch.length = 0;
+	pixman_region32_fini(&rect_batch.pending);
+	pixman_region32_init(&rect_batch.pending);
+}
+
+static void rect_batch_end(void) {
+	rect_batch_flush();
+	pixman_region32_fini(&rect_batch.pending);
+	rect_batch.output = NULL;
+}
+
+/**
+ * Flush the batch if anything in it would be drawn over by the region.
+ */
+static void rect_batch_flush_overlapping(pixman_region32_t *region) {
+	if (rect_batch.length == 0) {
+		return;
+	}
+	pixman_region32_t overlap;
+	pixman_region32_init(&overlap);
+	pixman_region32_intersect(&overlap, &rect_batch.pending, region);
+	if (pixman_region32_not_empty(&overlap)) {
+		rect_batch_flush();
+	}
+	pixman_region32_fini(&overlap);
+}
+
+static void rect_batch_add(pixman_region32_t *region,
+		const float color[static 4]) {
+	int index = -1;
+	for (int i = 0; i < rect_batch.length; ++i) {
+		if (memcmp(rect_batch.colors[i].color, color,
+				sizeof(float) * 4) == 0) {
+			index = i;
+			break;
+		}
+	}
+
+	// Drawing an opaque colour twice is harmless, but anything else has to
+	// be drawn in order
+	pixman_region32_t overlap;
+	pixman_region32_init(&overlap);
+	pixman_region32_intersect(&overlap, &rect_batch.pending, region);
+	if (index >= 0 && color[3] == 1.0f) {
+		pixman_region32_subtract(&overlap, &overlap,
+			&rect_batch.colors[index].region);
+	}
+	if (pixman_region32_not_empty(&overlap)) {
+		rect_batch_flush();
+		index = -1;
+	}
+	pixman_region32_fini(&overlap);
+
+	if (index < 0) {
+		if (rect_batch.length == RECT_BATCH_COLORS) {
+			rect_batch_flush();
+		}
+		index = rect_batch.length++;
+		memcpy(rect_batch.colors[index].color, color, sizeof(float) * 4);
+		pixman_region32_init(&rect_batch.colors[index].region);
+	}
+	pixman_region32_union(&rect_batch.colors[index].region,
+		&rect_batch.colors[index].region, region);
+	pixman_region32_union(&rect_batch.pending, &rect_batch.pending, region);
+}
+
 static void render_texture(struct wlr_output *wlr_output,
 		pixman_region32_t *output_damage, struct wlr_texture *texture,
 		const struct wlr_box *box, const float matrix[static 9], float alpha) {
@@ -91,14 +243,18 @@ static void render_texture(struct wlr_output *wlr_output,
 	pixman_region32_intersect(&damage, &damage, output_damage);
 	bool damaged = pixman_region32_not_empty(&damage);
 	if (!damaged) {
+		count_occluded_draw(box);
 		goto damage_finish;
 	}
 
+	rect_batch_flush_overlapping(&damage);
+
 	int nrects;
 	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
 	for (int i = 0; i < nrects; ++i) {
 		scissor_output(wlr_output, &rects[i]);
 		wlr_render_texture_with_matrix(renderer, texture, matrix, alpha);
+		++frame_texture_draws;
 	}
 
 damage_finish:
@@ -167,9 +323,6 @@ static void render_drag_icons(struct sway_output *output,
 static void render_rect(struct wlr_output *wlr_output,
 		pixman_region32_t *output_damage, const struct wlr_box *_box,
 		float color[static 4]) {
-	struct wlr_renderer *renderer =
-		wlr_backend_get_renderer(wlr_output->backend);
-
 	struct wlr_box box;
 	memcpy(&box, _box, sizeof(struct wlr_box));
 	box.x -= wlr_output->lx * wlr_output->scale;
@@ -182,16 +335,11 @@ static void render_rect(struct wlr_output *wlr_output,
 	pixman_region32_intersect(&damage, &damage, output_damage);
 	bool damaged = pixman_region32_not_empty(&damage);
 	if (!damaged) {
+		count_occluded_draw(&box);
 		goto damage_finish;
 	}
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(wlr_output, &rects[i]);
-		wlr_render_rect(renderer, &box, color,
-			wlr_output->transform_matrix);
-	}
+	rect_batch_add(&damage, color);
 
 damage_finish:
 	pixman_region32_fini(&damage);
@@ -343,6 +491,28 @@ static void render_view(struct sway_output *output, pixman_region32_t *damage,
 	}
 }
 
+/**
+ * Render the part of an atlas image which lies in box. The image is drawn at
+ * the top-left corner of the box, which may be narrower than the image.
+ */
+static void render_atlas_image(struct wlr_output *wlr_output,
+		pixman_region32_t *output_damage, struct sway_atlas_image *image,
+		const struct wlr_box *box, float alpha) {
+	struct wlr_box texture_box = {
+		.x = box->x - image->box.x,
+		.y = box->y - image->box.y,
+	};
+	wlr_texture_get_size(image->texture,
+		&texture_box.width, &texture_box.height);
+
+	float matrix[9];
+	wlr_matrix_project_box(matrix, &texture_box, WL_OUTPUT_TRANSFORM_NORMAL,
+		0.0, wlr_output->transform_matrix);
+
+	render_texture(wlr_output, output_damage, image->texture, box,
+		matrix, alpha);
+}
+
 /**
  * Render a titlebar.
  *
@@ -356,8 +526,8 @@ static void render_view(struct sway_output *output, pixman_region32_t *damage,
 static void render_titlebar(struct sway_output *output,
 		pixman_region32_t *output_damage, struct sway_container *con,
 		int x, int y, int width,
-		struct border_colors *colors, struct wlr_texture *title_texture,
-		struct wlr_texture *marks_texture) {
+		struct border_colors *colors, struct sway_text_texture *title_texture,
+		struct sway_text_texture *marks_texture) {
 	struct wlr_box box;
 	float color[4];
 	struct sway_container_state *state = &con->current;
@@ -435,10 +605,13 @@ static void render_titlebar(struct sway_output *output,
 	// Marks
 	int ob_marks_x = 0; // output-buffer-local
 	int ob_marks_width = 0; // output-buffer-local
-	if (config->show_marks && marks_texture) {
-		struct wlr_box texture_box;
-		wlr_texture_get_size(marks_texture,
-			&texture_box.width, &texture_box.height);
+	struct sway_atlas_image *marks_image = config->show_marks ?
+		text_texture_get_image(marks_texture) : NULL;
+	if (marks_image) {
+		struct wlr_box texture_box = {
+			.width = marks_image->box.width,
+			.height = marks_image->box.height,
+		};
 		ob_marks_width = texture_box.width;
 
 		// The marks texture might be shorter than the config->font_height, in
@@ -459,16 +632,11 @@ static void render_titlebar(struct sway_output *output,
 		texture_box.y = round((bg_y - output_y) * output_scale) +
 			ob_padding_above;
 
-		float matrix[9];
-		wlr_matrix_project_box(matrix, &texture_box,
-			WL_OUTPUT_TRANSFORM_NORMAL,
-			0.0, output->wlr_output->transform_matrix);
-
 		if (ob_inner_width < texture_box.width) {
 			texture_box.width = ob_inner_width;
 		}
-		render_texture(output->wlr_output, output_damage, marks_texture,
-			&texture_box, matrix, con->alpha);
+		render_atlas_image(output->wlr_output, output_damage, marks_image,
+			&texture_box, con->alpha);
 
 		// Padding above
 		memcpy(&color, colors->background, sizeof(float) * 4);
@@ -488,10 +656,13 @@ static void render_titlebar(struct sway_output *output,
 	// Title text
 	int ob_title_x = 0;  // output-buffer-local
 	int ob_title_width = 0; // output-buffer-local
-	if (title_texture) {
-		struct wlr_box texture_box;
-		wlr_texture_get_size(title_texture,
-			&texture_box.width, &texture_box.height);
+	struct sway_atlas_image *title_image =
+		text_texture_get_image(title_texture);
+	if (title_image) {
+		struct wlr_box texture_box = {
+			.width = title_image->box.width,
+			.height = title_image->box.height,
+		};
 		ob_title_width = texture_box.width;
 
 		// The title texture might be shorter than the config->font_height,
@@ -526,17 +697,12 @@ static void render_titlebar(struct sway_output *output,
 		texture_box.y =
 			round((bg_y - output_y) * output_scale) + ob_padding_above;
 
-		float matrix[9];
-		wlr_matrix_project_box(matrix, &texture_box,
-			WL_OUTPUT_TRANSFORM_NORMAL,
-			0.0, output->wlr_output->transform_matrix);
-
 		if (ob_inner_width - ob_marks_width < texture_box.width) {
 			texture_box.width = ob_inner_width - ob_marks_width;
 		}
 
-		render_texture(output->wlr_output, output_damage, title_texture,
-			&texture_box, matrix, con->alpha);
+		render_atlas_image(output->wlr_output, output_damage, title_image,
+			&texture_box, con->alpha);
 
 		// Padding above
 		memcpy(&color, colors->background, sizeof(float) * 4);
@@ -685,8 +851,8 @@ static void render_containers_linear(struct sway_output *output,
 		if (child->view) {
 			struct sway_view *view = child->view;
 			struct border_colors *colors;
-			struct wlr_texture *title_texture;
-			struct wlr_texture *marks_texture;
+			struct sway_text_texture *title_texture;
+			struct sway_text_texture *marks_texture;
 			struct sway_container_state *state = &child->current;
 
 			if (view_is_urgent(view)) {
@@ -740,8 +906,8 @@ static void render_containers_tabbed(struct sway_output *output,
 		struct sway_view *view = child->view;
 		struct sway_container_state *cstate = &child->current;
 		struct border_colors *colors;
-		struct wlr_texture *title_texture;
-		struct wlr_texture *marks_texture;
+		struct sway_text_texture *title_texture;
+		struct sway_text_texture *marks_texture;
 		bool urgent = view ?
 			view_is_urgent(view) : container_has_urgent_child(child);
 
@@ -805,8 +971,8 @@ static void render_containers_stacked(struct sway_output *output,
 		struct sway_view *view = child->view;
 		struct sway_container_state *cstate = &child->current;
 		struct border_colors *colors;
-		struct wlr_texture *title_texture;
-		struct wlr_texture *marks_texture;
+		struct sway_text_texture *title_texture;
+		struct sway_text_texture *marks_texture;
 		bool urgent = view ?
 			view_is_urgent(view) : container_has_urgent_child(child);
 
@@ -902,8 +1068,8 @@ static void render_floating_container(struct sway_output *soutput,
 	if (con->view) {
 		struct sway_view *view = con->view;
 		struct border_colors *colors;
-		struct wlr_texture *title_texture;
-		struct wlr_texture *marks_texture;
+		struct sway_text_texture *title_texture;
+		struct sway_text_texture *marks_texture;
 
 		if (view_is_urgent(view)) {
 			colors = &config->border_colors.urgent;
@@ -932,8 +1098,257 @@ static void render_floating_container(struct sway_output *soutput,
 	}
 }
 
-static void render_floating(struct sway_output *soutput,
+/**
+ * The damage left for each part of the scene after subtracting the opaque
+ * regions of everything which is drawn above it.
+ */
+struct occlusion {
+	pixman_region32_t unmanaged;
+	pixman_region32_t *floating; // One per visible floating container
+	int floating_length;
+	pixman_region32_t workspace;
+	pixman_region32_t background; // Also used to clear the output
+};
+
+static void opaque_surface_iterator(struct sway_output *output,
+		struct wlr_surface *surface, struct wlr_box *box, float rotation,
+		void *data) {
+	pixman_region32_t *opaque = data;
+	if (rotation != 0.0f || !wlr_surface_get_texture(surface)) {
+		return;
+	}
+
+	// When the surface is scaled, texels at the edge of the opaque region get
+	// blended with their translucent neighbours, so only trust the interior.
+	float scale = output->wlr_output->scale;
+	int inset = surface->current.scale == scale ? 0 : 1;
+
+	int nrects;
+	pixman_box32_t *rects =
+		pixman_region32_rectangles(&surface->opaque_region, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		int x1 = ceil((box->x + rects[i].x1) * scale) + inset;
+		int y1 = ceil((box->y + rects[i].y1) * scale) + inset;
+		int x2 = floor((box->x + rects[i].x2) * scale) - inset;
+		int y2 = floor((box->y + rects[i].y2) * scale) - inset;
+		if (x2 > x1 && y2 > y1) {
+			pixman_region32_union_rect(opaque, opaque,
+				x1, y1, x2 - x1, y2 - y1);
+		}
+	}
+}
+
+/**
+ * Add a border which render_view or render_top_border draws. The box is
+ * layout-local, as it is for render_rect before scaling.
+ */
+static void opaque_add_border(struct sway_output *output,
+		pixman_region32_t *opaque, int x, int y, int width, int height) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_box box = {
+		.x = x,
+		.y = y,
+		.width = width,
+		.height = height,
+	};
+	scale_box(&box, wlr_output->scale);
+	box.x -= wlr_output->lx * wlr_output->scale;
+	box.y -= wlr_output->ly * wlr_output->scale;
+	pixman_region32_union_rect(opaque, opaque,
+		box.x, box.y, box.width, box.height);
+}
+
+/**
+ * Borders can be drawn in any of the colour classes, depending on focus and
+ * urgency, so they are only treated as opaque if all of them are.
+ */
+static bool border_colors_opaque(void) {
+	struct border_colors *classes[] = {
+		&config->border_colors.focused,
+		&config->border_colors.focused_inactive,
+		&config->border_colors.unfocused,
+		&config->border_colors.urgent,
+	};
+	for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); ++i) {
+		if (classes[i]->child_border[3] < 1.0f ||
+				classes[i]->indicator[3] < 1.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void container_add_opaque(struct sway_output *output,
+		pixman_region32_t *opaque, struct sway_container *con,
+		bool opaque_borders);
+
+static void container_children_add_opaque(struct sway_output *output,
+		pixman_region32_t *opaque, enum sway_container_layout layout,
+		list_t *children, struct sway_container *active_child,
+		bool opaque_borders) {
+	if (layout == L_TABBED || layout == L_STACKED) {
+		// Only the active child is drawn below the titlebars
+		if (active_child) {
+			container_add_opaque(output, opaque, active_child, opaque_borders);
+		}
+		return;
+	}
+	for (int i = 0; i < children->length; ++i) {
+		container_add_opaque(output, opaque, children->items[i],
+			opaque_borders);
+	}
+}
+
+/**
+ * Add the parts of a container which render_view will fill with opaque
+ * pixels. Titlebars are left out, since they are assembled from textures and
+ * padding which are not guaranteed to cover them.
+ */
+static void container_add_opaque(struct sway_output *output,
+		pixman_region32_t *opaque, struct sway_container *con,
+		bool opaque_borders) {
+	if (!con->view) {
+		container_children_add_opaque(output, opaque, con->current.layout,
+			con->current.children, con->current.focused_inactive_child,
+			opaque_borders);
+		return;
+	}
+	if (con->alpha < 1.0f) {
+		return;
+	}
+
+	struct sway_view *view = con->view;
+	if (!view->saved_buffer && view->surface) {
+		double ox = con->current.content_x -
+			output->wlr_output->lx - view->geometry.x;
+		double oy = con->current.content_y -
+			output->wlr_output->ly - view->geometry.y;
+		output_surface_for_each_surface(output, view->surface, ox, oy,
+			opaque_surface_iterator, opaque);
+	}
+
+	struct sway_container_state *state = &con->current;
+	if (!opaque_borders || state->border == B_NONE ||
+			state->border == B_CSD) {
+		return;
+	}
+	if (state->border == B_PIXEL && state->border_top) {
+		opaque_add_border(output, opaque, state->x, state->y,
+			state->width, state->border_thickness);
+	}
+	if (state->border_left) {
+		opaque_add_border(output, opaque, state->x, state->content_y,
+			state->border_thickness, state->content_height);
+	}
+	if (state->border_right) {
+		opaque_add_border(output, opaque,
+			state->content_x + state->content_width, state->content_y,
+			state->border_thickness, state->content_height);
+	}
+	if (state->border_bottom) {
+		opaque_add_border(output, opaque,
+			state->x, state->content_y + state->content_height,
+			state->width, state->border_thickness);
+	}
+}
+
+/**
+ * Walk the scene front to back, recording for each part of it the damage
+ * which is not covered by something opaque drawn later in the frame.
+ */
+static void occlusion_init(struct occlusion *occlusion,
+		struct sway_output *output, struct sway_workspace *workspace,
 		pixman_region32_t *damage) {
+	pixman_region32_init(&occlusion->unmanaged);
+	pixman_region32_init(&occlusion->workspace);
+	pixman_region32_init(&occlusion->background);
+	occlusion->floating = NULL;
+	occlusion->floating_length = 0;
+
+	if (debug.noocclusion) {
+		pixman_region32_copy(&occlusion->unmanaged, damage);
+		pixman_region32_copy(&occlusion->workspace, damage);
+		pixman_region32_copy(&occlusion->background, damage);
+		return;
+	}
+
+	for (int i = 0; i < root->outputs->length; ++i) {
+		struct sway_output *other = root->outputs->items[i];
+		for (int j = 0; j < other->current.workspaces->length; ++j) {
+			struct sway_workspace *ws = other->current.workspaces->items[j];
+			if (workspace_is_visible(ws)) {
+				occlusion->floating_length += ws->current.floating->length;
+			}
+		}
+	}
+	if (occlusion->floating_length > 0) {
+		occlusion->floating = calloc(occlusion->floating_length,
+			sizeof(pixman_region32_t));
+		if (!occlusion->floating) {
+			wlr_log(WLR_ERROR, "Unable to allocate occlusion regions");
+			occlusion->floating_length = 0;
+		}
+	}
+
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+	output_layer_for_each_surface(output,
+		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY],
+		opaque_surface_iterator, &opaque);
+	output_layer_for_each_surface(output,
+		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP],
+		opaque_surface_iterator, &opaque);
+
+	pixman_region32_subtract(&occlusion->unmanaged, damage, &opaque);
+#if HAVE_XWAYLAND
+	output_unmanaged_for_each_surface(output, &root->xwayland_unmanaged,
+		opaque_surface_iterator, &opaque);
+#endif
+
+	// Same order as render_floating, reversed
+	bool opaque_borders = border_colors_opaque();
+	int index = occlusion->floating_length;
+	for (int i = root->outputs->length - 1; i >= 0 && index > 0; --i) {
+		struct sway_output *other = root->outputs->items[i];
+		for (int j = other->current.workspaces->length - 1;
+				j >= 0 && index > 0; --j) {
+			struct sway_workspace *ws = other->current.workspaces->items[j];
+			if (!workspace_is_visible(ws)) {
+				continue;
+			}
+			for (int k = ws->current.floating->length - 1;
+					k >= 0 && index > 0; --k) {
+				struct sway_container *floater = ws->current.floating->items[k];
+				pixman_region32_t *region = &occlusion->floating[--index];
+				pixman_region32_init(region);
+				pixman_region32_subtract(region, damage, &opaque);
+				container_add_opaque(output, &opaque, floater, opaque_borders);
+			}
+		}
+	}
+
+	pixman_region32_subtract(&occlusion->workspace, damage, &opaque);
+	container_children_add_opaque(output, &opaque, workspace->current.layout,
+		workspace->current.tiling, workspace->current.focused_inactive_child,
+		opaque_borders);
+
+	pixman_region32_subtract(&occlusion->background, damage, &opaque);
+	pixman_region32_fini(&opaque);
+}
+
+static void occlusion_finish(struct occlusion *occlusion) {
+	pixman_region32_fini(&occlusion->unmanaged);
+	for (int i = 0; i < occlusion->floating_length; ++i) {
+		pixman_region32_fini(&occlusion->floating[i]);
+	}
+	free(occlusion->floating);
+	pixman_region32_fini(&occlusion->workspace);
+	pixman_region32_fini(&occlusion->background);
+}
+
+static void render_floating(struct sway_output *soutput,
+		pixman_region32_t *damage, struct occlusion *occlusion) {
+	int index = 0;
 	for (int i = 0; i < root->outputs->length; ++i) {
 		struct sway_output *output = root->outputs->items[i];
 		for (int j = 0; j < output->current.workspaces->length; ++j) {
@@ -943,7 +1358,11 @@ static void render_floating(struct sway_output *soutput,
 			}
 			for (int k = 0; k < ws->current.floating->length; ++k) {
 				struct sway_container *floater = ws->current.floating->items[k];
-				render_floating_container(soutput, damage, floater);
+				pixman_region32_t *floater_damage = damage;
+				if (index < occlusion->floating_length) {
+					floater_damage = &occlusion->floating[index++];
+				}
+				render_floating_container(soutput, floater_damage, floater);
 			}
 		}
 	}
@@ -967,8 +1386,23 @@ static void render_dropzones(struct sway_output *output,
 	}
 }
 
+static float region_fraction(pixman_region32_t *region, int width,
+		int height) {
+	if (width <= 0 || height <= 0) {
+		return 0;
+	}
+	int64_t area = 0;
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		area += (int64_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+	}
+	return (float)area / ((int64_t)width * height);
+}
+
 void output_render(struct sway_output *output, struct timespec *when,
-		pixman_region32_t *damage) {
+		pixman_region32_t *damage, struct sway_frame_stats *stats) {
 	struct wlr_output *wlr_output = output->wlr_output;
 
 	struct wlr_renderer *renderer =
@@ -983,7 +1417,16 @@ void output_render(struct sway_output *output, struct timespec *when,
 		return;
 	}
 
+	if (debug.render_stats) {
+		frame_damage = damage;
+		frame_occluded_draws = 0;
+	}
+	frame_texture_draws = 0;
+	frame_rect_draws = 0;
+	frame_clears = 0;
+
 	wlr_renderer_begin(renderer, wlr_output->width, wlr_output->height);
+	rect_batch_begin(wlr_output);
 
 	if (!pixman_region32_not_empty(damage)) {
 		// Output isn't damaged but needs buffer swap
@@ -992,12 +1435,18 @@ void output_render(struct sway_output *output, struct timespec *when,
 
 	if (debug.damage == DAMAGE_HIGHLIGHT) {
 		wlr_renderer_clear(renderer, (float[]){1, 1, 0, 1});
+		++frame_clears;
 	} else if (debug.damage == DAMAGE_RERENDER) {
 		int width, height;
 		wlr_output_transformed_resolution(wlr_output, &width, &height);
 		pixman_region32_union_rect(damage, damage, 0, 0, width, height);
 	}
 
+	int output_width, output_height;
+	wlr_output_transformed_resolution(wlr_output,
+		&output_width, &output_height);
+	stats->damaged = region_fraction(damage, output_width, output_height);
+
 	if (output_has_opaque_overlay_layer_surface(output)) {
 		goto render_overlay;
 	}
@@ -1011,6 +1460,7 @@ void output_render(struct sway_output *output, struct timespec *when,
 		for (int i = 0; i < nrects; ++i) {
 			scissor_output(wlr_output, &rects[i]);
 			wlr_renderer_clear(renderer, clear_color);
+			++frame_clears;
 		}
 
 		// TODO: handle views smaller than the output
@@ -1039,25 +1489,34 @@ void output_render(struct sway_output *output, struct timespec *when,
 	} else {
 		float clear_color[] = {0.25f, 0.25f, 0.25f, 1.0f};
 
+		struct occlusion occlusion;
+		occlusion_init(&occlusion, output, workspace, damage);
+
 		int nrects;
-		pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+		pixman_box32_t *rects =
+			pixman_region32_rectangles(&occlusion.background, &nrects);
 		for (int i = 0; i < nrects; ++i) {
 			scissor_output(wlr_output, &rects[i]);
 			wlr_renderer_clear(renderer, clear_color);
+			++frame_clears;
 		}
 
-		render_layer(output, damage,
+		render_layer(output, &occlusion.background,
 			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
-		render_layer(output, damage,
+		render_layer(output, &occlusion.background,
 			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM]);
 
-		render_workspace(output, damage, workspace, workspace->current.focused);
-		render_floating(output, damage);
+		render_workspace(output, &occlusion.workspace, workspace,
+			workspace->current.focused);
+		render_floating(output, damage, &occlusion);
 #if HAVE_XWAYLAND
-		render_unmanaged(output, damage, &root->xwayland_unmanaged);
+		render_unmanaged(output, &occlusion.unmanaged,
+			&root->xwayland_unmanaged);
 #endif
 		render_layer(output, damage,
 			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
+
+		occlusion_finish(&occlusion);
 	}
 
 	render_dropzones(output, damage);
@@ -1074,6 +1533,8 @@ render_overlay:
 	render_drag_icons(output, damage, &root->drag_icons);
 
 renderer_end:
+	rect_batch_end();
+
 	if (debug.render_tree) {
 		wlr_renderer_scissor(renderer, NULL);
 		wlr_render_texture(renderer, root->debug_tree,
@@ -1084,6 +1545,17 @@ renderer_end:
 	wlr_output_render_software_cursors(wlr_output, damage);
 	wlr_renderer_end(renderer);
 
+	stats->texture_draws = frame_texture_draws;
+	stats->rect_draws = frame_rect_draws;
+
+	if (frame_damage) {
+		wlr_log(WLR_DEBUG, "Rendered frame on %s: %d draw calls, "
+			"%zu draws occluded", wlr_output->name,
+			frame_clears + frame_texture_draws + frame_rect_draws,
+			frame_occluded_draws);
+		frame_damage = NULL;
+	}
+
 	int width, height;
 	wlr_output_transformed_resolution(wlr_output, &width, &height);
 
@@ -0,0 +1,381 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-server.h>
+#include "cairo.h"
+#include "pango.h"
+#include "sway/config.h"
+#include "sway/desktop/atlas.h"
+#include "sway/desktop/text_texture.h"
+#include "sway/input/input-manager.h"
+#include "sway/input/seat.h"
+#include "sway/output.h"
+#include "sway/tree/container.h"
+#include "sway/tree/root.h"
+#include "sway/tree/workspace.h"
+#include "list.h"
+#include "log.h"
+
+// How many textures which nothing uses are kept for later reuse
+#define TEXT_TEXTURE_UNUSED_MAX 128
+// Text drawn more recently than this is never evicted, so that the budget
+// can't make sway rasterise what is on screen over and over
+#define TEXT_TEXTURE_EVICT_AGE_MS 3000
+// How often the budget is checked
+#define TEXT_TEXTURE_BUDGET_INTERVAL_MS 1000
+
+static struct {
+	list_t *all; // struct sway_text_texture *
+	struct wl_list unused; // struct sway_text_texture::link, newest first
+	int unused_length;
+	uint64_t evictions;
+	uint32_t last_budget_check;
+} text_textures;
+
+static uint32_t timespec_to_msec(const struct timespec *t) {
+	return t->tv_sec * 1000 + t->tv_nsec / 1000000;
+}
+
+static uint32_t get_current_time_msec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_msec(&now);
+}
+
+static uint32_t hash_string(uint32_t hash, const char *str) {
+	// FNV-1a
+	for (; *str; ++str) {
+		hash ^= (uint8_t)*str;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static uint32_t key_hash(const struct sway_text_texture_key *key) {
+	return hash_string(hash_string(2166136261u, key->font), key->text);
+}
+
+static bool keys_equal(const struct sway_text_texture_key *a,
+		const struct sway_text_texture_key *b) {
+	return a->scale == b->scale && a->height == b->height &&
+		a->subpixel == b->subpixel && a->markup == b->markup &&
+		a->subpixel_antialias == b->subpixel_antialias &&
+		a->renderer == b->renderer &&
+		memcmp(a->foreground, b->foreground, sizeof(a->foreground)) == 0 &&
+		memcmp(a->background, b->background, sizeof(a->background)) == 0 &&
+		strcmp(a->text, b->text) == 0 && strcmp(a->font, b->font) == 0;
+}
+
+static bool key_copy(struct sway_text_texture_key *dest,
+		const struct sway_text_texture_key *src) {
+	char *text = strdup(src->text);
+	char *font = strdup(src->font);
+	if (!text || !font) {
+		free(text);
+		free(font);
+		return false;
+	}
+	free((char *)dest->text);
+	free((char *)dest->font);
+	*dest = *src;
+	dest->text = text;
+	dest->font = font;
+	return true;
+}
+
+static bool texture_rasterise(struct sway_text_texture *texture) {
+	struct sway_text_texture_key *key = &texture->key;
+
+	cairo_font_options_t *fo = NULL;
+	if (key->subpixel_antialias) {
+		fo = cairo_font_options_create();
+		cairo_font_options_set_hint_style(fo, CAIRO_HINT_STYLE_FULL);
+		cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_SUBPIXEL);
+		cairo_font_options_set_subpixel_order(fo,
+				to_cairo_subpixel_order(key->subpixel));
+	}
+
+	// We must use a non-nil cairo_t for cairo_set_font_options to work.
+	// Therefore, we cannot use cairo_create(NULL).
+	int width = 0;
+	cairo_surface_t *dummy_surface = cairo_image_surface_create(
+			CAIRO_FORMAT_ARGB32, 0, 0);
+	cairo_t *c = cairo_create(dummy_surface);
+	cairo_set_antialias(c, CAIRO_ANTIALIAS_BEST);
+	if (fo) {
+		cairo_set_font_options(c, fo);
+	}
+	get_text_size(c, key->font, &width, NULL, NULL, key->scale,
+			key->markup, "%s", key->text);
+	cairo_surface_destroy(dummy_surface);
+	cairo_destroy(c);
+
+	cairo_surface_t *surface = cairo_image_surface_create(
+			CAIRO_FORMAT_ARGB32, width, key->height);
+	cairo_t *cairo = cairo_create(surface);
+	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+	if (fo) {
+		cairo_set_font_options(cairo, fo);
+		cairo_font_options_destroy(fo);
+	}
+	cairo_set_source_rgba(cairo, key->background[0], key->background[1],
+			key->background[2], key->background[3]);
+	cairo_paint(cairo);
+	cairo_set_source_rgba(cairo, key->foreground[0], key->foreground[1],
+			key->foreground[2], key->foreground[3]);
+	cairo_move_to(cairo, 0, 0);
+
+	pango_printf(cairo, key->font, key->scale, key->markup,
+			"%s", key->text);
+
+	cairo_surface_flush(surface);
+	unsigned char *data = cairo_image_surface_get_data(surface);
+	int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+	atlas_image_update(&texture->image, key->renderer, key->scale,
+			stride, width, key->height, data);
+	cairo_surface_destroy(surface);
+	cairo_destroy(cairo);
+
+	texture->last_rendered = get_current_time_msec();
+	return texture->image != NULL;
+}
+
+static void texture_destroy(struct sway_text_texture *texture) {
+	int index = list_find(text_textures.all, texture);
+	if (index != -1) {
+		list_del(text_textures.all, index);
+	}
+	atlas_image_destroy(texture->image);
+	free((char *)texture->key.text);
+	free((char *)texture->key.font);
+	free(texture);
+}
+
+static void texture_unuse(struct sway_text_texture *texture) {
+	wl_list_remove(&texture->link);
+	wl_list_init(&texture->link);
+	--text_textures.unused_length;
+}
+
+void text_texture_release(struct sway_text_texture *texture) {
+	if (!texture || --texture->refs > 0) {
+		return;
+	}
+	wl_list_insert(&text_textures.unused, &texture->link);
+	++text_textures.unused_length;
+
+	while (text_textures.unused_length > TEXT_TEXTURE_UNUSED_MAX) {
+		struct sway_text_texture *oldest =
+			wl_container_of(text_textures.unused.prev, oldest, link);
+		texture_unuse(oldest);
+		texture_destroy(oldest);
+	}
+}
+
+static struct sway_text_texture *texture_find(
+		const struct sway_text_texture_key *key, uint32_t hash) {
+	for (int i = 0; text_textures.all && i < text_textures.all->length; ++i) {
+		struct sway_text_texture *cached = text_textures.all->items[i];
+		// Most entries differ in their text, which the hash rules out
+		if (cached->hash == hash && keys_equal(&cached->key, key)) {
+			return cached;
+		}
+	}
+	return NULL;
+}
+
+void text_texture_update(struct sway_text_texture **_texture,
+		const struct sway_text_texture_key *key) {
+	struct sway_text_texture *texture = *_texture;
+	if (texture && keys_equal(&texture->key, key)) {
+		return;
+	}
+
+	uint32_t hash = key_hash(key);
+	struct sway_text_texture *cached = texture_find(key, hash);
+	if (cached) {
+		if (cached->refs++ == 0) {
+			texture_unuse(cached);
+		}
+		text_texture_release(texture);
+		*_texture = cached;
+		return;
+	}
+
+	if (!texture || texture->refs > 1) {
+		// Someone else still shows the old text
+		text_texture_release(texture);
+		texture = *_texture = calloc(1, sizeof(struct sway_text_texture));
+		if (!texture) {
+			wlr_log(WLR_ERROR, "Unable to allocate text texture");
+			return;
+		}
+		texture->refs = 1;
+		wl_list_init(&texture->link);
+		if (!text_textures.all) {
+			text_textures.all = create_list();
+			wl_list_init(&text_textures.unused);
+		}
+		list_add(text_textures.all, texture);
+	}
+
+	texture->hash = hash;
+	if (!key_copy(&texture->key, key) || !texture_rasterise(texture)) {
+		texture_destroy(texture);
+		*_texture = NULL;
+	}
+}
+
+struct sway_atlas_image *text_texture_get_image(
+		struct sway_text_texture *texture) {
+	if (!texture) {
+		return NULL;
+	}
+	if (!texture->image) {
+		if (!texture_rasterise(texture)) {
+			return NULL;
+		}
+		wlr_log(WLR_DEBUG, "Rasterised evicted text texture %p again",
+				texture);
+	}
+	texture->last_rendered = get_current_time_msec();
+	return texture->image;
+}
+
+/**
+ * Whether the container's titlebar is drawn on its workspace. A container in
+ * an inactive tab or stack still shows its own title, but nothing inside it is
+ * drawn.
+ */
+static bool container_title_is_shown(struct sway_container *con) {
+	struct sway_seat *seat = input_manager_current_seat();
+	for (struct sway_container *ancestor = con->parent; ancestor;
+			ancestor = ancestor->parent) {
+		enum sway_container_layout layout = container_parent_layout(ancestor);
+		if ((layout == L_TABBED || layout == L_STACKED)
+				&& !container_is_floating(ancestor)) {
+			struct sway_node *parent = ancestor->parent ?
+				&ancestor->parent->node : &ancestor->workspace->node;
+			if (seat_get_active_tiling_child(seat, parent) != &ancestor->node) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void mark_visible(struct sway_container *con, void *data) {
+	if (!container_title_is_shown(con)) {
+		return;
+	}
+	struct sway_text_texture *textures[] = {
+		con->title_focused, con->title_focused_inactive,
+		con->title_unfocused, con->title_urgent,
+		con->marks_focused, con->marks_focused_inactive,
+		con->marks_unfocused, con->marks_urgent,
+	};
+	for (size_t i = 0; i < sizeof(textures) / sizeof(textures[0]); ++i) {
+		if (textures[i]) {
+			textures[i]->visible = true;
+		}
+	}
+}
+
+/**
+ * Mark the text of every container whose titlebar is on screen. Outputs only
+ * draw it again when it is damaged, so its age says nothing about whether it
+ * is still visible.
+ */
+static void mark_visible_textures(void) {
+	for (int i = 0; i < text_textures.all->length; ++i) {
+		struct sway_text_texture *texture = text_textures.all->items[i];
+		texture->visible = false;
+	}
+	for (int i = 0; i < root->outputs->length; ++i) {
+		struct sway_output *output = root->outputs->items[i];
+		struct sway_workspace *ws = output_get_active_workspace(output);
+		if (ws) {
+			workspace_for_each_container(ws, mark_visible, NULL);
+		}
+	}
+}
+
+static int compare_last_rendered(const void *_a, const void *_b) {
+	struct sway_text_texture *a = *(struct sway_text_texture **)_a;
+	struct sway_text_texture *b = *(struct sway_text_texture **)_b;
+	// Compare the ages, so that wrapping around is harmless
+	uint32_t now = text_textures.last_budget_check;
+	uint32_t age_a = now - a->last_rendered;
+	uint32_t age_b = now - b->last_rendered;
+	return age_a > age_b ? -1 : age_a < age_b ? 1 : 0;
+}
+
+void text_texture_enforce_budget(const struct timespec *now) {
+	uint32_t now_msec = timespec_to_msec(now);
+	if (!config->texture_budget || !text_textures.all ||
+			now_msec - text_textures.last_budget_check <
+				TEXT_TEXTURE_BUDGET_INTERVAL_MS) {
+		return;
+	}
+	text_textures.last_budget_check = now_msec;
+
+	// The budget is measured in the images' own bytes. Pages are shared, so
+	// evicting a single image rarely frees one.
+	struct sway_atlas_usage usage;
+	atlas_get_usage(&usage);
+	if (usage.image_bytes <= config->texture_budget) {
+		return;
+	}
+
+	mark_visible_textures();
+	list_t *candidates = create_list();
+	for (int i = 0; i < text_textures.all->length; ++i) {
+		struct sway_text_texture *texture = text_textures.all->items[i];
+		if (texture->image && !texture->visible &&
+				now_msec - texture->last_rendered >=
+					TEXT_TEXTURE_EVICT_AGE_MS) {
+			list_add(candidates, texture);
+		}
+	}
+	list_qsort(candidates, compare_last_rendered);
+
+	int evicted = 0;
+	for (int i = 0; i < candidates->length &&
+			usage.image_bytes > config->texture_budget; ++i) {
+		struct sway_text_texture *texture = candidates->items[i];
+		if (texture->refs == 0) {
+			// Nobody would draw it again
+			texture_unuse(texture);
+			texture_destroy(texture);
+		} else {
+			atlas_image_destroy(texture->image);
+			texture->image = NULL;
+		}
+		++text_textures.evictions;
+		++evicted;
+		atlas_get_usage(&usage);
+	}
+	list_free(candidates);
+
+	if (evicted) {
+		// Don't keep a page which the evictions emptied
+		atlas_trim();
+		atlas_get_usage(&usage);
+		wlr_log(WLR_DEBUG, "Evicted %d text textures, %zu bytes of texture "
+				"memory in use", evicted, usage.bytes);
+	}
+}
+
+void text_texture_get_stats(struct sway_text_texture_stats *stats) {
+	stats->textures = 0;
+	stats->evicted = 0;
+	for (int i = 0; text_textures.all && i < text_textures.all->length; ++i) {
+		struct sway_text_texture *texture = text_textures.all->items[i];
+		++stats->textures;
+		if (!texture->image) {
+			++stats->evicted;
+		}
+	}
+	stats->unused = text_textures.unused_length;
+	stats->evictions = text_textures.evictions;
+}
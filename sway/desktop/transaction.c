@@ -13,7 +13,9 @@
 #include "sway/desktop/transaction.h"
 #include "sway/input/cursor.h"
 #include "sway/input/input-manager.h"
+#include "sway/ipc-json.h"
 #include "sway/output.h"
+#include "sway/tree/arrange.h"
 #include "sway/tree/container.h"
 #include "sway/tree/node.h"
 #include "sway/tree/view.h"
@@ -191,29 +193,210 @@ static void transaction_add_node(struct sway_transaction *transaction,
 	node->ntxnrefs++;
 }
 
+static bool lists_equal(list_t *a, list_t *b) {
+	int a_length = a ? a->length : 0;
+	int b_length = b ? b->length : 0;
+	if (a_length != b_length) {
+		return false;
+	}
+	for (int i = 0; i < a_length; ++i) {
+		if (a->items[i] != b->items[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Damage the titlebar and borders of a view's container, which is everything
+ * in its box except the content area.
+ */
+static void damage_container_frame(struct sway_container *con) {
+	struct sway_container_state *state = &con->current;
+	double content_right = state->content_x + state->content_width;
+	double content_bottom = state->content_y + state->content_height;
+	struct wlr_box strips[] = {
+		{ // Top, including the titlebar
+			.x = state->x,
+			.y = state->y,
+			.width = state->width,
+			.height = state->content_y - state->y,
+		},
+		{ // Bottom
+			.x = state->x,
+			.y = content_bottom,
+			.width = state->width,
+			.height = state->y + state->height - content_bottom,
+		},
+		{ // Left
+			.x = state->x,
+			.y = state->content_y,
+			.width = state->content_x - state->x,
+			.height = state->content_height,
+		},
+		{ // Right
+			.x = content_right,
+			.y = state->content_y,
+			.width = state->x + state->width - content_right,
+			.height = state->content_height,
+		},
+	};
+	for (size_t i = 0; i < sizeof(strips) / sizeof(strips[0]); ++i) {
+		if (strips[i].width <= 0 || strips[i].height <= 0) {
+			continue;
+		}
+		// Pad by 1px, because the edges are doubles and might be fractions
+		strips[i].x -= 1;
+		strips[i].y -= 1;
+		strips[i].width += 2;
+		strips[i].height += 2;
+		desktop_damage_box(&strips[i]);
+	}
+}
+
+/**
+ * Damage what changes when a different child of a container becomes the
+ * active one. Tabs and stacks show a different child entirely, other layouts
+ * only change the colour of the two childrens' frames.
+ */
+static void damage_active_child(enum sway_container_layout layout,
+		struct wlr_box *box, struct sway_container *old_child,
+		struct sway_container *new_child) {
+	if (layout == L_TABBED || layout == L_STACKED) {
+		desktop_damage_box(box);
+		return;
+	}
+	struct sway_container *children[] = { old_child, new_child };
+	for (size_t i = 0; i < 2; ++i) {
+		struct sway_container *child = children[i];
+		if (!child) {
+			continue;
+		}
+		if (child->view) {
+			damage_container_frame(child);
+		} else {
+			desktop_damage_whole_container(child);
+		}
+	}
+}
+
 static void apply_output_state(struct sway_output *output,
 		struct sway_output_state *state) {
-	output_damage_whole(output);
+	// The workspaces list only matters for the active workspace, whose own
+	// changes are damaged when its state is applied
+	bool switched = output->current.active_workspace != state->active_workspace;
 	list_free(output->current.workspaces);
 	memcpy(&output->current, state, sizeof(struct sway_output_state));
-	output_damage_whole(output);
+	if (switched || output->node.destroying) {
+		output_damage_whole(output);
+	}
 }
 
 static void apply_workspace_state(struct sway_workspace *ws,
 		struct sway_workspace_state *state) {
-	output_damage_whole(ws->current.output);
+	struct sway_workspace_state *old = &ws->current;
+	bool whole = ws->node.destroying || old->output != state->output ||
+		old->fullscreen != state->fullscreen ||
+		old->x != state->x || old->y != state->y ||
+		old->width != state->width || old->height != state->height ||
+		old->layout != state->layout || old->focused != state->focused;
+	if (whole) {
+		if (old->output) {
+			output_damage_whole(old->output);
+		}
+		list_free(ws->current.floating);
+		list_free(ws->current.tiling);
+		memcpy(&ws->current, state, sizeof(struct sway_workspace_state));
+		if (ws->current.output) {
+			output_damage_whole(ws->current.output);
+		}
+		return;
+	}
+
+	struct wlr_box box = {
+		.x = state->x,
+		.y = state->y,
+		.width = state->width,
+		.height = state->height,
+	};
+	if (!lists_equal(old->tiling, state->tiling)) {
+		// Tabs are resized and the indicator border depends on the number of
+		// siblings. Children which moved damage themselves.
+		if (state->layout == L_TABBED || state->layout == L_STACKED) {
+			desktop_damage_box(&box);
+		} else {
+			for (int i = 0; i < state->tiling->length; ++i) {
+				struct sway_container *child = state->tiling->items[i];
+				if (child->view) {
+					damage_container_frame(child);
+				}
+			}
+		}
+	} else if (old->focused_inactive_child != state->focused_inactive_child) {
+		damage_active_child(state->layout, &box,
+			old->focused_inactive_child, state->focused_inactive_child);
+	}
+
+	// Raising a floating container changes the stacking order without
+	// changing its state
+	int old_floating_length = old->floating ? old->floating->length : 0;
+	for (int i = 0; i < state->floating->length; ++i) {
+		struct sway_container *floater = state->floating->items[i];
+		if (i >= old_floating_length || old->floating->items[i] != floater) {
+			desktop_damage_whole_container(floater);
+		}
+	}
+
 	list_free(ws->current.floating);
 	list_free(ws->current.tiling);
 	memcpy(&ws->current, state, sizeof(struct sway_workspace_state));
-	output_damage_whole(ws->current.output);
 }
 
-static void apply_container_state(struct sway_container *container,
+/**
+ * Return true if anything which decides where a container and its borders are
+ * drawn has changed.
+ */
+static bool container_state_moved(struct sway_container_state *old,
 		struct sway_container_state *state) {
+	return old->x != state->x || old->y != state->y ||
+		old->width != state->width || old->height != state->height ||
+		old->content_x != state->content_x ||
+		old->content_y != state->content_y ||
+		old->content_width != state->content_width ||
+		old->content_height != state->content_height ||
+		old->is_fullscreen != state->is_fullscreen ||
+		old->workspace != state->workspace ||
+		old->parent != state->parent ||
+		old->border != state->border ||
+		old->border_thickness != state->border_thickness ||
+		old->border_top != state->border_top ||
+		old->border_bottom != state->border_bottom ||
+		old->border_left != state->border_left ||
+		old->border_right != state->border_right;
+}
+
+/**
+ * Return true if the view's surface shows something other than the buffer
+ * which was saved when the transaction was committed. The saved buffer holds
+ * a reference, so a newly attached buffer is always a different object.
+ */
+static bool view_saved_buffer_outdated(struct sway_view *view) {
+	if (!view->saved_buffer || !view->surface) {
+		return true;
+	}
+	struct wlr_surface *surface = view->surface;
+	// Subsurfaces aren't drawn while a saved buffer is shown
+	return view->saved_buffer != surface->buffer ||
+		view->saved_buffer_width != surface->current.width ||
+		view->saved_buffer_height != surface->current.height ||
+		memcmp(&view->saved_geometry, &view->geometry,
+			sizeof(struct wlr_box)) != 0 ||
+		!wl_list_empty(&surface->subsurfaces);
+}
+
+static void damage_view_content(struct sway_container *container) {
 	struct sway_view *view = container->view;
-	// Damage the old location
-	desktop_damage_whole_container(container);
-	if (view && view->saved_buffer) {
+	if (view->saved_buffer) {
 		struct wlr_box box = {
 			.x = container->current.content_x - view->saved_geometry.x,
 			.y = container->current.content_y - view->saved_geometry.y,
@@ -222,6 +405,39 @@ static void apply_container_state(struct sway_container *container,
 		};
 		desktop_damage_box(&box);
 	}
+	if (view->surface) {
+		struct wlr_surface *surface = view->surface;
+		struct wlr_box box = {
+			.x = container->current.content_x - view->geometry.x,
+			.y = container->current.content_y - view->geometry.y,
+			.width = surface->current.width,
+			.height = surface->current.height,
+		};
+		desktop_damage_box(&box);
+	}
+}
+
+static void apply_container_state(struct sway_container *container,
+		struct sway_container_state *state) {
+	struct sway_view *view = container->view;
+	struct sway_container_state *old = &container->current;
+	bool moved = container->node.destroying ||
+		container_state_moved(old, state);
+	bool content_changed = view && view_saved_buffer_outdated(view);
+	bool children_changed = old->layout != state->layout ||
+		!lists_equal(old->children, state->children);
+	bool focus_changed = old->focused != state->focused;
+	struct sway_container *old_active_child = old->focused_inactive_child;
+
+	if (moved) {
+		// Damage the old location
+		desktop_damage_whole_container(container);
+		if (view) {
+			damage_view_content(container);
+		}
+	} else if (content_changed) {
+		damage_view_content(container);
+	}
 
 	// There are separate children lists for each instruction state, the
 	// container's current state and the container's pending state
@@ -238,17 +454,28 @@ static void apply_container_state(struct sway_container *container,
 		}
 	}
 
-	// Damage the new location
-	desktop_damage_whole_container(container);
-	if (view && view->surface) {
-		struct wlr_surface *surface = view->surface;
-		struct wlr_box box = {
-			.x = container->current.content_x - view->geometry.x,
-			.y = container->current.content_y - view->geometry.y,
-			.width = surface->current.width,
-			.height = surface->current.height,
-		};
-		desktop_damage_box(&box);
+	// Damage the new location, or whatever changed in place
+	struct wlr_box box = {
+		.x = state->x,
+		.y = state->y,
+		.width = state->width,
+		.height = state->height,
+	};
+	if (moved) {
+		desktop_damage_whole_container(container);
+		if (view) {
+			damage_view_content(container);
+		}
+	} else if (view) {
+		if (focus_changed) {
+			damage_container_frame(container);
+		}
+	} else if (children_changed || focus_changed) {
+		// Focus is passed down to every descendant's colours
+		desktop_damage_whole_container(container);
+	} else if (old_active_child != state->focused_inactive_child) {
+		damage_active_child(state->layout, &box,
+			old_active_child, state->focused_inactive_child);
 	}
 
 	if (!container->node.destroying) {
@@ -261,6 +488,8 @@ static void apply_container_state(struct sway_container *container,
  */
 static void transaction_apply(struct sway_transaction *transaction) {
 	wlr_log(WLR_DEBUG, "Applying transaction %p", transaction);
+	timing_add(&server.timings.transaction_latency,
+			timing_since(&transaction->commit_time));
 	if (debug.txn_timings) {
 		struct timespec now;
 		clock_gettime(CLOCK_MONOTONIC, &now);
@@ -293,6 +522,7 @@ static void transaction_apply(struct sway_transaction *transaction) {
 			break;
 		}
 
+		ipc_json_invalidate_node(node);
 		node->instruction = NULL;
 	}
 
@@ -430,9 +660,7 @@ static void transaction_commit(struct sway_transaction *transaction) {
 		node->instruction = instruction;
 	}
 	transaction->num_configures = transaction->num_waiting;
-	if (debug.txn_timings) {
-		clock_gettime(CLOCK_MONOTONIC, &transaction->commit_time);
-	}
+	clock_gettime(CLOCK_MONOTONIC, &transaction->commit_time);
 	if (debug.noatomic) {
 		transaction->num_waiting = 0;
 	} else if (debug.txn_wait) {
@@ -509,6 +737,8 @@ void transaction_notify_view_ready_by_size(struct sway_view *view,
 }
 
 void transaction_commit_dirty(void) {
+	// Whatever made a hidden workspace visible doesn't necessarily arrange it
+	arrange_stale_workspaces();
 	if (!server.dirty_nodes->length) {
 		return;
 	}
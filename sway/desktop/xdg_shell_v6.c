@@ -11,6 +11,7 @@
 #include "sway/input/cursor.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
+#include "sway/ipc-json.h"
 #include "sway/output.h"
 #include "sway/server.h"
 #include "sway/tree/arrange.h"
@@ -314,6 +315,7 @@ static void handle_set_app_id(struct wl_listener *listener, void *data) {
 	struct sway_xdg_shell_v6_view *xdg_shell_v6_view =
 		wl_container_of(listener, xdg_shell_v6_view, set_app_id);
 	struct sway_view *view = &xdg_shell_v6_view->view;
+	ipc_json_invalidate_node(&view->container->node);
 	view_execute_criteria(view);
 }
 
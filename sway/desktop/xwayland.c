@@ -11,6 +11,7 @@
 #include "sway/input/cursor.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
+#include "sway/ipc-json.h"
 #include "sway/output.h"
 #include "sway/server.h"
 #include "sway/tree/arrange.h"
@@ -523,6 +524,7 @@ static void handle_set_class(struct wl_listener *listener, void *data) {
 	if (!xsurface->mapped) {
 		return;
 	}
+	ipc_json_invalidate_node(&view->container->node);
 	view_execute_criteria(view);
 }
 
@@ -534,6 +536,7 @@ static void handle_set_role(struct wl_listener *listener, void *data) {
 	if (!xsurface->mapped) {
 		return;
 	}
+	ipc_json_invalidate_node(&view->container->node);
 	view_execute_criteria(view);
 }
 
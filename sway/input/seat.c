@@ -15,6 +15,7 @@
 #include "sway/input/input-manager.h"
 #include "sway/input/keyboard.h"
 #include "sway/input/seat.h"
+#include "sway/ipc-json.h"
 #include "sway/ipc-server.h"
 #include "sway/layers.h"
 #include "sway/output.h"
@@ -652,6 +653,12 @@ void seat_set_raw_focus(struct sway_seat *seat, struct sway_node *node) {
 	wl_list_insert(&seat->focus_stack, &seat_node->link);
 	node_set_dirty(node);
 	node_set_dirty(node_get_parent(node));
+
+	// The focus order of every ancestor has changed
+	for (struct sway_node *parent = node_get_parent(node); parent;
+			parent = node_get_parent(parent)) {
+		ipc_json_invalidate_node(parent);
+	}
 }
 
 void seat_set_focus(struct sway_seat *seat, struct sway_node *node) {
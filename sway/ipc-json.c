@@ -1,14 +1,21 @@
+#define _POSIX_C_SOURCE 200809L
 #include <json-c/json.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include "config.h"
+#include "ipc-encoding.h"
 #include "log.h"
 #include "sway/config.h"
+#include "sway/desktop/atlas.h"
+#include "sway/desktop/text_texture.h"
 #include "sway/ipc-json.h"
 #include "sway/tree/container.h"
 #include "sway/tree/view.h"
 #include "sway/tree/workspace.h"
 #include "sway/output.h"
+#include "sway/server.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
 #include <wlr/types/wlr_box.h>
@@ -134,14 +141,13 @@ static json_object *ipc_json_create_empty_rect(void) {
 }
 
 static json_object *ipc_json_create_node(int id, char *name,
-		bool focused, json_object *focus, struct wlr_box *box) {
+		json_object *focus, struct wlr_box *box) {
 	json_object *object = json_object_new_object();
 
 	json_object_object_add(object, "id", json_object_new_int(id));
 	json_object_object_add(object, "name",
 			name ? json_object_new_string(name) : NULL);
 	json_object_object_add(object, "rect", ipc_json_create_rect(box));
-	json_object_object_add(object, "focused", json_object_new_boolean(focused));
 	json_object_object_add(object, "focus", focus);
 
 	// set default values to be compatible with i3
@@ -162,7 +168,6 @@ static json_object *ipc_json_create_node(int id, char *name,
 	json_object_object_add(object, "geometry", ipc_json_create_empty_rect());
 	json_object_object_add(object, "window", NULL);
 	json_object_object_add(object, "urgent", json_object_new_boolean(false));
-	json_object_object_add(object, "floating_nodes", json_object_new_array());
 	json_object_object_add(object, "sticky", json_object_new_boolean(false));
 
 	return object;
@@ -236,6 +241,126 @@ static void ipc_json_describe_output(struct sway_output *output,
 	}
 }
 
+static int compare_doubles(const void *_a, const void *_b) {
+	double a = *(const double *)_a, b = *(const double *)_b;
+	return (a > b) - (a < b);
+}
+
+/**
+ * Summarise samples with percentiles and a histogram. Each bucket counts the
+ * samples up to and including its bound, and the final bucket counts the
+ * samples above every bound. The samples are sorted in place.
+ */
+static json_object *describe_distribution(double *values, int count,
+		const double *bounds, int bounds_length) {
+	json_object *object = json_object_new_object();
+	json_object_object_add(object, "count", json_object_new_int(count));
+	if (count == 0) {
+		return object;
+	}
+	qsort(values, count, sizeof(double), compare_doubles);
+
+	double sum = 0;
+	for (int i = 0; i < count; ++i) {
+		sum += values[i];
+	}
+	json_object_object_add(object, "min", json_object_new_double(values[0]));
+	json_object_object_add(object, "mean",
+			json_object_new_double(sum / count));
+	const struct {
+		const char *name;
+		int percent;
+	} percentiles[] = { { "p50", 50 }, { "p90", 90 }, { "p99", 99 } };
+	for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+		int rank = (count * percentiles[i].percent + 99) / 100;
+		json_object_object_add(object, percentiles[i].name,
+				json_object_new_double(values[rank > 0 ? rank - 1 : 0]));
+	}
+	json_object_object_add(object, "max",
+			json_object_new_double(values[count - 1]));
+
+	json_object *bounds_array = json_object_new_array();
+	json_object *counts = json_object_new_array();
+	int i = 0;
+	for (int bucket = 0; bucket <= bounds_length; ++bucket) {
+		int in_bucket = 0;
+		while (i < count && (bucket == bounds_length ||
+					values[i] <= bounds[bucket])) {
+			++in_bucket;
+			++i;
+		}
+		if (bucket < bounds_length) {
+			json_object_array_add(bounds_array,
+					json_object_new_double(bounds[bucket]));
+		}
+		json_object_array_add(counts, json_object_new_int(in_bucket));
+	}
+	json_object *histogram = json_object_new_object();
+	json_object_object_add(histogram, "bounds", bounds_array);
+	json_object_object_add(histogram, "counts", counts);
+	json_object_object_add(object, "histogram", histogram);
+	return object;
+}
+
+json_object *ipc_json_describe_render_stats(struct sway_output *output) {
+	struct sway_render_stats *stats = &output->render_stats;
+
+	json_object *object = json_object_new_object();
+	json_object_object_add(object, "name",
+			json_object_new_string(output->wlr_output->name));
+	json_object_object_add(object, "frames_rendered",
+			json_object_new_int64(stats->rendered));
+	json_object_object_add(object, "frames_skipped",
+			json_object_new_int64(stats->skipped));
+
+	int count = stats->frames_length;
+	double *values = malloc(sizeof(double) * (count ? count : 1));
+	if (!values) {
+		wlr_log(WLR_ERROR, "Unable to allocate render statistics");
+		return object;
+	}
+
+	static const double cpu_bounds[] = {
+		250, 500, 1000, 2000, 4000, 8000, 16000, 32000,
+	};
+	for (int i = 0; i < count; ++i) {
+		values[i] = stats->frames[i].cpu_nsec / 1000.0;
+	}
+	json_object_object_add(object, "cpu_time_us", describe_distribution(
+			values, count, cpu_bounds, sizeof(cpu_bounds) / sizeof(double)));
+
+	static const double draw_bounds[] = { 1, 4, 16, 64, 256, 1024, 4096 };
+	for (int i = 0; i < count; ++i) {
+		values[i] = stats->frames[i].texture_draws;
+	}
+	json_object_object_add(object, "texture_draws", describe_distribution(
+			values, count, draw_bounds, sizeof(draw_bounds) / sizeof(double)));
+	for (int i = 0; i < count; ++i) {
+		values[i] = stats->frames[i].rect_draws;
+	}
+	json_object_object_add(object, "rect_draws", describe_distribution(
+			values, count, draw_bounds, sizeof(draw_bounds) / sizeof(double)));
+
+	static const double damage_bounds[] = { 0.01, 0.05, 0.1, 0.25, 0.5, 0.75 };
+	for (int i = 0; i < count; ++i) {
+		values[i] = stats->frames[i].damaged;
+	}
+	json_object_object_add(object, "damaged_fraction", describe_distribution(
+			values, count, damage_bounds,
+			sizeof(damage_bounds) / sizeof(double)));
+
+	static const double frame_done_bounds[] = { 0, 1, 2, 4, 8, 16, 32 };
+	for (int i = 0; i < count; ++i) {
+		values[i] = stats->frames[i].frame_done;
+	}
+	json_object_object_add(object, "frame_done", describe_distribution(
+			values, count, frame_done_bounds,
+			sizeof(frame_done_bounds) / sizeof(double)));
+
+	free(values);
+	return object;
+}
+
 json_object *ipc_json_describe_disabled_output(struct sway_output *output) {
 	struct wlr_output *wlr_output = output->wlr_output;
 
@@ -258,52 +383,6 @@ json_object *ipc_json_describe_disabled_output(struct sway_output *output) {
 	return object;
 }
 
-static json_object *ipc_json_describe_scratchpad_output(void) {
-	struct wlr_box box;
-	root_get_box(root, &box);
-
-	// Create focus stack for __i3_scratch workspace
-	json_object *workspace_focus = json_object_new_array();
-	for (int i = root->scratchpad->length - 1; i >= 0; --i) {
-		struct sway_container *container = root->scratchpad->items[i];
-		json_object_array_add(workspace_focus,
-				json_object_new_int(container->node.id));
-	}
-
-	json_object *workspace = ipc_json_create_node(i3_scratch_id,
-				"__i3_scratch", false, workspace_focus, &box);
-	json_object_object_add(workspace, "type",
-			json_object_new_string("workspace"));
-
-	// List all hidden scratchpad containers as floating nodes
-	json_object *floating_array = json_object_new_array();
-	for (int i = 0; i < root->scratchpad->length; ++i) {
-		struct sway_container *container = root->scratchpad->items[i];
-		if (!container->workspace) {
-			json_object_array_add(floating_array,
-				ipc_json_describe_node_recursive(&container->node));
-		}
-	}
-	json_object_object_add(workspace, "floating_nodes", floating_array);
-
-	// Create focus stack for __i3 output
-	json_object *output_focus = json_object_new_array();
-	json_object_array_add(output_focus, json_object_new_int(i3_scratch_id));
-
-	json_object *output = ipc_json_create_node(i3_output_id,
-					"__i3", false, output_focus, &box);
-	json_object_object_add(output, "type",
-			json_object_new_string("output"));
-	json_object_object_add(output, "layout",
-			json_object_new_string("output"));
-
-	json_object *nodes = json_object_new_array();
-	json_object_array_add(nodes, workspace);
-	json_object_object_add(output, "nodes", nodes);
-
-	return output;
-}
-
 static void ipc_json_describe_workspace(struct sway_workspace *workspace,
 		json_object *object) {
 	int num = isdigit(workspace->name[0]) ? atoi(workspace->name) : -1;
@@ -323,15 +402,6 @@ static void ipc_json_describe_workspace(struct sway_workspace *workspace,
 	json_object_object_add(object, "orientation",
 			json_object_new_string(
 				ipc_json_orientation_description(workspace->layout)));
-
-	// Floating
-	json_object *floating_array = json_object_new_array();
-	for (int i = 0; i < workspace->floating->length; ++i) {
-		struct sway_container *floater = workspace->floating->items[i];
-		json_object_array_add(floating_array,
-				ipc_json_describe_node_recursive(&floater->node));
-	}
-	json_object_object_add(object, "floating_nodes", floating_array);
 }
 
 static void ipc_json_describe_view(struct sway_container *c, json_object *object) {
@@ -442,7 +512,6 @@ static void ipc_json_describe_container(struct sway_container *c, json_object *o
 				ipc_json_border_description(c->current.border)));
 	json_object_object_add(object, "current_border_width",
 			json_object_new_int(c->current.border_thickness));
-	json_object_object_add(object, "floating_nodes", json_object_new_array());
 
 	if (c->view) {
 		ipc_json_describe_view(c, object);
@@ -477,13 +546,16 @@ static void focus_inactive_children_iterator(struct sway_node *node,
 	json_object_array_add(focus, json_object_new_int(node->id));
 }
 
-json_object *ipc_json_describe_node(struct sway_node *node) {
+static json_object *ipc_json_describe_node_fields(struct sway_node *node) {
 	struct sway_seat *seat = input_manager_get_default_seat();
-	bool focused = seat_get_focus(seat) == node;
 	char *name = node_get_name(node);
 
 	struct wlr_box box;
-	node_get_box(node, &box);
+	if (node->type == N_WORKSPACE) {
+		workspace_get_arranged_box(node->sway_workspace, &box);
+	} else {
+		node_get_box(node, &box);
+	}
 
 	json_object *focus = json_object_new_array();
 	struct focus_inactive_data data = {
@@ -493,7 +565,7 @@ json_object *ipc_json_describe_node(struct sway_node *node) {
 	seat_for_each_node(seat, focus_inactive_children_iterator, &data);
 
 	json_object *object = ipc_json_create_node(
-				(int)node->id, name, focused, focus, &box);
+				(int)node->id, name, focus, &box);
 
 	switch (node->type) {
 	case N_ROOT:
@@ -513,48 +585,294 @@ json_object *ipc_json_describe_node(struct sway_node *node) {
 	return object;
 }
 
-json_object *ipc_json_describe_node_recursive(struct sway_node *node) {
-	json_object *object = ipc_json_describe_node(node);
-	int i;
+void ipc_json_invalidate_node(struct sway_node *node) {
+	for (int i = 0; i < IPC_ENCODING_COUNT; ++i) {
+		free(node->ipc_cache[i].data);
+		node->ipc_cache[i].data = NULL;
+		node->ipc_cache[i].length = 0;
+	}
+}
+
+/**
+ * Node descriptions are assembled from the cached per-node fragments, so that
+ * unchanged nodes don't need to be described again for every query.
+ */
+static void ipc_json_append_node_fragment(struct ipc_serializer *serializer,
+		struct sway_node *node) {
+	enum ipc_encoding encoding = serializer->encoding;
+	if (!node->ipc_cache[encoding].data) {
+		json_object *object = ipc_json_describe_node_fields(node);
+		struct ipc_serializer fragment;
+		ipc_serializer_init(&fragment, encoding);
+		ipc_serializer_add_open_object(&fragment, object);
+		node->ipc_cache[encoding].data = ipc_serializer_finish(&fragment,
+				&node->ipc_cache[encoding].length);
+		json_object_put(object);
+		if (!node->ipc_cache[encoding].data) {
+			serializer->failed = true;
+			return;
+		}
+	}
+	ipc_serializer_add_encoded(serializer, node->ipc_cache[encoding].data,
+			node->ipc_cache[encoding].length);
+}
+
+static void ipc_json_append_node(struct ipc_serializer *serializer,
+		struct sway_node *node);
+
+static void ipc_json_append_node_list(struct ipc_serializer *serializer,
+		const char *key, list_t *list) {
+	ipc_serializer_add_key(serializer, key);
+	ipc_serializer_begin_array(serializer);
+	for (int i = 0; list && i < list->length; ++i) {
+		struct sway_container *con = list->items[i];
+		ipc_json_append_node(serializer, &con->node);
+	}
+	ipc_serializer_end_array(serializer);
+}
+
+static void ipc_json_append_scratchpad_output(
+		struct ipc_serializer *serializer) {
+	struct wlr_box box;
+	root_get_box(root, &box);
+
+	// Create focus stack for __i3_scratch workspace
+	json_object *workspace_focus = json_object_new_array();
+	for (int i = root->scratchpad->length - 1; i >= 0; --i) {
+		struct sway_container *container = root->scratchpad->items[i];
+		json_object_array_add(workspace_focus,
+				json_object_new_int(container->node.id));
+	}
+
+	json_object *workspace = ipc_json_create_node(i3_scratch_id,
+				"__i3_scratch", workspace_focus, &box);
+	json_object_object_add(workspace, "type",
+			json_object_new_string("workspace"));
+
+	// Create focus stack for __i3 output
+	json_object *output_focus = json_object_new_array();
+	json_object_array_add(output_focus, json_object_new_int(i3_scratch_id));
+
+	json_object *output = ipc_json_create_node(i3_output_id,
+					"__i3", output_focus, &box);
+	json_object_object_add(output, "type",
+			json_object_new_string("output"));
+	json_object_object_add(output, "layout",
+			json_object_new_string("output"));
+
+	ipc_serializer_add_open_object(serializer, output);
+	ipc_serializer_add_key(serializer, "focused");
+	ipc_serializer_add_bool(serializer, false);
+	ipc_serializer_add_key(serializer, "floating_nodes");
+	ipc_serializer_begin_array(serializer);
+	ipc_serializer_end_array(serializer);
+	ipc_serializer_add_key(serializer, "nodes");
+	ipc_serializer_begin_array(serializer);
+	ipc_serializer_add_open_object(serializer, workspace);
+	ipc_serializer_add_key(serializer, "focused");
+	ipc_serializer_add_bool(serializer, false);
+
+	// List all hidden scratchpad containers as floating nodes
+	ipc_serializer_add_key(serializer, "floating_nodes");
+	ipc_serializer_begin_array(serializer);
+	for (int i = 0; i < root->scratchpad->length; ++i) {
+		struct sway_container *container = root->scratchpad->items[i];
+		if (!container->workspace) {
+			ipc_json_append_node(serializer, &container->node);
+		}
+	}
+	ipc_serializer_end_array(serializer);
+	ipc_serializer_end_object(serializer);
+	ipc_serializer_end_array(serializer);
+	ipc_serializer_end_object(serializer);
+
+	json_object_put(workspace);
+	json_object_put(output);
+}
+
+/**
+ * Append a node's description without its "focused" key or end of object.
+ */
+static void ipc_json_append_node_open(struct ipc_serializer *serializer,
+		struct sway_node *node, bool recursive) {
+	ipc_json_append_node_fragment(serializer, node);
+	ipc_json_append_node_list(serializer, "floating_nodes",
+			node->type == N_WORKSPACE ?
+			node->sway_workspace->floating : NULL);
+	if (!recursive) {
+		return;
+	}
 
-	json_object *children = json_object_new_array();
 	switch (node->type) {
 	case N_ROOT:
-		json_object_array_add(children,
-				ipc_json_describe_scratchpad_output());
-		for (i = 0; i < root->outputs->length; ++i) {
+		ipc_serializer_add_key(serializer, "nodes");
+		ipc_serializer_begin_array(serializer);
+		ipc_json_append_scratchpad_output(serializer);
+		for (int i = 0; i < root->outputs->length; ++i) {
 			struct sway_output *output = root->outputs->items[i];
-			json_object_array_add(children,
-					ipc_json_describe_node_recursive(&output->node));
+			ipc_json_append_node(serializer, &output->node);
 		}
+		ipc_serializer_end_array(serializer);
 		break;
 	case N_OUTPUT:
-		for (i = 0; i < node->sway_output->workspaces->length; ++i) {
+		ipc_serializer_add_key(serializer, "nodes");
+		ipc_serializer_begin_array(serializer);
+		for (int i = 0; i < node->sway_output->workspaces->length; ++i) {
 			struct sway_workspace *ws = node->sway_output->workspaces->items[i];
-			json_object_array_add(children,
-					ipc_json_describe_node_recursive(&ws->node));
+			ipc_json_append_node(serializer, &ws->node);
 		}
+		ipc_serializer_end_array(serializer);
 		break;
 	case N_WORKSPACE:
-		for (i = 0; i < node->sway_workspace->tiling->length; ++i) {
-			struct sway_container *con = node->sway_workspace->tiling->items[i];
-			json_object_array_add(children,
-					ipc_json_describe_node_recursive(&con->node));
-		}
+		ipc_json_append_node_list(serializer, "nodes",
+				node->sway_workspace->tiling);
 		break;
 	case N_CONTAINER:
-		if (node->sway_container->children) {
-			for (i = 0; i < node->sway_container->children->length; ++i) {
-				struct sway_container *child =
-					node->sway_container->children->items[i];
-				json_object_array_add(children,
-						ipc_json_describe_node_recursive(&child->node));
-			}
-		}
+		ipc_json_append_node_list(serializer, "nodes",
+				node->sway_container->children);
 		break;
 	}
-	json_object_object_add(object, "nodes", children);
+}
+
+static void ipc_json_append_node(struct ipc_serializer *serializer,
+		struct sway_node *node) {
+	struct sway_seat *seat = input_manager_get_default_seat();
+	ipc_json_append_node_open(serializer, node, true);
+	ipc_serializer_add_key(serializer, "focused");
+	ipc_serializer_add_bool(serializer, seat_get_focus(seat) == node);
+	ipc_serializer_end_object(serializer);
+}
+
+char *ipc_json_describe_node_recursive(struct sway_node *node,
+		enum ipc_encoding encoding, size_t *length) {
+	struct ipc_serializer serializer;
+	ipc_serializer_init(&serializer, encoding);
+	ipc_json_append_node(&serializer, node);
+	return ipc_serializer_finish(&serializer, length);
+}
+
+char *ipc_json_describe_workspaces(enum ipc_encoding encoding,
+		size_t *length) {
+	struct sway_seat *seat = input_manager_get_default_seat();
+	struct sway_workspace *focused_ws = seat_get_focused_workspace(seat);
+	struct ipc_serializer serializer;
+	ipc_serializer_init(&serializer, encoding);
+	ipc_serializer_begin_array(&serializer);
+	for (int i = 0; i < root->outputs->length; ++i) {
+		struct sway_output *output = root->outputs->items[i];
+		struct sway_workspace *active_ws = output_get_active_workspace(output);
+		for (int j = 0; j < output->workspaces->length; ++j) {
+			struct sway_workspace *ws = output->workspaces->items[j];
+			// The focused indicator is set differently for the
+			// get_workspaces reply
+			ipc_json_append_node_open(&serializer, &ws->node, false);
+			ipc_serializer_add_key(&serializer, "focused");
+			ipc_serializer_add_bool(&serializer, ws == focused_ws);
+			ipc_serializer_add_key(&serializer, "visible");
+			ipc_serializer_add_bool(&serializer, ws == active_ws);
+			ipc_serializer_end_object(&serializer);
+		}
+	}
+	ipc_serializer_end_array(&serializer);
+	return ipc_serializer_finish(&serializer, length);
+}
+
+char *ipc_json_describe_outputs(enum ipc_encoding encoding, size_t *length) {
+	struct sway_seat *seat = input_manager_get_default_seat();
+	struct sway_workspace *focused_ws = seat_get_focused_workspace(seat);
+	struct ipc_serializer serializer;
+	ipc_serializer_init(&serializer, encoding);
+	ipc_serializer_begin_array(&serializer);
+	for (int i = 0; i < root->outputs->length; ++i) {
+		struct sway_output *output = root->outputs->items[i];
+		// The focused indicator is set differently for the get_outputs reply
+		ipc_json_append_node_open(&serializer, &output->node, false);
+		ipc_serializer_add_key(&serializer, "focused");
+		ipc_serializer_add_bool(&serializer,
+				focused_ws && output == focused_ws->output);
+		ipc_serializer_end_object(&serializer);
+	}
+	struct sway_output *output;
+	wl_list_for_each(output, &root->all_outputs, link) {
+		if (!output->enabled) {
+			json_object *object = ipc_json_describe_disabled_output(output);
+			ipc_serializer_add_object(&serializer, object);
+			json_object_put(object);
+		}
+	}
+	ipc_serializer_end_array(&serializer);
+	return ipc_serializer_finish(&serializer, length);
+}
+
+static json_object *describe_timing(struct sway_timing *timing,
+		const double *bounds, int bounds_length) {
+	int count = timing->length;
+	double *values = malloc(sizeof(double) * (count ? count : 1));
+	if (!values) {
+		wlr_log(WLR_ERROR, "Unable to allocate timings");
+		return NULL;
+	}
+	for (int i = 0; i < count; ++i) {
+		values[i] = timing->samples[i] / 1000.0;
+	}
+	json_object *object =
+		describe_distribution(values, count, bounds, bounds_length);
+	json_object_object_add(object, "total",
+			json_object_new_int64(timing->count));
+	free(values);
+	return object;
+}
 
+json_object *ipc_json_describe_timings(struct sway_timings *timings) {
+	static const double latency_bounds[] = {
+		1000, 2000, 4000, 8000, 16000, 32000, 64000, 128000,
+	};
+	static const double cpu_bounds[] = {
+		50, 100, 250, 500, 1000, 2000, 4000, 8000, 16000,
+	};
+
+	json_object *object = json_object_new_object();
+	json_object_object_add(object, "pending_transactions",
+			json_object_new_int(server.transactions->length));
+	json_object_object_add(object, "transaction_latency_us",
+			describe_timing(&timings->transaction_latency, latency_bounds,
+				sizeof(latency_bounds) / sizeof(double)));
+	json_object_object_add(object, "arrange_us",
+			describe_timing(&timings->arrange, cpu_bounds,
+				sizeof(cpu_bounds) / sizeof(double)));
+	json_object_object_add(object, "render_us",
+			describe_timing(&timings->render, cpu_bounds,
+				sizeof(cpu_bounds) / sizeof(double)));
+	return object;
+}
+
+json_object *ipc_json_describe_texture_usage(void) {
+	struct sway_atlas_usage usage;
+	atlas_get_usage(&usage);
+	struct sway_text_texture_stats stats;
+	text_texture_get_stats(&stats);
+
+	json_object *object = json_object_new_object();
+	json_object_object_add(object, "budget",
+			json_object_new_int64(config->texture_budget));
+	json_object_object_add(object, "bytes",
+			json_object_new_int64(usage.bytes));
+	json_object_object_add(object, "image_bytes",
+			json_object_new_int64(usage.image_bytes));
+	json_object_object_add(object, "atlas_pages",
+			json_object_new_int(usage.pages));
+	json_object_object_add(object, "images",
+			json_object_new_int(usage.images));
+	json_object_object_add(object, "own_textures",
+			json_object_new_int(usage.own_textures));
+	json_object_object_add(object, "text_textures",
+			json_object_new_int(stats.textures));
+	json_object_object_add(object, "unused_text_textures",
+			json_object_new_int(stats.unused));
+	json_object_object_add(object, "evicted_text_textures",
+			json_object_new_int(stats.evicted));
+	json_object_object_add(object, "evictions",
+			json_object_new_int64(stats.evictions));
 	return object;
 }
 
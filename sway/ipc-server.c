@@ -15,6 +15,7 @@
 #include <sys/un.h>
 #include <unistd.h>
 #include <wayland-server.h>
+#include "ipc-encoding.h"
 #include "sway/commands.h"
 #include "sway/config.h"
 #include "sway/desktop/transaction.h"
@@ -39,18 +40,39 @@ static struct wl_listener ipc_display_destroy;
 
 static const char ipc_magic[] = {'i', '3', '-', 'i', 'p', 'c'};
 
+// Once this much is queued for a client, redundant events are coalesced
+static const size_t ipc_coalesce_watermark = 64 * 1024;
+// Events which would grow the queue past this are dropped until the client
+// catches up, at which point it is told to resync
+static const size_t ipc_max_write_buffer_size = 4000000; // 4 MB
+
+// An event in a client's write buffer which a newer event may replace
+struct ipc_queued_event {
+	enum ipc_command_type event;
+	char *key;
+	size_t offset; // into the write buffer, including the header
+	size_t length;
+};
+
 struct ipc_client {
 	struct wl_event_source *event_source;
 	struct wl_event_source *writable_event_source;
 	struct sway_server *server;
 	int fd;
+	uint32_t id;
 	uint32_t payload_length;
 	uint32_t security_policy;
 	enum ipc_command_type current_command;
 	enum ipc_command_type subscribed_events;
+	enum ipc_encoding encoding;
 	size_t write_buffer_len;
 	size_t write_buffer_size;
 	char *write_buffer;
+
+	list_t *queued_events; // struct ipc_queued_event *
+	uint32_t resync_events; // event_mask of event types being dropped
+	size_t events_dropped;
+	size_t events_coalesced;
 };
 
 struct sockaddr_un *ipc_user_sockaddr(void);
@@ -174,10 +196,13 @@ int ipc_handle_connection(int fd, uint32_t mask, void *data) {
 		close(client_fd);
 		return 0;
 	}
+	static uint32_t next_id = 1;
 	client->server = server;
+	client->id = next_id++;
 	client->payload_length = 0;
 	client->fd = client_fd;
 	client->subscribed_events = 0;
+	client->encoding = IPC_ENCODING_JSON;
 	client->event_source = wl_event_loop_add_fd(server->wl_event_loop,
 			client_fd, WL_EVENT_READABLE, ipc_client_handle_readable, client);
 	client->writable_event_source = NULL;
@@ -190,6 +215,10 @@ int ipc_handle_connection(int fd, uint32_t mask, void *data) {
 		close(client_fd);
 		return 0;
 	}
+	client->queued_events = create_list();
+	client->resync_events = 0;
+	client->events_dropped = 0;
+	client->events_coalesced = 0;
 
 	wlr_log(WLR_DEBUG, "New client: fd %d", client_fd);
 	list_add(ipc_client_list, client);
@@ -270,15 +299,220 @@ static bool ipc_has_event_listeners(enum ipc_command_type event) {
 	return false;
 }
 
-static void ipc_send_event(const char *json_string, enum ipc_command_type event) {
+/**
+ * Send a reply in the encoding selected by the client.
+ */
+static bool ipc_send_object(struct ipc_client *client, json_object *json) {
+	size_t length;
+	char *payload = ipc_encode_object(client->encoding, json, &length);
+	if (!payload) {
+		wlr_log(WLR_ERROR, "Unable to encode IPC reply");
+		ipc_client_disconnect(client);
+		return false;
+	}
+	bool client_valid = ipc_send_reply(client, payload, (uint32_t)length);
+	free(payload);
+	return client_valid;
+}
+
+/**
+ * Send a reply which was formatted as JSON, converting it if the client has
+ * selected another encoding.
+ */
+static bool ipc_send_json_string(struct ipc_client *client,
+		const char *json_string) {
+	if (client->encoding == IPC_ENCODING_JSON) {
+		return ipc_send_reply(client, json_string,
+				(uint32_t)strlen(json_string));
+	}
+	json_object *json = json_tokener_parse(json_string);
+	bool client_valid = ipc_send_object(client, json);
+	json_object_put(json);
+	return client_valid;
+}
+
+static void ipc_queued_event_destroy(struct ipc_queued_event *queued) {
+	free(queued->key);
+	free(queued);
+}
+
+/**
+ * Cut any queued events with the same key out of the client's write buffer.
+ * Only events which haven't been partially written yet are tracked.
+ */
+static void ipc_client_coalesce_event(struct ipc_client *client,
+		enum ipc_command_type event, const char *key) {
+	for (int i = 0; i < client->queued_events->length; ++i) {
+		struct ipc_queued_event *queued = client->queued_events->items[i];
+		if (queued->event != event || strcmp(queued->key, key) != 0) {
+			continue;
+		}
+		size_t end = queued->offset + queued->length;
+		memmove(client->write_buffer + queued->offset,
+				client->write_buffer + end, client->write_buffer_len - end);
+		client->write_buffer_len -= queued->length;
+		for (int j = i + 1; j < client->queued_events->length; ++j) {
+			struct ipc_queued_event *later = client->queued_events->items[j];
+			later->offset -= queued->length;
+		}
+		list_del(client->queued_events, i--);
+		ipc_queued_event_destroy(queued);
+		client->events_coalesced++;
+	}
+}
+
+/**
+ * Forget queued events which have (partially) been written to the client.
+ */
+static void ipc_client_consume_queued_events(struct ipc_client *client,
+		size_t written) {
+	while (client->queued_events->length) {
+		struct ipc_queued_event *queued = client->queued_events->items[0];
+		if (queued->offset >= written) {
+			break;
+		}
+		list_del(client->queued_events, 0);
+		ipc_queued_event_destroy(queued);
+	}
+	for (int i = 0; i < client->queued_events->length; ++i) {
+		struct ipc_queued_event *queued = client->queued_events->items[i];
+		queued->offset -= written;
+	}
+}
+
+static const char *ipc_event_name(enum ipc_command_type event) {
+	switch (event) {
+	case IPC_EVENT_WORKSPACE:
+		return "workspace";
+	case IPC_EVENT_OUTPUT:
+		return "output";
+	case IPC_EVENT_MODE:
+		return "mode";
+	case IPC_EVENT_WINDOW:
+		return "window";
+	case IPC_EVENT_BARCONFIG_UPDATE:
+		return "barconfig_update";
+	case IPC_EVENT_BINDING:
+		return "binding";
+	case IPC_EVENT_SHUTDOWN:
+		return "shutdown";
+	case IPC_EVENT_TICK:
+		return "tick";
+	case IPC_EVENT_BAR_STATE_UPDATE:
+		return "bar_state_update";
+	case IPC_EVENT_RENDER_STATS:
+		return "render_stats";
+	default:
+		return "unknown";
+	}
+}
+
+/**
+ * Once a client which had events dropped has caught up, tell it which event
+ * types it has missed so that it can query the current state again.
+ */
+static bool ipc_client_send_resync(struct ipc_client *client) {
+	for (uint32_t bit = 0; bit < 32; ++bit) {
+		if ((client->resync_events & (1u << bit)) == 0) {
+			continue;
+		}
+		enum ipc_command_type event = (1u << 31) | bit;
+		wlr_log(WLR_DEBUG, "Sending %s::resync event to client %d",
+				ipc_event_name(event), client->fd);
+		json_object *json = json_object_new_object();
+		json_object_object_add(json, "change", json_object_new_string("resync"));
+		json_object_object_add(json, "dropped",
+				json_object_new_int64(client->events_dropped));
+		client->current_command = event;
+		bool client_valid = ipc_send_object(client, json);
+		json_object_put(json);
+		if (!client_valid) {
+			return false;
+		}
+	}
+	client->resync_events = 0;
+	return true;
+}
+
+/**
+ * Queue an event for a subscribed client. If coalesce_key is not NULL, older
+ * events of the same type and key may be replaced while the client is behind.
+ */
+static bool ipc_client_queue_event(struct ipc_client *client,
+		const char *payload, uint32_t payload_length,
+		enum ipc_command_type event, const char *coalesce_key) {
+	if (client->resync_events & event_mask(event)) {
+		client->events_dropped++;
+		return true;
+	}
+
+	if (coalesce_key && client->write_buffer_len >= ipc_coalesce_watermark) {
+		ipc_client_coalesce_event(client, event, coalesce_key);
+	}
+	if (client->write_buffer_len + ipc_header_size + payload_length >=
+			ipc_max_write_buffer_size) {
+		wlr_log(WLR_INFO, "Client %d is not reading %s events, dropping them "
+				"until it catches up", client->fd, ipc_event_name(event));
+		client->resync_events |= event_mask(event);
+		client->events_dropped++;
+		return true;
+	}
+
+	size_t offset = client->write_buffer_len;
+	client->current_command = event;
+	if (!ipc_send_reply(client, payload, payload_length)) {
+		return false;
+	}
+
+	if (coalesce_key) {
+		struct ipc_queued_event *queued =
+			calloc(1, sizeof(struct ipc_queued_event));
+		if (!queued) {
+			return true;
+		}
+		queued->event = event;
+		queued->key = strdup(coalesce_key);
+		queued->offset = offset;
+		queued->length = client->write_buffer_len - offset;
+		list_add(client->queued_events, queued);
+	}
+	return true;
+}
+
+// An event serialised in one encoding, or NULL if no subscriber uses it
+struct ipc_event_payload {
+	char *data;
+	size_t length;
+};
+
+/**
+ * Return a bitmask of the encodings used by clients subscribed to the event.
+ */
+static uint32_t ipc_event_encodings(enum ipc_command_type event) {
+	uint32_t encodings = 0;
+	for (int i = 0; i < ipc_client_list->length; i++) {
+		struct ipc_client *client = ipc_client_list->items[i];
+		if (client->subscribed_events & event_mask(event)) {
+			encodings |= 1 << client->encoding;
+		}
+	}
+	return encodings;
+}
+
+static void ipc_send_event(struct ipc_event_payload *payloads,
+		enum ipc_command_type event, const char *coalesce_key) {
 	struct ipc_client *client;
 	for (int i = 0; i < ipc_client_list->length; i++) {
 		client = ipc_client_list->items[i];
 		if ((client->subscribed_events & event_mask(event)) == 0) {
 			continue;
 		}
-		client->current_command = event;
-		if (!ipc_send_reply(client, json_string, (uint32_t) strlen(json_string))) {
+		struct ipc_event_payload *payload = &payloads[client->encoding];
+		if (!payload->data) {
+			continue;
+		}
+		if (!ipc_client_queue_event(client, payload->data,
+					(uint32_t)payload->length, event, coalesce_key)) {
 			wlr_log_errno(WLR_INFO, "Unable to send reply to IPC client");
 			/* ipc_send_reply destroys client on error, which also
 			 * removes it from the list, so we need to process
@@ -288,31 +522,94 @@ static void ipc_send_event(const char *json_string, enum ipc_command_type event)
 	}
 }
 
+/**
+ * Serialise the event once for each encoding used by its subscribers.
+ */
+static void ipc_send_event_object(json_object *json,
+		enum ipc_command_type event, const char *coalesce_key) {
+	uint32_t encodings = ipc_event_encodings(event);
+	struct ipc_event_payload payloads[IPC_ENCODING_COUNT] = {0};
+	for (int i = 0; i < IPC_ENCODING_COUNT; ++i) {
+		if (encodings & (1 << i)) {
+			payloads[i].data = ipc_encode_object(i, json, &payloads[i].length);
+		}
+	}
+	ipc_send_event(payloads, event, coalesce_key);
+	for (int i = 0; i < IPC_ENCODING_COUNT; ++i) {
+		free(payloads[i].data);
+	}
+}
+
+/**
+ * Send an event of the form {"change": <change>, <key>: <node>...}, assembled
+ * from the nodes' cached descriptions. Each node may be NULL.
+ */
+static void ipc_send_event_nodes(const char *change, int count,
+		const char **keys, struct sway_node **nodes,
+		enum ipc_command_type event, const char *coalesce_key) {
+	uint32_t encodings = ipc_event_encodings(event);
+	struct ipc_event_payload payloads[IPC_ENCODING_COUNT] = {0};
+	json_object *change_obj = json_object_new_string(change);
+	for (int i = 0; i < IPC_ENCODING_COUNT; ++i) {
+		if ((encodings & (1 << i)) == 0) {
+			continue;
+		}
+		struct ipc_serializer serializer;
+		ipc_serializer_init(&serializer, i);
+		ipc_serializer_begin_object(&serializer);
+		ipc_serializer_add_key(&serializer, "change");
+		ipc_serializer_add_object(&serializer, change_obj);
+		for (int j = 0; j < count; ++j) {
+			ipc_serializer_add_key(&serializer, keys[j]);
+			if (!nodes[j]) {
+				ipc_serializer_add_object(&serializer, NULL);
+				continue;
+			}
+			size_t length;
+			char *node = ipc_json_describe_node_recursive(nodes[j], i, &length);
+			if (!node) {
+				serializer.failed = true;
+				continue;
+			}
+			ipc_serializer_add_encoded(&serializer, node, length);
+			free(node);
+		}
+		ipc_serializer_end_object(&serializer);
+		payloads[i].data = ipc_serializer_finish(&serializer,
+				&payloads[i].length);
+	}
+	json_object_put(change_obj);
+
+	ipc_send_event(payloads, event, coalesce_key);
+	for (int i = 0; i < IPC_ENCODING_COUNT; ++i) {
+		free(payloads[i].data);
+	}
+}
+
 void ipc_event_workspace(struct sway_workspace *old,
 		struct sway_workspace *new, const char *change) {
 	if (!ipc_has_event_listeners(IPC_EVENT_WORKSPACE)) {
 		return;
 	}
 	wlr_log(WLR_DEBUG, "Sending workspace::%s event", change);
-	json_object *obj = json_object_new_object();
-	json_object_object_add(obj, "change", json_object_new_string(change));
-	if (old) {
-		json_object_object_add(obj, "old",
-				ipc_json_describe_node_recursive(&old->node));
-	} else {
-		json_object_object_add(obj, "old", NULL);
-	}
-
-	if (new) {
-		json_object_object_add(obj, "current",
-				ipc_json_describe_node_recursive(&new->node));
-	} else {
-		json_object_object_add(obj, "current", NULL);
-	}
-
-	const char *json_string = json_object_to_json_string(obj);
-	ipc_send_event(json_string, IPC_EVENT_WORKSPACE);
-	json_object_put(obj);
+	const char *keys[] = { "old", "current" };
+	struct sway_node *nodes[] = {
+		old ? &old->node : NULL,
+		new ? &new->node : NULL,
+	};
+
+	// Only the latest focus change matters to a client which is behind
+	char coalesce_key[64];
+	const char *key = NULL;
+	if (strcmp(change, "focus") == 0) {
+		key = change;
+	} else if (strcmp(change, "urgent") == 0 && new) {
+		snprintf(coalesce_key, sizeof(coalesce_key), "%s:%zu",
+				change, new->node.id);
+		key = coalesce_key;
+	}
+
+	ipc_send_event_nodes(change, 2, keys, nodes, IPC_EVENT_WORKSPACE, key);
 }
 
 void ipc_event_window(struct sway_container *window, const char *change) {
@@ -320,14 +617,23 @@ void ipc_event_window(struct sway_container *window, const char *change) {
 		return;
 	}
 	wlr_log(WLR_DEBUG, "Sending window::%s event", change);
-	json_object *obj = json_object_new_object();
-	json_object_object_add(obj, "change", json_object_new_string(change));
-	json_object_object_add(obj, "container",
-			ipc_json_describe_node_recursive(&window->node));
-
-	const char *json_string = json_object_to_json_string(obj);
-	ipc_send_event(json_string, IPC_EVENT_WINDOW);
-	json_object_put(obj);
+	const char *keys[] = { "container" };
+	struct sway_node *nodes[] = { &window->node };
+
+	// These events describe the container's full state, so only the latest
+	// one of each is needed by a client which is behind
+	char coalesce_key[64];
+	const char *key = NULL;
+	if (strcmp(change, "focus") == 0) {
+		key = change;
+	} else if (strcmp(change, "title") == 0 || strcmp(change, "mark") == 0 ||
+			strcmp(change, "urgent") == 0) {
+		snprintf(coalesce_key, sizeof(coalesce_key), "%s:%zu",
+				change, window->node.id);
+		key = coalesce_key;
+	}
+
+	ipc_send_event_nodes(change, 1, keys, nodes, IPC_EVENT_WINDOW, key);
 }
 
 void ipc_event_barconfig_update(struct bar_config *bar) {
@@ -337,8 +643,7 @@ void ipc_event_barconfig_update(struct bar_config *bar) {
 	wlr_log(WLR_DEBUG, "Sending barconfig_update event");
 	json_object *json = ipc_json_describe_bar_config(bar);
 
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_BARCONFIG_UPDATE);
+	ipc_send_event_object(json, IPC_EVENT_BARCONFIG_UPDATE, NULL);
 	json_object_put(json);
 }
 
@@ -353,8 +658,7 @@ void ipc_event_bar_state_update(struct bar_config *bar) {
 	json_object_object_add(json, "visible_by_modifier",
 			json_object_new_boolean(bar->visible_by_modifier));
 
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_BAR_STATE_UPDATE);
+	ipc_send_event_object(json, IPC_EVENT_BAR_STATE_UPDATE, bar->id);
 	json_object_put(json);
 }
 
@@ -368,8 +672,7 @@ void ipc_event_mode(const char *mode, bool pango) {
 	json_object_object_add(obj, "pango_markup",
 			json_object_new_boolean(pango));
 
-	const char *json_string = json_object_to_json_string(obj);
-	ipc_send_event(json_string, IPC_EVENT_MODE);
+	ipc_send_event_object(obj, IPC_EVENT_MODE, "mode");
 	json_object_put(obj);
 }
 
@@ -382,8 +685,7 @@ void ipc_event_shutdown(const char *reason) {
 	json_object *json = json_object_new_object();
 	json_object_object_add(json, "change", json_object_new_string(reason));
 
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_SHUTDOWN);
+	ipc_send_event_object(json, IPC_EVENT_SHUTDOWN, NULL);
 	json_object_put(json);
 }
 
@@ -455,8 +757,18 @@ void ipc_event_binding(struct sway_binding *binding) {
 	json_object *json = json_object_new_object();
 	json_object_object_add(json, "change", json_object_new_string("run"));
 	json_object_object_add(json, "binding", json_binding);
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_BINDING);
+	ipc_send_event_object(json, IPC_EVENT_BINDING, NULL);
+	json_object_put(json);
+}
+
+void ipc_event_render_stats(struct sway_output *output) {
+	if (!ipc_event_encodings(IPC_EVENT_RENDER_STATS)) {
+		return;
+	}
+	json_object *json = ipc_json_describe_render_stats(output);
+	// Only the latest statistics of each output are worth sending
+	ipc_send_event_object(json, IPC_EVENT_RENDER_STATS,
+			output->wlr_output->name);
 	json_object_put(json);
 }
 
@@ -470,8 +782,7 @@ static void ipc_event_tick(const char *payload) {
 	json_object_object_add(json, "first", json_object_new_boolean(false));
 	json_object_object_add(json, "payload", json_object_new_string(payload));
 
-	const char *json_string = json_object_to_json_string(json);
-	ipc_send_event(json_string, IPC_EVENT_TICK);
+	ipc_send_event_object(json, IPC_EVENT_TICK, NULL);
 	json_object_put(json);
 }
 
@@ -508,6 +819,14 @@ int ipc_client_handle_writable(int client_fd, uint32_t mask, void *data) {
 
 	memmove(client->write_buffer, client->write_buffer + written, client->write_buffer_len - written);
 	client->write_buffer_len -= written;
+	ipc_client_consume_queued_events(client, written);
+
+	if (client->resync_events &&
+			client->write_buffer_len < ipc_coalesce_watermark) {
+		if (!ipc_client_send_resync(client)) {
+			return 0;
+		}
+	}
 
 	if (client->write_buffer_len == 0 && client->writable_event_source) {
 		wl_event_source_remove(client->writable_event_source);
@@ -534,30 +853,16 @@ void ipc_client_disconnect(struct ipc_client *client) {
 		i++;
 	}
 	list_del(ipc_client_list, i);
+	while (client->queued_events->length) {
+		ipc_queued_event_destroy(client->queued_events->items[0]);
+		list_del(client->queued_events, 0);
+	}
+	list_free(client->queued_events);
 	free(client->write_buffer);
 	close(client->fd);
 	free(client);
 }
 
-static void ipc_get_workspaces_callback(struct sway_workspace *workspace,
-		void *data) {
-	json_object *workspace_json = ipc_json_describe_node(&workspace->node);
-	// override the default focused indicator because
-	// it's set differently for the get_workspaces reply
-	struct sway_seat *seat = input_manager_get_default_seat();
-	struct sway_workspace *focused_ws = seat_get_focused_workspace(seat);
-	bool focused = workspace == focused_ws;
-	json_object_object_del(workspace_json, "focused");
-	json_object_object_add(workspace_json, "focused",
-			json_object_new_boolean(focused));
-	json_object_array_add((json_object *)data, workspace_json);
-
-	focused_ws = output_get_active_workspace(workspace->output);
-	bool visible = workspace == focused_ws;
-	json_object_object_add(workspace_json, "visible",
-			json_object_new_boolean(visible));
-}
-
 static void ipc_get_marks_callback(struct sway_container *con, void *data) {
 	json_object *marks = (json_object *)data;
 	for (int i = 0; i < con->marks->length; ++i) {
@@ -597,8 +902,7 @@ void ipc_client_handle_command(struct ipc_client *client) {
 		list_t *res_list = execute_command(buf, NULL, NULL);
 		transaction_commit_dirty();
 		char *json = cmd_results_to_json(res_list);
-		int length = strlen(json);
-		client_valid = ipc_send_reply(client, json, (uint32_t)length);
+		client_valid = ipc_send_json_string(client, json);
 		free(json);
 		while (res_list->length) {
 			struct cmd_results *results = res_list->items[0];
@@ -612,51 +916,37 @@ void ipc_client_handle_command(struct ipc_client *client) {
 	case IPC_SEND_TICK:
 	{
 		ipc_event_tick(buf);
-		ipc_send_reply(client, "{\"success\": true}", 17);
+		ipc_send_json_string(client, "{\"success\": true}");
 		goto exit_cleanup;
 	}
 
 	case IPC_GET_OUTPUTS:
 	{
-		json_object *outputs = json_object_new_array();
-		for (int i = 0; i < root->outputs->length; ++i) {
-			struct sway_output *output = root->outputs->items[i];
-			json_object *output_json = ipc_json_describe_node(&output->node);
-
-			// override the default focused indicator because it's set
-			// differently for the get_outputs reply
-			struct sway_seat *seat = input_manager_get_default_seat();
-			struct sway_workspace *focused_ws =
-				seat_get_focused_workspace(seat);
-			bool focused = focused_ws && output == focused_ws->output;
-			json_object_object_del(output_json, "focused");
-			json_object_object_add(output_json, "focused",
-				json_object_new_boolean(focused));
-
-			json_object_array_add(outputs, output_json);
-		}
-		struct sway_output *output;
-		wl_list_for_each(output, &root->all_outputs, link) {
-			if (!output->enabled) {
-				json_object_array_add(outputs,
-						ipc_json_describe_disabled_output(output));
-			}
+		size_t length;
+		char *payload = ipc_json_describe_outputs(client->encoding, &length);
+		if (!payload) {
+			ipc_client_disconnect(client);
+			client_valid = false;
+			goto exit_cleanup;
 		}
-		const char *json_string = json_object_to_json_string(outputs);
-		client_valid =
-			ipc_send_reply(client, json_string, (uint32_t)strlen(json_string));
-		json_object_put(outputs); // free
+		client_valid = ipc_send_reply(client, payload, (uint32_t)length);
+		free(payload);
 		goto exit_cleanup;
 	}
 
 	case IPC_GET_WORKSPACES:
 	{
-		json_object *workspaces = json_object_new_array();
-		root_for_each_workspace(ipc_get_workspaces_callback, workspaces);
-		const char *json_string = json_object_to_json_string(workspaces);
-		client_valid =
-			ipc_send_reply(client, json_string, (uint32_t)strlen(json_string));
-		json_object_put(workspaces); // free
+		// Hidden workspaces which haven't been arranged are described with
+		// the rect they will have once shown, without arranging them
+		size_t length;
+		char *payload = ipc_json_describe_workspaces(client->encoding, &length);
+		if (!payload) {
+			ipc_client_disconnect(client);
+			client_valid = false;
+			goto exit_cleanup;
+		}
+		client_valid = ipc_send_reply(client, payload, (uint32_t)length);
+		free(payload);
 		goto exit_cleanup;
 	}
 
@@ -666,7 +956,7 @@ void ipc_client_handle_command(struct ipc_client *client) {
 		struct json_object *request = json_tokener_parse(buf);
 		if (request == NULL || !json_object_is_type(request, json_type_array)) {
 			const char msg[] = "{\"success\": false}";
-			client_valid = ipc_send_reply(client, msg, strlen(msg));
+			client_valid = ipc_send_json_string(client, msg);
 			wlr_log(WLR_INFO, "Failed to parse subscribe request");
 			goto exit_cleanup;
 		}
@@ -689,12 +979,14 @@ void ipc_client_handle_command(struct ipc_client *client) {
 				client->subscribed_events |= event_mask(IPC_EVENT_WINDOW);
 			} else if (strcmp(event_type, "binding") == 0) {
 				client->subscribed_events |= event_mask(IPC_EVENT_BINDING);
+			} else if (strcmp(event_type, "render_stats") == 0) {
+				client->subscribed_events |= event_mask(IPC_EVENT_RENDER_STATS);
 			} else if (strcmp(event_type, "tick") == 0) {
 				client->subscribed_events |= event_mask(IPC_EVENT_TICK);
 				is_tick = true;
 			} else {
 				const char msg[] = "{\"success\": false}";
-				client_valid = ipc_send_reply(client, msg, strlen(msg));
+				client_valid = ipc_send_json_string(client, msg);
 				json_object_put(request);
 				wlr_log(WLR_INFO, "Unsupported event type in subscribe request");
 				goto exit_cleanup;
@@ -703,11 +995,11 @@ void ipc_client_handle_command(struct ipc_client *client) {
 
 		json_object_put(request);
 		const char msg[] = "{\"success\": true}";
-		client_valid = ipc_send_reply(client, msg, strlen(msg));
+		client_valid = ipc_send_json_string(client, msg);
 		if (is_tick) {
 			client->current_command = IPC_EVENT_TICK;
 			const char tickmsg[] = "{\"first\": true, \"payload\": \"\"}";
-			ipc_send_reply(client, tickmsg, strlen(tickmsg));
+			ipc_send_json_string(client, tickmsg);
 		}
 		goto exit_cleanup;
 	}
@@ -719,9 +1011,7 @@ void ipc_client_handle_command(struct ipc_client *client) {
 		wl_list_for_each(device, &server.input->devices, link) {
 			json_object_array_add(inputs, ipc_json_describe_input(device));
 		}
-		const char *json_string = json_object_to_json_string(inputs);
-		client_valid =
-			ipc_send_reply(client, json_string, (uint32_t)strlen(json_string));
+		client_valid = ipc_send_object(client, inputs);
 		json_object_put(inputs); // free
 		goto exit_cleanup;
 	}
@@ -733,20 +1023,92 @@ void ipc_client_handle_command(struct ipc_client *client) {
 		wl_list_for_each(seat, &server.input->seats, link) {
 			json_object_array_add(seats, ipc_json_describe_seat(seat));
 		}
-		const char *json_string = json_object_to_json_string(seats);
-		client_valid =
-			ipc_send_reply(client, json_string, (uint32_t)strlen(json_string));
+		client_valid = ipc_send_object(client, seats);
 		json_object_put(seats); // free
 		goto exit_cleanup;
 	}
 
+	case IPC_GET_CLIENTS:
+	{
+		json_object *clients = json_object_new_array();
+		for (int i = 0; i < ipc_client_list->length; ++i) {
+			struct ipc_client *ipc_client = ipc_client_list->items[i];
+			json_object *object = json_object_new_object();
+			json_object_object_add(object, "id",
+					json_object_new_int(ipc_client->id));
+
+			json_object *events = json_object_new_array();
+			for (uint32_t bit = 0; bit < 32; ++bit) {
+				if ((uint32_t)ipc_client->subscribed_events & (1u << bit)) {
+					enum ipc_command_type event = (1u << 31) | bit;
+					json_object_array_add(events,
+							json_object_new_string(ipc_event_name(event)));
+				}
+			}
+			json_object_object_add(object, "subscribed_events", events);
+
+			json_object_object_add(object, "queued_bytes",
+					json_object_new_int64(ipc_client->write_buffer_len));
+			json_object_object_add(object, "events_coalesced",
+					json_object_new_int64(ipc_client->events_coalesced));
+			json_object_object_add(object, "events_dropped",
+					json_object_new_int64(ipc_client->events_dropped));
+			json_object_object_add(object, "resync_pending",
+					json_object_new_boolean(ipc_client->resync_events != 0));
+			json_object_array_add(clients, object);
+		}
+		client_valid = ipc_send_object(client, clients);
+		json_object_put(clients); // free
+		goto exit_cleanup;
+	}
+
+	case IPC_GET_RENDER_STATS:
+	{
+		json_object *outputs = json_object_new_array();
+		for (int i = 0; i < root->outputs->length; ++i) {
+			struct sway_output *output = root->outputs->items[i];
+			json_object_array_add(outputs,
+					ipc_json_describe_render_stats(output));
+		}
+		client_valid = ipc_send_object(client, outputs);
+		json_object_put(outputs); // free
+		goto exit_cleanup;
+	}
+
+	case IPC_GET_TEXTURE_USAGE:
+	{
+		json_object *usage = ipc_json_describe_texture_usage();
+		client_valid = ipc_send_object(client, usage);
+		json_object_put(usage); // free
+		goto exit_cleanup;
+	}
+
+	case IPC_GET_TIMINGS:
+	{
+		json_object *timings = ipc_json_describe_timings(&server.timings);
+		client_valid = ipc_send_object(client, timings);
+		json_object_put(timings); // free
+		if (strcmp(buf, "reset") == 0) {
+			timings_reset(&server.timings);
+		}
+		goto exit_cleanup;
+	}
+
 	case IPC_GET_TREE:
 	{
-		json_object *tree = ipc_json_describe_node_recursive(&root->node);
-		const char *json_string = json_object_to_json_string(tree);
-		client_valid =
-			ipc_send_reply(client, json_string, (uint32_t) strlen(json_string));
-		json_object_put(tree);
+		// As for get_workspaces, hidden workspaces which haven't been arranged
+		// are described with the rect they will have once shown. Their
+		// containers keep the geometry of their last arrangement.
+		size_t length;
+		char *payload = ipc_json_describe_node_recursive(&root->node,
+				client->encoding, &length);
+		if (!payload) {
+			ipc_client_disconnect(client);
+			client_valid = false;
+			goto exit_cleanup;
+		}
+		client_valid = ipc_send_reply(client, payload, (uint32_t)length);
+		free(payload);
 		goto exit_cleanup;
 	}
 
@@ -754,9 +1116,7 @@ void ipc_client_handle_command(struct ipc_client *client) {
 	{
 		json_object *marks = json_object_new_array();
 		root_for_each_container(ipc_get_marks_callback, marks);
-		const char *json_string = json_object_to_json_string(marks);
-		client_valid =
-			ipc_send_reply(client, json_string, (uint32_t)strlen(json_string));
+		client_valid = ipc_send_object(client, marks);
 		json_object_put(marks);
 		goto exit_cleanup;
 	}
@@ -764,9 +1124,7 @@ void ipc_client_handle_command(struct ipc_client *client) {
 	case IPC_GET_VERSION:
 	{
 		json_object *version = ipc_json_get_version();
-		const char *json_string = json_object_to_json_string(version);
-		client_valid =
-			ipc_send_reply(client, json_string, (uint32_t)strlen(json_string));
+		client_valid = ipc_send_object(client, version);
 		json_object_put(version); // free
 		goto exit_cleanup;
 	}
@@ -780,10 +1138,7 @@ void ipc_client_handle_command(struct ipc_client *client) {
 				struct bar_config *bar = config->bars->items[i];
 				json_object_array_add(bars, json_object_new_string(bar->id));
 			}
-			const char *json_string = json_object_to_json_string(bars);
-			client_valid =
-				ipc_send_reply(client, json_string,
-					(uint32_t)strlen(json_string));
+			client_valid = ipc_send_object(client, bars);
 			json_object_put(bars); // free
 		} else {
 			// Send particular bar's details
@@ -797,15 +1152,11 @@ void ipc_client_handle_command(struct ipc_client *client) {
 			}
 			if (!bar) {
 				const char *error = "{ \"success\": false, \"error\": \"No bar with that ID\" }";
-				client_valid =
-					ipc_send_reply(client, error, (uint32_t)strlen(error));
+				client_valid = ipc_send_json_string(client, error);
 				goto exit_cleanup;
 			}
 			json_object *json = ipc_json_describe_bar_config(bar);
-			const char *json_string = json_object_to_json_string(json);
-			client_valid =
-				ipc_send_reply(client, json_string,
-					(uint32_t)strlen(json_string));
+			client_valid = ipc_send_object(client, json);
 			json_object_put(json); // free
 		}
 		goto exit_cleanup;
@@ -818,9 +1169,7 @@ void ipc_client_handle_command(struct ipc_client *client) {
 			struct sway_mode *mode = config->modes->items[i];
 			json_object_array_add(modes, json_object_new_string(mode->name));
 		}
-		const char *json_string = json_object_to_json_string(modes);
-		client_valid =
-			ipc_send_reply(client, json_string, (uint32_t)strlen(json_string));
+		client_valid = ipc_send_object(client, modes);
 		json_object_put(modes); // free
 		goto exit_cleanup;
 	}
@@ -829,9 +1178,7 @@ void ipc_client_handle_command(struct ipc_client *client) {
 	{
 		json_object *json = json_object_new_object();
 		json_object_object_add(json, "config", json_object_new_string(config->current_config));
-		const char *json_string = json_object_to_json_string(json);
-		client_valid =
-			ipc_send_reply(client, json_string, (uint32_t)strlen(json_string));
+		client_valid = ipc_send_object(client, json);
 		json_object_put(json); // free
 		goto exit_cleanup;
     }
@@ -840,7 +1187,33 @@ void ipc_client_handle_command(struct ipc_client *client) {
 	{
 		// It was decided sway will not support this, just return success:false
 		const char msg[] = "{\"success\": false}";
-		ipc_send_reply(client, msg, strlen(msg));
+		ipc_send_json_string(client, msg);
+		goto exit_cleanup;
+	}
+
+	case IPC_SET_ENCODING:
+	{
+		// The reply is sent in the previous encoding, so that the client
+		// knows how to read it
+		enum ipc_encoding encoding = client->encoding;
+		bool found = false;
+		for (int i = 0; i < IPC_ENCODING_COUNT; ++i) {
+			if (strcmp(buf, ipc_encoding_name(i)) == 0) {
+				encoding = i;
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			wlr_log(WLR_INFO, "Unsupported IPC encoding '%s'", buf);
+		}
+		json_object *json = json_object_new_object();
+		json_object_object_add(json, "success", json_object_new_boolean(found));
+		client_valid = ipc_send_object(client, json);
+		json_object_put(json);
+		if (client_valid) {
+			client->encoding = encoding;
+		}
 		goto exit_cleanup;
 	}
 
@@ -867,17 +1240,18 @@ bool ipc_send_reply(struct ipc_client *client, const char *payload, uint32_t pay
 	memcpy(&data32[0], &payload_length, sizeof(payload_length));
 	memcpy(&data32[1], &client->current_command, sizeof(client->current_command));
 
-	while (client->write_buffer_len + ipc_header_size + payload_length >=
-				 client->write_buffer_size) {
-		client->write_buffer_size *= 2;
-	}
-
-	if (client->write_buffer_size > 4e6) { // 4 MB
+	if (client->write_buffer_len + ipc_header_size + payload_length >=
+			ipc_max_write_buffer_size) {
 		wlr_log(WLR_ERROR, "Client write buffer too big, disconnecting client");
 		ipc_client_disconnect(client);
 		return false;
 	}
 
+	while (client->write_buffer_len + ipc_header_size + payload_length >=
+				 client->write_buffer_size) {
+		client->write_buffer_size *= 2;
+	}
+
 	char *new_buffer = realloc(client->write_buffer, client->write_buffer_size);
 	if (!new_buffer) {
 		wlr_log(WLR_ERROR, "Unable to reallocate ipc client write buffer");
@@ -897,6 +1271,12 @@ bool ipc_send_reply(struct ipc_client *client, const char *payload, uint32_t pay
 				ipc_client_handle_writable, client);
 	}
 
-	wlr_log(WLR_DEBUG, "Added IPC reply to client %d queue: %s", client->fd, payload);
+	if (client->encoding == IPC_ENCODING_JSON) {
+		wlr_log(WLR_DEBUG, "Added IPC reply to client %d queue: %.*s",
+				client->fd, (int)payload_length, payload);
+	} else {
+		wlr_log(WLR_DEBUG, "Added %s IPC reply of %u bytes to client %d queue",
+				ipc_encoding_name(client->encoding), payload_length, client->fd);
+	}
 	return true;
 }
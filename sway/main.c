@@ -207,6 +207,10 @@ void enable_debug_flag(const char *flag) {
 		debug.damage = DAMAGE_RERENDER;
 	} else if (strcmp(flag, "noatomic") == 0) {
 		debug.noatomic = true;
+	} else if (strcmp(flag, "noocclusion") == 0) {
+		debug.noocclusion = true;
+	} else if (strcmp(flag, "render-stats") == 0) {
+		debug.render_stats = true;
 	} else if (strcmp(flag, "render-tree") == 0) {
 		debug.render_tree = true;
 	} else if (strcmp(flag, "txn-wait") == 0) {
@@ -0,0 +1,23 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include "sway/timing.h"
+
+void timing_add(struct sway_timing *timing, int64_t nsec) {
+	timing->samples[timing->next] = nsec;
+	timing->next = (timing->next + 1) % TIMING_SAMPLES;
+	if (timing->length < TIMING_SAMPLES) {
+		++timing->length;
+	}
+	++timing->count;
+}
+
+int64_t timing_since(const struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)(now.tv_sec - start->tv_sec) * 1000000000 +
+		(now.tv_nsec - start->tv_nsec);
+}
+
+void timings_reset(struct sway_timings *timings) {
+	memset(timings, 0, sizeof(*timings));
+}
@@ -3,11 +3,14 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
+#include "sway/ipc-json.h"
 #include "sway/tree/arrange.h"
 #include "sway/tree/container.h"
 #include "sway/output.h"
+#include "sway/server.h"
 #include "sway/tree/workspace.h"
 #include "sway/tree/view.h"
 #include "list.h"
@@ -126,6 +129,22 @@ static void apply_stacked_layout(list_t *children, struct wlr_box *parent) {
 	}
 }
 
+// Arranging recurses, so only the outermost call is timed
+static int arrange_depth = 0;
+static struct timespec arrange_start;
+
+static void arrange_timing_begin(void) {
+	if (arrange_depth++ == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &arrange_start);
+	}
+}
+
+static void arrange_timing_end(void) {
+	if (--arrange_depth == 0) {
+		timing_add(&server.timings.arrange, timing_since(&arrange_start));
+	}
+}
+
 static void arrange_floating(list_t *floating) {
 	for (int i = 0; i < floating->length; ++i) {
 		struct sway_container *floater = floating->items[i];
@@ -165,25 +184,25 @@ void arrange_container(struct sway_container *container) {
 	if (config->reloading) {
 		return;
 	}
+	if (container->workspace && container->workspace->arrange_stale) {
+		// The whole workspace is arranged once it's shown
+		return;
+	}
+	arrange_timing_begin();
 	if (container->view) {
 		view_autoconfigure(container->view);
-		node_set_dirty(&container->node);
-		return;
+	} else {
+		struct wlr_box box;
+		container_get_box(container, &box);
+		arrange_children(container->children, container->layout, &box);
 	}
-	struct wlr_box box;
-	container_get_box(container, &box);
-	arrange_children(container->children, container->layout, &box);
 	node_set_dirty(&container->node);
+	arrange_timing_end();
 }
 
-void arrange_workspace(struct sway_workspace *workspace) {
-	if (config->reloading) {
-		return;
-	}
-	if (!workspace->output) {
-		// Happens when there are no outputs connected
-		return;
-	}
+static void workspace_arrange(struct sway_workspace *workspace) {
+	arrange_timing_begin();
+	workspace->arrange_stale = false;
 	struct sway_output *output = workspace->output;
 	struct wlr_box *area = &output->usable_area;
 	wlr_log(WLR_DEBUG, "Usable area for ws: %dx%d@%d,%d",
@@ -232,39 +251,88 @@ void arrange_workspace(struct sway_workspace *workspace) {
 		arrange_children(workspace->tiling, workspace->layout, &box);
 		arrange_floating(workspace->floating);
 	}
+	arrange_timing_end();
+}
+
+void arrange_workspace(struct sway_workspace *workspace) {
+	if (config->reloading) {
+		return;
+	}
+	if (!workspace->output) {
+		// Happens when there are no outputs connected
+		return;
+	}
+	// Arranging a hidden workspace configures all of its views, which is
+	// wasted on a workspace nobody is looking at. Workspaces which have never
+	// been arranged still are, so that their geometry is never empty.
+	bool first_arrange = workspace->width == 0 && workspace->height == 0;
+	if (!first_arrange && !workspace_is_visible(workspace)) {
+		if (!workspace->arrange_stale) {
+			wlr_log(WLR_DEBUG, "Deferring arrangement of hidden workspace '%s'",
+					workspace->name);
+			workspace->arrange_stale = true;
+		}
+		// Its IPC description is based on the output, which may have changed
+		ipc_json_invalidate_node(&workspace->node);
+		return;
+	}
+	workspace_arrange(workspace);
+}
+
+void arrange_workspace_if_stale(struct sway_workspace *workspace) {
+	if (!workspace->arrange_stale || config->reloading || !workspace->output) {
+		return;
+	}
+	workspace_arrange(workspace);
+}
+
+void arrange_stale_workspaces(void) {
+	for (int i = 0; i < root->outputs->length; ++i) {
+		struct sway_output *output = root->outputs->items[i];
+		struct sway_workspace *workspace = output_get_active_workspace(output);
+		if (workspace) {
+			arrange_workspace_if_stale(workspace);
+		}
+	}
 }
 
 void arrange_output(struct sway_output *output) {
 	if (config->reloading) {
 		return;
 	}
+	arrange_timing_begin();
 	const struct wlr_box *output_box = wlr_output_layout_get_box(
 			root->output_layout, output->wlr_output);
 	output->lx = output_box->x;
 	output->ly = output_box->y;
 	output->width = output_box->width;
 	output->height = output_box->height;
+	ipc_json_invalidate_node(&output->node);
 
 	for (int i = 0; i < output->workspaces->length; ++i) {
 		struct sway_workspace *workspace = output->workspaces->items[i];
 		arrange_workspace(workspace);
 	}
+	arrange_timing_end();
 }
 
 void arrange_root(void) {
 	if (config->reloading) {
 		return;
 	}
+	arrange_timing_begin();
 	const struct wlr_box *layout_box =
 		wlr_output_layout_get_box(root->output_layout, NULL);
 	root->x = layout_box->x;
 	root->y = layout_box->y;
 	root->width = layout_box->width;
 	root->height = layout_box->height;
+	ipc_json_invalidate_node(&root->node);
 	for (int i = 0; i < root->outputs->length; ++i) {
 		struct sway_output *output = root->outputs->items[i];
 		arrange_output(output);
 	}
+	arrange_timing_end();
 }
 
 void arrange_node(struct sway_node *node) {
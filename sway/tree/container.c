@@ -12,9 +12,11 @@
 #include "pango.h"
 #include "sway/config.h"
 #include "sway/desktop.h"
+#include "sway/desktop/text_texture.h"
 #include "sway/desktop/transaction.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
+#include "sway/ipc-json.h"
 #include "sway/ipc-server.h"
 #include "sway/output.h"
 #include "sway/server.h"
@@ -60,19 +62,20 @@ void container_destroy(struct sway_container *con) {
 	}
 	free(con->title);
 	free(con->formatted_title);
-	wlr_texture_destroy(con->title_focused);
-	wlr_texture_destroy(con->title_focused_inactive);
-	wlr_texture_destroy(con->title_unfocused);
-	wlr_texture_destroy(con->title_urgent);
+	ipc_json_invalidate_node(&con->node);
+	text_texture_release(con->title_focused);
+	text_texture_release(con->title_focused_inactive);
+	text_texture_release(con->title_unfocused);
+	text_texture_release(con->title_urgent);
 	list_free(con->children);
 	list_free(con->current.children);
 	list_free(con->outputs);
 
 	list_free_items_and_destroy(con->marks);
-	wlr_texture_destroy(con->marks_focused);
-	wlr_texture_destroy(con->marks_focused_inactive);
-	wlr_texture_destroy(con->marks_unfocused);
-	wlr_texture_destroy(con->marks_urgent);
+	text_texture_release(con->marks_focused);
+	text_texture_release(con->marks_focused_inactive);
+	text_texture_release(con->marks_unfocused);
+	text_texture_release(con->marks_urgent);
 
 	if (con->view) {
 		if (con->view->container == con) {
@@ -436,66 +439,31 @@ struct sway_output *container_get_effective_output(struct sway_container *con) {
 }
 
 static void update_title_texture(struct sway_container *con,
-		struct wlr_texture **texture, struct border_colors *class) {
+		struct sway_text_texture **texture, struct border_colors *class) {
 	struct sway_output *output = container_get_effective_output(con);
 	if (!output) {
 		return;
 	}
-	if (*texture) {
-		wlr_texture_destroy(*texture);
-		*texture = NULL;
-	}
 	if (!con->formatted_title) {
+		text_texture_release(*texture);
+		*texture = NULL;
 		return;
 	}
 
 	double scale = output->wlr_output->scale;
-	int width = 0;
-	int height = con->title_height * scale;
-
-	// We must use a non-nil cairo_t for cairo_set_font_options to work.
-	// Therefore, we cannot use cairo_create(NULL).
-	cairo_surface_t *dummy_surface = cairo_image_surface_create(
-			CAIRO_FORMAT_ARGB32, 0, 0);
-	cairo_t *c = cairo_create(dummy_surface);
-	cairo_set_antialias(c, CAIRO_ANTIALIAS_BEST);
-	cairo_font_options_t *fo = cairo_font_options_create();
-	cairo_font_options_set_hint_style(fo, CAIRO_HINT_STYLE_FULL);
-	cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_SUBPIXEL);
-	cairo_font_options_set_subpixel_order(fo, to_cairo_subpixel_order(output->wlr_output->subpixel));
-	cairo_set_font_options(c, fo);
-	get_text_size(c, config->font, &width, NULL, NULL, scale,
-			config->pango_markup, "%s", con->formatted_title);
-	cairo_surface_destroy(dummy_surface);
-	cairo_destroy(c);
-
-	cairo_surface_t *surface = cairo_image_surface_create(
-			CAIRO_FORMAT_ARGB32, width, height);
-	cairo_t *cairo = cairo_create(surface);
-	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
-	cairo_set_font_options(cairo, fo);
-	cairo_font_options_destroy(fo);
-	cairo_set_source_rgba(cairo, class->background[0], class->background[1],
-			class->background[2], class->background[3]);
-	cairo_paint(cairo);
-	PangoContext *pango = pango_cairo_create_context(cairo);
-	cairo_set_source_rgba(cairo, class->text[0], class->text[1],
-			class->text[2], class->text[3]);
-	cairo_move_to(cairo, 0, 0);
-
-	pango_printf(cairo, config->font, scale, config->pango_markup,
-			"%s", con->formatted_title);
-
-	cairo_surface_flush(surface);
-	unsigned char *data = cairo_image_surface_get_data(surface);
-	int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(
-			output->wlr_output->backend);
-	*texture = wlr_texture_from_pixels(
-			renderer, WL_SHM_FORMAT_ARGB8888, stride, width, height, data);
-	cairo_surface_destroy(surface);
-	g_object_unref(pango);
-	cairo_destroy(cairo);
+	struct sway_text_texture_key key = {
+		.text = con->formatted_title,
+		.font = config->font,
+		.markup = config->pango_markup,
+		.subpixel_antialias = true,
+		.scale = scale,
+		.subpixel = output->wlr_output->subpixel,
+		.height = con->title_height * scale,
+		.renderer = wlr_backend_get_renderer(output->wlr_output->backend),
+	};
+	memcpy(key.foreground, class->text, sizeof(key.foreground));
+	memcpy(key.background, class->background, sizeof(key.background));
+	text_texture_update(texture, &key);
 }
 
 void container_update_title_textures(struct sway_container *container) {
@@ -1011,7 +979,9 @@ void container_discover_outputs(struct sway_container *con) {
 	double old_scale = old_output && old_output->enabled ?
 		old_output->wlr_output->scale : -1;
 	double new_scale = new_output ? new_output->wlr_output->scale : -1;
-	if (old_scale != new_scale) {
+	// Textures for the new output are usually cached already, in which case
+	// this is cheap
+	if (old_output != new_output || old_scale != new_scale) {
 		container_update_title_textures(con);
 		container_update_marks_textures(con);
 	}
@@ -1266,6 +1236,7 @@ bool container_find_and_unmark(char *mark) {
 			free(con_mark);
 			list_del(con->marks, i);
 			container_update_marks_textures(con);
+			ipc_json_invalidate_node(&con->node);
 			ipc_event_window(con, "mark");
 			return true;
 		}
@@ -1278,6 +1249,7 @@ void container_clear_marks(struct sway_container *con) {
 		free(con->marks->items[i]);
 	}
 	con->marks->length = 0;
+	ipc_json_invalidate_node(&con->node);
 	ipc_event_window(con, "mark");
 }
 
@@ -1293,20 +1265,19 @@ bool container_has_mark(struct sway_container *con, char *mark) {
 
 void container_add_mark(struct sway_container *con, char *mark) {
 	list_add(con->marks, strdup(mark));
+	ipc_json_invalidate_node(&con->node);
 	ipc_event_window(con, "mark");
 }
 
 static void update_marks_texture(struct sway_container *con,
-		struct wlr_texture **texture, struct border_colors *class) {
+		struct sway_text_texture **texture, struct border_colors *class) {
 	struct sway_output *output = container_get_effective_output(con);
 	if (!output) {
 		return;
 	}
-	if (*texture) {
-		wlr_texture_destroy(*texture);
-		*texture = NULL;
-	}
 	if (!con->marks->length) {
+		text_texture_release(*texture);
+		*texture = NULL;
 		return;
 	}
 
@@ -1335,38 +1306,19 @@ static void update_marks_texture(struct sway_container *con,
 	free(part);
 
 	double scale = output->wlr_output->scale;
-	int width = 0;
-	int height = con->title_height * scale;
-
-	cairo_t *c = cairo_create(NULL);
-	get_text_size(c, config->font, &width, NULL, NULL, scale, false,
-			"%s", buffer);
-	cairo_destroy(c);
-
-	cairo_surface_t *surface = cairo_image_surface_create(
-			CAIRO_FORMAT_ARGB32, width, height);
-	cairo_t *cairo = cairo_create(surface);
-	cairo_set_source_rgba(cairo, class->background[0], class->background[1],
-			class->background[2], class->background[3]);
-	cairo_paint(cairo);
-	PangoContext *pango = pango_cairo_create_context(cairo);
-	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
-	cairo_set_source_rgba(cairo, class->text[0], class->text[1],
-			class->text[2], class->text[3]);
-	cairo_move_to(cairo, 0, 0);
-
-	pango_printf(cairo, config->font, scale, false, "%s", buffer);
-
-	cairo_surface_flush(surface);
-	unsigned char *data = cairo_image_surface_get_data(surface);
-	int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(
-			output->wlr_output->backend);
-	*texture = wlr_texture_from_pixels(
-			renderer, WL_SHM_FORMAT_ARGB8888, stride, width, height, data);
-	cairo_surface_destroy(surface);
-	g_object_unref(pango);
-	cairo_destroy(cairo);
+	struct sway_text_texture_key key = {
+		.text = buffer,
+		.font = config->font,
+		.markup = false,
+		.subpixel_antialias = false,
+		.scale = scale,
+		.subpixel = WL_OUTPUT_SUBPIXEL_UNKNOWN,
+		.height = con->title_height * scale,
+		.renderer = wlr_backend_get_renderer(output->wlr_output->backend),
+	};
+	memcpy(key.foreground, class->text, sizeof(key.foreground));
+	memcpy(key.background, class->background, sizeof(key.background));
+	text_texture_update(texture, &key);
 	free(buffer);
 }
 
@@ -1,4 +1,5 @@
 #define _POSIX_C_SOURCE 200809L
+#include "sway/ipc-json.h"
 #include "sway/output.h"
 #include "sway/server.h"
 #include "sway/tree/container.h"
@@ -30,6 +31,7 @@ const char *node_type_to_str(enum sway_node_type type) {
 }
 
 void node_set_dirty(struct sway_node *node) {
+	ipc_json_invalidate_node(node);
 	if (node->dirty) {
 		return;
 	}
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <strings.h>
 #include <wlr/types/wlr_output_damage.h>
+#include "sway/ipc-json.h"
 #include "sway/ipc-server.h"
 #include "sway/layers.h"
 #include "sway/output.h"
@@ -203,6 +204,11 @@ void output_destroy(struct sway_output *output) {
 	}
 	list_free(output->workspaces);
 	list_free(output->current.workspaces);
+	if (output->repaint_timer) {
+		wl_event_source_remove(output->repaint_timer);
+	}
+	ipc_json_invalidate_node(&output->node);
+	free(output->swaybg_config);
 	free(output);
 }
 
@@ -225,10 +231,7 @@ void output_disable(struct sway_output *output) {
 
 	root_for_each_container(untrack_output, output);
 
-	if (output->bg_pid) {
-		terminate_swaybg(output->bg_pid);
-		output->bg_pid = 0;
-	}
+	update_swaybg(output, NULL);
 
 	int index = list_find(root->outputs, output);
 	list_del(root->outputs, index);
@@ -5,6 +5,7 @@
 #include <wlr/types/wlr_output_layout.h>
 #include "sway/desktop/transaction.h"
 #include "sway/input/seat.h"
+#include "sway/ipc-json.h"
 #include "sway/ipc-server.h"
 #include "sway/output.h"
 #include "sway/tree/arrange.h"
@@ -53,6 +54,7 @@ void root_destroy(struct sway_root *root) {
 	list_free(root->saved_workspaces);
 	list_free(root->outputs);
 	wlr_output_layout_destroy(root->output_layout);
+	ipc_json_invalidate_node(&root->node);
 	free(root);
 }
 
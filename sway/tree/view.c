@@ -18,6 +18,7 @@
 #include "sway/desktop.h"
 #include "sway/desktop/transaction.h"
 #include "sway/input/cursor.h"
+#include "sway/ipc-json.h"
 #include "sway/ipc-server.h"
 #include "sway/output.h"
 #include "sway/input/seat.h"
@@ -626,6 +627,12 @@ void view_map(struct sway_view *view, struct wlr_surface *wlr_surface,
 	if (should_focus(view)) {
 		input_manager_set_focus(&view->container->node);
 	}
+
+	// Arranging a hidden workspace is deferred until it's shown, but the view
+	// still needs a size to start with
+	if (view->container->workspace) {
+		arrange_workspace_if_stale(view->container->workspace);
+	}
 }
 
 void view_unmap(struct sway_view *view) {
@@ -667,6 +674,12 @@ void view_update_size(struct sway_view *view, int width, int height) {
 				"Expected a floating container")) {
 		return;
 	}
+	// The view chose this size itself, so it's the one it wants when floating
+	if (view->natural_width != width || view->natural_height != height) {
+		view->natural_width = width;
+		view->natural_height = height;
+		ipc_json_invalidate_node(&view->container->node);
+	}
 	view->container->content_width = width;
 	view->container->content_height = height;
 	view->container->current.content_width = width;
@@ -968,6 +981,7 @@ void view_update_title(struct sway_view *view, bool force) {
 	// Update title after the global font height is updated
 	container_update_title_textures(view->container);
 
+	ipc_json_invalidate_node(&view->container->node);
 	ipc_event_window(view->container, "title");
 }
 
@@ -1035,6 +1049,11 @@ void view_set_urgent(struct sway_view *view, bool enable) {
 	}
 	container_damage_whole(view->container);
 
+	// Ancestors report whether they have an urgent child
+	for (struct sway_node *node = &view->container->node; node;
+			node = node_get_parent(node)) {
+		ipc_json_invalidate_node(node);
+	}
 	ipc_event_window(view->container, "urgent");
 
 	if (view->container->workspace) {
@@ -9,6 +9,7 @@
 #include "sway/input/input-manager.h"
 #include "sway/input/cursor.h"
 #include "sway/input/seat.h"
+#include "sway/ipc-json.h"
 #include "sway/ipc-server.h"
 #include "sway/output.h"
 #include "sway/tree/arrange.h"
@@ -143,6 +144,7 @@ void workspace_destroy(struct sway_workspace *workspace) {
 
 	free(workspace->name);
 	free(workspace->representation);
+	ipc_json_invalidate_node(&workspace->node);
 	list_free_items_and_destroy(workspace->output_priority);
 	list_free(workspace->floating);
 	list_free(workspace->tiling);
@@ -572,6 +574,7 @@ void workspace_detect_urgent(struct sway_workspace *workspace) {
 
 	if (workspace->urgent != new_urgent) {
 		workspace->urgent = new_urgent;
+		ipc_json_invalidate_node(&workspace->node);
 		ipc_event_workspace(NULL, workspace, "urgent");
 		output_damage_whole(workspace->output);
 	}
@@ -707,11 +710,9 @@ void workspace_remove_gaps(struct sway_workspace *ws) {
 	ws->current_gaps.left = 0;
 }
 
-void workspace_add_gaps(struct sway_workspace *ws) {
-	if (ws->current_gaps.top > 0 || ws->current_gaps.right > 0 ||
-			ws->current_gaps.bottom > 0 || ws->current_gaps.left > 0) {
-		return;
-	}
+static void workspace_get_gaps(struct sway_workspace *ws,
+		struct side_gaps *gaps) {
+	*gaps = (struct side_gaps){0};
 	if (config->smart_gaps) {
 		struct sway_seat *seat = input_manager_get_default_seat();
 		struct sway_container *focus =
@@ -724,16 +725,24 @@ void workspace_add_gaps(struct sway_workspace *ws) {
 		}
 	}
 
-	ws->current_gaps = ws->gaps_outer;
+	*gaps = ws->gaps_outer;
 	if (ws->layout == L_TABBED || ws->layout == L_STACKED) {
 		// We have to add inner gaps for this, because children of tabbed and
 		// stacked containers don't apply their own gaps - they assume the
 		// tabbed/stacked container is using gaps.
-		ws->current_gaps.top += ws->gaps_inner;
-		ws->current_gaps.right += ws->gaps_inner;
-		ws->current_gaps.bottom += ws->gaps_inner;
-		ws->current_gaps.left += ws->gaps_inner;
+		gaps->top += ws->gaps_inner;
+		gaps->right += ws->gaps_inner;
+		gaps->bottom += ws->gaps_inner;
+		gaps->left += ws->gaps_inner;
 	}
+}
+
+void workspace_add_gaps(struct sway_workspace *ws) {
+	if (ws->current_gaps.top > 0 || ws->current_gaps.right > 0 ||
+			ws->current_gaps.bottom > 0 || ws->current_gaps.left > 0) {
+		return;
+	}
+	workspace_get_gaps(ws, &ws->current_gaps);
 
 	ws->x += ws->current_gaps.left;
 	ws->y += ws->current_gaps.top;
@@ -765,6 +774,7 @@ void workspace_update_representation(struct sway_workspace *ws) {
 		return;
 	}
 	container_build_representation(ws->layout, ws->tiling, ws->representation);
+	ipc_json_invalidate_node(&ws->node);
 }
 
 void workspace_get_box(struct sway_workspace *workspace, struct wlr_box *box) {
@@ -774,6 +784,23 @@ void workspace_get_box(struct sway_workspace *workspace, struct wlr_box *box) {
 	box->height = workspace->height;
 }
 
+void workspace_get_arranged_box(struct sway_workspace *workspace,
+		struct wlr_box *box) {
+	struct sway_output *output = workspace->output;
+	if (!workspace->arrange_stale || !output) {
+		workspace_get_box(workspace, box);
+		return;
+	}
+	// Mirrors workspace_arrange, without touching the workspace
+	struct side_gaps gaps;
+	workspace_get_gaps(workspace, &gaps);
+	struct wlr_box *area = &output->usable_area;
+	box->x = output->wlr_output->lx + area->x + gaps.left;
+	box->y = output->wlr_output->ly + area->y + gaps.top;
+	box->width = area->width - gaps.left - gaps.right;
+	box->height = area->height - gaps.top - gaps.bottom;
+}
+
 static void count_tiling_views(struct sway_container *con, void *data) {
 	if (con->view && !container_is_floating_or_child(con)) {
 		size_t *count = data;
@@ -53,8 +53,7 @@ static void swaybar_output_free(struct swaybar_output *output) {
 	}
 	zxdg_output_v1_destroy(output->xdg_output);
 	wl_output_destroy(output->output);
-	destroy_buffer(&output->buffers[0]);
-	destroy_buffer(&output->buffers[1]);
+	destroy_buffer_pool(&output->buffers);
 	free_hotspots(&output->hotspots);
 	free_workspaces(&output->workspaces);
 	wl_list_remove(&output->link);
@@ -336,13 +335,12 @@ static const struct wl_registry_listener registry_listener = {
 
 bool bar_setup(struct swaybar *bar, const char *socket_path) {
 	bar->visible = true;
+	bar->running = true;
 	bar->config = init_config();
 	wl_list_init(&bar->outputs);
 	bar->eventloop = loop_create();
 
-	bar->ipc_socketfd = ipc_open_socket(socket_path);
-	bar->ipc_event_socketfd = ipc_open_socket(socket_path);
-	if (!ipc_initialize(bar)) {
+	if (!ipc_initialize(bar, socket_path)) {
 		return false;
 	}
 	if (bar->config->status_command) {
@@ -391,13 +389,6 @@ static void display_in(int fd, short mask, void *data) {
 	}
 }
 
-static void ipc_in(int fd, short mask, void *data) {
-	struct swaybar *bar = data;
-	if (handle_ipc_readable(bar)) {
-		set_bar_dirty(bar);
-	}
-}
-
 static void status_in(int fd, short mask, void *data) {
 	struct swaybar *bar = data;
 	if (mask & (POLLHUP | POLLERR)) {
@@ -412,7 +403,6 @@ static void status_in(int fd, short mask, void *data) {
 void bar_run(struct swaybar *bar) {
 	loop_add_fd(bar->eventloop, wl_display_get_fd(bar->display), POLLIN,
 			display_in, bar);
-	loop_add_fd(bar->eventloop, bar->ipc_event_socketfd, POLLIN, ipc_in, bar);
 	if (bar->status) {
 		loop_add_fd(bar->eventloop, bar->status->read_fd, POLLIN,
 				status_in, bar);
@@ -422,7 +412,7 @@ void bar_run(struct swaybar *bar) {
 		loop_add_fd(bar->eventloop, bar->tray->fd, POLLIN, tray_in, bar->tray->bus);
 	}
 #endif
-	while (1) {
+	while (bar->running) {
 		errno = 0;
 		if (wl_display_flush(bar->display) == -1 && errno != EAGAIN) {
 			break;
@@ -446,8 +436,8 @@ void bar_teardown(struct swaybar *bar) {
 	if (bar->config) {
 		free_config(bar->config);
 	}
-	close(bar->ipc_event_socketfd);
-	close(bar->ipc_socketfd);
+	ipc_connection_destroy(bar->ipc_event_connection);
+	ipc_connection_destroy(bar->ipc_connection);
 	if (bar->status) {
 		status_line_free(bar->status);
 	}
@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200809
 #include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <json-c/json.h>
@@ -8,14 +9,45 @@
 #include "swaybar/ipc.h"
 #include "config.h"
 #include "ipc-client.h"
+#include "ipc-encoding.h"
 #include "list.h"
 
 void ipc_send_workspace_command(struct swaybar *bar, const char *ws) {
 	const char *fmt = "workspace \"%s\"";
 	uint32_t size = snprintf(NULL, 0, fmt, ws);
-	char command[size];
-	snprintf(command, size, fmt, ws);
-	ipc_single_command(bar->ipc_socketfd, IPC_COMMAND, command, &size);
+	char command[size + 1];
+	snprintf(command, size + 1, fmt, ws);
+	// The reply isn't needed, so don't wait for it
+	ipc_connection_send(bar->ipc_connection, IPC_COMMAND, command, size,
+			NULL, NULL);
+}
+
+struct ipc_reply {
+	struct swaybar *bar;
+	json_object *json;
+};
+
+static void handle_reply(struct ipc_response *response, void *data) {
+	struct ipc_reply *reply = data;
+	if (response) {
+		reply->json = ipc_decode_payload(reply->bar->ipc_encoding,
+				response->payload, response->size);
+	}
+}
+
+/**
+ * Issue a command on the main socket and wait for its decoded reply. This is
+ * only used during startup, before the bar has anything to draw.
+ */
+static json_object *ipc_get_reply(struct swaybar *bar, uint32_t type,
+		const char *payload) {
+	struct ipc_reply reply = { .bar = bar };
+	uint32_t len = payload ? strlen(payload) : 0;
+	if (ipc_connection_send(bar->ipc_connection, type, payload, len,
+				handle_reply, &reply)) {
+		ipc_connection_roundtrip(bar->ipc_connection);
+	}
+	return reply.json;
 }
 
 char *parse_font(const char *font) {
@@ -144,13 +176,11 @@ static void ipc_parse_colors(
 }
 
 static bool ipc_parse_config(
-		struct swaybar_config *config, const char *payload) {
-	json_object *bar_config = json_tokener_parse(payload);
+		struct swaybar_config *config, json_object *bar_config) {
 	json_object *success;
 	if (json_object_object_get_ex(bar_config, "success", &success)
 			&& !json_object_get_boolean(success)) {
 		wlr_log(WLR_ERROR, "No bar with that ID. Use 'swaymsg -t get_bar_config to get the available bar configs.");
-		json_object_put(bar_config);
 		return false;
 	}
 	json_object *markup, *mode, *hidden_state, *position, *status_command;
@@ -317,24 +347,15 @@ static bool ipc_parse_config(
 	}
 #endif
 
-	json_object_put(bar_config);
 	return true;
 }
 
-bool ipc_get_workspaces(struct swaybar *bar) {
+static void ipc_parse_workspaces(struct swaybar *bar, json_object *results) {
 	struct swaybar_output *output;
 	wl_list_for_each(output, &bar->outputs, link) {
 		free_workspaces(&output->workspaces);
 		output->focused = false;
 	}
-	uint32_t len = 0;
-	char *res = ipc_single_command(bar->ipc_socketfd,
-			IPC_GET_WORKSPACES, NULL, &len);
-	json_object *results = json_tokener_parse(res);
-	if (!results) {
-		free(res);
-		return false;
-	}
 
 	bar->visible_by_urgency = false;
 	size_t length = json_object_array_length(results);
@@ -388,16 +409,44 @@ bool ipc_get_workspaces(struct swaybar *bar) {
 			}
 		}
 	}
+	determine_bar_visibility(bar, false);
+}
+
+static void handle_get_workspaces(struct ipc_response *response, void *data) {
+	struct swaybar *bar = data;
+	bar->workspaces_pending = false;
+	if (!response) {
+		return;
+	}
+	if (bar->workspaces_outdated) {
+		// Skip drawing this reply, as a newer one will follow
+		bar->workspaces_outdated = false;
+		ipc_get_workspaces(bar);
+		return;
+	}
+	json_object *results = ipc_decode_payload(bar->ipc_encoding,
+			response->payload, response->size);
+	if (!results) {
+		wlr_log(WLR_ERROR, "failed to parse workspaces");
+		return;
+	}
+	ipc_parse_workspaces(bar, results);
 	json_object_put(results);
-	free(res);
-	return determine_bar_visibility(bar, false);
+}
+
+void ipc_get_workspaces(struct swaybar *bar) {
+	// Workspace events often come in bursts, so only keep one request in
+	// flight and send another once it has been answered
+	if (bar->workspaces_pending) {
+		bar->workspaces_outdated = true;
+		return;
+	}
+	bar->workspaces_pending = ipc_connection_send(bar->ipc_connection,
+			IPC_GET_WORKSPACES, NULL, 0, handle_get_workspaces, bar);
 }
 
 static void ipc_get_outputs(struct swaybar *bar) {
-	uint32_t len = 0;
-	char *res = ipc_single_command(bar->ipc_socketfd,
-			IPC_GET_OUTPUTS, NULL, &len);
-	json_object *outputs = json_tokener_parse(res);
+	json_object *outputs = ipc_get_reply(bar, IPC_GET_OUTPUTS, NULL);
 	for (size_t i = 0; i < json_object_array_length(outputs); ++i) {
 		json_object *output = json_object_array_get_idx(outputs, i);
 		json_object *output_name, *output_active;
@@ -425,36 +474,51 @@ static void ipc_get_outputs(struct swaybar *bar) {
 		}
 	}
 	json_object_put(outputs);
-	free(res);
 }
 
 void ipc_execute_binding(struct swaybar *bar, struct swaybar_binding *bind) {
 	wlr_log(WLR_DEBUG, "Executing binding for button %u (release=%d): `%s`",
 			bind->button, bind->release, bind->command);
-	uint32_t len = strlen(bind->command);
-	free(ipc_single_command(bar->ipc_socketfd,
-			IPC_COMMAND, bind->command, &len));
+	ipc_connection_send(bar->ipc_connection, IPC_COMMAND, bind->command,
+			strlen(bind->command), NULL, NULL);
 }
 
-bool ipc_initialize(struct swaybar *bar) {
-	uint32_t len = strlen(bar->id);
-	char *res = ipc_single_command(bar->ipc_socketfd,
-			IPC_GET_BAR_CONFIG, bar->id, &len);
-	if (!ipc_parse_config(bar->config, res)) {
-		free(res);
+static void handle_ipc_event(struct ipc_response *resp, void *data);
+
+bool ipc_initialize(struct swaybar *bar, const char *socket_path) {
+	bar->ipc_connection = ipc_connection_create(
+			ipc_open_socket(socket_path), bar->eventloop);
+	bar->ipc_event_connection = ipc_connection_create(
+			ipc_open_socket(socket_path), bar->eventloop);
+	if (!bar->ipc_connection || !bar->ipc_event_connection) {
+		return false;
+	}
+	ipc_connection_set_event_handler(bar->ipc_event_connection,
+			handle_ipc_event, bar);
+
+	// The bar queries the tree on every workspace event, so prefer the
+	// cheaper binary encoding when sway supports it
+	bar->ipc_encoding = ipc_set_encoding(bar->ipc_connection,
+			IPC_ENCODING_CBOR) ? IPC_ENCODING_CBOR : IPC_ENCODING_JSON;
+	bar->ipc_event_encoding = ipc_set_encoding(bar->ipc_event_connection,
+			IPC_ENCODING_CBOR) ? IPC_ENCODING_CBOR : IPC_ENCODING_JSON;
+
+	json_object *bar_config = ipc_get_reply(bar, IPC_GET_BAR_CONFIG, bar->id);
+	if (!bar_config || !ipc_parse_config(bar->config, bar_config)) {
+		json_object_put(bar_config);
 		return false;
 	}
-	free(res);
+	json_object_put(bar_config);
 	ipc_get_outputs(bar);
 
 	struct swaybar_config *config = bar->config;
 	char subscribe[128]; // suitably large buffer
-	len = snprintf(subscribe, 128,
+	uint32_t len = snprintf(subscribe, 128,
 			"[ \"barconfig_update\" , \"bar_state_update\" %s %s ]",
 			config->binding_mode_indicator ? ", \"mode\"" : "",
 			config->workspace_buttons ? ", \"workspace\"" : "");
-	free(ipc_single_command(bar->ipc_event_socketfd,
-			IPC_SUBSCRIBE, subscribe, &len));
+	ipc_connection_send(bar->ipc_event_connection, IPC_SUBSCRIBE,
+			subscribe, len, NULL, NULL);
 	return true;
 }
 
@@ -524,23 +588,31 @@ static bool handle_barconfig_update(struct swaybar *bar,
 	return determine_bar_visibility(bar, true);
 }
 
-bool handle_ipc_readable(struct swaybar *bar) {
-	struct ipc_response *resp = ipc_recv_response(bar->ipc_event_socketfd);
+static void handle_ipc_event(struct ipc_response *resp, void *data) {
+	struct swaybar *bar = data;
 	if (!resp) {
-		return false;
+		wlr_log(WLR_ERROR, "Lost the IPC connection to sway");
+		// The connection is still dispatching, so the bar is torn down once
+		// bar_run returns
+		bar->running = false;
+		bar->exit_code = 1;
+		return;
 	}
 
-	json_object *result = json_tokener_parse(resp->payload);
+	json_object *result = ipc_decode_payload(bar->ipc_event_encoding,
+			resp->payload, resp->size);
 	if (!result) {
-		wlr_log(WLR_ERROR, "failed to parse payload as json");
-		free_ipc_response(resp);
-		return false;
+		wlr_log(WLR_ERROR, "failed to parse payload as %s",
+				ipc_encoding_name(bar->ipc_event_encoding));
+		return;
 	}
 
 	bool bar_is_dirty = true;
 	switch (resp->type) {
 	case IPC_EVENT_WORKSPACE:
-		bar_is_dirty = ipc_get_workspaces(bar);
+		// The bar is redrawn once the reply arrives
+		ipc_get_workspaces(bar);
+		bar_is_dirty = false;
 		break;
 	case IPC_EVENT_MODE: {
 		json_object *json_change, *json_pango_markup;
@@ -570,6 +642,7 @@ bool handle_ipc_readable(struct swaybar *bar) {
 		break;
 	}
 	json_object_put(result);
-	free_ipc_response(resp);
-	return bar_is_dirty;
+	if (bar_is_dirty) {
+		set_bar_dirty(bar);
+	}
 }
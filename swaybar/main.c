@@ -104,5 +104,5 @@ int main(int argc, char **argv) {
 
 	bar_run(&swaybar);
 	bar_teardown(&swaybar);
-	return 0;
+	return swaybar.exit_code;
 }
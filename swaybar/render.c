@@ -545,7 +545,7 @@ void render_frame(struct swaybar_output *output) {
 	} else if (height > 0) {
 		// Replay recording into shm and send it off
 		output->current_buffer = get_next_buffer(output->bar->shm,
-				output->buffers,
+				&output->buffers,
 				output->width * output->scale,
 				output->height * output->scale);
 		if (!output->current_buffer) {
@@ -1,6 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include <cairo.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include "swaybar/bar.h"
@@ -18,21 +19,100 @@
 
 // TODO menu
 
+#define SCALED_ICONS_MAX 4
+
 static bool sni_ready(struct swaybar_sni *sni) {
 	return sni->status && (sni->status[0] == 'N' ? // NeedsAttention
 			sni->attention_icon_name || sni->attention_icon_pixmap :
 			sni->icon_name || sni->icon_pixmap);
 }
 
+static void clear_scaled_icons(struct swaybar_sni *sni) {
+	for (int i = 0; i < sni->scaled_icons->length; ++i) {
+		struct swaybar_scaled_icon *scaled = sni->scaled_icons->items[i];
+		cairo_surface_destroy(scaled->surface);
+		free(scaled);
+	}
+	while (sni->scaled_icons->length) {
+		list_del(sni->scaled_icons, sni->scaled_icons->length - 1);
+	}
+}
+
+static void set_sni_icon(struct swaybar_sni *sni, cairo_surface_t *icon) {
+	cairo_surface_destroy(sni->icon);
+	sni->icon = icon;
+	clear_scaled_icons(sni);
+}
+
+/**
+ * The icon scaled to the given size. The few sizes the bar needs, one for each
+ * output scale, are kept until the icon changes.
+ */
+static cairo_surface_t *get_scaled_icon(struct swaybar_sni *sni, int size) {
+	for (int i = 0; i < sni->scaled_icons->length; ++i) {
+		struct swaybar_scaled_icon *scaled = sni->scaled_icons->items[i];
+		if (scaled->size == size) {
+			return cairo_surface_reference(scaled->surface);
+		}
+	}
+
+	cairo_surface_t *surface = cairo_image_surface_scale(sni->icon, size, size);
+	struct swaybar_scaled_icon *scaled =
+		calloc(1, sizeof(struct swaybar_scaled_icon));
+	if (!scaled) {
+		return surface;
+	}
+	scaled->size = size;
+	scaled->surface = cairo_surface_reference(surface);
+	list_add(sni->scaled_icons, scaled);
+	if (sni->scaled_icons->length > SCALED_ICONS_MAX) {
+		struct swaybar_scaled_icon *oldest = sni->scaled_icons->items[0];
+		cairo_surface_destroy(oldest->surface);
+		free(oldest);
+		list_del(sni->scaled_icons, 0);
+	}
+	return surface;
+}
+
 static void set_sni_dirty(struct swaybar_sni *sni) {
 	if (sni_ready(sni)) {
 		sni->min_size = sni->max_size = 0; // invalidate previous icon
-		set_bar_dirty(sni->tray->bar);
+		set_tray_dirty(sni->tray);
+	}
+}
+
+static bool pixmaps_equal(list_t *a, list_t *b) {
+	if (!a || !b || a->length != b->length) {
+		return a == b;
+	}
+	for (int i = 0; i < a->length; ++i) {
+		struct swaybar_pixmap *pa = a->items[i], *pb = b->items[i];
+		if (pa->size != pb->size ||
+				memcmp(pa->pixels, pb->pixels, pa->size * pa->size * 4) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Pixmaps are sent as non-premultiplied ARGB in network byte order, so they
+ * are converted to what cairo uses once, when they are received.
+ */
+static void decode_pixels(unsigned char *dest, const unsigned char *src,
+		int npixels) {
+	uint32_t *out = (uint32_t *)dest;
+	for (int i = 0; i < npixels; ++i, src += 4) {
+		uint32_t a = src[0];
+		uint32_t r = src[1] * a / 255;
+		uint32_t g = src[2] * a / 255;
+		uint32_t b = src[3] * a / 255;
+		out[i] = a << 24 | r << 16 | g << 8 | b;
 	}
 }
 
 static int read_pixmap(sd_bus_message *msg, struct swaybar_sni *sni,
-		const char *prop, list_t **dest) {
+		const char *prop, list_t **dest, bool *changed) {
 	int ret = sd_bus_message_enter_container(msg, 'a', "(iiay)");
 	if (ret < 0) {
 		wlr_log(WLR_ERROR, "%s %s: %s", sni->watcher_id, prop, strerror(-ret));
@@ -41,7 +121,12 @@ static int read_pixmap(sd_bus_message *msg, struct swaybar_sni *sni,
 
 	if (sd_bus_message_at_end(msg, 0)) {
 		wlr_log(WLR_DEBUG, "%s %s no. of icons = 0", sni->watcher_id, prop);
-		return ret;
+		if (*dest) {
+			list_free_items_and_destroy(*dest);
+			*dest = NULL;
+			*changed = true;
+		}
+		return sd_bus_message_exit_container(msg);
 	}
 
 	list_t *pixmaps = create_list();
@@ -56,8 +141,8 @@ static int read_pixmap(sd_bus_message *msg, struct swaybar_sni *sni,
 			goto error;
 		}
 
-		int size;
-		ret = sd_bus_message_read(msg, "ii", NULL, &size);
+		int width, size;
+		ret = sd_bus_message_read(msg, "ii", &width, &size);
 		if (ret < 0) {
 			wlr_log(WLR_ERROR, "%s %s: %s", sni->watcher_id, prop, strerror(-ret));
 			goto error;
@@ -71,16 +156,31 @@ static int read_pixmap(sd_bus_message *msg, struct swaybar_sni *sni,
 			goto error;
 		}
 
-		struct swaybar_pixmap *pixmap =
-			malloc(sizeof(struct swaybar_pixmap) + npixels);
-		pixmap->size = size;
-		memcpy(pixmap->pixels, pixels, npixels);
-		list_add(pixmaps, pixmap);
+		if (size <= 0 || width != size ||
+				npixels < (size_t)size * size * 4) {
+			wlr_log(WLR_DEBUG, "%s %s: skipping %dx%d icon with %zu bytes",
+					sni->watcher_id, prop, width, size, npixels);
+		} else {
+			struct swaybar_pixmap *pixmap =
+				malloc(sizeof(struct swaybar_pixmap) + size * size * 4);
+			if (pixmap) {
+				pixmap->size = size;
+				decode_pixels(pixmap->pixels, pixels, size * size);
+				list_add(pixmaps, pixmap);
+			}
+		}
 
 		sd_bus_message_exit_container(msg);
 	}
+	sd_bus_message_exit_container(msg);
+
+	if (pixmaps_equal(*dest, pixmaps)) {
+		list_free_items_and_destroy(pixmaps);
+		return ret;
+	}
 	list_free_items_and_destroy(*dest);
 	*dest = pixmaps;
+	*changed = true;
 	wlr_log(WLR_DEBUG, "%s %s no. of icons = %d", sni->watcher_id, prop,
 			pixmaps->length);
 
@@ -90,82 +190,152 @@ error:
 	return ret;
 }
 
-struct get_property_data {
-	struct swaybar_sni *sni;
-	const char *prop;
-	const char *type;
-	void *dest;
+// The properties which are read, all at once with GetAll
+// Ignored: Category, Id, Title, WindowId, OverlayIconName,
+//          OverlayIconPixmap, AttentionMovieName, ToolTip
+static const struct sni_property {
+	const char *name;
+	const char *type; // NULL for pixmaps
+	size_t offset;
+} sni_properties[] = {
+	{ "Status", "s", offsetof(struct swaybar_sni, status) },
+	{ "IconName", "s", offsetof(struct swaybar_sni, icon_name) },
+	{ "IconPixmap", NULL, offsetof(struct swaybar_sni, icon_pixmap) },
+	{ "AttentionIconName", "s",
+		offsetof(struct swaybar_sni, attention_icon_name) },
+	{ "AttentionIconPixmap", NULL,
+		offsetof(struct swaybar_sni, attention_icon_pixmap) },
+	{ "ItemIsMenu", "b", offsetof(struct swaybar_sni, item_is_menu) },
+	{ "Menu", "o", offsetof(struct swaybar_sni, menu) },
+	// Non-standard KDE property
+	{ "IconThemePath", "s", offsetof(struct swaybar_sni, icon_theme_path) },
 };
 
-static int get_property_callback(sd_bus_message *msg, void *data,
+static int read_property(sd_bus_message *msg, struct swaybar_sni *sni,
+		const struct sni_property *prop, bool *changed) {
+	void *dest = (char *)sni + prop->offset;
+	const char *type = prop->type;
+
+	int ret = sd_bus_message_enter_container(msg, 'v', type);
+	if (ret < 0) {
+		wlr_log(WLR_ERROR, "%s %s: %s", sni->watcher_id, prop->name,
+				strerror(-ret));
+		return ret;
+	}
+
+	if (!type) {
+		ret = read_pixmap(msg, sni, prop->name, dest, changed);
+	} else if (*type == 's' || *type == 'o') {
+		char *str;
+		ret = sd_bus_message_read(msg, type, &str);
+		if (ret >= 0) {
+			char **current = dest;
+			if (!*current || strcmp(*current, str) != 0) {
+				free(*current);
+				*current = strdup(str);
+				*changed = true;
+				wlr_log(WLR_DEBUG, "%s %s = '%s'", sni->watcher_id,
+						prop->name, str);
+			}
+		}
+	} else if (*type == 'b') {
+		int value; // "b" reads into an int, not a bool
+		ret = sd_bus_message_read(msg, type, &value);
+		if (ret >= 0 && *(bool *)dest != !!value) {
+			*(bool *)dest = value;
+			*changed = true;
+			wlr_log(WLR_DEBUG, "%s %s = %s", sni->watcher_id, prop->name,
+					value ? "true" : "false");
+		}
+	}
+	if (ret < 0) {
+		wlr_log(WLR_ERROR, "%s %s: %s", sni->watcher_id, prop->name,
+				strerror(-ret));
+		return ret;
+	}
+	return sd_bus_message_exit_container(msg);
+}
+
+static void sni_get_properties_async(struct swaybar_sni *sni);
+
+static int get_all_callback(sd_bus_message *msg, void *data,
 		sd_bus_error *error) {
-	struct get_property_data *d = data;
-	struct swaybar_sni *sni = d->sni;
-	const char *prop = d->prop;
-	const char *type = d->type;
-	void *dest = d->dest;
+	struct swaybar_sni *sni = data;
+	sni->get_all_slot = sd_bus_slot_unref(sni->get_all_slot);
 
 	int ret;
+	bool changed = false;
 	if (sd_bus_message_is_method_error(msg, NULL)) {
-		wlr_log(WLR_ERROR, "%s %s: %s", sni->watcher_id, prop,
+		wlr_log(WLR_ERROR, "%s: %s", sni->watcher_id,
 				sd_bus_message_get_error(msg)->message);
 		ret = sd_bus_message_get_errno(msg);
 		goto cleanup;
 	}
 
-	ret = sd_bus_message_enter_container(msg, 'v', type);
+	ret = sd_bus_message_enter_container(msg, 'a', "{sv}");
 	if (ret < 0) {
-		wlr_log(WLR_ERROR, "%s %s: %s", sni->watcher_id, prop, strerror(-ret));
+		wlr_log(WLR_ERROR, "%s: %s", sni->watcher_id, strerror(-ret));
 		goto cleanup;
 	}
-
-	if (!type) {
-		ret = read_pixmap(msg, sni, prop, dest);
+	while ((ret = sd_bus_message_enter_container(msg, 'e', "sv")) > 0) {
+		const char *name;
+		ret = sd_bus_message_read(msg, "s", &name);
 		if (ret < 0) {
-			goto cleanup;
+			break;
 		}
-	} else {
-		if (*type == 's' || *type == 'o') {
-			free(*(char **)dest);
+		const struct sni_property *prop = NULL;
+		for (size_t i = 0;
+				i < sizeof(sni_properties) / sizeof(sni_properties[0]); ++i) {
+			if (strcmp(sni_properties[i].name, name) == 0) {
+				prop = &sni_properties[i];
+				break;
+			}
+		}
+		if (!prop) {
+			ret = sd_bus_message_skip(msg, "v");
+		} else if ((ret = read_property(msg, sni, prop, &changed)) < 0) {
+			// A property of the wrong type doesn't spoil the others, and
+			// read_property has logged it already
+			ret = sd_bus_message_skip(msg, "v");
 		}
-
-		ret = sd_bus_message_read(msg, type, dest);
 		if (ret < 0) {
-			wlr_log(WLR_ERROR, "%s %s: %s", sni->watcher_id, prop, strerror(-ret));
-			goto cleanup;
+			break;
 		}
-
-		if (*type == 's' || *type == 'o') {
-			char **str = dest;
-			*str = strdup(*str);
-			wlr_log(WLR_DEBUG, "%s %s = '%s'", sni->watcher_id, prop, *str);
-		} else if (*type == 'b') {
-			wlr_log(WLR_DEBUG, "%s %s = %s", sni->watcher_id, prop,
-					*(bool *)dest ? "true" : "false");
+		ret = sd_bus_message_exit_container(msg);
+		if (ret < 0) {
+			break;
 		}
 	}
+	if (ret < 0) {
+		wlr_log(WLR_ERROR, "%s: %s", sni->watcher_id, strerror(-ret));
+	}
 
-	if (strcmp(prop, "Status") == 0 || (sni->status && (sni->status[0] == 'N' ?
-				prop[0] == 'A' : strncmp(prop, "Icon", 4) == 0))) {
+cleanup:
+	if (changed) {
 		set_sni_dirty(sni);
 	}
-cleanup:
-	free(data);
+	if (sni->get_all_pending) {
+		// Something changed again while we were waiting for the reply
+		sni->get_all_pending = false;
+		sni_get_properties_async(sni);
+	}
 	return ret;
 }
 
-static void sni_get_property_async(struct swaybar_sni *sni, const char *prop,
-		const char *type, void *dest) {
-	struct get_property_data *data = malloc(sizeof(struct get_property_data));
-	data->sni = sni;
-	data->prop = prop;
-	data->type = type;
-	data->dest = dest;
-	int ret = sd_bus_call_method_async(sni->tray->bus, NULL, sni->service,
-			sni->path, "org.freedesktop.DBus.Properties", "Get",
-			get_property_callback, data, "ss", sni->interface, prop);
+/**
+ * Fetch every property with one call. While one is in flight, further
+ * requests are merged into a single one which is sent once it returns.
+ */
+static void sni_get_properties_async(struct swaybar_sni *sni) {
+	if (sni->get_all_slot) {
+		sni->get_all_pending = true;
+		return;
+	}
+	int ret = sd_bus_call_method_async(sni->tray->bus, &sni->get_all_slot,
+			sni->service, sni->path, "org.freedesktop.DBus.Properties",
+			"GetAll", get_all_callback, sni, "s", sni->interface);
 	if (ret < 0) {
-		wlr_log(WLR_ERROR, "%s %s: %s", sni->watcher_id, prop, strerror(-ret));
+		wlr_log(WLR_ERROR, "%s: %s", sni->watcher_id, strerror(-ret));
 	}
 }
 
@@ -198,16 +368,14 @@ static int sni_check_msg_sender(struct swaybar_sni *sni, sd_bus_message *msg,
 
 static int handle_new_icon(sd_bus_message *msg, void *data, sd_bus_error *error) {
 	struct swaybar_sni *sni = data;
-	sni_get_property_async(sni, "IconName", "s", &sni->icon_name);
-	sni_get_property_async(sni, "IconPixmap", NULL, &sni->icon_pixmap);
+	sni_get_properties_async(sni);
 	return sni_check_msg_sender(sni, msg, "icon");
 }
 
 static int handle_new_attention_icon(sd_bus_message *msg, void *data,
 		sd_bus_error *error) {
 	struct swaybar_sni *sni = data;
-	sni_get_property_async(sni, "AttentionIconName", "s", &sni->attention_icon_name);
-	sni_get_property_async(sni, "AttentionIconPixmap", NULL, &sni->attention_icon_pixmap);
+	sni_get_properties_async(sni);
 	return sni_check_msg_sender(sni, msg, "attention icon");
 }
 
@@ -220,14 +388,14 @@ static int handle_new_status(sd_bus_message *msg, void *data, sd_bus_error *erro
 		if (r < 0) {
 			wlr_log(WLR_ERROR, "%s new status error: %s", sni->watcher_id, strerror(-ret));
 			ret = r;
-		} else {
+		} else if (!sni->status || strcmp(sni->status, status) != 0) {
 			free(sni->status);
 			sni->status = strdup(status);
 			wlr_log(WLR_DEBUG, "%s has new status = '%s'", sni->watcher_id, status);
 			set_sni_dirty(sni);
 		}
 	} else {
-		sni_get_property_async(sni, "Status", "s", &sni->status);
+		sni_get_properties_async(sni);
 	}
 
 	return ret;
@@ -249,6 +417,7 @@ struct swaybar_sni *create_sni(char *id, struct swaybar_tray *tray) {
 		return NULL;
 	}
 	sni->tray = tray;
+	sni->scaled_icons = create_list();
 	sni->watcher_id = strdup(id);
 	char *path_ptr = strchr(id, '/');
 	if (!path_ptr) {
@@ -259,18 +428,9 @@ struct swaybar_sni *create_sni(char *id, struct swaybar_tray *tray) {
 		sni->service = strndup(id, path_ptr - id);
 		sni->path = strdup(path_ptr);
 		sni->interface = "org.kde.StatusNotifierItem";
-		sni_get_property_async(sni, "IconThemePath", "s", &sni->icon_theme_path);
 	}
 
-	// Ignored: Category, Id, Title, WindowId, OverlayIconName,
-	//          OverlayIconPixmap, AttentionMovieName, ToolTip
-	sni_get_property_async(sni, "Status", "s", &sni->status);
-	sni_get_property_async(sni, "IconName", "s", &sni->icon_name);
-	sni_get_property_async(sni, "IconPixmap", NULL, &sni->icon_pixmap);
-	sni_get_property_async(sni, "AttentionIconName", "s", &sni->attention_icon_name);
-	sni_get_property_async(sni, "AttentionIconPixmap", NULL, &sni->attention_icon_pixmap);
-	sni_get_property_async(sni, "ItemIsMenu", "b", &sni->item_is_menu);
-	sni_get_property_async(sni, "Menu", "o", &sni->menu);
+	sni_get_properties_async(sni);
 
 	sni_match_signal(sni, &sni->new_icon_slot, "NewIcon", handle_new_icon);
 	sni_match_signal(sni, &sni->new_attention_icon_slot, "NewAttentionIcon",
@@ -288,15 +448,23 @@ void destroy_sni(struct swaybar_sni *sni) {
 	sd_bus_slot_unref(sni->new_icon_slot);
 	sd_bus_slot_unref(sni->new_attention_icon_slot);
 	sd_bus_slot_unref(sni->new_status_slot);
+	// Drops the callback of a call which is still in flight
+	sd_bus_slot_unref(sni->get_all_slot);
+
+	cairo_surface_destroy(sni->icon);
+	clear_scaled_icons(sni);
+	list_free(sni->scaled_icons);
 
 	free(sni->watcher_id);
 	free(sni->service);
 	free(sni->path);
 	free(sni->status);
 	free(sni->icon_name);
-	free(sni->icon_pixmap);
+	list_free_items_and_destroy(sni->icon_pixmap);
 	free(sni->attention_icon_name);
+	list_free_items_and_destroy(sni->attention_icon_pixmap);
 	free(sni->menu);
+	free(sni->icon_theme_path);
 	free(sni);
 }
 
@@ -388,8 +556,7 @@ uint32_t render_sni(cairo_t *cairo, struct swaybar_output *output, double *x,
 						&sni->min_size, &sni->max_size);
 			}
 			if (icon_path) {
-				cairo_surface_destroy(sni->icon);
-				sni->icon = load_background_image(icon_path);
+				set_sni_icon(sni, load_background_image(icon_path));
 				free(icon_path);
 				icon_found = true;
 			}
@@ -410,10 +577,19 @@ uint32_t render_sni(cairo_t *cairo, struct swaybar_output *output, double *x,
 					}
 				}
 				struct swaybar_pixmap *pixmap = pixmaps->items[idx];
-				cairo_surface_destroy(sni->icon);
-				sni->icon = cairo_image_surface_create_for_data(pixmap->pixels,
-						CAIRO_FORMAT_ARGB32, pixmap->size, pixmap->size,
-						cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, pixmap->size));
+				// A copy, since the pixmaps are replaced when they change
+				cairo_surface_t *icon = cairo_image_surface_create(
+						CAIRO_FORMAT_ARGB32, pixmap->size, pixmap->size);
+				cairo_surface_flush(icon);
+				unsigned char *data = cairo_image_surface_get_data(icon);
+				int stride = cairo_image_surface_get_stride(icon);
+				for (int row = 0; row < pixmap->size; ++row) {
+					memcpy(data + row * stride,
+							pixmap->pixels + row * pixmap->size * 4,
+							pixmap->size * 4);
+				}
+				cairo_surface_mark_dirty(icon);
+				set_sni_icon(sni, icon);
 			}
 		}
 	}
@@ -424,7 +600,7 @@ uint32_t render_sni(cairo_t *cairo, struct swaybar_output *output, double *x,
 		int actual_size = cairo_image_surface_get_height(sni->icon);
 		icon_size = actual_size < ideal_size ?
 			actual_size*(ideal_size/actual_size) : ideal_size;
-		icon = cairo_image_surface_scale(sni->icon, icon_size, icon_size);
+		icon = get_scaled_icon(sni, icon_size);
 	} else { // draw a :(
 		icon_size = ideal_size*0.8;
 		icon = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, icon_size, icon_size);
@@ -11,6 +11,7 @@
 #include "swaybar/tray/watcher.h"
 #include "list.h"
 #include "log.h"
+#include "loop.h"
 
 static int handle_lost_watcher(sd_bus_message *msg,
 		void *data, sd_bus_error *error) {
@@ -76,6 +77,9 @@ void destroy_tray(struct swaybar_tray *tray) {
 	if (!tray) {
 		return;
 	}
+	if (tray->redraw_timer) {
+		loop_remove_timer(tray->bar->eventloop, tray->redraw_timer);
+	}
 	finish_host(&tray->host_xdg);
 	finish_host(&tray->host_kde);
 	for (int i = 0; i < tray->items->length; ++i) {
@@ -100,6 +104,25 @@ void tray_in(int fd, short mask, void *data) {
 	}
 }
 
+static void handle_redraw_timer(void *data) {
+	struct swaybar_tray *tray = data;
+	tray->redraw_timer = NULL;
+	// Waits for the frame callback if a frame is already on its way
+	set_bar_dirty(tray->bar);
+}
+
+void set_tray_dirty(struct swaybar_tray *tray) {
+	if (tray->redraw_timer) {
+		return;
+	}
+	// Runs after the messages which are already queued have been handled
+	tray->redraw_timer = loop_add_timer(tray->bar->eventloop, 0,
+			handle_redraw_timer, tray);
+	if (!tray->redraw_timer) {
+		set_bar_dirty(tray->bar);
+	}
+}
+
 static int cmp_output(const void *item, const void *cmp_to) {
 	return strcmp(item, cmp_to);
 }
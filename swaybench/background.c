@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <json-c/json.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "background-image.h"
+#include "cairo.h"
+#include "log.h"
+
+static const struct {
+	const char *name;
+	enum background_mode mode;
+} modes[] = {
+	{ "fill", BACKGROUND_MODE_FILL },
+	{ "fit", BACKGROUND_MODE_FIT },
+	{ "stretch", BACKGROUND_MODE_STRETCH },
+	{ "center", BACKGROUND_MODE_CENTER },
+	{ "tile", BACKGROUND_MODE_TILE },
+};
+
+static int64_t get_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * A gradient with some detail, so that the scaling filter has work to do.
+ */
+static cairo_surface_t *create_test_image(int width, int height) {
+	cairo_surface_t *image =
+		cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+	cairo_t *cairo = cairo_create(image);
+	cairo_pattern_t *gradient =
+		cairo_pattern_create_linear(0, 0, width, height);
+	cairo_pattern_add_color_stop_rgb(gradient, 0, 0.1, 0.2, 0.6);
+	cairo_pattern_add_color_stop_rgb(gradient, 1, 0.9, 0.5, 0.1);
+	cairo_set_source(cairo, gradient);
+	cairo_paint(cairo);
+	cairo_pattern_destroy(gradient);
+	cairo_set_source_rgb(cairo, 1, 1, 1);
+	cairo_set_line_width(cairo, 1);
+	for (int x = 0; x < width; x += 16) {
+		cairo_move_to(cairo, x + 0.5, 0);
+		cairo_line_to(cairo, width - x + 0.5, height);
+	}
+	cairo_stroke(cairo);
+	cairo_destroy(cairo);
+	return image;
+}
+
+/**
+ * A fresh copy has none of the scaled results cached on it.
+ */
+static cairo_surface_t *copy_image(cairo_surface_t *image) {
+	int width = cairo_image_surface_get_width(image);
+	int height = cairo_image_surface_get_height(image);
+	cairo_surface_t *copy = cairo_image_surface_create(
+			cairo_image_surface_get_format(image), width, height);
+	cairo_t *cairo = cairo_create(copy);
+	cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cairo, image, 0, 0);
+	cairo_paint(cairo);
+	cairo_destroy(cairo);
+	return copy;
+}
+
+static int64_t time_render(cairo_t *cairo, cairo_surface_t *image,
+		enum background_mode mode, int width, int height) {
+	int64_t start = get_time_nsec();
+	render_background_image(cairo, image, mode, width, height);
+	cairo_surface_flush(cairo_get_target(cairo));
+	return get_time_nsec() - start;
+}
+
+int main(int argc, char **argv) {
+	static struct option long_options[] = {
+		{"help", no_argument, NULL, 'h'},
+		{"image", required_argument, NULL, 'I'},
+		{"iterations", required_argument, NULL, 'i'},
+		{"size", required_argument, NULL, 's'},
+		{0, 0, 0, 0}
+	};
+
+	const char *usage =
+		"Usage: swaybench-background [options]\n"
+		"\n"
+		"Measures render_background_image in each mode, for images which\n"
+		"have not been scaled before and for ones whose scaled result is\n"
+		"cached, and reports the mean time per call in milliseconds as JSON.\n"
+		"\n"
+		"  -h, --help               Show help message and quit.\n"
+		"  -I, --image <path>       Image to use instead of a generated one.\n"
+		"  -i, --iterations <n>     Calls to time in each case (default 20).\n"
+		"  -s, --size <WxH>         Size of the buffer (default 1920x1080).\n";
+
+	const char *path = NULL;
+	int iterations = 20;
+	int width = 1920, height = 1080;
+
+	int c;
+	while (1) {
+		int option_index = 0;
+		c = getopt_long(argc, argv, "hI:i:s:", long_options, &option_index);
+		if (c == -1) {
+			break;
+		}
+		switch (c) {
+		case 'I':
+			path = optarg;
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%dx%d", &width, &height) != 2) {
+				width = height = 0;
+			}
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (iterations <= 0 || width <= 0 || height <= 0) {
+		fprintf(stderr, "%s", usage);
+		return EXIT_FAILURE;
+	}
+
+	wlr_log_init(WLR_ERROR, NULL);
+
+	cairo_surface_t *image = path ? load_background_image(path) :
+		create_test_image(2560, 1600);
+	if (!image) {
+		return EXIT_FAILURE;
+	}
+
+	cairo_surface_t *buffer =
+		cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	cairo_t *cairo = cairo_create(buffer);
+
+	json_object *results = json_object_new_object();
+	for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+		int64_t cold = 0;
+		for (int j = 0; j < iterations; ++j) {
+			cairo_surface_t *copy = copy_image(image);
+			cold += time_render(cairo, copy, modes[i].mode, width, height);
+			cairo_surface_destroy(copy);
+		}
+
+		// The first call scales the image and caches the result
+		render_background_image(cairo, image, modes[i].mode, width, height);
+		int64_t cached = 0;
+		for (int j = 0; j < iterations; ++j) {
+			cached += time_render(cairo, image, modes[i].mode, width, height);
+		}
+
+		json_object *result = json_object_new_object();
+		json_object_object_add(result, "cold_ms",
+				json_object_new_double(cold / 1e6 / iterations));
+		json_object_object_add(result, "cached_ms",
+				json_object_new_double(cached / 1e6 / iterations));
+		json_object_object_add(results, modes[i].name, result);
+	}
+
+	json_object *report = json_object_new_object();
+	json_object_object_add(report, "image_width",
+			json_object_new_int(cairo_image_surface_get_width(image)));
+	json_object_object_add(report, "image_height",
+			json_object_new_int(cairo_image_surface_get_height(image)));
+	json_object_object_add(report, "buffer_width", json_object_new_int(width));
+	json_object_object_add(report, "buffer_height",
+			json_object_new_int(height));
+	json_object_object_add(report, "iterations",
+			json_object_new_int(iterations));
+	json_object_object_add(report, "modes", results);
+	printf("%s\n", json_object_to_json_string_ext(report,
+			JSON_C_TO_STRING_PRETTY));
+	json_object_put(report);
+
+	cairo_destroy(cairo);
+	cairo_surface_destroy(buffer);
+	cairo_surface_destroy(image);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-client.h>
+#include "log.h"
+#include "loop.h"
+#include "pool-buffer.h"
+#include "swaybench/swaybench.h"
+#include "xdg-shell-client-protocol.h"
+
+#define DEFAULT_WIDTH 640
+#define DEFAULT_HEIGHT 480
+
+struct bench_client {
+	const struct swaybench_client_args *args;
+	struct loop *loop;
+	bool running;
+
+	struct wl_display *display;
+	struct wl_compositor *compositor;
+	struct wl_shm *shm;
+	struct xdg_wm_base *wm_base;
+
+	struct wl_surface *surface;
+	struct xdg_surface *xdg_surface;
+	struct xdg_toplevel *toplevel;
+	struct buffer_pool buffers;
+
+	// The most recent configure, which has not been acked yet
+	bool configure_pending;
+	uint32_t configure_serial;
+	int32_t configure_width, configure_height;
+
+	bool configured;
+	uint32_t width, height;
+	unsigned int frame;
+	unsigned int title_changes;
+};
+
+static volatile sig_atomic_t churn_titles = 0;
+static volatile sig_atomic_t churn_damage = 0;
+
+static void handle_sigusr(int sig) {
+	if (sig == SIGUSR1) {
+		churn_titles = !churn_titles;
+	} else {
+		churn_damage = !churn_damage;
+	}
+}
+
+static void draw(struct bench_client *client, bool full) {
+	struct pool_buffer *buffer = get_next_buffer(client->shm,
+			&client->buffers, client->width, client->height);
+	if (!buffer) {
+		// All buffers are still held by sway
+		return;
+	}
+	++client->frame;
+
+	// Damage a small square which moves across the window
+	int size = 32;
+	int x = (client->frame * size) % (client->width > (uint32_t)size ?
+			client->width - size : 1);
+	int y = (client->args->index * size) % (client->height > (uint32_t)size ?
+			client->height - size : 1);
+
+	cairo_t *cairo = buffer->cairo;
+	double shade = (client->args->index % 8) / 8.0;
+	cairo_set_source_rgb(cairo, shade, 0.3, 1.0 - shade);
+	cairo_paint(cairo);
+	cairo_set_source_rgb(cairo, 1.0, 1.0, 1.0);
+	cairo_rectangle(cairo, x, y, size, size);
+	cairo_fill(cairo);
+
+	wl_surface_attach(client->surface, buffer->buffer, 0, 0);
+	if (full) {
+		wl_surface_damage_buffer(client->surface, 0, 0,
+				client->width, client->height);
+	} else {
+		wl_surface_damage_buffer(client->surface, x, y, size, size);
+	}
+	wl_surface_commit(client->surface);
+}
+
+static void ack_configure(void *data) {
+	struct bench_client *client = data;
+	if (!client->configure_pending) {
+		return;
+	}
+	client->configure_pending = false;
+	xdg_surface_ack_configure(client->xdg_surface, client->configure_serial);
+	client->width = client->configure_width > 0 ?
+		client->configure_width : DEFAULT_WIDTH;
+	client->height = client->configure_height > 0 ?
+		client->configure_height : DEFAULT_HEIGHT;
+	client->configured = true;
+	// Resized, so the whole window is new
+	draw(client, true);
+}
+
+static void tick(void *data) {
+	struct bench_client *client = data;
+	if (churn_titles) {
+		char title[64];
+		snprintf(title, sizeof(title), "swaybench %d: %u",
+				client->args->index, ++client->title_changes);
+		xdg_toplevel_set_title(client->toplevel, title);
+		if (!churn_damage) {
+			wl_surface_commit(client->surface);
+		}
+	}
+	if (churn_damage && client->configured) {
+		draw(client, false);
+	}
+	loop_add_timer(client->loop, client->args->churn_interval_ms,
+			tick, client);
+}
+
+static void xdg_surface_handle_configure(void *data,
+		struct xdg_surface *xdg_surface, uint32_t serial) {
+	struct bench_client *client = data;
+	client->configure_serial = serial;
+	// A newer configure supersedes one which is still being delayed
+	bool scheduled = client->configure_pending;
+	client->configure_pending = true;
+	if (client->args->configure_delay_ms <= 0) {
+		ack_configure(client);
+	} else if (!scheduled) {
+		loop_add_timer(client->loop, client->args->configure_delay_ms,
+				ack_configure, client);
+	}
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+	.configure = xdg_surface_handle_configure,
+};
+
+static void toplevel_handle_configure(void *data,
+		struct xdg_toplevel *toplevel, int32_t width, int32_t height,
+		struct wl_array *states) {
+	struct bench_client *client = data;
+	client->configure_width = width;
+	client->configure_height = height;
+}
+
+static void toplevel_handle_close(void *data, struct xdg_toplevel *toplevel) {
+	struct bench_client *client = data;
+	client->running = false;
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+	.configure = toplevel_handle_configure,
+	.close = toplevel_handle_close,
+};
+
+static void wm_base_handle_ping(void *data, struct xdg_wm_base *wm_base,
+		uint32_t serial) {
+	xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+	.ping = wm_base_handle_ping,
+};
+
+static void handle_global(void *data, struct wl_registry *registry,
+		uint32_t name, const char *interface, uint32_t version) {
+	struct bench_client *client = data;
+	if (strcmp(interface, wl_compositor_interface.name) == 0) {
+		client->compositor = wl_registry_bind(registry, name,
+				&wl_compositor_interface, 4);
+	} else if (strcmp(interface, wl_shm_interface.name) == 0) {
+		client->shm = wl_registry_bind(registry, name,
+				&wl_shm_interface, 1);
+	} else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+		client->wm_base = wl_registry_bind(registry, name,
+				&xdg_wm_base_interface, 1);
+		xdg_wm_base_add_listener(client->wm_base, &wm_base_listener, client);
+	}
+}
+
+static void handle_global_remove(void *data, struct wl_registry *registry,
+		uint32_t name) {
+	// Who cares
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = handle_global,
+	.global_remove = handle_global_remove,
+};
+
+static void display_in(int fd, short mask, void *data) {
+	struct bench_client *client = data;
+	if (wl_display_dispatch(client->display) == -1) {
+		client->running = false;
+	}
+}
+
+int swaybench_run_client(const struct swaybench_client_args *args) {
+	struct bench_client client = {
+		.args = args,
+		.running = true,
+	};
+
+	struct sigaction action = { .sa_handler = handle_sigusr };
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGUSR1, &action, NULL);
+	sigaction(SIGUSR2, &action, NULL);
+
+	client.display = wl_display_connect(NULL);
+	if (!client.display) {
+		wlr_log(WLR_ERROR, "Client %d: unable to connect to the compositor",
+				args->index);
+		return EXIT_FAILURE;
+	}
+	struct wl_registry *registry = wl_display_get_registry(client.display);
+	wl_registry_add_listener(registry, &registry_listener, &client);
+	wl_display_roundtrip(client.display);
+	if (!client.compositor || !client.shm || !client.wm_base) {
+		wlr_log(WLR_ERROR, "Client %d: compositor is missing a global",
+				args->index);
+		wl_display_disconnect(client.display);
+		return EXIT_FAILURE;
+	}
+
+	client.surface = wl_compositor_create_surface(client.compositor);
+	client.xdg_surface =
+		xdg_wm_base_get_xdg_surface(client.wm_base, client.surface);
+	xdg_surface_add_listener(client.xdg_surface, &xdg_surface_listener,
+			&client);
+	client.toplevel = xdg_surface_get_toplevel(client.xdg_surface);
+	xdg_toplevel_add_listener(client.toplevel, &toplevel_listener, &client);
+	char title[64];
+	snprintf(title, sizeof(title), "swaybench %d", args->index);
+	xdg_toplevel_set_title(client.toplevel, title);
+	xdg_toplevel_set_app_id(client.toplevel, "swaybench");
+	wl_surface_commit(client.surface);
+
+	client.loop = loop_create();
+	loop_add_fd(client.loop, wl_display_get_fd(client.display), POLLIN,
+			display_in, &client);
+	loop_add_timer(client.loop, args->churn_interval_ms, tick, &client);
+
+	while (client.running) {
+		if (wl_display_flush(client.display) == -1 && errno != EAGAIN) {
+			break;
+		}
+		loop_poll(client.loop);
+	}
+
+	loop_destroy(client.loop);
+	destroy_buffer_pool(&client.buffers);
+	xdg_toplevel_destroy(client.toplevel);
+	xdg_surface_destroy(client.xdg_surface);
+	wl_surface_destroy(client.surface);
+	wl_display_disconnect(client.display);
+	return EXIT_SUCCESS;
+}
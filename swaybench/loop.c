@@ -0,0 +1,259 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <getopt.h>
+#include <json-c/json.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "log.h"
+#include "loop.h"
+
+struct loop_bench {
+	struct loop *loop;
+	int (*pipes)[2];
+	int fds;
+	int dispatched;
+	int timers_fired;
+};
+
+static int64_t get_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void handle_fd(int fd, short mask, void *data) {
+	struct loop_bench *bench = data;
+	char buf[64];
+	while (read(fd, buf, sizeof(buf)) == -1 && errno == EINTR) {
+		// Try again
+	}
+	++bench->dispatched;
+}
+
+static void handle_timer(void *data) {
+	struct loop_bench *bench = data;
+	++bench->timers_fired;
+}
+
+static void wake(struct loop_bench *bench, int i) {
+	while (write(bench->pipes[i][1], "x", 1) == -1 && errno == EINTR) {
+		// Try again
+	}
+}
+
+/**
+ * Each pipe takes two fds, so the soft limit is raised as far as it goes.
+ */
+static bool raise_fd_limit(int fds) {
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+		return false;
+	}
+	rlim_t needed = (rlim_t)fds * 2 + 16;
+	if (limit.rlim_cur >= needed) {
+		return true;
+	}
+	if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < needed) {
+		return false;
+	}
+	limit.rlim_cur = needed;
+	return setrlimit(RLIMIT_NOFILE, &limit) == 0;
+}
+
+static double per_op(int64_t nsec, int ops) {
+	return ops > 0 ? (double)nsec / ops : 0;
+}
+
+static json_object *bench_fds(struct loop_bench *bench, int iterations) {
+	json_object *result = json_object_new_object();
+
+	int64_t start = get_time_nsec();
+	for (int i = 0; i < bench->fds; ++i) {
+		loop_add_fd(bench->loop, bench->pipes[i][0], POLLIN, handle_fd, bench);
+	}
+	json_object_object_add(result, "add_ns", json_object_new_double(
+			per_op(get_time_nsec() - start, bench->fds)));
+
+	// One fd out of all of them is ready, which is what clients usually see
+	bench->dispatched = 0;
+	start = get_time_nsec();
+	for (int i = 0; i < iterations; ++i) {
+		wake(bench, i % bench->fds);
+		loop_poll(bench->loop);
+	}
+	json_object_object_add(result, "poll_one_ready_ns", json_object_new_double(
+			per_op(get_time_nsec() - start, iterations)));
+
+	// Every fd is ready, so a single poll dispatches all of them
+	int rounds = iterations / bench->fds > 0 ? iterations / bench->fds : 1;
+	bench->dispatched = 0;
+	int64_t elapsed = 0;
+	for (int round = 0; round < rounds; ++round) {
+		for (int i = 0; i < bench->fds; ++i) {
+			wake(bench, i);
+		}
+		start = get_time_nsec();
+		while (bench->dispatched < (round + 1) * bench->fds) {
+			loop_poll(bench->loop);
+		}
+		elapsed += get_time_nsec() - start;
+	}
+	json_object_object_add(result, "poll_all_ready_ns_per_fd",
+			json_object_new_double(per_op(elapsed, rounds * bench->fds)));
+
+	start = get_time_nsec();
+	for (int i = 0; i < bench->fds; ++i) {
+		loop_remove_fd(bench->loop, bench->pipes[i][0]);
+	}
+	json_object_object_add(result, "remove_ns", json_object_new_double(
+			per_op(get_time_nsec() - start, bench->fds)));
+	return result;
+}
+
+static json_object *bench_timers(struct loop_bench *bench, int count) {
+	json_object *result = json_object_new_object();
+	struct loop_timer **timers = calloc(count, sizeof(struct loop_timer *));
+	if (!timers) {
+		return result;
+	}
+
+	// Far enough in the future that none of them expire meanwhile, and
+	// spread out so that they don't all land in the same place in the heap
+	int64_t start = get_time_nsec();
+	for (int i = 0; i < count; ++i) {
+		timers[i] = loop_add_timer(bench->loop,
+				60000 + (int)((i * 7919L) % count), handle_timer, bench);
+	}
+	json_object_object_add(result, "add_ns", json_object_new_double(
+			per_op(get_time_nsec() - start, count)));
+
+	// Removed in a different order than they were added
+	start = get_time_nsec();
+	for (int i = 0; i < count; ++i) {
+		int j = (int)((i * 7919L) % count);
+		if (timers[j]) {
+			loop_remove_timer(bench->loop, timers[j]);
+			timers[j] = NULL;
+		}
+	}
+	for (int i = 0; i < count; ++i) {
+		if (timers[i]) {
+			loop_remove_timer(bench->loop, timers[i]);
+		}
+	}
+	json_object_object_add(result, "remove_ns", json_object_new_double(
+			per_op(get_time_nsec() - start, count)));
+	free(timers);
+
+	bench->timers_fired = 0;
+	for (int i = 0; i < count; ++i) {
+		loop_add_timer(bench->loop, 0, handle_timer, bench);
+	}
+	start = get_time_nsec();
+	while (bench->timers_fired < count) {
+		loop_poll(bench->loop);
+	}
+	json_object_object_add(result, "expire_ns", json_object_new_double(
+			per_op(get_time_nsec() - start, count)));
+	return result;
+}
+
+int main(int argc, char **argv) {
+	static struct option long_options[] = {
+		{"help", no_argument, NULL, 'h'},
+		{"fds", required_argument, NULL, 'f'},
+		{"iterations", required_argument, NULL, 'i'},
+		{"timers", required_argument, NULL, 't'},
+		{0, 0, 0, 0}
+	};
+
+	const char *usage =
+		"Usage: swaybench-loop [options]\n"
+		"\n"
+		"Measures the client event loop with many fds and timers and\n"
+		"reports the time per operation in nanoseconds as JSON.\n"
+		"\n"
+		"  -h, --help               Show help message and quit.\n"
+		"  -f, --fds <n>            Pipes to add to the loop (default 1000).\n"
+		"  -i, --iterations <n>     Polls to time (default 100000).\n"
+		"  -t, --timers <n>         Timers to add and remove (default 100000).\n";
+
+	int fds = 1000;
+	int iterations = 100000;
+	int timers = 100000;
+
+	int c;
+	while (1) {
+		int option_index = 0;
+		c = getopt_long(argc, argv, "hf:i:t:", long_options, &option_index);
+		if (c == -1) {
+			break;
+		}
+		switch (c) {
+		case 'f':
+			fds = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 't':
+			timers = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (fds <= 0 || iterations <= 0 || timers <= 0) {
+		fprintf(stderr, "%s", usage);
+		return EXIT_FAILURE;
+	}
+
+	wlr_log_init(WLR_ERROR, NULL);
+
+	if (!raise_fd_limit(fds)) {
+		fprintf(stderr, "Unable to open %d pipes, see ulimit -n\n", fds);
+		return EXIT_FAILURE;
+	}
+	struct loop_bench bench = {
+		.loop = loop_create(),
+		.pipes = calloc(fds, sizeof(int[2])),
+		.fds = fds,
+	};
+	if (!bench.pipes) {
+		return EXIT_FAILURE;
+	}
+	for (int i = 0; i < fds; ++i) {
+		if (pipe(bench.pipes[i]) != 0) {
+			wlr_log_errno(WLR_ERROR, "Unable to create pipe");
+			return EXIT_FAILURE;
+		}
+	}
+
+	json_object *report = json_object_new_object();
+	json_object_object_add(report, "fds", json_object_new_int(fds));
+	json_object_object_add(report, "iterations",
+			json_object_new_int(iterations));
+	json_object_object_add(report, "timers", json_object_new_int(timers));
+	json_object_object_add(report, "fd_results",
+			bench_fds(&bench, iterations));
+	json_object_object_add(report, "timer_results",
+			bench_timers(&bench, timers));
+	printf("%s\n", json_object_to_json_string_ext(report,
+			JSON_C_TO_STRING_PRETTY));
+	json_object_put(report);
+
+	for (int i = 0; i < fds; ++i) {
+		close(bench.pipes[i][0]);
+		close(bench.pipes[i][1]);
+	}
+	free(bench.pipes);
+	loop_destroy(bench.loop);
+	return EXIT_SUCCESS;
+}
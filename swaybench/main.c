@@ -0,0 +1,668 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <getopt.h>
+#include <json-c/json.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "ipc-client.h"
+#include "log.h"
+#include "swaybench/swaybench.h"
+
+// How long to wait for sway to finish what a phase started
+#define SETTLE_TIMEOUT_MS 10000
+
+static const char *const layout_commands[] = {
+	"layout tabbed",
+	"layout stacking",
+	"layout splitv",
+	"layout splith",
+	NULL,
+};
+
+static const char *const focus_commands[] = {
+	"focus left",
+	"focus left",
+	"focus right",
+	"focus right",
+	NULL,
+};
+
+static const char *const move_commands[] = {
+	"move left",
+	"move right",
+	"split vertical",
+	"focus parent",
+	"move up",
+	"move down",
+	NULL,
+};
+
+static const char *const workspace_commands[] = {
+	"workspace 2",
+	"workspace 1",
+	NULL,
+};
+
+static const char *const floating_commands[] = {
+	"floating toggle",
+	"resize set 400 300",
+	"move position 100 100",
+	"floating toggle",
+	NULL,
+};
+
+static const struct swaybench_phase tiling_phases[] = {
+	{ .name = "layout", .commands = layout_commands, .repeat = 25 },
+	{ .name = "focus", .commands = focus_commands, .repeat = 25 },
+	{ .name = "move", .commands = move_commands, .repeat = 10 },
+	{ .name = "workspace", .commands = workspace_commands, .repeat = 25 },
+	{ .name = "floating", .commands = floating_commands, .repeat = 10 },
+	{ .name = "ipc", .ipc_requests = 1000 },
+	{ .name = NULL },
+};
+
+static const struct swaybench_phase churn_phases[] = {
+	{ .name = "titles", .churn_ms = 3000, .churn_titles = true },
+	{ .name = "damage", .churn_ms = 3000, .churn_damage = true },
+	{
+		.name = "titles+damage",
+		.churn_ms = 3000,
+		.churn_titles = true,
+		.churn_damage = true,
+	},
+	{ .name = NULL },
+};
+
+static const struct swaybench_phase slow_client_phases[] = {
+	{ .name = "layout", .commands = layout_commands, .repeat = 10 },
+	{ .name = "move", .commands = move_commands, .repeat = 5 },
+	{ .name = NULL },
+};
+
+static const struct swaybench_scenario scenarios[] = {
+	{
+		.name = "tiling",
+		.description = "Layout, focus, move, workspace and floating commands "
+			"with 8 windows, then IPC throughput",
+		.clients = 8,
+		.churn_interval_ms = 16,
+		.phases = tiling_phases,
+	},
+	{
+		.name = "churn",
+		.description = "16 windows changing their titles and contents at 60Hz",
+		.clients = 16,
+		.churn_interval_ms = 16,
+		.phases = churn_phases,
+	},
+	{
+		.name = "slow-clients",
+		.description = "Layout and move commands with 8 windows which take "
+			"30ms to answer configures",
+		.clients = 8,
+		.configure_delay_ms = 30,
+		.churn_interval_ms = 16,
+		.phases = slow_client_phases,
+	},
+};
+
+struct bench_driver {
+	const struct swaybench_scenario *scenario;
+	char *socket_path;
+	int ipc_fd;
+	pid_t *clients;
+	int clients_length;
+};
+
+static int64_t get_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void sleep_msec(int ms) {
+	struct timespec ts = {
+		.tv_sec = ms / 1000,
+		.tv_nsec = (ms % 1000) * 1000000,
+	};
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+		// Keep sleeping
+	}
+}
+
+static const struct swaybench_scenario *find_scenario(const char *name) {
+	for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+		if (strcmp(scenarios[i].name, name) == 0) {
+			return &scenarios[i];
+		}
+	}
+	return NULL;
+}
+
+static json_object *ipc_request(struct bench_driver *driver, uint32_t type,
+		const char *payload) {
+	uint32_t len = strlen(payload);
+	char *reply = ipc_single_command(driver->ipc_fd, type, payload, &len);
+	if (!reply) {
+		return NULL;
+	}
+	json_object *object = json_tokener_parse(reply);
+	free(reply);
+	return object;
+}
+
+static json_object *get_timings(struct bench_driver *driver, bool reset) {
+	return ipc_request(driver, IPC_GET_TIMINGS, reset ? "reset" : "");
+}
+
+/**
+ * Wait until sway has no transactions left to apply.
+ */
+static bool wait_settled(struct bench_driver *driver) {
+	int64_t deadline = get_time_nsec() + SETTLE_TIMEOUT_MS * 1000000LL;
+	while (get_time_nsec() < deadline) {
+		json_object *timings = get_timings(driver, false);
+		json_object *pending = NULL;
+		if (!timings ||
+				!json_object_object_get_ex(timings, "pending_transactions",
+					&pending)) {
+			json_object_put(timings);
+			wlr_log(WLR_ERROR, "Unable to get timings from sway");
+			return false;
+		}
+		int count = json_object_get_int(pending);
+		json_object_put(timings);
+		if (count == 0) {
+			return true;
+		}
+		sleep_msec(1);
+	}
+	wlr_log(WLR_ERROR, "Timed out waiting for transactions to finish");
+	return false;
+}
+
+static int count_windows(json_object *node) {
+	int count = 0;
+	json_object *app_id = NULL;
+	if (json_object_object_get_ex(node, "app_id", &app_id) && app_id &&
+			strcmp(json_object_get_string(app_id), "swaybench") == 0) {
+		++count;
+	}
+	const char *lists[] = { "nodes", "floating_nodes" };
+	for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i) {
+		json_object *children = NULL;
+		if (!json_object_object_get_ex(node, lists[i], &children)) {
+			continue;
+		}
+		for (size_t j = 0; j < json_object_array_length(children); ++j) {
+			count += count_windows(json_object_array_get_idx(children, j));
+		}
+	}
+	return count;
+}
+
+static bool wait_mapped(struct bench_driver *driver, int expected) {
+	int64_t deadline = get_time_nsec() + SETTLE_TIMEOUT_MS * 1000000LL;
+	while (get_time_nsec() < deadline) {
+		json_object *tree = ipc_request(driver, IPC_GET_TREE, "");
+		if (!tree) {
+			return false;
+		}
+		int count = count_windows(tree);
+		json_object_put(tree);
+		if (count >= expected) {
+			return wait_settled(driver);
+		}
+		sleep_msec(5);
+	}
+	wlr_log(WLR_ERROR, "Timed out waiting for %d windows to map", expected);
+	return false;
+}
+
+static void signal_clients(struct bench_driver *driver, int sig) {
+	for (int i = 0; i < driver->clients_length; ++i) {
+		kill(driver->clients[i], sig);
+	}
+}
+
+static bool spawn_clients(struct bench_driver *driver) {
+	const struct swaybench_scenario *scenario = driver->scenario;
+	driver->clients = calloc(scenario->clients, sizeof(pid_t));
+	if (!driver->clients) {
+		return false;
+	}
+	for (int i = 0; i < scenario->clients; ++i) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			wlr_log_errno(WLR_ERROR, "Unable to fork client");
+			return false;
+		} else if (pid == 0) {
+			close(driver->ipc_fd);
+			struct swaybench_client_args args = {
+				.index = i,
+				.configure_delay_ms = scenario->configure_delay_ms,
+				.churn_interval_ms = scenario->churn_interval_ms,
+			};
+			_exit(swaybench_run_client(&args));
+		}
+		driver->clients[driver->clients_length++] = pid;
+	}
+	return true;
+}
+
+static void stop_clients(struct bench_driver *driver) {
+	signal_clients(driver, SIGTERM);
+	for (int i = 0; i < driver->clients_length; ++i) {
+		waitpid(driver->clients[i], NULL, 0);
+	}
+	driver->clients_length = 0;
+}
+
+static json_object *describe_samples(int64_t *samples, int count) {
+	json_object *object = json_object_new_object();
+	json_object_object_add(object, "count", json_object_new_int(count));
+	if (count == 0) {
+		return object;
+	}
+	// Insertion sort is plenty for a few hundred samples
+	for (int i = 1; i < count; ++i) {
+		int64_t value = samples[i];
+		int j = i - 1;
+		for (; j >= 0 && samples[j] > value; --j) {
+			samples[j + 1] = samples[j];
+		}
+		samples[j + 1] = value;
+	}
+	double sum = 0;
+	for (int i = 0; i < count; ++i) {
+		sum += samples[i] / 1000.0;
+	}
+	json_object_object_add(object, "min",
+			json_object_new_double(samples[0] / 1000.0));
+	json_object_object_add(object, "mean",
+			json_object_new_double(sum / count));
+	int p99 = (count * 99 + 99) / 100 - 1;
+	json_object_object_add(object, "p50",
+			json_object_new_double(samples[(count - 1) / 2] / 1000.0));
+	json_object_object_add(object, "p99",
+			json_object_new_double(samples[p99] / 1000.0));
+	json_object_object_add(object, "max",
+			json_object_new_double(samples[count - 1] / 1000.0));
+	return object;
+}
+
+static bool run_commands(struct bench_driver *driver,
+		const struct swaybench_phase *phase, json_object *result) {
+	int per_round = 0;
+	while (phase->commands[per_round]) {
+		++per_round;
+	}
+	int count = per_round * phase->repeat;
+	int64_t *samples = calloc(count ? count : 1, sizeof(int64_t));
+	if (!samples) {
+		return false;
+	}
+
+	bool ok = true;
+	int sent = 0;
+	for (int round = 0; ok && round < phase->repeat; ++round) {
+		for (int i = 0; ok && i < per_round; ++i) {
+			int64_t start = get_time_nsec();
+			json_object *reply = ipc_request(driver, IPC_COMMAND,
+					phase->commands[i]);
+			if (!reply) {
+				ok = false;
+				break;
+			}
+			// Commands may fail harmlessly, e.g. moving past the edge
+			json_object_put(reply);
+			ok = wait_settled(driver);
+			samples[sent++] = get_time_nsec() - start;
+		}
+	}
+
+	json_object_object_add(result, "command_us",
+			describe_samples(samples, sent));
+	free(samples);
+	return ok;
+}
+
+static void count_reply(struct ipc_response *response, void *data) {
+	size_t *bytes = data;
+	if (response) {
+		*bytes += response->size;
+	}
+}
+
+static bool run_ipc(struct bench_driver *driver,
+		const struct swaybench_phase *phase, json_object *result) {
+	int n = phase->ipc_requests;
+
+	// One request at a time
+	size_t bytes = 0;
+	int64_t start = get_time_nsec();
+	for (int i = 0; i < n; ++i) {
+		uint32_t len = 0;
+		char *reply =
+			ipc_single_command(driver->ipc_fd, IPC_GET_TREE, "", &len);
+		if (!reply) {
+			return false;
+		}
+		bytes += len;
+		free(reply);
+	}
+	double seconds = (get_time_nsec() - start) / 1e9;
+	json_object *sync = json_object_new_object();
+	json_object_object_add(sync, "request",
+			json_object_new_string("get_tree"));
+	json_object_object_add(sync, "requests", json_object_new_int(n));
+	json_object_object_add(sync, "requests_per_second",
+			json_object_new_double(n / seconds));
+	json_object_object_add(sync, "bytes_per_second",
+			json_object_new_double(bytes / seconds));
+	json_object_object_add(result, "ipc_sequential", sync);
+
+	// Everything at once, on a connection of its own
+	int fd = ipc_open_socket(driver->socket_path);
+	struct ipc_connection *conn = ipc_connection_create(fd, NULL);
+	if (!conn) {
+		close(fd);
+		return false;
+	}
+	bytes = 0;
+	start = get_time_nsec();
+	bool ok = true;
+	for (int i = 0; ok && i < n; ++i) {
+		ok = ipc_connection_send(conn, IPC_GET_WORKSPACES, "", 0,
+				count_reply, &bytes);
+	}
+	ok = ok && ipc_connection_roundtrip(conn);
+	seconds = (get_time_nsec() - start) / 1e9;
+	ipc_connection_destroy(conn);
+	if (!ok) {
+		return false;
+	}
+	json_object *pipelined = json_object_new_object();
+	json_object_object_add(pipelined, "request",
+			json_object_new_string("get_workspaces"));
+	json_object_object_add(pipelined, "requests", json_object_new_int(n));
+	json_object_object_add(pipelined, "requests_per_second",
+			json_object_new_double(n / seconds));
+	json_object_object_add(pipelined, "bytes_per_second",
+			json_object_new_double(bytes / seconds));
+	json_object_object_add(result, "ipc_pipelined", pipelined);
+	return true;
+}
+
+static bool run_phase(struct bench_driver *driver,
+		const struct swaybench_phase *phase, json_object *results) {
+	wlr_log(WLR_INFO, "Running phase %s", phase->name);
+	json_object_put(get_timings(driver, true));
+
+	json_object *result = json_object_new_object();
+	json_object_object_add(result, "name", json_object_new_string(phase->name));
+	json_object_array_add(results, result);
+
+	int64_t start = get_time_nsec();
+	bool ok = true;
+	if (phase->commands) {
+		ok = run_commands(driver, phase, result);
+	}
+	if (ok && phase->churn_ms) {
+		if (phase->churn_titles) {
+			signal_clients(driver, SIGUSR1);
+		}
+		if (phase->churn_damage) {
+			signal_clients(driver, SIGUSR2);
+		}
+		sleep_msec(phase->churn_ms);
+		if (phase->churn_titles) {
+			signal_clients(driver, SIGUSR1);
+		}
+		if (phase->churn_damage) {
+			signal_clients(driver, SIGUSR2);
+		}
+		ok = wait_settled(driver);
+	}
+	if (ok && phase->ipc_requests) {
+		ok = run_ipc(driver, phase, result);
+	}
+	int64_t elapsed = get_time_nsec() - start;
+
+	json_object_object_add(result, "wall_ms",
+			json_object_new_double(elapsed / 1e6));
+	json_object *timings = get_timings(driver, true);
+	if (timings) {
+		json_object_object_add(result, "sway", timings);
+	}
+	json_object_object_add(result, "ok", json_object_new_boolean(ok));
+	return ok;
+}
+
+static int run_driver(const char *scenario_name, const char *results_path) {
+	struct bench_driver driver = {
+		.scenario = find_scenario(scenario_name),
+		.socket_path = get_socketpath(),
+	};
+	if (!driver.scenario || !driver.socket_path) {
+		wlr_log(WLR_ERROR, "Unknown scenario or no sway socket");
+		return EXIT_FAILURE;
+	}
+	driver.ipc_fd = ipc_open_socket(driver.socket_path);
+
+	json_object *report = json_object_new_object();
+	json_object_object_add(report, "scenario",
+			json_object_new_string(scenario_name));
+	json_object *version = ipc_request(&driver, IPC_GET_VERSION, "");
+	json_object *human_readable = NULL;
+	if (version && json_object_object_get_ex(version, "human_readable",
+				&human_readable)) {
+		json_object_object_add(report, "sway_version",
+				json_object_get(human_readable));
+	}
+	json_object_put(version);
+	json_object *results = json_object_new_array();
+	json_object_object_add(report, "phases", results);
+
+	// Mapping the clients is the first phase
+	json_object_put(get_timings(&driver, true));
+	int64_t start = get_time_nsec();
+	bool ok = spawn_clients(&driver) &&
+		wait_mapped(&driver, driver.scenario->clients);
+	json_object *map = json_object_new_object();
+	json_object_object_add(map, "name", json_object_new_string("map"));
+	json_object_object_add(map, "wall_ms",
+			json_object_new_double((get_time_nsec() - start) / 1e6));
+	json_object *timings = get_timings(&driver, true);
+	if (timings) {
+		json_object_object_add(map, "sway", timings);
+	}
+	json_object_object_add(map, "ok", json_object_new_boolean(ok));
+	json_object_array_add(results, map);
+
+	for (const struct swaybench_phase *phase = driver.scenario->phases;
+			ok && phase->name; ++phase) {
+		ok = run_phase(&driver, phase, results);
+	}
+	json_object_object_add(report, "ok", json_object_new_boolean(ok));
+
+	stop_clients(&driver);
+	if (json_object_to_file_ext((char *)results_path, report,
+				JSON_C_TO_STRING_PRETTY) != 0) {
+		wlr_log(WLR_ERROR, "Unable to write results to %s", results_path);
+		ok = false;
+	}
+	json_object_put(report);
+
+	json_object_put(ipc_request(&driver, IPC_COMMAND, "exit"));
+	close(driver.ipc_fd);
+	free(driver.socket_path);
+	free(driver.clients);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool write_config(const char *path, const char *self,
+		const char *scenario, const char *results_path) {
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		wlr_log_errno(WLR_ERROR, "Unable to create %s", path);
+		return false;
+	}
+	fprintf(f, "# Generated by swaybench\n"
+			"swaynag_command -\n"
+			"font monospace 10\n"
+			"exec '%s' --driver '%s' '%s'\n", self, scenario, results_path);
+	fclose(f);
+	return true;
+}
+
+static int run_benchmark(const char *sway, const char *scenario,
+		const char *output) {
+	char self[PATH_MAX];
+	ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+	if (len < 0) {
+		wlr_log_errno(WLR_ERROR, "Unable to find the swaybench executable");
+		return EXIT_FAILURE;
+	}
+	self[len] = '\0';
+
+	char dir[] = "/tmp/swaybench-XXXXXX";
+	if (!mkdtemp(dir)) {
+		wlr_log_errno(WLR_ERROR, "Unable to create a temporary directory");
+		return EXIT_FAILURE;
+	}
+	char config_path[PATH_MAX], results_path[PATH_MAX];
+	snprintf(config_path, sizeof(config_path), "%s/config", dir);
+	snprintf(results_path, sizeof(results_path), "%s/results.json", dir);
+	if (!write_config(config_path, self, scenario, results_path)) {
+		return EXIT_FAILURE;
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		wlr_log_errno(WLR_ERROR, "Unable to fork");
+		return EXIT_FAILURE;
+	} else if (pid == 0) {
+		setenv("WLR_BACKENDS", "headless", true);
+		setenv("WLR_LIBINPUT_NO_DEVICES", "1", true);
+		setenv("WLR_HEADLESS_OUTPUTS", "1", false);
+		unsetenv("WAYLAND_DISPLAY");
+		unsetenv("DISPLAY");
+		unsetenv("SWAYSOCK");
+		execlp(sway, sway, "-c", config_path, NULL);
+		wlr_log_errno(WLR_ERROR, "Unable to run %s", sway);
+		_exit(EXIT_FAILURE);
+	}
+	int status = 0;
+	waitpid(pid, &status, 0);
+
+	json_object *report = json_object_from_file(results_path);
+	int ret = EXIT_FAILURE;
+	if (!report) {
+		wlr_log(WLR_ERROR, "The benchmark did not produce any results");
+	} else {
+		json_object *ok = NULL;
+		if (json_object_object_get_ex(report, "ok", &ok) &&
+				json_object_get_boolean(ok)) {
+			ret = EXIT_SUCCESS;
+		}
+		if (output) {
+			json_object_to_file_ext((char *)output, report,
+					JSON_C_TO_STRING_PRETTY);
+		} else {
+			printf("%s\n", json_object_to_json_string_ext(report,
+					JSON_C_TO_STRING_PRETTY));
+		}
+		json_object_put(report);
+	}
+
+	unlink(results_path);
+	unlink(config_path);
+	rmdir(dir);
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	static struct option long_options[] = {
+		{"help", no_argument, NULL, 'h'},
+		{"list", no_argument, NULL, 'l'},
+		{"output", required_argument, NULL, 'o'},
+		{"sway", required_argument, NULL, 's'},
+		{"driver", no_argument, NULL, 'D'},
+		{0, 0, 0, 0}
+	};
+
+	const char *usage =
+		"Usage: swaybench [options] <scenario>\n"
+		"\n"
+		"Runs sway on the headless backend with synthetic clients and\n"
+		"reports timings of each phase of the scenario as JSON.\n"
+		"\n"
+		"  -h, --help             Show help message and quit.\n"
+		"  -l, --list             List the scenarios and quit.\n"
+		"  -o, --output <file>    Write the results to a file.\n"
+		"  -s, --sway <path>      The sway executable to run.\n";
+
+	const char *sway = "sway";
+	const char *output = NULL;
+	bool driver = false;
+
+	int c;
+	while (1) {
+		int option_index = 0;
+		c = getopt_long(argc, argv, "hlo:s:", long_options, &option_index);
+		if (c == -1) {
+			break;
+		}
+		switch (c) {
+		case 'l':
+			for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]);
+					++i) {
+				printf("%-14s %s\n", scenarios[i].name,
+						scenarios[i].description);
+			}
+			return EXIT_SUCCESS;
+		case 'o':
+			output = optarg;
+			break;
+		case 's':
+			sway = optarg;
+			break;
+		case 'D':
+			driver = true;
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	wlr_log_init(WLR_INFO, NULL);
+
+	if (driver) {
+		// Started by sway from the generated config
+		if (argc - optind != 2) {
+			return EXIT_FAILURE;
+		}
+		return run_driver(argv[optind], argv[optind + 1]);
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "%s", usage);
+		return EXIT_FAILURE;
+	}
+	if (!find_scenario(argv[optind])) {
+		fprintf(stderr, "Unknown scenario: %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	return run_benchmark(sway, argv[optind], output);
+}
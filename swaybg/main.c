@@ -1,49 +1,84 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include <wayland-client.h>
 #include <wlr/util/log.h>
 #include "background-image.h"
 #include "pool-buffer.h"
 #include "cairo.h"
+#include "loop.h"
 #include "util.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
+#include "xdg-output-unstable-v1-client-protocol.h"
+
+/**
+ * swaybg draws the backgrounds of all outputs. Sway writes the configuration
+ * to its stdin, one line per output:
+ *
+ *   <output name> TAB <path or color> TAB <mode> [TAB <fallback color>]
+ *
+ * A line with only an output name removes the background of that output.
+ */
+
+struct swaybg_image {
+	char *path;
+	cairo_surface_t *surface;
+	int refs;
+	struct wl_list link; // swaybg_state::images
+};
 
-struct swaybg_args {
-	int output_idx;
-	const char *path;
+struct swaybg_output_config {
+	char *output;
+	char *path;
 	enum background_mode mode;
-	const char *fallback;
+	uint32_t color;
+	bool has_color;
+	struct swaybg_image *image; // NULL for solid colors
+	struct wl_list link; // swaybg_state::configs
 };
 
-struct swaybg_context {
-	uint32_t color;
-	cairo_surface_t *image;
+struct swaybg_output {
+	struct swaybg_state *state;
+	uint32_t wl_name;
+	struct wl_output *wl_output;
+	struct zxdg_output_v1 *xdg_output;
+	char *name;
+
+	struct swaybg_output_config *config;
+
+	struct wl_surface *surface;
+	struct zwlr_layer_surface_v1 *layer_surface;
+	bool configured;
+
+	uint32_t width, height;
+	int32_t scale;
+	struct buffer_pool buffers;
+	struct wl_list link; // swaybg_state::outputs
 };
 
 struct swaybg_state {
-	const struct swaybg_args *args;
-	struct swaybg_context context;
-
 	struct wl_display *display;
 	struct wl_compositor *compositor;
 	struct zwlr_layer_shell_v1 *layer_shell;
+	struct zxdg_output_manager_v1 *xdg_output_manager;
 	struct wl_shm *shm;
+	struct loop *loop;
 
-	struct wl_output *output;
-	struct wl_surface *surface;
-	struct wl_region *input_region;
-	struct zwlr_layer_surface_v1 *layer_surface;
+	struct wl_list outputs; // struct swaybg_output::link
+	struct wl_list configs; // struct swaybg_output_config::link
+	struct wl_list images; // struct swaybg_image::link
 
+	char *input;
+	size_t input_length, input_size;
 	bool run_display;
-	uint32_t width, height;
-	int32_t scale;
-	struct pool_buffer buffers[2];
-	struct pool_buffer *current_buffer;
 };
 
 bool is_valid_color(const char *color) {
@@ -64,68 +99,104 @@ bool is_valid_color(const char *color) {
 	return true;
 }
 
-static void render_frame(struct swaybg_state *state) {
-	int buffer_width = state->width * state->scale,
-		buffer_height = state->height * state->scale;
-	state->current_buffer = get_next_buffer(state->shm,
-			state->buffers, buffer_width, buffer_height);
-	if (!state->current_buffer) {
+/**
+ * Images are decoded once, however many outputs show them.
+ */
+static struct swaybg_image *image_get(struct swaybg_state *state,
+		const char *path) {
+	struct swaybg_image *image;
+	wl_list_for_each(image, &state->images, link) {
+		if (strcmp(image->path, path) == 0) {
+			++image->refs;
+			return image;
+		}
+	}
+
+	cairo_surface_t *surface = load_background_image(path);
+	if (!surface) {
+		return NULL;
+	}
+	image = calloc(1, sizeof(struct swaybg_image));
+	if (!image) {
+		wlr_log(WLR_ERROR, "Unable to allocate image");
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+	image->path = strdup(path);
+	image->surface = surface;
+	image->refs = 1;
+	wl_list_insert(&state->images, &image->link);
+	wlr_log(WLR_DEBUG, "Decoded %s", path);
+	return image;
+}
+
+static void image_release(struct swaybg_image *image) {
+	if (!image || --image->refs > 0) {
 		return;
 	}
-	cairo_t *cairo = state->current_buffer->cairo;
+	wl_list_remove(&image->link);
+	cairo_surface_destroy(image->surface);
+	free(image->path);
+	free(image);
+}
+
+static void render_frame(struct swaybg_output *output) {
+	struct swaybg_output_config *config = output->config;
+	int buffer_width = output->width * output->scale,
+		buffer_height = output->height * output->scale;
+	struct pool_buffer *buffer = get_next_buffer(output->state->shm,
+			&output->buffers, buffer_width, buffer_height);
+	if (!buffer) {
+		return;
+	}
+	cairo_t *cairo = buffer->cairo;
 	cairo_save(cairo);
 	cairo_set_operator(cairo, CAIRO_OPERATOR_CLEAR);
 	cairo_paint(cairo);
 	cairo_restore(cairo);
-	if (state->args->mode == BACKGROUND_MODE_SOLID_COLOR) {
-		cairo_set_source_u32(cairo, state->context.color);
+	if (config->has_color) {
+		cairo_set_source_u32(cairo, config->color);
 		cairo_paint(cairo);
-	} else {
-		if (state->args->fallback && state->context.color) {
-			cairo_set_source_u32(cairo, state->context.color);
-			cairo_paint(cairo);
-		}
-		render_background_image(cairo, state->context.image,
-				state->args->mode, buffer_width, buffer_height);
+	}
+	if (config->image) {
+		render_background_image(cairo, config->image->surface,
+				config->mode, buffer_width, buffer_height);
 	}
 
-	wl_surface_set_buffer_scale(state->surface, state->scale);
-	wl_surface_attach(state->surface, state->current_buffer->buffer, 0, 0);
-	wl_surface_damage(state->surface, 0, 0, state->width, state->height);
-	wl_surface_commit(state->surface);
+	wl_surface_set_buffer_scale(output->surface, output->scale);
+	wl_surface_attach(output->surface, buffer->buffer, 0, 0);
+	wl_surface_damage(output->surface, 0, 0, output->width, output->height);
+	wl_surface_commit(output->surface);
 }
 
-static bool prepare_context(struct swaybg_state *state) {
-	if (state->args->mode == BACKGROUND_MODE_SOLID_COLOR) {
-		state->context.color = parse_color(state->args->path);
-		return is_valid_color(state->args->path);
-	}
-	if (state->args->fallback && is_valid_color(state->args->fallback)) {
-		state->context.color = parse_color(state->args->fallback);
+static void destroy_layer_surface(struct swaybg_output *output) {
+	if (output->layer_surface) {
+		zwlr_layer_surface_v1_destroy(output->layer_surface);
+		output->layer_surface = NULL;
 	}
-	if (!(state->context.image = load_background_image(state->args->path))) {
-		return false;
+	if (output->surface) {
+		wl_surface_destroy(output->surface);
+		output->surface = NULL;
 	}
-	return true;
+	output->configured = false;
+	destroy_buffer_pool(&output->buffers);
 }
 
 static void layer_surface_configure(void *data,
 		struct zwlr_layer_surface_v1 *surface,
 		uint32_t serial, uint32_t width, uint32_t height) {
-	struct swaybg_state *state = data;
-	state->width = width;
-	state->height = height;
+	struct swaybg_output *output = data;
+	output->width = width;
+	output->height = height;
+	output->configured = true;
 	zwlr_layer_surface_v1_ack_configure(surface, serial);
-	render_frame(state);
+	render_frame(output);
 }
 
 static void layer_surface_closed(void *data,
 		struct zwlr_layer_surface_v1 *surface) {
-	struct swaybg_state *state = data;
-	zwlr_layer_surface_v1_destroy(state->layer_surface);
-	wl_surface_destroy(state->surface);
-	wl_region_destroy(state->input_region);
-	state->run_display = false;
+	struct swaybg_output *output = data;
+	destroy_layer_surface(output);
 }
 
 static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
@@ -133,6 +204,188 @@ static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
 	.closed = layer_surface_closed,
 };
 
+static void create_layer_surface(struct swaybg_output *output) {
+	struct swaybg_state *state = output->state;
+	output->surface = wl_compositor_create_surface(state->compositor);
+	assert(output->surface);
+
+	// Empty input region
+	struct wl_region *input_region =
+		wl_compositor_create_region(state->compositor);
+	assert(input_region);
+	wl_surface_set_input_region(output->surface, input_region);
+	wl_region_destroy(input_region);
+
+	output->layer_surface = zwlr_layer_shell_v1_get_layer_surface(
+			state->layer_shell, output->surface, output->wl_output,
+			ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, "wallpaper");
+	assert(output->layer_surface);
+
+	zwlr_layer_surface_v1_set_size(output->layer_surface, 0, 0);
+	zwlr_layer_surface_v1_set_anchor(output->layer_surface,
+			ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+			ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT |
+			ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
+			ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT);
+	zwlr_layer_surface_v1_set_exclusive_zone(output->layer_surface, -1);
+	zwlr_layer_surface_v1_add_listener(output->layer_surface,
+			&layer_surface_listener, output);
+	wl_surface_commit(output->surface);
+}
+
+/**
+ * Match the output with its configuration, and create, redraw or destroy its
+ * surface accordingly.
+ */
+static void output_update(struct swaybg_output *output) {
+	if (!output->name) {
+		// Not known yet
+		return;
+	}
+	struct swaybg_output_config *config = NULL, *candidate;
+	wl_list_for_each(candidate, &output->state->configs, link) {
+		if (strcmp(candidate->output, output->name) == 0) {
+			config = candidate;
+			break;
+		}
+	}
+
+	output->config = config;
+	if (!config) {
+		destroy_layer_surface(output);
+	} else if (!output->layer_surface) {
+		create_layer_surface(output);
+	} else if (output->configured) {
+		render_frame(output);
+	}
+}
+
+static void destroy_config(struct swaybg_output_config *config) {
+	wl_list_remove(&config->link);
+	image_release(config->image);
+	free(config->output);
+	free(config->path);
+	free(config);
+}
+
+static bool config_equal(struct swaybg_output_config *a,
+		struct swaybg_output_config *b) {
+	return a->mode == b->mode && a->has_color == b->has_color &&
+		(!a->has_color || a->color == b->color) &&
+		strcmp(a->path, b->path) == 0;
+}
+
+static void handle_config_line(struct swaybg_state *state, char *line) {
+	char *fields[4] = {0};
+	int count = 0;
+	char *saveptr;
+	for (char *field = strtok_r(line, "\t", &saveptr);
+			field && count < 4; field = strtok_r(NULL, "\t", &saveptr)) {
+		fields[count++] = field;
+	}
+	if (count == 0) {
+		return;
+	}
+
+	struct swaybg_output_config *old = NULL, *config;
+	wl_list_for_each(config, &state->configs, link) {
+		if (strcmp(config->output, fields[0]) == 0) {
+			old = config;
+			break;
+		}
+	}
+
+	config = NULL;
+	if (count >= 3) {
+		config = calloc(1, sizeof(struct swaybg_output_config));
+		if (!config) {
+			wlr_log(WLR_ERROR, "Unable to allocate output config");
+			return;
+		}
+		config->output = strdup(fields[0]);
+		config->path = strdup(fields[1]);
+		config->mode = parse_background_mode(fields[2]);
+		wl_list_init(&config->link);
+		if (config->mode == BACKGROUND_MODE_INVALID) {
+			destroy_config(config);
+			return;
+		}
+		if (config->mode == BACKGROUND_MODE_SOLID_COLOR) {
+			if (!is_valid_color(config->path)) {
+				destroy_config(config);
+				return;
+			}
+			config->color = parse_color(config->path);
+			config->has_color = true;
+		} else if (count == 4 && is_valid_color(fields[3])) {
+			config->color = parse_color(fields[3]);
+			config->has_color = true;
+		}
+
+		if (old && config_equal(old, config)) {
+			// Happens on every reload
+			destroy_config(config);
+			return;
+		}
+		if (config->mode != BACKGROUND_MODE_SOLID_COLOR &&
+				!(config->image = image_get(state, config->path))) {
+			destroy_config(config);
+			return;
+		}
+	}
+
+	if (old) {
+		destroy_config(old);
+	}
+	if (config) {
+		wl_list_insert(&state->configs, &config->link);
+	}
+
+	struct swaybg_output *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		if (output->name && strcmp(output->name, fields[0]) == 0) {
+			output_update(output);
+		}
+	}
+}
+
+static void handle_input(int fd, short mask, void *data) {
+	struct swaybg_state *state = data;
+	if (state->input_size - state->input_length < 1024) {
+		size_t size = state->input_size ? state->input_size * 2 : 4096;
+		char *input = realloc(state->input, size);
+		if (!input) {
+			wlr_log(WLR_ERROR, "Unable to allocate input buffer");
+			state->run_display = false;
+			return;
+		}
+		state->input = input;
+		state->input_size = size;
+	}
+
+	ssize_t n = read(fd, state->input + state->input_length,
+			state->input_size - state->input_length - 1);
+	if (n <= 0) {
+		if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+			return;
+		}
+		// Sway went away, or closed the pipe to replace us
+		state->run_display = false;
+		return;
+	}
+	state->input_length += n;
+	state->input[state->input_length] = '\0';
+
+	char *start = state->input, *end;
+	while ((end = strchr(start, '\n'))) {
+		*end = '\0';
+		handle_config_line(state, start);
+		start = end + 1;
+	}
+	state->input_length -= start - state->input;
+	memmove(state->input, start, state->input_length);
+}
+
 static void output_geometry(void *data, struct wl_output *output, int32_t x,
 		int32_t y, int32_t width_mm, int32_t height_mm, int32_t subpixel,
 		const char *make, const char *model, int32_t transform) {
@@ -148,11 +401,12 @@ static void output_done(void *data, struct wl_output *output) {
 	// Who cares
 }
 
-static void output_scale(void *data, struct wl_output *output, int32_t factor) {
-	struct swaybg_state *state = data;
-	state->scale = factor;
-	if (state->run_display) {
-		render_frame(state);
+static void output_scale(void *data, struct wl_output *wl_output,
+		int32_t factor) {
+	struct swaybg_output *output = data;
+	output->scale = factor;
+	if (output->configured) {
+		render_frame(output);
 	}
 }
 
@@ -163,6 +417,65 @@ static const struct wl_output_listener output_listener = {
 	.scale = output_scale,
 };
 
+static void xdg_output_handle_logical_position(void *data,
+		struct zxdg_output_v1 *xdg_output, int32_t x, int32_t y) {
+	// Who cares
+}
+
+static void xdg_output_handle_logical_size(void *data,
+		struct zxdg_output_v1 *xdg_output, int32_t width, int32_t height) {
+	// Who cares
+}
+
+static void xdg_output_handle_name(void *data,
+		struct zxdg_output_v1 *xdg_output, const char *name) {
+	struct swaybg_output *output = data;
+	free(output->name);
+	output->name = strdup(name);
+}
+
+static void xdg_output_handle_description(void *data,
+		struct zxdg_output_v1 *xdg_output, const char *description) {
+	// Who cares
+}
+
+static void xdg_output_handle_done(void *data,
+		struct zxdg_output_v1 *xdg_output) {
+	struct swaybg_output *output = data;
+	if (!output->layer_surface) {
+		output_update(output);
+	}
+}
+
+static const struct zxdg_output_v1_listener xdg_output_listener = {
+	.logical_position = xdg_output_handle_logical_position,
+	.logical_size = xdg_output_handle_logical_size,
+	.name = xdg_output_handle_name,
+	.description = xdg_output_handle_description,
+	.done = xdg_output_handle_done,
+};
+
+static void add_xdg_output(struct swaybg_output *output) {
+	if (output->xdg_output || !output->state->xdg_output_manager) {
+		return;
+	}
+	output->xdg_output = zxdg_output_manager_v1_get_xdg_output(
+			output->state->xdg_output_manager, output->wl_output);
+	zxdg_output_v1_add_listener(output->xdg_output, &xdg_output_listener,
+			output);
+}
+
+static void destroy_output(struct swaybg_output *output) {
+	destroy_layer_surface(output);
+	if (output->xdg_output) {
+		zxdg_output_v1_destroy(output->xdg_output);
+	}
+	wl_output_destroy(output->wl_output);
+	wl_list_remove(&output->link);
+	free(output->name);
+	free(output);
+}
+
 static void handle_global(void *data, struct wl_registry *registry,
 		uint32_t name, const char *interface, uint32_t version) {
 	struct swaybg_state *state = data;
@@ -173,22 +486,39 @@ static void handle_global(void *data, struct wl_registry *registry,
 		state->shm = wl_registry_bind(registry, name,
 				&wl_shm_interface, 1);
 	} else if (strcmp(interface, wl_output_interface.name) == 0) {
-		static int output_idx = 0;
-		if (output_idx == state->args->output_idx) {
-			state->output = wl_registry_bind(registry, name,
-					&wl_output_interface, 3);
-			wl_output_add_listener(state->output, &output_listener, state);
+		struct swaybg_output *output = calloc(1, sizeof(struct swaybg_output));
+		if (!output) {
+			wlr_log(WLR_ERROR, "Unable to allocate output");
+			return;
 		}
-		output_idx++;
+		output->state = state;
+		output->wl_name = name;
+		output->scale = 1;
+		output->wl_output = wl_registry_bind(registry, name,
+				&wl_output_interface, 3);
+		wl_output_add_listener(output->wl_output, &output_listener, output);
+		wl_list_insert(&state->outputs, &output->link);
+		add_xdg_output(output);
 	} else if (strcmp(interface, zwlr_layer_shell_v1_interface.name) == 0) {
 		state->layer_shell = wl_registry_bind(
 				registry, name, &zwlr_layer_shell_v1_interface, 1);
+	} else if (strcmp(interface, zxdg_output_manager_v1_interface.name) == 0) {
+		state->xdg_output_manager = wl_registry_bind(registry, name,
+				&zxdg_output_manager_v1_interface, 2);
 	}
 }
 
 static void handle_global_remove(void *data, struct wl_registry *registry,
 		uint32_t name) {
-	// who cares
+	struct swaybg_state *state = data;
+	struct swaybg_output *output, *tmp;
+	wl_list_for_each_safe(output, tmp, &state->outputs, link) {
+		if (output->wl_name == name) {
+			wlr_log(WLR_DEBUG, "Destroying output %s", output->name);
+			destroy_output(output);
+			break;
+		}
+	}
 }
 
 static const struct wl_registry_listener registry_listener = {
@@ -196,30 +526,25 @@ static const struct wl_registry_listener registry_listener = {
 	.global_remove = handle_global_remove,
 };
 
+static void display_in(int fd, short mask, void *data) {
+	struct swaybg_state *state = data;
+	if (wl_display_dispatch(state->display) == -1) {
+		state->run_display = false;
+	}
+}
+
 int main(int argc, const char **argv) {
-	struct swaybg_args args = {0};
 	struct swaybg_state state = {0};
-	state.args = &args;
+	wl_list_init(&state.outputs);
+	wl_list_init(&state.configs);
+	wl_list_init(&state.images);
 	wlr_log_init(WLR_DEBUG, NULL);
 
-	if (argc < 4 || argc > 5) {
+	if (argc != 1 || isatty(STDIN_FILENO)) {
 		wlr_log(WLR_ERROR, "Do not run this program manually. "
 				"See man 5 sway and look for output options.");
 		return 1;
 	}
-	args.output_idx = atoi(argv[1]);
-	args.path = argv[2];
-
-	args.mode = parse_background_mode(argv[3]);
-	if (args.mode == BACKGROUND_MODE_INVALID) {
-		return 1;
-	}
-
-	args.fallback = argc == 5 ? argv[4] : NULL;
-
-	if (!prepare_context(&state)) {
-		return 1;
-	}
 
 	state.display = wl_display_connect(NULL);
 	if (!state.display) {
@@ -232,38 +557,40 @@ int main(int argc, const char **argv) {
 	struct wl_registry *registry = wl_display_get_registry(state.display);
 	wl_registry_add_listener(registry, &registry_listener, &state);
 	wl_display_roundtrip(state.display);
-	assert(state.compositor && state.layer_shell && state.output && state.shm);
+	assert(state.compositor && state.layer_shell && state.shm &&
+			state.xdg_output_manager);
 
-	// Second roundtrip to get output properties
+	// The xdg-output manager may have been announced after some outputs
+	struct swaybg_output *output, *tmp;
+	wl_list_for_each(output, &state.outputs, link) {
+		add_xdg_output(output);
+	}
+	// Second roundtrip to get output names
 	wl_display_roundtrip(state.display);
 
-	state.surface = wl_compositor_create_surface(state.compositor);
-	assert(state.surface);
-
-	state.input_region = wl_compositor_create_region(state.compositor);
-	assert(state.input_region);
-	wl_surface_set_input_region(state.surface, state.input_region);
-
-	state.layer_surface = zwlr_layer_shell_v1_get_layer_surface(
-			state.layer_shell, state.surface, state.output,
-			ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, "wallpaper");
-	assert(state.layer_surface);
-
-	zwlr_layer_surface_v1_set_size(state.layer_surface, 0, 0);
-	zwlr_layer_surface_v1_set_anchor(state.layer_surface,
-			ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
-			ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT |
-			ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
-			ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT);
-	zwlr_layer_surface_v1_set_exclusive_zone(state.layer_surface, -1);
-	zwlr_layer_surface_v1_add_listener(state.layer_surface,
-			&layer_surface_listener, &state);
-	wl_surface_commit(state.surface);
-	wl_display_roundtrip(state.display);
+	state.loop = loop_create();
+	loop_add_fd(state.loop, wl_display_get_fd(state.display), POLLIN,
+			display_in, &state);
+	loop_add_fd(state.loop, STDIN_FILENO, POLLIN, handle_input, &state);
 
 	state.run_display = true;
-	while (wl_display_dispatch(state.display) != -1 && state.run_display) {
-		// This space intentionally left blank
+	while (state.run_display) {
+		errno = 0;
+		if (wl_display_flush(state.display) == -1 && errno != EAGAIN) {
+			break;
+		}
+		loop_poll(state.loop);
+	}
+
+	wl_list_for_each_safe(output, tmp, &state.outputs, link) {
+		destroy_output(output);
+	}
+	struct swaybg_output_config *config, *config_tmp;
+	wl_list_for_each_safe(config, config_tmp, &state.configs, link) {
+		destroy_config(config);
 	}
+	loop_destroy(state.loop);
+	free(state.input);
+	wl_display_disconnect(state.display);
 	return 0;
 }
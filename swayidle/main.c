@@ -3,12 +3,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
@@ -30,21 +32,48 @@
 static struct org_kde_kwin_idle *idle_manager = NULL;
 static struct wl_seat *seat = NULL;
 
+/**
+ * Only the shortest timeout is registered with the compositor, so that it
+ * resets a single timer on input. The longer ones are run from a local timer,
+ * which is armed for the next of them whenever one has fired, and disarmed
+ * when we resume.
+ */
 struct swayidle_state {
 	struct wl_display *display;
 	struct wl_event_loop *event_loop;
 	list_t *timeout_cmds; // struct swayidle_timeout_cmd *
 	char *lock_cmd;
+
+	struct org_kde_kwin_idle_timeout *idle_timer;
+	int registered_timeout; // 0 when forced idle by SIGUSR1
+	struct wl_event_source *tier_timer;
+	struct timespec idle_since; // When input stopped, only valid while idle
+	bool idle;
+
+	bool stats;
+	unsigned long idle_events, resume_events; // From the compositor
+	unsigned long timeouts_run, resumes_run;
 } state;
 
 struct swayidle_timeout_cmd {
-	int timeout, registered_timeout;
-	struct org_kde_kwin_idle_timeout *idle_timer;
+	int timeout; // In ms, -1 if it only runs when idle is forced
+	bool fired; // Since the last resume
 	char *idle_cmd;
 	char *resume_cmd;
 };
 
+static void print_stats(void) {
+	if (!state.stats) {
+		return;
+	}
+	fprintf(stderr, "swayidle: %lu idle and %lu resume events from the "
+			"compositor, %lu timeouts and %lu resumes handled\n",
+			state.idle_events, state.resume_events,
+			state.timeouts_run, state.resumes_run);
+}
+
 void sway_terminate(int exit_code) {
+	print_stats();
 	wl_display_disconnect(state.display);
 	wl_event_loop_destroy(state.event_loop);
 	exit(exit_code);
@@ -232,40 +261,113 @@ static const struct wl_registry_listener registry_listener = {
 
 static const struct org_kde_kwin_idle_timeout_listener idle_timer_listener;
 
-static void register_timeout(struct swayidle_timeout_cmd *cmd,
-		int timeout) {
-	if (cmd->idle_timer != NULL) {
-		org_kde_kwin_idle_timeout_destroy(cmd->idle_timer);
-		cmd->idle_timer = NULL;
+static int shortest_timeout(void) {
+	int shortest = -1;
+	for (int i = 0; i < state.timeout_cmds->length; ++i) {
+		struct swayidle_timeout_cmd *cmd = state.timeout_cmds->items[i];
+		if (cmd->timeout > 0 && (shortest < 0 || cmd->timeout < shortest)) {
+			shortest = cmd->timeout;
+		}
 	}
+	return shortest;
+}
+
+static void register_timeout(int timeout) {
+	if (state.idle_timer != NULL) {
+		org_kde_kwin_idle_timeout_destroy(state.idle_timer);
+		state.idle_timer = NULL;
+	}
+	state.registered_timeout = timeout;
 	if (timeout < 0) {
 		wlr_log(WLR_DEBUG, "Not registering idle timeout");
 		return;
 	}
 	wlr_log(WLR_DEBUG, "Register with timeout: %d", timeout);
-	cmd->idle_timer =
+	state.idle_timer =
 		org_kde_kwin_idle_get_idle_timeout(idle_manager, seat, timeout);
-	org_kde_kwin_idle_timeout_add_listener(cmd->idle_timer,
-		&idle_timer_listener, cmd);
-	cmd->registered_timeout = timeout;
+	org_kde_kwin_idle_timeout_add_listener(state.idle_timer,
+		&idle_timer_listener, NULL);
 }
 
-static void handle_idle(void *data, struct org_kde_kwin_idle_timeout *timer) {
-	struct swayidle_timeout_cmd *cmd = data;
-	wlr_log(WLR_DEBUG, "idle state");
-	if (cmd->idle_cmd) {
-		cmd_exec(cmd->idle_cmd);
+static int idle_elapsed_ms(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long long ms = (now.tv_sec - state.idle_since.tv_sec) * 1000LL +
+		(now.tv_nsec - state.idle_since.tv_nsec) / 1000000;
+	return ms > INT_MAX ? INT_MAX : (int)ms;
+}
+
+/**
+ * Run the commands of every timeout which has passed, and arm the timer for
+ * the next one.
+ */
+static void run_timeouts(bool forced) {
+	int elapsed = forced ? INT_MAX : idle_elapsed_ms();
+	int next = -1;
+	for (int i = 0; i < state.timeout_cmds->length; ++i) {
+		struct swayidle_timeout_cmd *cmd = state.timeout_cmds->items[i];
+		if (cmd->fired) {
+			continue;
+		}
+		if (forced || (cmd->timeout > 0 && cmd->timeout <= elapsed)) {
+			wlr_log(WLR_DEBUG, "idle state");
+			cmd->fired = true;
+			++state.timeouts_run;
+			if (cmd->idle_cmd) {
+				cmd_exec(cmd->idle_cmd);
+			}
+		} else if (cmd->timeout > 0 && (next < 0 || cmd->timeout < next)) {
+			next = cmd->timeout;
+		}
+	}
+	if (next > 0) {
+		// Commands can take a while, so look at the clock again
+		int wait = next - idle_elapsed_ms();
+		wl_event_source_timer_update(state.tier_timer, wait > 0 ? wait : 1);
+	}
+}
+
+static int handle_tier_timer(void *data) {
+	if (state.idle) {
+		run_timeouts(false);
 	}
+	return 0;
+}
+
+static void handle_idle(void *data, struct org_kde_kwin_idle_timeout *timer) {
+	++state.idle_events;
+	bool forced = state.registered_timeout == 0;
+	// The compositor tells us once the shortest timeout has passed
+	clock_gettime(CLOCK_MONOTONIC, &state.idle_since);
+	state.idle_since.tv_sec -= state.registered_timeout / 1000;
+	state.idle_since.tv_nsec -= (state.registered_timeout % 1000) * 1000000L;
+	if (state.idle_since.tv_nsec < 0) {
+		state.idle_since.tv_sec--;
+		state.idle_since.tv_nsec += 1000000000L;
+	}
+	state.idle = true;
+	run_timeouts(forced);
 }
 
 static void handle_resume(void *data, struct org_kde_kwin_idle_timeout *timer) {
-	struct swayidle_timeout_cmd *cmd = data;
+	++state.resume_events;
 	wlr_log(WLR_DEBUG, "active state");
-	if (cmd->registered_timeout != cmd->timeout) {
-		register_timeout(cmd, cmd->timeout);
+	state.idle = false;
+	wl_event_source_timer_update(state.tier_timer, 0);
+	int timeout = shortest_timeout();
+	if (state.registered_timeout != timeout) {
+		register_timeout(timeout);
 	}
-	if (cmd->resume_cmd) {
-		cmd_exec(cmd->resume_cmd);
+	for (int i = 0; i < state.timeout_cmds->length; ++i) {
+		struct swayidle_timeout_cmd *cmd = state.timeout_cmds->items[i];
+		if (!cmd->fired) {
+			continue;
+		}
+		cmd->fired = false;
+		++state.resumes_run;
+		if (cmd->resume_cmd) {
+			cmd_exec(cmd->resume_cmd);
+		}
 	}
 }
 
@@ -340,17 +442,28 @@ static int parse_sleep(int argc, char **argv) {
 static int parse_args(int argc, char *argv[]) {
 	bool debug = false;
 
+	static struct option long_options[] = {
+		{"debug", no_argument, NULL, 'd'},
+		{"help", no_argument, NULL, 'h'},
+		{"stats", no_argument, NULL, 'S'},
+		{0, 0, 0, 0}
+	};
+
 	int c;
-	while ((c = getopt(argc, argv, "hd")) != -1) {
+	while ((c = getopt_long(argc, argv, "hd", long_options, NULL)) != -1) {
 		switch (c) {
 		case 'd':
 			debug = true;
 			break;
+		case 'S':
+			state.stats = true;
+			break;
 		case 'h':
 		case '?':
 			printf("Usage: %s [OPTIONS]\n", argv[0]);
 			printf("  -d\tdebug\n");
 			printf("  -h\tthis help menu\n");
+			printf("  --stats\tprint how many events were handled on exit\n");
 			return 1;
 		default:
 			return 1;
@@ -386,9 +499,8 @@ static int handle_signal(int sig, void *data) {
 		return 0;
 	case SIGUSR1:
 		wlr_log(WLR_DEBUG, "Got SIGUSR1");
-		for (int i = 0; i < state.timeout_cmds->length; ++i) {
-			register_timeout(state.timeout_cmds->items[i], 0);
-		}
+		// Every timeout runs, and the real one is registered again on resume
+		register_timeout(0);
 		return 1;
 	}
 	assert(false); // not reached
@@ -463,10 +575,9 @@ int main(int argc, char *argv[]) {
 		sway_terminate(0);
 	}
 
-	for (int i = 0; i < state.timeout_cmds->length; ++i) {
-		struct swayidle_timeout_cmd *cmd = state.timeout_cmds->items[i];
-		register_timeout(cmd, cmd->timeout);
-	}
+	state.tier_timer =
+		wl_event_loop_add_timer(state.event_loop, handle_tier_timer, NULL);
+	register_timeout(shortest_timeout());
 
 	wl_display_roundtrip(state.display);
 
@@ -0,0 +1,174 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include "swaylock/comm.h"
+#include "swaylock/swaylock.h"
+
+// [0] carries requests to the child, [1] carries replies from it
+static int comm[2][2] = {{-1, -1}, {-1, -1}};
+static pid_t child = -1;
+
+static bool read_full(int fd, void *buf, size_t size) {
+	size_t offs = 0;
+	while (offs < size) {
+		ssize_t amt = read(fd, (char *)buf + offs, size - offs);
+		if (amt < 0 && errno == EINTR) {
+			continue;
+		} else if (amt <= 0) {
+			return false;
+		}
+		offs += (size_t)amt;
+	}
+	return true;
+}
+
+static bool write_full(int fd, const void *buf, size_t size) {
+	size_t offs = 0;
+	while (offs < size) {
+		ssize_t amt = write(fd, (const char *)buf + offs, size - offs);
+		if (amt < 0 && errno == EINTR) {
+			continue;
+		} else if (amt < 0) {
+			return false;
+		}
+		offs += (size_t)amt;
+	}
+	return true;
+}
+
+ssize_t read_comm_request(char **buf_ptr) {
+	size_t size;
+	ssize_t amt = read(comm[0][0], &size, sizeof(size));
+	if (amt == 0) {
+		return 0;
+	} else if (amt != sizeof(size)) {
+		wlr_log_errno(WLR_ERROR, "read pw request");
+		return -1;
+	}
+	wlr_log(WLR_DEBUG, "received pw check request");
+	char *buf = malloc(size);
+	if (!buf) {
+		wlr_log_errno(WLR_ERROR, "failed to malloc pw buffer");
+		return -1;
+	}
+	if (!read_full(comm[0][0], buf, size)) {
+		wlr_log_errno(WLR_ERROR, "failed to read pw");
+		free(buf);
+		return -1;
+	}
+	*buf_ptr = buf;
+	return size;
+}
+
+bool write_comm_reply(bool success) {
+	if (!write_full(comm[1][1], &success, sizeof(success))) {
+		wlr_log_errno(WLR_ERROR, "failed to write pw check result");
+		return false;
+	}
+	return true;
+}
+
+static void clear_buffer(char *buf, size_t size) {
+	// Use volatile keyword so so compiler can't optimize this out.
+	volatile char *buffer = buf;
+	volatile char zero = '\0';
+	for (size_t i = 0; i < size; ++i) {
+		buffer[i] = zero;
+	}
+}
+
+void reject_comm_requests(void) {
+	while (1) {
+		char *buf;
+		ssize_t size = read_comm_request(&buf);
+		if (size <= 0) {
+			break;
+		}
+		clear_buffer(buf, size);
+		free(buf);
+		if (!write_comm_reply(false)) {
+			break;
+		}
+	}
+	exit(EXIT_FAILURE);
+}
+
+static void close_pipe(int fds[2]) {
+	for (int i = 0; i < 2; ++i) {
+		if (fds[i] != -1) {
+			close(fds[i]);
+			fds[i] = -1;
+		}
+	}
+}
+
+bool spawn_comm_child(void) {
+	if (pipe(comm[0]) != 0) {
+		wlr_log_errno(WLR_ERROR, "failed to create pipe");
+		return false;
+	}
+	if (pipe(comm[1]) != 0) {
+		wlr_log_errno(WLR_ERROR, "failed to create pipe");
+		close_pipe(comm[0]);
+		return false;
+	}
+	child = fork();
+	if (child < 0) {
+		wlr_log_errno(WLR_ERROR, "failed to fork");
+		close_pipe(comm[0]);
+		close_pipe(comm[1]);
+		return false;
+	} else if (child == 0) {
+		close(comm[0][1]);
+		close(comm[1][0]);
+		run_pw_backend_child();
+	}
+	close(comm[0][0]);
+	close(comm[1][1]);
+	comm[0][0] = comm[1][1] = -1;
+	return true;
+}
+
+void close_comm_child(void) {
+	close_pipe(comm[0]);
+	close_pipe(comm[1]);
+	if (child > 0) {
+		// Fails with ECHILD once we have daemonized, which is fine
+		waitpid(child, NULL, 0);
+		child = -1;
+	}
+}
+
+bool write_comm_request(struct swaylock_password *pw) {
+	bool result = false;
+	size_t len = pw->len + 1;
+	if (!write_full(comm[0][1], &len, sizeof(len))) {
+		wlr_log_errno(WLR_ERROR, "Failed to request pw check");
+		goto ret;
+	}
+	if (!write_full(comm[0][1], pw->buffer, len)) {
+		wlr_log_errno(WLR_ERROR, "Failed to write pw buffer");
+		goto ret;
+	}
+	result = true;
+ret:
+	clear_password_buffer(pw);
+	return result;
+}
+
+bool read_comm_reply(bool *success) {
+	if (!read_full(comm[1][0], success, sizeof(*success))) {
+		wlr_log_errno(WLR_ERROR, "Failed to read pw result");
+		return false;
+	}
+	wlr_log(WLR_DEBUG, "pw result: %d", *success);
+	return true;
+}
+
+int get_comm_reply_fd(void) {
+	return comm[1][0];
+}
@@ -5,6 +5,8 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -70,14 +72,20 @@ static void daemonize(void) {
 
 static void destroy_surface(struct swaylock_surface *surface) {
 	wl_list_remove(&surface->link);
+	if (surface->subsurface != NULL) {
+		wl_subsurface_destroy(surface->subsurface);
+	}
+	if (surface->child != NULL) {
+		wl_surface_destroy(surface->child);
+	}
 	if (surface->layer_surface != NULL) {
 		zwlr_layer_surface_v1_destroy(surface->layer_surface);
 	}
 	if (surface->surface != NULL) {
 		wl_surface_destroy(surface->surface);
 	}
-	destroy_buffer(&surface->buffers[0]);
-	destroy_buffer(&surface->buffers[1]);
+	destroy_buffer_pool(&surface->buffers);
+	destroy_buffer_pool(&surface->indicator_buffers);
 	wl_output_destroy(surface->output);
 	free(surface);
 }
@@ -94,6 +102,21 @@ static bool surface_is_opaque(struct swaylock_surface *surface) {
 	return (surface->state->args.colors.background & 0xff) == 0xff;
 }
 
+static void update_opaque_region(struct swaylock_surface *surface) {
+	struct wl_region *region = NULL;
+	if (surface_is_opaque(surface) &&
+			surface->state->args.mode != BACKGROUND_MODE_CENTER &&
+			surface->state->args.mode != BACKGROUND_MODE_FIT) {
+		region = wl_compositor_create_region(surface->state->compositor);
+		wl_region_add(region, 0, 0, INT32_MAX, INT32_MAX);
+	}
+	// Applied with the next commit
+	wl_surface_set_opaque_region(surface->surface, region);
+	if (region) {
+		wl_region_destroy(region);
+	}
+}
+
 static void create_layer_surface(struct swaylock_surface *surface) {
 	struct swaylock_state *state = surface->state;
 
@@ -102,6 +125,18 @@ static void create_layer_surface(struct swaylock_surface *surface) {
 	surface->surface = wl_compositor_create_surface(state->compositor);
 	assert(surface->surface);
 
+	surface->child = wl_compositor_create_surface(state->compositor);
+	assert(surface->child);
+	surface->subsurface = wl_subcompositor_get_subsurface(
+			state->subcompositor, surface->child, surface->surface);
+	assert(surface->subsurface);
+	// The indicator is updated without committing the whole output
+	wl_subsurface_set_desync(surface->subsurface);
+	struct wl_region *input_region =
+		wl_compositor_create_region(state->compositor);
+	wl_surface_set_input_region(surface->child, input_region);
+	wl_region_destroy(input_region);
+
 	surface->layer_surface = zwlr_layer_shell_v1_get_layer_surface(
 			state->layer_shell, surface->surface, surface->output,
 			ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, "lockscreen");
@@ -119,15 +154,7 @@ static void create_layer_surface(struct swaylock_surface *surface) {
 	zwlr_layer_surface_v1_add_listener(surface->layer_surface,
 			&layer_surface_listener, surface);
 
-	if (surface_is_opaque(surface) &&
-			surface->state->args.mode != BACKGROUND_MODE_CENTER &&
-			surface->state->args.mode != BACKGROUND_MODE_FIT) {
-		struct wl_region *region =
-			wl_compositor_create_region(surface->state->compositor);
-		wl_region_add(region, 0, 0, INT32_MAX, INT32_MAX);
-		wl_surface_set_opaque_region(surface->surface, region);
-		wl_region_destroy(region);
-	}
+	update_opaque_region(surface);
 
 	wl_surface_commit(surface->surface);
 }
@@ -155,6 +182,17 @@ static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
 
 static const struct wl_callback_listener surface_frame_listener;
 
+static void request_frame(struct swaylock_surface *surface) {
+	// The indicator is a desync subsurface, so while it is shown it is the
+	// surface which gets redrawn and presented
+	struct wl_surface *target =
+		surface->indicator_size ? surface->child : surface->surface;
+	struct wl_callback *callback = wl_surface_frame(target);
+	wl_callback_add_listener(callback, &surface_frame_listener, surface);
+	surface->frame_pending = true;
+	wl_surface_commit(target);
+}
+
 static void surface_frame_handle_done(void *data, struct wl_callback *callback,
 		uint32_t time) {
 	struct swaylock_surface *surface = data;
@@ -163,13 +201,10 @@ static void surface_frame_handle_done(void *data, struct wl_callback *callback,
 	surface->frame_pending = false;
 
 	if (surface->dirty) {
-		// Schedule a frame in case the surface is damaged again
-		struct wl_callback *callback = wl_surface_frame(surface->surface);
-		wl_callback_add_listener(callback, &surface_frame_listener, surface);
-		surface->frame_pending = true;
-
 		render_frame(surface);
 		surface->dirty = false;
+		// Schedule a frame in case the surface is damaged again
+		request_frame(surface);
 	}
 }
 
@@ -182,11 +217,7 @@ void damage_surface(struct swaylock_surface *surface) {
 	if (surface->frame_pending) {
 		return;
 	}
-
-	struct wl_callback *callback = wl_surface_frame(surface->surface);
-	wl_callback_add_listener(callback, &surface_frame_listener, surface);
-	surface->frame_pending = true;
-	wl_surface_commit(surface->surface);
+	request_frame(surface);
 }
 
 void damage_state(struct swaylock_state *state) {
@@ -273,6 +304,9 @@ static void handle_global(void *data, struct wl_registry *registry,
 	if (strcmp(interface, wl_compositor_interface.name) == 0) {
 		state->compositor = wl_registry_bind(registry, name,
 				&wl_compositor_interface, 3);
+	} else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+		state->subcompositor = wl_registry_bind(registry, name,
+				&wl_subcompositor_interface, 1);
 	} else if (strcmp(interface, wl_shm_interface.name) == 0) {
 		state->shm = wl_registry_bind(registry, name,
 				&wl_shm_interface, 1);
@@ -340,6 +374,15 @@ static cairo_surface_t *select_image(struct swaylock_state *state,
 	return default_image;
 }
 
+static void destroy_image(struct swaylock_image *image) {
+	if (image->cairo_surface) {
+		cairo_surface_destroy(image->cairo_surface);
+	}
+	free(image->output_name);
+	free(image->path);
+	free(image);
+}
+
 static void load_image(char *arg, struct swaylock_state *state) {
 	// [<output>:]<path>
 	struct swaylock_image *image = calloc(1, sizeof(struct swaylock_image));
@@ -365,10 +408,7 @@ static void load_image(char *arg, struct swaylock_state *state) {
 						image->path);
 			}
 			wl_list_remove(&iter_image->link);
-			free(iter_image->cairo_surface);
-			free(iter_image->output_name);
-			free(iter_image->path);
-			free(iter_image);
+			destroy_image(iter_image);
 			break;
 		}
 	}
@@ -381,15 +421,9 @@ static void load_image(char *arg, struct swaylock_state *state) {
 		wordfree(&p);
 	}
 
-	// Load the actual image
-	image->cairo_surface = load_background_image(image->path);
-	if (!image->cairo_surface) {
-		free(image);
-		return;
-	}
+	// The image is decoded once the lock surfaces are up, see
+	// start_image_decoding
 	wl_list_insert(&state->images, &image->link);
-	wlr_log(WLR_DEBUG, "Loaded image %s for output %s",
-			image->path, image->output_name ? image->output_name : "*");
 }
 
 static void set_default_colors(struct swaylock_colors *colors) {
@@ -845,9 +879,166 @@ static void display_in(int fd, short mask, void *data) {
 	}
 }
 
+// How many threads decode images at most
+#define IMAGE_DECODE_THREADS_MAX 4
+
+/**
+ * Decodes the images on a few threads, so that startup doesn't wait for them
+ * one after another. The lock surfaces show the background colour until the
+ * image they use is ready. Each decoded image is sent back to the main thread
+ * through a pipe.
+ */
+struct image_decoder {
+	struct swaylock_image **images;
+	int image_count;
+	int done_count; // Only used by the main thread
+
+	pthread_mutex_t mutex;
+	int next_image; // Guarded by the mutex
+
+	pthread_t threads[IMAGE_DECODE_THREADS_MAX];
+	int thread_count;
+	int fds[2];
+};
+
+struct image_decoded {
+	struct swaylock_image *image;
+	cairo_surface_t *cairo_surface; // NULL if the image couldn't be read
+};
+
+static void *decode_images(void *data) {
+	struct image_decoder *decoder = data;
+	while (true) {
+		pthread_mutex_lock(&decoder->mutex);
+		int i = decoder->next_image++;
+		pthread_mutex_unlock(&decoder->mutex);
+		if (i >= decoder->image_count) {
+			break;
+		}
+
+		struct image_decoded decoded = {
+			.image = decoder->images[i],
+			.cairo_surface = load_background_image(decoder->images[i]->path),
+		};
+		// Smaller than PIPE_BUF, so the write is atomic
+		if (write(decoder->fds[1], &decoded, sizeof(decoded))
+				!= sizeof(decoded)) {
+			wlr_log_errno(WLR_ERROR, "Failed to hand over decoded image");
+			if (decoded.cairo_surface) {
+				cairo_surface_destroy(decoded.cairo_surface);
+			}
+		}
+	}
+	return NULL;
+}
+
+static void finish_image_decoding(struct image_decoder *decoder) {
+	for (int i = 0; i < decoder->thread_count; ++i) {
+		pthread_join(decoder->threads[i], NULL);
+	}
+	loop_remove_fd(state.eventloop, decoder->fds[0]);
+	close(decoder->fds[0]);
+	close(decoder->fds[1]);
+	pthread_mutex_destroy(&decoder->mutex);
+	free(decoder->images);
+	free(decoder);
+}
+
+static void update_surface_image(struct swaylock_surface *surface) {
+	cairo_surface_t *image = select_image(surface->state, surface);
+	if (image == surface->image) {
+		return;
+	}
+	surface->image = image;
+	// Makes render_frame draw the background again
+	surface->background_width = surface->background_height = 0;
+	update_opaque_region(surface);
+	damage_surface(surface);
+}
+
+static void image_decoded_in(int fd, short mask, void *data) {
+	struct image_decoder *decoder = data;
+	struct image_decoded decoded;
+	if (read(fd, &decoded, sizeof(decoded)) != sizeof(decoded)) {
+		wlr_log_errno(WLR_ERROR, "Failed to read decoded image");
+		return;
+	}
+
+	struct swaylock_image *image = decoded.image;
+	if (decoded.cairo_surface) {
+		image->cairo_surface = decoded.cairo_surface;
+		wlr_log(WLR_DEBUG, "Loaded image %s for output %s",
+				image->path, image->output_name ? image->output_name : "*");
+	} else {
+		// Outputs which would have used it fall back to the default image
+		wl_list_remove(&image->link);
+		destroy_image(image);
+	}
+
+	struct swaylock_surface *surface;
+	wl_list_for_each(surface, &state.surfaces, link) {
+		if (surface->surface) {
+			update_surface_image(surface);
+		}
+	}
+
+	if (++decoder->done_count == decoder->image_count) {
+		finish_image_decoding(decoder);
+	}
+}
+
+static void start_image_decoding(struct swaylock_state *state) {
+	int image_count = wl_list_length(&state->images);
+	if (image_count == 0 || state->args.mode == BACKGROUND_MODE_SOLID_COLOR) {
+		return;
+	}
+
+	struct image_decoder *decoder = calloc(1, sizeof(struct image_decoder));
+	if (!decoder) {
+		wlr_log(WLR_ERROR, "Unable to allocate image decoder");
+		return;
+	}
+	decoder->images = calloc(image_count, sizeof(struct swaylock_image *));
+	if (!decoder->images || pipe(decoder->fds) != 0) {
+		wlr_log_errno(WLR_ERROR, "Unable to set up image decoding");
+		free(decoder->images);
+		free(decoder);
+		return;
+	}
+	struct swaylock_image *image;
+	wl_list_for_each(image, &state->images, link) {
+		decoder->images[decoder->image_count++] = image;
+	}
+	pthread_mutex_init(&decoder->mutex, NULL);
+	loop_add_fd(state->eventloop, decoder->fds[0], POLLIN,
+			image_decoded_in, decoder);
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int thread_count = image_count < IMAGE_DECODE_THREADS_MAX ?
+		image_count : IMAGE_DECODE_THREADS_MAX;
+	if (cpus > 0 && cpus < thread_count) {
+		thread_count = cpus;
+	}
+	for (int i = 0; i < thread_count; ++i) {
+		if (pthread_create(&decoder->threads[decoder->thread_count], NULL,
+					decode_images, decoder) != 0) {
+			wlr_log(WLR_ERROR, "Unable to start image decoding thread");
+			continue;
+		}
+		++decoder->thread_count;
+	}
+	if (decoder->thread_count == 0) {
+		// Decode them here instead, the images show up once the loop runs
+		decode_images(decoder);
+	}
+}
+
 int main(int argc, char **argv) {
 	wlr_log_init(WLR_DEBUG, NULL);
 	initialize_pw_backend();
+	// Writing to a worker which has died must not kill us, as that would
+	// unlock the session
+	signal(SIGPIPE, SIG_IGN);
 
 	enum line_mode line_mode = LM_LINE;
 	state.args = (struct swaylock_args){
@@ -913,7 +1104,8 @@ int main(int argc, char **argv) {
 	struct wl_registry *registry = wl_display_get_registry(state.display);
 	wl_registry_add_listener(registry, &registry_listener, &state);
 	wl_display_roundtrip(state.display);
-	assert(state.compositor && state.layer_shell && state.shm);
+	assert(state.compositor && state.subcompositor && state.layer_shell &&
+			state.shm);
 	if (!state.input_inhibit_manager) {
 		wlr_log(WLR_ERROR, "Compositor does not support the input inhibitor "
 				"protocol, refusing to run insecurely");
@@ -959,6 +1151,9 @@ int main(int argc, char **argv) {
 	state.eventloop = loop_create();
 	loop_add_fd(state.eventloop, wl_display_get_fd(state.display), POLLIN,
 			display_in, NULL);
+	swaylock_watch_comm_reply(&state);
+	// Not before daemonizing, since the threads wouldn't survive the fork
+	start_image_decoding(&state);
 
 	state.run_display = true;
 	while (state.run_display) {
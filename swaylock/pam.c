@@ -6,24 +6,38 @@
 #include <string.h>
 #include <unistd.h>
 #include <wlr/util/log.h>
+#include "swaylock/comm.h"
 #include "swaylock/swaylock.h"
 
+static char *pw_buf = NULL;
+
 void initialize_pw_backend(void) {
-	// TODO: only call pam_start once. keep the same handle the whole time
+	if (!spawn_comm_child()) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+bool restart_pw_backend(void) {
+	return spawn_comm_child();
 }
 
 static int function_conversation(int num_msg, const struct pam_message **msg,
 		struct pam_response **resp, void *data) {
-	struct swaylock_password *pw = data;
 	/* PAM expects an array of responses, one for each message */
 	struct pam_response *pam_reply = calloc(
 			num_msg, sizeof(struct pam_response));
+	if (pam_reply == NULL) {
+		return PAM_ABORT;
+	}
 	*resp = pam_reply;
 	for (int i = 0; i < num_msg; ++i) {
 		switch (msg[i]->msg_style) {
 		case PAM_PROMPT_ECHO_OFF:
 		case PAM_PROMPT_ECHO_ON:
-			pam_reply[i].resp = strdup(pw->buffer); // PAM clears and frees this
+			pam_reply[i].resp = strdup(pw_buf); // PAM clears and frees this
+			if (pam_reply[i].resp == NULL) {
+				return PAM_ABORT;
+			}
 			break;
 		case PAM_ERROR_MSG:
 		case PAM_TEXT_INFO:
@@ -33,30 +47,70 @@ static int function_conversation(int num_msg, const struct pam_message **msg,
 	return PAM_SUCCESS;
 }
 
-bool attempt_password(struct swaylock_password *pw) {
+static void clear_buffer(char *buf, size_t size) {
+	// Use volatile keyword so so compiler can't optimize this out.
+	volatile char *buffer = buf;
+	volatile char zero = '\0';
+	for (size_t i = 0; i < size; ++i) {
+		buffer[i] = zero;
+	}
+}
+
+void run_pw_backend_child(void) {
 	struct passwd *passwd = getpwuid(getuid());
+	if (!passwd) {
+		wlr_log_errno(WLR_ERROR, "getpwuid failed");
+		reject_comm_requests();
+	}
+
 	char *username = passwd->pw_name;
-	const struct pam_conv local_conversation = {
-		function_conversation, pw
+	const struct pam_conv conv = {
+		.conv = function_conversation,
+		.appdata_ptr = NULL,
 	};
-	pam_handle_t *local_auth_handle = NULL;
-	int pam_err;
-	if ((pam_err = pam_start("swaylock", username,
-					&local_conversation, &local_auth_handle)) != PAM_SUCCESS) {
-		wlr_log(WLR_ERROR, "PAM returned error %d", pam_err);
-	}
-	if ((pam_err = pam_authenticate(local_auth_handle, 0)) != PAM_SUCCESS) {
-		wlr_log(WLR_ERROR, "pam_authenticate failed");
-		goto fail;
-	}
-	// TODO: only call pam_end once we succeed at authing. refresh tokens beforehand
-	if ((pam_err = pam_end(local_auth_handle, pam_err)) != PAM_SUCCESS) {
+	// The same handle is used for every attempt, so that modules which keep
+	// state between them (such as faillock) see them as one session
+	pam_handle_t *auth_handle = NULL;
+	if (pam_start("swaylock", username, &conv, &auth_handle) != PAM_SUCCESS) {
+		wlr_log(WLR_ERROR, "pam_start failed");
+		reject_comm_requests();
+	}
+
+	wlr_log(WLR_DEBUG, "Prepared to authorize user %s", username);
+
+	int pam_status = PAM_SUCCESS;
+	while (1) {
+		ssize_t size = read_comm_request(&pw_buf);
+		if (size < 0) {
+			exit(EXIT_FAILURE);
+		} else if (size == 0) {
+			break;
+		}
+
+		pam_status = pam_authenticate(auth_handle, 0);
+		bool success = pam_status == PAM_SUCCESS;
+		if (!success) {
+			wlr_log(WLR_ERROR, "pam_authenticate failed: %s",
+					pam_strerror(auth_handle, pam_status));
+		}
+
+		clear_buffer(pw_buf, size);
+		free(pw_buf);
+		pw_buf = NULL;
+
+		if (!write_comm_reply(success)) {
+			exit(EXIT_FAILURE);
+		}
+		if (success) {
+			// Unlocking, so there won't be another attempt
+			pam_setcred(auth_handle, PAM_REFRESH_CRED);
+			break;
+		}
+	}
+
+	if (pam_end(auth_handle, pam_status) != PAM_SUCCESS) {
 		wlr_log(WLR_ERROR, "pam_end failed");
-		goto fail;
+		exit(EXIT_FAILURE);
 	}
-	clear_password_buffer(pw);
-	return true;
-fail:
-	clear_password_buffer(pw);
-	return false;
+	exit(EXIT_SUCCESS);
 }
@@ -1,11 +1,12 @@
 #include <assert.h>
-#include <errno.h>
+#include <poll.h>
 #include <pwd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <wlr/util/log.h>
 #include <xkbcommon/xkbcommon.h>
+#include "swaylock/comm.h"
 #include "swaylock/swaylock.h"
 #include "swaylock/seat.h"
 #include "loop.h"
@@ -72,9 +73,33 @@ static void schedule_password_clear(struct swaylock_state *state) {
 			state->eventloop, 10000, clear_password, state);
 }
 
-static void handle_preverify_timeout(void *data) {
+// How often the indicator moves on while the password is being checked
+#define VERIFY_ANIMATION_INTERVAL 100
+
+static void animate_verification(void *data) {
 	struct swaylock_state *state = data;
-	state->verify_password_timer = NULL;
+	state->verify_animation_timer = NULL;
+	if (state->auth_state != AUTH_STATE_VALIDATING) {
+		return;
+	}
+	++state->verify_animation_step;
+	damage_state(state);
+	state->verify_animation_timer = loop_add_timer(state->eventloop,
+			VERIFY_ANIMATION_INTERVAL, animate_verification, state);
+}
+
+static bool restart_comm_child(struct swaylock_state *state) {
+	if (get_comm_reply_fd() >= 0) {
+		return true;
+	}
+	// Done here rather than when it dies, so that a worker which keeps
+	// crashing is only started again once per attempt
+	if (!restart_pw_backend()) {
+		return false;
+	}
+	wlr_log(WLR_INFO, "Restarted the password checking subprocess");
+	swaylock_watch_comm_reply(state);
+	return true;
 }
 
 static void submit_password(struct swaylock_state *state) {
@@ -82,47 +107,125 @@ static void submit_password(struct swaylock_state *state) {
 		return;
 	}
 
+	// The password is checked by the worker process, and the reply comes back
+	// through the event loop, so we keep drawing and taking input meanwhile
+	if (!restart_comm_child(state) ||
+			!write_comm_request(&state->password)) {
+		clear_password_buffer(&state->password);
+		state->auth_state = AUTH_STATE_INVALID;
+		damage_state(state);
+		schedule_indicator_clear(state);
+		return;
+	}
+
+	if (state->clear_indicator_timer) {
+		loop_remove_timer(state->eventloop, state->clear_indicator_timer);
+		state->clear_indicator_timer = NULL;
+	}
+	if (state->clear_password_timer) {
+		loop_remove_timer(state->eventloop, state->clear_password_timer);
+		state->clear_password_timer = NULL;
+	}
 	state->auth_state = AUTH_STATE_VALIDATING;
+	state->verify_animation_step = 0;
+	if (!state->verify_animation_timer) {
+		state->verify_animation_timer = loop_add_timer(state->eventloop,
+				VERIFY_ANIMATION_INTERVAL, animate_verification, state);
+	}
 	damage_state(state);
+}
 
-	// We generally want to wait until all surfaces are showing the
-	// "verifying" state before we go and verify the password, because
-	// verifying it is a blocking operation. However, if the surface is on
-	// an output with DPMS off then it won't update, so we set a timer.
-	state->verify_password_timer = loop_add_timer(
-			state->eventloop, 50, handle_preverify_timeout, state);
-
-	while (state->run_display && state->verify_password_timer) {
-		errno = 0;
-		if (wl_display_flush(state->display) == -1 && errno != EAGAIN) {
-			break;
-		}
-		loop_poll(state->eventloop);
-
-		bool ok = 1;
-		struct swaylock_surface *surface;
-		wl_list_for_each(surface, &state->surfaces, link) {
-			if (surface->dirty) {
-				ok = 0;
-			}
-		}
-		if (ok) {
-			break;
-		}
+void swaylock_handle_auth_result(struct swaylock_state *state, bool success) {
+	if (state->verify_animation_timer) {
+		loop_remove_timer(state->eventloop, state->verify_animation_timer);
+		state->verify_animation_timer = NULL;
 	}
-	wl_display_flush(state->display);
-
-	if (attempt_password(&state->password)) {
+	if (success) {
 		state->run_display = false;
 		return;
 	}
 	state->auth_state = AUTH_STATE_INVALID;
 	damage_state(state);
 	schedule_indicator_clear(state);
+
+	if (state->submit_queued) {
+		// Enter was pressed again while the last password was being checked
+		state->submit_queued = false;
+		submit_password(state);
+	} else if (state->password.len) {
+		schedule_password_clear(state);
+	}
+}
+
+static void comm_in(int fd, short mask, void *data) {
+	struct swaylock_state *state = data;
+	bool success = false;
+	if (!(mask & POLLIN) || !read_comm_reply(&success)) {
+		// Exiting would unlock the session, so the attempt fails instead and
+		// the worker is started again for the next one
+		wlr_log(WLR_ERROR, "Password checking subprocess died");
+		loop_remove_fd(state->eventloop, fd);
+		close_comm_child();
+		if (state->auth_state != AUTH_STATE_VALIDATING) {
+			return;
+		}
+		success = false;
+	}
+	swaylock_handle_auth_result(state, success);
+}
+
+void swaylock_watch_comm_reply(struct swaylock_state *state) {
+	loop_add_fd(state->eventloop, get_comm_reply_fd(), POLLIN, comm_in, state);
+}
+
+/**
+ * Keys which are pressed while a password is being checked only edit the
+ * buffer, so that the indicator keeps showing that we're verifying.
+ */
+static void queue_key(struct swaylock_state *state,
+		xkb_keysym_t keysym, uint32_t codepoint) {
+	switch (keysym) {
+	case XKB_KEY_KP_Enter: /* fallthrough */
+	case XKB_KEY_Return:
+		state->submit_queued = true;
+		break;
+	case XKB_KEY_Delete:
+	case XKB_KEY_BackSpace:
+		backspace(&state->password);
+		break;
+	case XKB_KEY_Escape:
+		clear_password_buffer(&state->password);
+		state->submit_queued = false;
+		break;
+	case XKB_KEY_d:
+		if (state->xkb.control) {
+			state->submit_queued = true;
+			break;
+		}
+		// fallthrough
+	case XKB_KEY_c: /* fallthrough */
+	case XKB_KEY_u:
+		if (state->xkb.control) {
+			clear_password_buffer(&state->password);
+			state->submit_queued = false;
+			break;
+		}
+		// fallthrough
+	default:
+		if (codepoint) {
+			append_ch(&state->password, codepoint);
+		}
+		break;
+	}
 }
 
 void swaylock_handle_key(struct swaylock_state *state,
 		xkb_keysym_t keysym, uint32_t codepoint) {
+	if (state->auth_state == AUTH_STATE_VALIDATING) {
+		queue_key(state, keysym, codepoint);
+		return;
+	}
+
 	switch (keysym) {
 	case XKB_KEY_KP_Enter: /* fallthrough */
 	case XKB_KEY_Return:
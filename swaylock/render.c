@@ -22,29 +22,32 @@ static void set_color_for_state(cairo_t *cairo, struct swaylock_state *state,
 	}
 }
 
-void render_frame(struct swaylock_surface *surface) {
+static void place_indicator(struct swaylock_surface *surface) {
+	// Applied with the next commit of the background surface
+	wl_subsurface_set_position(surface->subsurface,
+			((int)surface->width - surface->indicator_size) / 2,
+			((int)surface->height - surface->indicator_size) / 2);
+	surface->position_pending = true;
+}
+
+static void render_background(struct swaylock_surface *surface) {
 	struct swaylock_state *state = surface->state;
 
 	int buffer_width = surface->width * surface->scale;
 	int buffer_height = surface->height * surface->scale;
-	if (buffer_width == 0 || buffer_height == 0) {
-		return; // not yet configured
+	if (surface->background_width == (uint32_t)buffer_width &&
+			surface->background_height == (uint32_t)buffer_height) {
+		// Nothing on it has changed
+		return;
 	}
 
 	surface->current_buffer = get_next_buffer(state->shm,
-			surface->buffers, buffer_width, buffer_height);
+			&surface->buffers, buffer_width, buffer_height);
 	if (surface->current_buffer == NULL) {
 		return;
 	}
 
 	cairo_t *cairo = surface->current_buffer->cairo;
-	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
-	cairo_font_options_t *fo = cairo_font_options_create();
-	cairo_font_options_set_hint_style(fo, CAIRO_HINT_STYLE_FULL);
-	cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_SUBPIXEL);
-	cairo_font_options_set_subpixel_order(fo, to_cairo_subpixel_order(surface->subpixel));
-	cairo_set_font_options(cairo, fo);
-	cairo_font_options_destroy(fo);
 	cairo_identity_matrix(cairo);
 
 	cairo_save(cairo);
@@ -57,109 +60,180 @@ void render_frame(struct swaylock_surface *surface) {
 				state->args.mode, buffer_width, buffer_height);
 	}
 	cairo_restore(cairo);
+
+	surface->background_width = buffer_width;
+	surface->background_height = buffer_height;
+	if (surface->indicator_size) {
+		place_indicator(surface);
+	}
+	wl_surface_set_buffer_scale(surface->surface, surface->scale);
+	wl_surface_attach(surface->surface, surface->current_buffer->buffer, 0, 0);
+	wl_surface_damage(surface->surface, 0, 0, surface->width, surface->height);
+	wl_surface_commit(surface->surface);
+	surface->position_pending = false;
+}
+
+static void render_indicator(struct swaylock_surface *surface) {
+	struct swaylock_state *state = surface->state;
+
+	if (!state->args.show_indicator || state->auth_state == AUTH_STATE_IDLE) {
+		if (surface->indicator_size) {
+			surface->indicator_size = 0;
+			wl_surface_attach(surface->child, NULL, 0, 0);
+			wl_surface_commit(surface->child);
+		}
+		return;
+	}
+
+	// Room for the ring, its borders and some antialiasing
+	int size = (state->args.radius + state->args.thickness) * 2 + 4;
+	if (size != surface->indicator_size) {
+		surface->indicator_size = size;
+		place_indicator(surface);
+	}
+
+	int buffer_diameter = size * surface->scale;
+	struct pool_buffer *buffer = get_next_buffer(state->shm,
+			&surface->indicator_buffers, buffer_diameter, buffer_diameter);
+	if (buffer == NULL) {
+		return;
+	}
+
+	cairo_t *cairo = buffer->cairo;
+	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+	cairo_font_options_t *fo = cairo_font_options_create();
+	cairo_font_options_set_hint_style(fo, CAIRO_HINT_STYLE_FULL);
+	cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_SUBPIXEL);
+	cairo_font_options_set_subpixel_order(fo, to_cairo_subpixel_order(surface->subpixel));
+	cairo_set_font_options(cairo, fo);
+	cairo_font_options_destroy(fo);
 	cairo_identity_matrix(cairo);
 
+	cairo_save(cairo);
+	cairo_set_operator(cairo, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cairo);
+	cairo_restore(cairo);
+
 	int arc_radius = state->args.radius * surface->scale;
 	int arc_thickness = state->args.thickness * surface->scale;
 	float type_indicator_border_thickness =
 		TYPE_INDICATOR_BORDER_THICKNESS * surface->scale;
 
-	if (state->args.show_indicator && state->auth_state != AUTH_STATE_IDLE) {
-		// Draw circle
-		cairo_set_line_width(cairo, arc_thickness);
-		cairo_arc(cairo, buffer_width / 2, buffer_height / 2, arc_radius,
-				0, 2 * M_PI);
-		set_color_for_state(cairo, state, &state->args.colors.inside);
-		cairo_fill_preserve(cairo);
-		set_color_for_state(cairo, state, &state->args.colors.ring);
-		cairo_stroke(cairo);
-
-		// Draw a message
-		char *text = NULL;
-		set_color_for_state(cairo, state, &state->args.colors.text);
-		cairo_select_font_face(cairo, state->args.font,
-				CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-		cairo_set_font_size(cairo, arc_radius / 3.0f);
-		switch (state->auth_state) {
-		case AUTH_STATE_VALIDATING:
-			text = "verifying";
-			break;
-		case AUTH_STATE_INVALID:
-			text = "wrong";
-			break;
-		case AUTH_STATE_CLEAR:
-			text = "cleared";
-			break;
-		case AUTH_STATE_INPUT:
-		case AUTH_STATE_INPUT_NOP:
-			if (state->xkb.caps_lock) {
-				text = "Caps Lock";
-			}
-			break;
-		default:
-			break;
+	// Draw circle
+	cairo_set_line_width(cairo, arc_thickness);
+	cairo_arc(cairo, buffer_diameter / 2, buffer_diameter / 2, arc_radius,
+			0, 2 * M_PI);
+	set_color_for_state(cairo, state, &state->args.colors.inside);
+	cairo_fill_preserve(cairo);
+	set_color_for_state(cairo, state, &state->args.colors.ring);
+	cairo_stroke(cairo);
+
+	// Draw a message
+	char *text = NULL;
+	set_color_for_state(cairo, state, &state->args.colors.text);
+	cairo_select_font_face(cairo, state->args.font,
+			CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cairo, arc_radius / 3.0f);
+	switch (state->auth_state) {
+	case AUTH_STATE_VALIDATING:
+		text = "verifying";
+		break;
+	case AUTH_STATE_INVALID:
+		text = "wrong";
+		break;
+	case AUTH_STATE_CLEAR:
+		text = "cleared";
+		break;
+	case AUTH_STATE_INPUT:
+	case AUTH_STATE_INPUT_NOP:
+		if (state->xkb.caps_lock) {
+			text = "Caps Lock";
 		}
+		break;
+	default:
+		break;
+	}
 
-		if (text) {
-			cairo_text_extents_t extents;
-			double x, y;
-			cairo_text_extents(cairo, text, &extents);
-			x = (buffer_width / 2) -
-				(extents.width / 2 + extents.x_bearing);
-			y = (buffer_height / 2) -
-				(extents.height / 2 + extents.y_bearing);
-
-			cairo_move_to(cairo, x, y);
-			cairo_show_text(cairo, text);
-			cairo_close_path(cairo);
-			cairo_new_sub_path(cairo);
-		}
+	if (text) {
+		cairo_text_extents_t extents;
+		double x, y;
+		cairo_text_extents(cairo, text, &extents);
+		x = (buffer_diameter / 2) -
+			(extents.width / 2 + extents.x_bearing);
+		y = (buffer_diameter / 2) -
+			(extents.height / 2 + extents.y_bearing);
+
+		cairo_move_to(cairo, x, y);
+		cairo_show_text(cairo, text);
+		cairo_close_path(cairo);
+		cairo_new_sub_path(cairo);
+	}
 
-		// Typing indicator: Highlight random part on keypress
-		if (state->auth_state == AUTH_STATE_INPUT
-				|| state->auth_state == AUTH_STATE_BACKSPACE) {
-			static double highlight_start = 0;
+	// Typing indicator: Highlight random part on keypress
+	// While verifying, the highlight goes round instead
+	if (state->auth_state == AUTH_STATE_INPUT
+			|| state->auth_state == AUTH_STATE_BACKSPACE
+			|| state->auth_state == AUTH_STATE_VALIDATING) {
+		static double highlight_start = 0;
+		if (state->auth_state == AUTH_STATE_VALIDATING) {
+			highlight_start = state->verify_animation_step * M_PI / 12;
+		} else {
 			highlight_start +=
 				(rand() % (int)(M_PI * 100)) / 100.0 + M_PI * 0.5;
-			cairo_arc(cairo, buffer_width / 2, buffer_height / 2,
-					arc_radius, highlight_start,
-					highlight_start + TYPE_INDICATOR_RANGE);
-			if (state->auth_state == AUTH_STATE_INPUT) {
-				cairo_set_source_u32(cairo, state->args.colors.key_highlight);
-			} else {
-				cairo_set_source_u32(cairo, state->args.colors.bs_highlight);
-			}
-			cairo_stroke(cairo);
-
-			// Draw borders
-			cairo_set_source_u32(cairo, state->args.colors.separator);
-			cairo_arc(cairo, buffer_width / 2, buffer_height / 2,
-					arc_radius, highlight_start,
-					highlight_start + type_indicator_border_thickness);
-			cairo_stroke(cairo);
-
-			cairo_arc(cairo, buffer_width / 2, buffer_height / 2,
-					arc_radius, highlight_start + TYPE_INDICATOR_RANGE,
-					highlight_start + TYPE_INDICATOR_RANGE +
-						type_indicator_border_thickness);
-			cairo_stroke(cairo);
 		}
+		cairo_arc(cairo, buffer_diameter / 2, buffer_diameter / 2,
+				arc_radius, highlight_start,
+				highlight_start + TYPE_INDICATOR_RANGE);
+		if (state->auth_state == AUTH_STATE_BACKSPACE) {
+			cairo_set_source_u32(cairo, state->args.colors.bs_highlight);
+		} else {
+			cairo_set_source_u32(cairo, state->args.colors.key_highlight);
+		}
+		cairo_stroke(cairo);
 
-		// Draw inner + outer border of the circle
-		set_color_for_state(cairo, state, &state->args.colors.line);
-		cairo_set_line_width(cairo, 2.0 * surface->scale);
-		cairo_arc(cairo, buffer_width / 2, buffer_height / 2,
-				arc_radius - arc_thickness / 2, 0, 2 * M_PI);
+		// Draw borders
+		cairo_set_source_u32(cairo, state->args.colors.separator);
+		cairo_arc(cairo, buffer_diameter / 2, buffer_diameter / 2,
+				arc_radius, highlight_start,
+				highlight_start + type_indicator_border_thickness);
 		cairo_stroke(cairo);
-		cairo_arc(cairo, buffer_width / 2, buffer_height / 2,
-				arc_radius + arc_thickness / 2, 0, 2 * M_PI);
+
+		cairo_arc(cairo, buffer_diameter / 2, buffer_diameter / 2,
+				arc_radius, highlight_start + TYPE_INDICATOR_RANGE,
+				highlight_start + TYPE_INDICATOR_RANGE +
+					type_indicator_border_thickness);
 		cairo_stroke(cairo);
 	}
 
-	wl_surface_set_buffer_scale(surface->surface, surface->scale);
-	wl_surface_attach(surface->surface, surface->current_buffer->buffer, 0, 0);
-	wl_surface_damage(surface->surface, 0, 0, surface->width, surface->height);
-	wl_surface_commit(surface->surface);
+	// Draw inner + outer border of the circle
+	set_color_for_state(cairo, state, &state->args.colors.line);
+	cairo_set_line_width(cairo, 2.0 * surface->scale);
+	cairo_arc(cairo, buffer_diameter / 2, buffer_diameter / 2,
+			arc_radius - arc_thickness / 2, 0, 2 * M_PI);
+	cairo_stroke(cairo);
+	cairo_arc(cairo, buffer_diameter / 2, buffer_diameter / 2,
+			arc_radius + arc_thickness / 2, 0, 2 * M_PI);
+	cairo_stroke(cairo);
+
+	wl_surface_set_buffer_scale(surface->child, surface->scale);
+	wl_surface_attach(surface->child, buffer->buffer, 0, 0);
+	wl_surface_damage(surface->child, 0, 0, size, size);
+	wl_surface_commit(surface->child);
+}
+
+void render_frame(struct swaylock_surface *surface) {
+	if (surface->width == 0 || surface->height == 0) {
+		return; // not yet configured
+	}
+	// The indicator goes first, so that a new position for it is applied
+	// together with a new background
+	render_indicator(surface);
+	render_background(surface);
+	if (surface->position_pending) {
+		// The background is unchanged, but the indicator has moved
+		wl_surface_commit(surface->surface);
+		surface->position_pending = false;
+	}
 }
 
 void render_frames(struct swaylock_state *state) {
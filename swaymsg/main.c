@@ -13,6 +13,7 @@
 #include "stringop.h"
 #include "ipc-client.h"
 #include "log.h"
+#include "loop.h"
 
 void sway_terminate(int exit_code) {
 	exit(exit_code);
@@ -306,17 +307,325 @@ static void pretty_print(int type, json_object *resp) {
 	}
 }
 
+static const struct {
+	const char *name;
+	uint32_t type;
+} message_types[] = {
+	{ "command", IPC_COMMAND },
+	{ "get_workspaces", IPC_GET_WORKSPACES },
+	{ "get_seats", IPC_GET_SEATS },
+	{ "get_clients", IPC_GET_CLIENTS },
+	{ "get_render_stats", IPC_GET_RENDER_STATS },
+	{ "get_texture_usage", IPC_GET_TEXTURE_USAGE },
+	{ "get_timings", IPC_GET_TIMINGS },
+	{ "get_inputs", IPC_GET_INPUTS },
+	{ "get_outputs", IPC_GET_OUTPUTS },
+	{ "get_tree", IPC_GET_TREE },
+	{ "get_marks", IPC_GET_MARKS },
+	{ "get_bar_config", IPC_GET_BAR_CONFIG },
+	{ "get_version", IPC_GET_VERSION },
+	{ "get_binding_modes", IPC_GET_BINDING_MODES },
+	{ "get_config", IPC_GET_CONFIG },
+	{ "send_tick", IPC_SEND_TICK },
+	{ "subscribe", IPC_SUBSCRIBE },
+};
+
+static bool parse_type(const char *name, uint32_t *type) {
+	for (size_t i = 0; i < sizeof(message_types) / sizeof(message_types[0]); ++i) {
+		if (strcasecmp(name, message_types[i].name) == 0) {
+			*type = message_types[i].type;
+			return true;
+		}
+	}
+	return false;
+}
+
+struct swaymsg_state {
+	uint32_t type;
+	bool quiet;
+	bool raw;
+	bool monitor;
+	bool done;
+	int ret;
+};
+
+static void handle_reply(struct ipc_response *resp, void *data) {
+	struct swaymsg_state *state = data;
+	if (!resp) {
+		fprintf(stderr, "ERROR: Unable to receive IPC response\n");
+		state->ret = 1;
+		state->done = true;
+		return;
+	}
+	if (!state->quiet) {
+		// pretty print the json
+		json_object *obj = json_tokener_parse(resp->payload);
+
+		if (obj == NULL) {
+			fprintf(stderr, "ERROR: Could not parse json response from ipc. "
+					"This is a bug in sway.");
+			printf("%s\n", resp->payload);
+			state->ret = 1;
+		} else {
+			if (!success(obj, true)) {
+				state->ret = 1;
+			}
+			if (state->type != IPC_SUBSCRIBE || state->ret != 0) {
+				if (state->raw) {
+					printf("%s\n", json_object_to_json_string_ext(obj,
+						JSON_C_TO_STRING_PRETTY | JSON_C_TO_STRING_SPACED));
+				} else {
+					pretty_print(state->type, obj);
+				}
+			}
+			json_object_put(obj);
+		}
+	}
+	if (state->type != IPC_SUBSCRIBE || state->ret != 0) {
+		state->done = true;
+	}
+}
+
+static void handle_event(struct ipc_response *resp, void *data) {
+	struct swaymsg_state *state = data;
+	if (!resp) {
+		if (!state->done) {
+			fprintf(stderr, "ERROR: Unable to receive IPC response\n");
+			state->ret = 1;
+			state->done = true;
+		}
+		return;
+	}
+
+	json_object *obj = json_tokener_parse(resp->payload);
+	if (obj == NULL) {
+		fprintf(stderr, "ERROR: Could not parse json response from ipc"
+				". This is a bug in sway.");
+		state->ret = 1;
+		state->done = true;
+		return;
+	}
+	if (state->raw) {
+		printf("%s\n", json_object_to_json_string(obj));
+	} else {
+		printf("%s\n", json_object_to_json_string_ext(obj,
+			JSON_C_TO_STRING_PRETTY | JSON_C_TO_STRING_SPACED));
+	}
+	fflush(stdout);
+	json_object_put(obj);
+	if (!state->monitor) {
+		state->done = true;
+	}
+}
+
+// Estimated size of the replies which may be outstanding in batch mode before
+// reading more requests. sway disconnects clients which leave 4 MB unread.
+static const size_t batch_max_pending_bytes = 1024 * 1024;
+// Request types whose reply sizes are tracked
+#define BATCH_REPLY_TYPES 128
+
+struct batch_state {
+	struct loop *loop;
+	struct ipc_connection *conn;
+	bool quiet;
+	bool merge_commands;
+	int ret;
+	// Consecutive commands which are waiting to be sent as one
+	char *commands;
+	size_t commands_len;
+	// Largest reply seen so far for each request type, 0 until one arrives
+	size_t reply_size[BATCH_REPLY_TYPES];
+	// Estimated size of each outstanding reply, oldest first
+	size_t *pending;
+	size_t pending_head, pending_length, pending_capacity;
+	size_t pending_bytes;
+};
+
+static size_t batch_estimate_reply(struct batch_state *state, uint32_t type) {
+	if (type < BATCH_REPLY_TYPES && state->reply_size[type]) {
+		return state->reply_size[type];
+	}
+	// Nothing is known about it, so wait for it before sending more
+	return batch_max_pending_bytes;
+}
+
+static void handle_batch_reply(struct ipc_response *resp, void *data) {
+	struct batch_state *state = data;
+	state->pending_bytes -= state->pending[state->pending_head++];
+	if (state->pending_head == state->pending_length) {
+		state->pending_head = state->pending_length = 0;
+	}
+	if (!resp) {
+		state->ret = 1;
+		return;
+	}
+	if (resp->type < BATCH_REPLY_TYPES &&
+			resp->size > state->reply_size[resp->type]) {
+		state->reply_size[resp->type] = resp->size;
+	}
+	if (resp->type == IPC_COMMAND) {
+		json_object *obj = json_tokener_parse(resp->payload);
+		if (!success(obj, true)) {
+			state->ret = 1;
+		}
+		json_object_put(obj);
+	}
+	if (!state->quiet) {
+		fwrite(resp->payload, 1, resp->size, stdout);
+		fputc('\n', stdout);
+	}
+}
+
+static void batch_send(struct batch_state *state, uint32_t type,
+		const char *payload) {
+	if (state->pending_length == state->pending_capacity) {
+		size_t capacity = state->pending_capacity ?
+			state->pending_capacity * 2 : 16;
+		size_t *pending = realloc(state->pending, capacity * sizeof(size_t));
+		if (!pending) {
+			fprintf(stderr, "ERROR: Unable to allocate request\n");
+			state->ret = 1;
+			return;
+		}
+		state->pending = pending;
+		state->pending_capacity = capacity;
+	}
+	if (!ipc_connection_send(state->conn, type, payload, strlen(payload),
+				handle_batch_reply, state)) {
+		state->ret = 1;
+		return;
+	}
+	size_t estimate = batch_estimate_reply(state, type);
+	state->pending[state->pending_length++] = estimate;
+	state->pending_bytes += estimate;
+
+	// Don't let the replies pile up in sway while more requests are read
+	ipc_connection_poll(state->conn);
+	while (state->pending_bytes >= batch_max_pending_bytes &&
+			ipc_connection_get_pending(state->conn) > 0) {
+		loop_poll(state->loop);
+	}
+}
+
+static void batch_flush_commands(struct batch_state *state) {
+	if (state->commands) {
+		batch_send(state, IPC_COMMAND, state->commands);
+		free(state->commands);
+		state->commands = NULL;
+		state->commands_len = 0;
+	}
+}
+
+/**
+ * Hold back a command so that it can be joined with the following ones and
+ * applied by sway in a single transaction.
+ */
+static void batch_merge_command(struct batch_state *state, const char *command) {
+	size_t len = strlen(command);
+	size_t new_len = state->commands ? state->commands_len + 1 + len : len;
+	char *commands = realloc(state->commands, new_len + 1);
+	if (!commands) {
+		fprintf(stderr, "ERROR: Unable to allocate command\n");
+		state->ret = 1;
+		return;
+	}
+	if (state->commands) {
+		commands[state->commands_len] = ';';
+	}
+	memcpy(commands + new_len - len, command, len + 1);
+	state->commands = commands;
+	state->commands_len = new_len;
+}
+
+/**
+ * Read newline-delimited requests of the form "<type> [payload]", send them
+ * over one connection without waiting for each reply, and print the raw
+ * replies one per line in the same order.
+ */
+static int run_batch(const char *path, const char *socket_path,
+		bool quiet, bool merge_commands) {
+	FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "ERROR: Unable to open %s\n", path);
+		return 1;
+	}
+
+	struct batch_state state = {
+		.loop = loop_create(),
+		.quiet = quiet,
+		.merge_commands = merge_commands,
+	};
+	state.conn = ipc_connection_create(ipc_open_socket(socket_path),
+			state.loop);
+	if (!state.conn) {
+		sway_abort("Unable to set up IPC connection");
+	}
+
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t nread;
+	int line_no = 0;
+	while ((nread = getline(&line, &line_size, f)) != -1) {
+		++line_no;
+		if (nread > 0 && line[nread - 1] == '\n') {
+			line[--nread] = '\0';
+		}
+		char *name = line + strspn(line, " \t");
+		if (!*name || *name == '#') {
+			continue;
+		}
+		size_t name_len = strcspn(name, " \t");
+		char *payload = name + name_len;
+		if (*payload) {
+			*payload++ = '\0';
+			payload += strspn(payload, " \t");
+		}
+
+		uint32_t type;
+		if (!parse_type(name, &type) || type == IPC_SUBSCRIBE) {
+			fprintf(stderr, "ERROR: Unsupported message type %s on line %d\n",
+					name, line_no);
+			state.ret = 1;
+			continue;
+		}
+		if (type == IPC_COMMAND && state.merge_commands) {
+			batch_merge_command(&state, payload);
+			continue;
+		}
+		batch_flush_commands(&state);
+		batch_send(&state, type, payload);
+	}
+	batch_flush_commands(&state);
+	free(line);
+	if (f != stdin) {
+		fclose(f);
+	}
+
+	if (!ipc_connection_roundtrip(state.conn)) {
+		fprintf(stderr, "ERROR: Unable to receive IPC response\n");
+		state.ret = 1;
+	}
+	ipc_connection_destroy(state.conn);
+	loop_destroy(state.loop);
+	free(state.pending);
+	return state.ret;
+}
+
 int main(int argc, char **argv) {
 	static bool quiet = false;
 	static bool raw = false;
 	static bool monitor = false;
+	static bool merge_commands = false;
 	char *socket_path = NULL;
 	char *cmdtype = NULL;
+	char *batch_path = NULL;
 
 	wlr_log_init(WLR_INFO, NULL);
 
 	static struct option long_options[] = {
+		{"batch", required_argument, NULL, 'b'},
 		{"help", no_argument, NULL, 'h'},
+		{"merge-commands", no_argument, NULL, 'M'},
 		{"monitor", no_argument, NULL, 'm'},
 		{"quiet", no_argument, NULL, 'q'},
 		{"raw", no_argument, NULL, 'r'},
@@ -329,7 +638,10 @@ int main(int argc, char **argv) {
 	const char *usage =
 		"Usage: swaymsg [options] [message]\n"
 		"\n"
+		"  -b, --batch <file>     Send newline-delimited requests from file\n"
+		"                         (- for stdin) and print raw replies.\n"
 		"  -h, --help             Show help message and quit.\n"
+		"  -M, --merge-commands   Join consecutive commands in a batch.\n"
 		"  -m, --monitor          Monitor until killed (-t SUBSCRIBE only)\n"
 		"  -q, --quiet            Be quiet.\n"
 		"  -r, --raw              Use raw output even if using a tty\n"
@@ -342,11 +654,17 @@ int main(int argc, char **argv) {
 	int c;
 	while (1) {
 		int option_index = 0;
-		c = getopt_long(argc, argv, "hmqrs:t:v", long_options, &option_index);
+		c = getopt_long(argc, argv, "b:hMmqrs:t:v", long_options, &option_index);
 		if (c == -1) {
 			break;
 		}
 		switch (c) {
+		case 'b': // Batch
+			batch_path = strdup(optarg);
+			break;
+		case 'M': // Merge commands
+			merge_commands = true;
+			break;
 		case 'm': // Monitor
 			monitor = true;
 			break;
@@ -382,35 +700,17 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	if (batch_path) {
+		int ret = run_batch(batch_path, socket_path, quiet, merge_commands);
+		free(batch_path);
+		free(cmdtype);
+		free(socket_path);
+		return ret;
+	}
+
 	uint32_t type = IPC_COMMAND;
 
-	if (strcasecmp(cmdtype, "command") == 0) {
-		type = IPC_COMMAND;
-	} else if (strcasecmp(cmdtype, "get_workspaces") == 0) {
-		type = IPC_GET_WORKSPACES;
-	} else if (strcasecmp(cmdtype, "get_seats") == 0) {
-		type = IPC_GET_SEATS;
-	} else if (strcasecmp(cmdtype, "get_inputs") == 0) {
-		type = IPC_GET_INPUTS;
-	} else if (strcasecmp(cmdtype, "get_outputs") == 0) {
-		type = IPC_GET_OUTPUTS;
-	} else if (strcasecmp(cmdtype, "get_tree") == 0) {
-		type = IPC_GET_TREE;
-	} else if (strcasecmp(cmdtype, "get_marks") == 0) {
-		type = IPC_GET_MARKS;
-	} else if (strcasecmp(cmdtype, "get_bar_config") == 0) {
-		type = IPC_GET_BAR_CONFIG;
-	} else if (strcasecmp(cmdtype, "get_version") == 0) {
-		type = IPC_GET_VERSION;
-	} else if (strcasecmp(cmdtype, "get_binding_modes") == 0) {
-		type = IPC_GET_BINDING_MODES;
-	} else if (strcasecmp(cmdtype, "get_config") == 0) {
-		type = IPC_GET_CONFIG;
-	} else if (strcasecmp(cmdtype, "send_tick") == 0) {
-		type = IPC_SEND_TICK;
-	} else if (strcasecmp(cmdtype, "subscribe") == 0) {
-		type = IPC_SUBSCRIBE;
-	} else {
+	if (!parse_type(cmdtype, &type)) {
 		sway_abort("Unknown message type %s", cmdtype);
 	}
 
@@ -429,65 +729,32 @@ int main(int argc, char **argv) {
 		command = strdup("");
 	}
 
-	int ret = 0;
-	int socketfd = ipc_open_socket(socket_path);
-	uint32_t len = strlen(command);
-	char *resp = ipc_single_command(socketfd, type, command, &len);
-	if (!quiet) {
-		// pretty print the json
-		json_object *obj = json_tokener_parse(resp);
-
-		if (obj == NULL) {
-			fprintf(stderr, "ERROR: Could not parse json response from ipc. "
-					"This is a bug in sway.");
-			printf("%s\n", resp);
-			ret = 1;
-		} else {
-			if (!success(obj, true)) {
-				ret = 1;
-			}
-			if (type != IPC_SUBSCRIBE  || ret != 0) {
-				if (raw) {
-					printf("%s\n", json_object_to_json_string_ext(obj,
-						JSON_C_TO_STRING_PRETTY | JSON_C_TO_STRING_SPACED));
-				} else {
-					pretty_print(type, obj);
-				}
-			}
-			json_object_put(obj);
-		}
+	struct swaymsg_state state = {
+		.type = type,
+		.quiet = quiet,
+		.raw = raw,
+		.monitor = monitor,
+	};
+	struct loop *loop = loop_create();
+	struct ipc_connection *conn =
+		ipc_connection_create(ipc_open_socket(socket_path), loop);
+	if (!conn) {
+		sway_abort("Unable to set up IPC connection");
+	}
+	ipc_connection_set_event_handler(conn, handle_event, &state);
+	if (!ipc_connection_send(conn, type, command, strlen(command),
+				handle_reply, &state)) {
+		state.ret = 1;
+		state.done = true;
 	}
 	free(command);
-	free(resp);
-
-	if (type == IPC_SUBSCRIBE && ret == 0) {
-		do {
-			struct ipc_response *reply = ipc_recv_response(socketfd);
-			if (!reply) {
-				break;
-			}
-
-			json_object *obj = json_tokener_parse(reply->payload);
-			if (obj == NULL) {
-				fprintf(stderr, "ERROR: Could not parse json response from ipc"
-						". This is a bug in sway.");
-				ret = 1;
-				break;
-			} else {
-				if (raw) {
-					printf("%s\n", json_object_to_json_string(obj));
-				} else {
-					printf("%s\n", json_object_to_json_string_ext(obj,
-						JSON_C_TO_STRING_PRETTY | JSON_C_TO_STRING_SPACED));
-				}
-				json_object_put(obj);
-			}
 
-			free_ipc_response(reply);
-		} while (monitor);
+	while (!state.done) {
+		loop_poll(loop);
 	}
 
-	close(socketfd);
+	ipc_connection_destroy(conn);
+	loop_destroy(loop);
 	free(socket_path);
-	return ret;
+	return state.ret;
 }
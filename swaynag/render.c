@@ -277,7 +277,7 @@ void render_frame(struct swaynag *swaynag) {
 		wl_display_roundtrip(swaynag->display);
 	} else {
 		swaynag->current_buffer = get_next_buffer(swaynag->shm,
-				swaynag->buffers,
+				&swaynag->buffers,
 				swaynag->width * swaynag->scale,
 				swaynag->height * swaynag->scale);
 		if (!swaynag->current_buffer) {
@@ -436,13 +436,7 @@ void swaynag_destroy(struct swaynag *swaynag) {
 		wl_cursor_theme_destroy(swaynag->pointer.cursor_theme);
 	}
 
-	if (&swaynag->buffers[0]) {
-		destroy_buffer(&swaynag->buffers[0]);
-	}
-
-	if (&swaynag->buffers[1]) {
-		destroy_buffer(&swaynag->buffers[1]);
-	}
+	destroy_buffer_pool(&swaynag->buffers);
 
 	if (swaynag->outputs.prev || swaynag->outputs.next) {
 		struct swaynag_output *output, *temp;